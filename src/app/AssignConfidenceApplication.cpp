@@ -7,13 +7,18 @@
 #include "AssignConfidenceApplication.h"
 #include "ComputeQValues.h"
 #include "io/MatchCollectionParser.h"
+#include "io/PSMColumnReader.h"
 #include "PosteriorEstimator.h"
 #include "util/FileUtils.h"
 #include "util/Params.h"
 #include "util/StringUtils.h"
 
+#include <algorithm>
+#include <limits>
 #include <map>
 #include <utility>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 using namespace std;
 using namespace Crux;
@@ -22,6 +27,81 @@ static const int MAX_PSMS = 10000000;
 // 14th decimal place
 static const double EPSILON = 0.00000000000001;
 
+/**
+ * \returns the number of threads to use, from num-threads.
+ */
+static int numThreads() {
+  int num_threads = Params::GetInt("num-threads");
+  if (num_threads < 1) {
+    num_threads = boost::thread::hardware_concurrency();
+  }
+  return num_threads < 1 ? 1 : num_threads;
+}
+
+template<typename Iterator, typename Less>
+static void stableSortSlice(Iterator first, Iterator last, Less less) {
+  stable_sort(first, last, less);
+}
+
+/**
+ * Stable-sorts values using num-threads threads. Each thread sorts a
+ * contiguous slice, then neighbouring slices are merged.
+ */
+template<typename T, typename Less>
+static void parallelSort(vector<T>& values, Less less) {
+  int num_slices = min(numThreads(), (int)(values.size() / 100000) + 1);
+  if (num_slices <= 1) {
+    stable_sort(values.begin(), values.end(), less);
+    return;
+  }
+  vector<size_t> bounds;
+  for (int slice = 0; slice <= num_slices; slice++) {
+    bounds.push_back(values.size() * slice / num_slices);
+  }
+  boost::thread_group threads;
+  for (int slice = 0; slice < num_slices; slice++) {
+    threads.create_thread(boost::bind(
+      &stableSortSlice<typename vector<T>::iterator, Less>,
+      values.begin() + bounds[slice], values.begin() + bounds[slice + 1], less));
+  }
+  threads.join_all();
+  for (size_t width = 1; width < (size_t)num_slices; width *= 2) {
+    for (size_t slice = 0; slice + width < (size_t)num_slices; slice += 2 * width) {
+      size_t last = min(slice + 2 * width, (size_t)num_slices);
+      inplace_merge(values.begin() + bounds[slice], values.begin() + bounds[slice + width],
+                    values.begin() + bounds[last], less);
+    }
+  }
+}
+
+/**
+ * Pairs each distinct score with its q-value, in increasing score order.
+ * A score that occurs more than once keeps the q-value of its last
+ * occurrence. Scores that are not finite are left out.
+ */
+static void sortScoreQValues(
+  const vector<FLOAT_T>& scores,
+  const vector<FLOAT_T>& qvalues,
+  vector< pair<FLOAT_T, FLOAT_T> >* score_qvalues
+) {
+  vector< pair<FLOAT_T, size_t> > order;
+  order.reserve(scores.size());
+  for (size_t i = 0; i < scores.size(); i++) {
+    if (!isinf(scores[i]) && !isnan(scores[i])) {
+      order.push_back(make_pair(scores[i], i));
+    }
+  }
+  parallelSort(order, less< pair<FLOAT_T, size_t> >());
+  score_qvalues->clear();
+  for (size_t i = 0; i < order.size(); i++) {
+    if (!score_qvalues->empty() && score_qvalues->back().first == order[i].first) {
+      score_qvalues->back().second = qvalues[order[i].second];
+    } else {
+      score_qvalues->push_back(make_pair(order[i].first, qvalues[order[i].second]));
+    }
+  }
+}
+
 /**
 * \returns a blank ComputeQValues object
 */
@@ -47,6 +127,143 @@ int stringToIndex(string myString) {
   return(returnValue);
 }
 
+/**
+ * Finds the target file and the separate decoy file, if any, of one input
+ * file. decoy_path is set to "" if there is no separate decoy file.
+ */
+static void findTargetDecoyFiles(
+  const string& input,
+  ESTIMATION_METHOD_T estimation_method,
+  string* target_path,
+  string* decoy_path
+) {
+  *target_path = input;
+  *decoy_path = input;
+
+  if (target_path->find("decoy") != string::npos) {
+    carp(CARP_FATAL, "%s appears to be a decoy file. Only target or concatenated files "
+                     "should be given to assign-confidence because it automatically searches for "
+                     "corresponding decoy files.", target_path->c_str());
+  }
+
+  check_target_decoy_files(*target_path, *decoy_path);
+
+  if (!FileUtils::Exists(*target_path)) {
+    carp(CARP_FATAL, "Target file %s not found", target_path->c_str());
+  } else if (!FileUtils::Exists(*decoy_path)) {
+    if (estimation_method == MIXMAX_METHOD) {
+      carp(CARP_FATAL, "Cannot find file %s. Decoy file from separate target-decoy search is "
+                       "required for mix-max q-value calculation", decoy_path->c_str());
+    }
+    carp(CARP_DEBUG, "Decoy file %s not found", decoy_path->c_str());
+    *decoy_path = "";
+  }
+}
+
+/**
+ * \returns the score types that are looked for, in order of preference, when
+ * the score parameter is not given.
+ */
+static vector<SCORER_TYPE_T> autoScoreTypes() {
+  SCORER_TYPE_T types[] = {
+    TAILOR_SCORE, //Added for tailor score calibration method by AKF
+    XCORR, EVALUE, BOTH_PVALUE, RESIDUE_EVIDENCE_PVAL, RESIDUE_EVIDENCE_SCORE,
+    TIDE_SEARCH_EXACT_PVAL, TIDE_SEARCH_EXACT_SMOOTHED, LOGP_BONF_WEIBULL_XCORR,
+    PERCOLATOR_SCORE
+  };
+  return vector<SCORER_TYPE_T>(types, types + sizeof(types) / sizeof(types[0]));
+}
+
+/**
+ * \returns whether smaller scores are better, and logs the sort order.
+ */
+static bool scoreAscending(SCORER_TYPE_T score_type) {
+  bool ascending = false;
+  switch (AssignConfidenceApplication::getDirection(score_type)) {
+    case -1:
+      ascending = false;
+      break;
+    case 1:
+      ascending = true;
+      break;
+    default:
+      carp(CARP_FATAL, "Cannot infer sort order for score %s.", scorer_type_to_string(score_type));
+  }
+  carp(CARP_INFO, "Score type=%s, sorting in %s order",
+       scorer_type_to_string(score_type), ascending ? "ascending" : "descending");
+  return ascending;
+}
+
+/**
+ * \returns the score whose rank decides whether a PSM is top-ranked.
+ */
+static SCORER_TYPE_T rankScoreType(SCORER_TYPE_T score_type) {
+  if (score_type == BOTH_PVALUE || score_type == RESIDUE_EVIDENCE_PVAL) {
+    return score_type;
+  }
+  return XCORR;
+}
+
+/**
+ * Target-decoy competition between the top-ranked target and decoy PSMs of
+ * a spectrum, with counters for the log.
+ */
+struct TargetDecoyCompetition {
+  int num_competitions;
+  int num_lost_decoys;
+  int num_ties;
+
+  TargetDecoyCompetition() : num_competitions(0), num_lost_decoys(0), num_ties(0) {}
+
+  /**
+   * \returns true if the target wins. Ties are broken randomly.
+   */
+  bool targetWins(FLOAT_T target_score, FLOAT_T decoy_score, bool ascending) {
+    FLOAT_T score_difference = target_score - decoy_score;
+    num_competitions++;
+    // Randomly break ties.
+    if (fabs(score_difference) < 1e-10) {
+      num_ties++;
+      score_difference += 0.5 - ((double)myrandom() / UNIFORM_INT_DISTRIBUTION_MAX);
+    }
+    if (ascending) { // smaller scores are better
+      score_difference *= -1.0;
+    }
+    return score_difference >= 0.0;
+  }
+
+  void log(size_t num_kept) const {
+    carp(CARP_INFO, "%d tdc_collection", num_kept);
+    if (num_competitions > 0) {
+      carp(CARP_INFO, "Randomly broke %d ties in %d target-decoy competitions.", num_ties, num_competitions);
+    }
+    if (num_lost_decoys > 0) {
+      carp(CARP_INFO, "Failed to find %d decoys.", num_lost_decoys);
+    }
+  }
+};
+
+static void logRankSkipped(int num_target_rank_skipped, int num_decoy_rank_skipped, int top_match) {
+  if (num_decoy_rank_skipped + num_target_rank_skipped > 0) {
+    carp(CARP_INFO, "Skipped %d target and %d decoy PSMs with rank > %d.",
+         num_target_rank_skipped, num_decoy_rank_skipped, top_match);
+  }
+}
+
+static void logFdrCounts(const vector<FLOAT_T>& qvalues) {
+  unsigned int fdr1 = 0;
+  unsigned int fdr5 = 0;
+  unsigned int fdr10 = 0;
+  for (vector<FLOAT_T>::const_iterator i = qvalues.begin(); i != qvalues.end(); i++) {
+    if (*i < 0.01) ++fdr1;
+    if (*i < 0.05) ++fdr5;
+    if (*i < 0.10) ++fdr10;
+  }
+  carp(CARP_INFO, "Number of PSMs at 1%% FDR = %d.", fdr1);
+  carp(CARP_INFO, "Number of PSMs at 5%% FDR = %d.", fdr5);
+  carp(CARP_INFO, "Number of PSMs at 10%% FDR = %d.", fdr10);
+}
+
 /**
 * main method for ComputeQValues
 */
@@ -56,11 +273,6 @@ int AssignConfidenceApplication::main(int argc, char** argv) {
 }
 
 int AssignConfidenceApplication::main(const vector<string>& input_files) {
-  // Prepare the output files if not in Cascade Search
-  if (spectrum_flag_ == NULL) {
-    output_ = new OutputFiles(this);
-  }
-  
   ESTIMATION_METHOD_T estimation_method;
   string method_param = Params::GetString("estimation-method");
   carp(CARP_INFO, "Estimation method = %s.", method_param.c_str());
@@ -163,6 +375,16 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
     carp(CARP_WARNING, "Sidak adjustment may not be compatible with score: %s", score_param.c_str());
   }
 
+  if (spectrum_flag_ == NULL && Params::GetBool("low-memory") &&
+      lowMemoryMain(input_files, estimation_method, score_type)) {
+    return 0;
+  }
+
+  // Prepare the output files if not in Cascade Search
+  if (spectrum_flag_ == NULL) {
+    output_ = new OutputFiles(this);
+  }
+
   // Create two match collections, for targets and decoys.
   MatchCollection* target_matches = new MatchCollection();
   map<int, MatchCollection*> decoy_matches; // key is decoy index
@@ -173,27 +395,8 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
 
   bool avgTdc = estimation_method == TDC_METHOD;
   for (vector<string>::const_iterator iter = input_files.begin(); iter != input_files.end(); ++iter) {
-    string target_path = *iter;
-    string decoy_path = *iter;
-
-    if (target_path.find("decoy") != string::npos) {
-      carp(CARP_FATAL, "%s appears to be a decoy file. Only target or concatenated files "
-                       "should be given to assign-confidence because it automatically searches for "
-                       "corresponding decoy files.", target_path.c_str());
-    }
-
-    check_target_decoy_files(target_path, decoy_path);
-
-    if (!FileUtils::Exists(target_path)) {
-      carp(CARP_FATAL, "Target file %s not found", target_path.c_str());
-    } else if (!FileUtils::Exists(decoy_path)) {
-      if (estimation_method == MIXMAX_METHOD) {
-        carp(CARP_FATAL, "Cannot find file %s. Decoy file from separate target-decoy search is "
-                         "required for mix-max q-value calculation", decoy_path.c_str());
-      }
-      carp(CARP_DEBUG, "Decoy file %s not found", decoy_path.c_str());
-      decoy_path = "";
-    }
+    string target_path, decoy_path;
+    findTargetDecoyFiles(*iter, estimation_method, &target_path, &decoy_path);
 
     MatchCollection* match_collection = parser.create(target_path, Params::GetString("protein-database"));
     distinct_matches = match_collection->getHasDistinctMatches();
@@ -207,17 +410,7 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
     // The score type that is used is the first one found
     // in the list below.
     if (score_type == INVALID_SCORER_TYPE) {
-      vector<SCORER_TYPE_T> scoreTypes;
-      scoreTypes.push_back(TAILOR_SCORE); //Added for tailor score calibration method by AKF
-      scoreTypes.push_back(XCORR);
-      scoreTypes.push_back(EVALUE);
-      scoreTypes.push_back(BOTH_PVALUE);
-      scoreTypes.push_back(RESIDUE_EVIDENCE_PVAL);
-      scoreTypes.push_back(RESIDUE_EVIDENCE_SCORE);
-      scoreTypes.push_back(TIDE_SEARCH_EXACT_PVAL);
-      scoreTypes.push_back(TIDE_SEARCH_EXACT_SMOOTHED);
-      scoreTypes.push_back(LOGP_BONF_WEIBULL_XCORR);
-      scoreTypes.push_back(PERCOLATOR_SCORE);
+      vector<SCORER_TYPE_T> scoreTypes = autoScoreTypes();
       for (vector<SCORER_TYPE_T>::const_iterator i = scoreTypes.begin(); i != scoreTypes.end(); i++) {
         if (match_collection->getScoredType(*i)) {
           score_type = *i;
@@ -229,18 +422,7 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
         carp(CARP_FATAL, "Could not detect score type. Specify the score type using the \"score\" parameter.");
       }
     }
-    switch (getDirection(score_type)) {
-      case -1:
-        ascending = false;
-        break;
-      case 1:
-        ascending = true;
-        break;
-      default:
-        carp(CARP_FATAL, "Cannot infer sort order for score %s.", scorer_type_to_string(score_type));
-    }
-    carp(CARP_INFO, "Score type=%s, sorting in %s order",
-         scorer_type_to_string(score_type), ascending ? "ascending" : "descending");
+    ascending = scoreAscending(score_type);
 
     if (!match_collection->getScoredType(score_type)) {
       const char* score_str = scorer_type_to_string(score_type);
@@ -345,9 +527,7 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
         }
 
         if (estimation_method != MIXMAX_METHOD) {
-          int numCompetitions = 0;
-          int numLostDecoys = 0;
-          int numTies = 0;
+          TargetDecoyCompetition tdc;
           MatchCollection* tdc_collection = new MatchCollection();
           tdc_collection->setScoredType(score_type, true);
           MatchIterator* target_iter = new MatchIterator(match_collection);
@@ -370,7 +550,7 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
             if (decoy_idx == 0) {
               carp(CARP_DEBUG, "Failed to find decoy for file=%s scan=%d charge=%d rank=%d.",
                    target_match->getSpectrum()->getFullFilename(), scanid, charge, rank);
-              numLostDecoys++;
+              tdc.num_lost_decoys++;
             }
 
             if (estimation_method == PEPTIDE_LEVEL_METHOD) {
@@ -401,17 +581,8 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
                    target_match->getSpectrum()->getFirstScan(), target_match->getCharge(), target_match->getScore(score_type),
                    decoy_match->getSpectrum()->getFirstScan(), decoy_match->getCharge(), decoy_match->getScore(score_type));
 
-              FLOAT_T score_difference = target_match->getScore(score_type) - decoy_match->getScore(score_type);
-              numCompetitions++;
-              // Randomly break ties.
-              if (fabs(score_difference) < 1e-10) {
-                numTies++;
-                score_difference += 0.5 - ((double)myrandom() / UNIFORM_INT_DISTRIBUTION_MAX);
-              }
-              if (ascending) { // smaller scores are better
-                score_difference *= -1.0;
-              }
-              if (score_difference >= 0.0) {
+              if (tdc.targetWins(target_match->getScore(score_type),
+                                 decoy_match->getScore(score_type), ascending)) {
                 tdc_collection->addMatch(target_match);
               } else {
                 tdc_collection->addMatch(decoy_match);
@@ -422,13 +593,7 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
           delete decoy_iter;
           delete match_collection;
           match_collection = tdc_collection;
-          carp(CARP_INFO, "%d tdc_collection", match_collection->getMatchTotal());
-          if (numCompetitions > 0) {
-            carp(CARP_INFO, "Randomly broke %d ties in %d target-decoy competitions.", numTies, numCompetitions);
-          }
-          if (numLostDecoys > 0) {
-            carp(CARP_INFO, "Failed to find %d decoys.", numLostDecoys);
-          }
+          tdc.log(match_collection->getMatchTotal());
         }
       }
       delete temp_collection;
@@ -441,33 +606,13 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
       bool is_decoy = match->getNullPeptide();
 
       // Only use top-ranked matches.
-      if (score_type == BOTH_PVALUE) {
-        if (match->getRank(BOTH_PVALUE) > top_match) {
-          if (is_decoy) {
-            num_decoy_rank_skipped++;
-          } else {
-            num_target_rank_skipped++;
-          }
-          continue;
-        }
-      } else if (score_type == RESIDUE_EVIDENCE_PVAL) {
-        if (match->getRank(RESIDUE_EVIDENCE_PVAL) > top_match) {
-          if (is_decoy) {
-            num_decoy_rank_skipped++;
-          } else {
-            num_target_rank_skipped++;
-          }
-          continue;
-        }
-      } else {
-        if (match->getRank(XCORR) > top_match) {
-          if (is_decoy) {
-            num_decoy_rank_skipped++;
-          } else {
-            num_target_rank_skipped++;
-          }
-          continue;
+      if (match->getRank(rankScoreType(score_type)) > top_match) {
+        if (is_decoy) {
+          num_decoy_rank_skipped++;
+        } else {
+          num_target_rank_skipped++;
         }
+        continue;
       }
 
       // Find and keep the best score for each decoy peptide.
@@ -518,10 +663,7 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
     }
     delete match_iterator;
     delete match_collection;
-    if (num_decoy_rank_skipped + num_target_rank_skipped > 0) {
-      carp(CARP_INFO, "Skipped %d target and %d decoy PSMs with rank > %d.",
-           num_target_rank_skipped, num_decoy_rank_skipped, top_match);
-    }
+    logRankSkipped(num_target_rank_skipped, num_decoy_rank_skipped, top_match);
     if (num_target_peptide_skipped + num_decoy_peptide_skipped > 0) {
       carp(CARP_INFO, "Skipped %d target and %d decoy PSMs due to peptide-level filtering.",
            num_target_peptide_skipped, num_decoy_peptide_skipped);
@@ -662,22 +804,37 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
       carp(CARP_FATAL, "No estimation method specified.");
   }
 
-  unsigned int fdr1 = 0;
-  unsigned int fdr5 = 0;
-  unsigned int fdr10 = 0;
-  for (vector<FLOAT_T>::const_iterator i = qvalues.begin(); i != qvalues.end(); i++) {
-    if (*i < 0.01) ++fdr1;
-    if (*i < 0.05) ++fdr5;
-    if (*i < 0.10) ++fdr10;
+  logFdrCounts(qvalues);
+
+  // Assign the q-values by sweeping the matches in score order alongside
+  // the distinct scores.
+  vector< pair<FLOAT_T, FLOAT_T> > score_qvalues;
+  sortScoreQValues(target_scores, qvalues, &score_qvalues);
+  vector<FLOAT_T>().swap(target_scores);
+  vector<FLOAT_T>().swap(qvalues);
+
+  vector<FLOAT_T> match_scores = target_matches->extractScores(score_type);
+  vector<FLOAT_T> match_qvalues(match_scores.size(), numeric_limits<double>::quiet_NaN());
+  vector< pair<FLOAT_T, size_t> > match_order;
+  match_order.reserve(match_scores.size());
+  for (size_t i = 0; i < match_scores.size(); i++) {
+    if (!isinf(match_scores[i]) && !isnan(match_scores[i])) {
+      match_order.push_back(make_pair(match_scores[i], i));
+    }
   }
-  carp(CARP_INFO, "Number of PSMs at 1%% FDR = %d.", fdr1);
-  carp(CARP_INFO, "Number of PSMs at 5%% FDR = %d.", fdr5);
-  carp(CARP_INFO, "Number of PSMs at 10%% FDR = %d.", fdr10);
-
-  // Store p-values to q-values as a hash, and then assign them.
-  map<FLOAT_T, FLOAT_T> qvalue_hash = store_arrays_as_hash(target_scores, qvalues);
-
-  target_matches->assignQValues(&qvalue_hash, score_type, derived_score_type);
+  parallelSort(match_order, less< pair<FLOAT_T, size_t> >());
+  vector< pair<FLOAT_T, FLOAT_T> >::const_iterator lookup = score_qvalues.begin();
+  for (vector< pair<FLOAT_T, size_t> >::const_iterator i = match_order.begin();
+       i != match_order.end(); i++) {
+    while (lookup != score_qvalues.end() && lookup->first < i->first) {
+      ++lookup;
+    }
+    if (lookup == score_qvalues.end() || lookup->first != i->first) {
+      carp(CARP_FATAL, "Cannot find q-value corresponding to score of %g.", i->first);
+    }
+    match_qvalues[i->second] = lookup->second;
+  }
+  target_matches->assignQValues(match_qvalues, derived_score_type);
 
   // Store targets by score.
   target_matches->sort(score_type);
@@ -720,6 +877,293 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
   return 0;
 } // Main
 
+/**
+ * \returns the tab-delimited column holding a score, or INVALID_COL if
+ * MatchFileReader does not read the score directly from a column.
+ */
+static MATCH_COLUMNS_T scoreColumn(SCORER_TYPE_T score_type) {
+  switch (score_type) {
+  case SP: return SP_SCORE_COL;
+  case XCORR: return XCORR_SCORE_COL;
+  case EVALUE: return EVALUE_COL;
+  case PERCOLATOR_SCORE: return PERCOLATOR_SCORE_COL;
+  case PERCOLATOR_QVALUE: return PERCOLATOR_QVALUE_COL;
+  case QRANKER_SCORE: return QRANKER_SCORE_COL;
+  case QRANKER_QVALUE: return QRANKER_QVALUE_COL;
+  case BARISTA_SCORE: return BARISTA_SCORE_COL;
+  case BARISTA_QVALUE: return BARISTA_QVALUE_COL;
+  case TIDE_SEARCH_EXACT_PVAL: return EXACT_PVALUE_COL;
+  case TIDE_SEARCH_REFACTORED_XCORR: return REFACTORED_SCORE_COL;
+  case RESIDUE_EVIDENCE_PVAL: return RESIDUE_PVALUE_COL;
+  case RESIDUE_EVIDENCE_SCORE: return RESIDUE_EVIDENCE_COL;
+  case BOTH_PVALUE: return BOTH_PVALUE_COL;
+  case TAILOR_SCORE: return TAILOR_COL;
+  default: return INVALID_COL;
+  }
+}
+
+/**
+ * Orders indices into a score array by their scores.
+ */
+struct ScoreIndexLess {
+  const vector<FLOAT_T>& scores_;
+  explicit ScoreIndexLess(const vector<FLOAT_T>& scores) : scores_(scores) {}
+  bool operator()(size_t x, size_t y) const { return scores_[x] < scores_[y]; }
+};
+
+struct ScoreIndexGreater {
+  const vector<FLOAT_T>& scores_;
+  explicit ScoreIndexGreater(const vector<FLOAT_T>& scores) : scores_(scores) {}
+  bool operator()(size_t x, size_t y) const { return scores_[x] > scores_[y]; }
+};
+
+bool AssignConfidenceApplication::lowMemoryMain(
+  const vector<string>& input_files,
+  ESTIMATION_METHOD_T estimation_method,
+  SCORER_TYPE_T score_type
+) {
+  if (estimation_method == PEPTIDE_LEVEL_METHOD || Params::GetBool("sidak") ||
+      !Params::GetBool("txt-output") || Params::GetBool("pepxml-output") ||
+      Params::GetBool("mzid-output")) {
+    carp(CARP_INFO, "low-memory is not available with peptide-level estimation, "
+         "Sidak adjustment or non-text output; loading full PSMs.");
+    return false;
+  }
+  if (input_files.empty()) {
+    carp(CARP_FATAL, "No input files found.");
+  }
+
+  // Open every input before doing any work, so that inputs that need the
+  // full PSM loader are detected before anything is written.
+  vector<PSMColumnReader*> targets;
+  vector<PSMColumnReader*> decoys;
+  string unsupported;
+  for (vector<string>::const_iterator iter = input_files.begin(); iter != input_files.end(); ++iter) {
+    string target_path, decoy_path;
+    findTargetDecoyFiles(*iter, estimation_method, &target_path, &decoy_path);
+    if (StringUtils::IEndsWith(target_path, ".xml") ||
+        StringUtils::IEndsWith(target_path, ".sqt") ||
+        StringUtils::IEndsWith(target_path, ".mzid")) {
+      unsupported = "input that is not tab-delimited";
+      break;
+    }
+    targets.push_back(new PSMColumnReader(target_path));
+    decoys.push_back(decoy_path.empty() ? NULL : new PSMColumnReader(decoy_path));
+    if (targets.back()->hasValues(DECOY_INDEX_COL) ||
+        (decoys.back() != NULL && decoys.back()->hasValues(DECOY_INDEX_COL))) {
+      unsupported = "multiple decoys per target (a-TDC)";
+    } else if (targets.back()->getHeader() != targets.front()->getHeader()) {
+      unsupported = "input files with different columns";
+    }
+  }
+
+  if (unsupported.empty() && score_type == INVALID_SCORER_TYPE) {
+    vector<SCORER_TYPE_T> score_types = autoScoreTypes();
+    for (size_t i = 0; i < score_types.size(); i++) {
+      // The Weibull p-value is not read directly, but it has its own column.
+      MATCH_COLUMNS_T col = (score_types[i] == LOGP_BONF_WEIBULL_XCORR) ?
+        PVALUE_COL : scoreColumn(score_types[i]);
+      if (col != INVALID_COL && targets.front()->hasValues(col)) {
+        score_type = score_types[i];
+        carp(CARP_INFO, "Automatically detected score type: %s", scorer_type_to_string(score_type));
+        break;
+      }
+    }
+    if (score_type == INVALID_SCORER_TYPE) {
+      carp(CARP_FATAL, "Could not detect score type. Specify the score type using the \"score\" parameter.");
+    }
+  }
+  MATCH_COLUMNS_T score_col = scoreColumn(score_type);
+  if (unsupported.empty() && score_col == INVALID_COL) {
+    unsupported = string("score ") + scorer_type_to_string(score_type);
+  }
+  if (!unsupported.empty()) {
+    carp(CARP_INFO, "low-memory is not available for %s; loading full PSMs.",
+         unsupported.c_str());
+    for (size_t i = 0; i < targets.size(); i++) {
+      delete targets[i];
+      delete decoys[i];
+    }
+    return false;
+  }
+
+  MATCH_COLUMNS_T rank_col = XCORR_RANK_COL;
+  switch (rankScoreType(score_type)) {
+  case BOTH_PVALUE: rank_col = BOTH_PVALUE_RANK; break;
+  case RESIDUE_EVIDENCE_PVAL: rank_col = RESIDUE_RANK_COL; break;
+  default: break;
+  }
+  bool ascending = scoreAscending(score_type);
+
+  const int top_match = 1;
+  const int max_rank_in = Params::GetInt("top-match-in");
+  const string decoy_prefix = Params::GetString("decoy-prefix");
+
+  // Targets that take part in q-value estimation: score, input file and the
+  // offset of the row in that file.
+  vector<FLOAT_T> target_scores;
+  vector<int> target_files;
+  vector<streamoff> target_offsets;
+  vector<FLOAT_T> decoy_scores;
+
+  for (size_t file = 0; file < targets.size(); file++) {
+    PSMColumnReader* target = targets[file];
+    PSMColumnReader* decoy = decoys[file];
+    if (!target->hasColumn(score_col)) {
+      carp(CARP_FATAL, "The PSM feature \"%s\" was not found in file \"%s\".",
+           scorer_type_to_string(score_type), target->getFileName().c_str());
+    }
+    map<string, int> spectrum_files;
+    target->read(score_col, rank_col, max_rank_in, decoy_prefix, false, &spectrum_files);
+    carp(CARP_INFO, "Found %d PSMs in %s.", target->size(), target->getFileName().c_str());
+
+    int num_target_rank_skipped = 0;
+    int num_decoy_rank_skipped = 0;
+
+    // The PSMs that survive target-decoy competition, in the order the full
+    // PSM loader visits them.
+    vector< pair<PSMColumnReader*, size_t> > candidates;
+    if (decoy == NULL || estimation_method == MIXMAX_METHOD) {
+      for (size_t i = 0; i < target->size(); i++) {
+        candidates.push_back(make_pair(target, i));
+      }
+    }
+    if (decoy != NULL) {
+      decoy->read(score_col, rank_col, max_rank_in, decoy_prefix, true, &spectrum_files);
+      carp(CARP_INFO, "Found %d PSMs in %s.", decoy->size(), decoy->getFileName().c_str());
+
+      // key = (spectrum file, scan number, charge, rank); value = row + 1
+      map<boost::tuple<int, int, int, int>, size_t> pairidx;
+      for (size_t i = 0; i < decoy->size(); i++) {
+        if (decoy->xcorrRank(i) > top_match) {
+          num_decoy_rank_skipped++;
+          continue;
+        }
+        if (estimation_method == MIXMAX_METHOD) {
+          decoy_scores.push_back(decoy->score(i));
+        } else {
+          size_t& idx = pairidx[boost::tuple<int, int, int, int>(
+            decoy->spectrumFile(i), decoy->scan(i), decoy->charge(i), decoy->xcorrRank(i))];
+          if (idx == 0) {
+            idx = i + 1;
+          }
+        }
+      }
+
+      if (estimation_method != MIXMAX_METHOD) {
+        TargetDecoyCompetition tdc;
+        for (size_t i = 0; i < target->size(); i++) {
+          if (target->xcorrRank(i) > top_match) {
+            num_target_rank_skipped++;
+            continue;
+          }
+          map<boost::tuple<int, int, int, int>, size_t>::const_iterator lookup =
+            pairidx.find(boost::tuple<int, int, int, int>(
+              target->spectrumFile(i), target->scan(i), target->charge(i), target->xcorrRank(i)));
+          if (lookup == pairidx.end()) {
+            carp(CARP_DEBUG, "Failed to find decoy for scan=%d charge=%d rank=%d.",
+                 target->scan(i), target->charge(i), target->xcorrRank(i));
+            tdc.num_lost_decoys++;
+            candidates.push_back(make_pair(target, i));
+            continue;
+          }
+          size_t decoy_row = lookup->second - 1;
+
+          // This is where the target-decoy competition happens.
+          if (tdc.targetWins(target->score(i), decoy->score(decoy_row), ascending)) {
+            candidates.push_back(make_pair(target, i));
+          } else {
+            candidates.push_back(make_pair(decoy, decoy_row));
+          }
+        }
+        tdc.log(candidates.size());
+      }
+    }
+
+    for (vector< pair<PSMColumnReader*, size_t> >::const_iterator i = candidates.begin();
+         i != candidates.end();
+         i++) {
+      PSMColumnReader* reader = i->first;
+      size_t row = i->second;
+      bool is_decoy = reader->decoy(row);
+      // Only use top-ranked matches.
+      if (reader->scoreRank(row) > top_match) {
+        if (is_decoy) {
+          num_decoy_rank_skipped++;
+        } else {
+          num_target_rank_skipped++;
+        }
+        continue;
+      }
+      if (is_decoy) {
+        decoy_scores.push_back(reader->score(row));
+      } else {
+        target_scores.push_back(reader->score(row));
+        target_files.push_back(file);
+        target_offsets.push_back(reader->offset(row));
+      }
+    }
+    target->clear();
+    if (decoy != NULL) {
+      decoy->clear();
+    }
+    logRankSkipped(num_target_rank_skipped, num_decoy_rank_skipped, top_match);
+  }
+
+  // Compute q-values.
+  carp(CARP_INFO, "There are %d target and %d decoy PSMs for q-value computation.",
+       target_scores.size(), decoy_scores.size());
+  vector<FLOAT_T> sorted_scores(target_scores);
+  vector<FLOAT_T> qvalues = (estimation_method == MIXMAX_METHOD) ?
+    compute_decoy_qvalues_mixmax(sorted_scores, decoy_scores, ascending, Params::GetDouble("pi-zero")) :
+    compute_decoy_qvalues_tdc(sorted_scores, decoy_scores, ascending, 1.0);
+  vector<FLOAT_T>().swap(decoy_scores);
+
+  logFdrCounts(qvalues);
+
+  // Score -> q-value as a sorted array, keeping the last q-value for
+  // tied scores.
+  vector< pair<FLOAT_T, FLOAT_T> > score_qvalues;
+  sortScoreQValues(sorted_scores, qvalues, &score_qvalues);
+  vector<FLOAT_T>().swap(sorted_scores);
+  vector<FLOAT_T>().swap(qvalues);
+
+  // Write the targets, best score first.
+  vector<size_t> order(target_scores.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  if (ascending) {
+    parallelSort(order, ScoreIndexLess(target_scores));
+  } else {
+    parallelSort(order, ScoreIndexGreater(target_scores));
+  }
+
+  MATCH_COLUMNS_T qvalue_col =
+    (estimation_method == MIXMAX_METHOD) ? QVALUE_MIXMAX_COL : QVALUE_TDC_COL;
+  string output_path = make_file_path(getFileStem() + ".target.txt");
+  ofstream* output = create_stream_in_path(output_path.c_str(), NULL, Params::GetBool("overwrite"));
+  *output << targets.front()->getHeader() << '\t' << get_column_header(qvalue_col) << endl;
+  int precision = Params::GetInt("precision");
+  string row;
+  for (vector<size_t>::const_iterator i = order.begin(); i != order.end(); i++) {
+    FLOAT_T score = target_scores[*i];
+    vector< pair<FLOAT_T, FLOAT_T> >::const_iterator lookup = lower_bound(
+      score_qvalues.begin(), score_qvalues.end(), make_pair(score, -numeric_limits<FLOAT_T>::infinity()));
+    FLOAT_T qvalue = (lookup != score_qvalues.end() && lookup->first == score) ? lookup->second : 1.0;
+    targets[target_files[*i]]->getRow(target_offsets[*i], &row);
+    *output << row << '\t' << StringUtils::ToString(qvalue, precision, false) << '\n';
+  }
+  output->close();
+  delete output;
+
+  for (size_t i = 0; i < targets.size(); i++) {
+    delete targets[i];
+    delete decoys[i];
+  }
+  return true;
+}
+
 
 /**
 * Find the best-scoring match for each peptide in a given collection.
@@ -810,21 +1254,6 @@ void AssignConfidenceApplication::convert_fdr_to_qvalue(
   }
 }
 
-/**
- * Store two parallel arrays of floats in a hash table.
- */
-map<FLOAT_T, FLOAT_T> AssignConfidenceApplication::store_arrays_as_hash(
-  const vector<FLOAT_T>& keys,
-  const vector<FLOAT_T>& values
-) {
-  map<FLOAT_T, FLOAT_T> return_value;
-  for (size_t i = 0; i < keys.size(); i++) {
-    carp(CARP_DETAILED_DEBUG, "%g maps to %g", keys[i], values[i]);
-    return_value[keys[i]] = values[i];
-  }
-  return return_value;
-}
-
 AssignConfidenceApplication::AtdcScoreSet::AtdcScoreSet(
   const vector<FLOAT_T>& targetScores,
   const vector< vector<FLOAT_T> >& decoyScores,
@@ -1097,11 +1526,11 @@ vector<FLOAT_T> AssignConfidenceApplication::compute_decoy_qvalues_tdc(
 
   // Sort both sets of scores.
   if (ascending) {
-    sort(target_scores.begin(), target_scores.end(), Match::ScoreLess);
-    sort(decoy_scores.begin(), decoy_scores.end(), Match::ScoreLess);
+    parallelSort(target_scores, Match::ScoreLess);
+    parallelSort(decoy_scores, Match::ScoreLess);
   } else {
-    sort(target_scores.begin(), target_scores.end(), Match::ScoreGreater);
-    sort(decoy_scores.begin(), decoy_scores.end(), Match::ScoreGreater);
+    parallelSort(target_scores, Match::ScoreGreater);
+    parallelSort(decoy_scores, Match::ScoreGreater);
   }
 
   // Compute false discovery rate for each target score.
@@ -1115,13 +1544,11 @@ vector<FLOAT_T> AssignConfidenceApplication::compute_decoy_qvalues_tdc(
     if (ascending) {
       while (decoy_idx < decoy_scores.size() &&
              Match::ScoreLess(decoy_scores[decoy_idx], target_score)) {
-        carp(CARP_DEBUG, "Decoy score %g.", decoy_scores[decoy_idx]);
         decoy_idx++;
       }
     } else {   
       while (decoy_idx < decoy_scores.size() &&
              Match::ScoreGreater(decoy_scores[decoy_idx], target_score)) {
-        carp(CARP_DEBUG, "Decoy score %g.", decoy_scores[decoy_idx]);
         decoy_idx++;
       }
     }
@@ -1131,8 +1558,8 @@ vector<FLOAT_T> AssignConfidenceApplication::compute_decoy_qvalues_tdc(
     if (fdr > 1.0) {
       fdr = 1.0;
     }
-    carp(CARP_DEBUG, "FDR for score %g = min(1,%d/%d) = %g",
-         target_score, decoy_idx, target_idx + 1, fdr);
+    IF_CARP(CARP_DEBUG, carp(CARP_DEBUG, "FDR for score %g = min(1,%d/%d) = %g",
+                             target_score, decoy_idx, target_idx + 1, fdr));
     qvalues.push_back(fdr);
     // assign fdr for this and any following with same score
     while (target_idx < target_scores.size() - 1 && target_scores[target_idx + 1] == target_score) {
@@ -1167,29 +1594,31 @@ vector<FLOAT_T> AssignConfidenceApplication::compute_decoy_qvalues_mixmax(
     carp(CARP_WARNING, "The mix-max procedure is not well behaved when # targets (%d) != # of decoys (%d).",
          num_targets, num_decoys);
   }
-  //estimate pi0 from data if it is not given.
+  IF_CARP(CARP_DEBUG,
+    for (size_t target_idx = 0; target_idx < min(num_targets, num_decoys); ++target_idx) {
+      carp(CARP_DEBUG, "target_scores[%d]=%lf decoy_scores[%d]=%lf",
+           target_idx, target_scores[target_idx],
+           target_idx, decoy_scores[target_idx]);
+    });
+
+  //Sort decoy and target stores
+  if (ascending) {
+    parallelSort(target_scores, greater<FLOAT_T>());
+    parallelSort(decoy_scores, greater<FLOAT_T>());
+  } else {
+    parallelSort(target_scores, less<FLOAT_T>());
+    parallelSort(decoy_scores, less<FLOAT_T>());
+  }
+
+  //estimate pi0 from data if it is not given. Both lists are sorted from
+  //worst to best, so they are merged rather than sorted together again.
   if (pi_zero == 1.0) {
     vector< pair<double, bool> > score_labels =
-      ComputeQValues::getScoreVector(target_scores, decoy_scores, ascending);
+      ComputeQValues::mergeScoreVector(target_scores, decoy_scores, ascending);
     pi_zero = ComputeQValues::estimatePi0(score_labels);
 
     carp(CARP_INFO, "Estimated pi_zero = %f", pi_zero);
   }
-  // continue with mix-max procedure
-  for (int target_idx = 0; target_idx < num_targets; ++target_idx) {
-    carp(CARP_DEBUG, "target_scores[%d]=%lf decoy_scores[%d]=%lf",
-         target_idx, target_scores[target_idx],
-         target_idx, decoy_scores[target_idx]);
-  }
-
-  //Sort decoy and target stores
-  if (ascending) {
-    sort(target_scores.begin(), target_scores.end(), greater<FLOAT_T>());
-    sort(decoy_scores.begin(), decoy_scores.end(), greater<FLOAT_T>());
-  } else {
-    sort(target_scores.begin(), target_scores.end());
-    sort(decoy_scores.begin(), decoy_scores.end());
-  }
 
   //histogram of the target scores.
   vector<double> h_w_le_z(num_decoys + 1, 0); //histogram for N_{w<=z}
@@ -1435,6 +1864,7 @@ vector<string> AssignConfidenceApplication::getOptions() const {
     "score",
     "sidak",
     "top-match-in",
+    "low-memory",
     "verbosity",
     "parameter-file",
     "overwrite",
@@ -1442,7 +1872,8 @@ vector<string> AssignConfidenceApplication::getOptions() const {
     "list-of-files",
     "combine-charge-states",
     "combine-modified-peptides",
-    "fileroot"
+    "fileroot",
+    "num-threads"
   };
   return vector<string>(arr, arr + sizeof(arr) / sizeof(string));
 }
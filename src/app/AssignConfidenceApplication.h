@@ -175,9 +175,6 @@ class AssignConfidenceApplication : public CruxApplication {
   static void convert_fdr_to_qvalue(
     std::vector<FLOAT_T>& qvalues); ///< Come in as FDRs, go out as q-values.
 
-  map<FLOAT_T, FLOAT_T> store_arrays_as_hash(
-    const std::vector<FLOAT_T>& keys,
-    const std::vector<FLOAT_T>& values);
   std::vector<FLOAT_T> compute_decoy_qvalues_tdc(
     std::vector<FLOAT_T>& target_scores,
     std::vector<FLOAT_T>& decoy_scores,
@@ -188,6 +185,19 @@ class AssignConfidenceApplication : public CruxApplication {
     std::vector<FLOAT_T>& decoy_scores,
     bool ascending,
     FLOAT_T pi_zero);
+
+ protected:
+  /**
+   * Computes q-values from the score columns of tab-delimited inputs,
+   * without building Match objects, and writes the original target rows
+   * sorted by score with the q-value column appended (--low-memory T).
+   * \returns false, before writing anything, if the inputs or options
+   * require loading full PSMs.
+   */
+  bool lowMemoryMain(
+    const vector<string>& input_files,
+    ESTIMATION_METHOD_T estimation_method,
+    SCORER_TYPE_T score_type);
 };
 
 #endif //ASSIGNCONFIDENCE_H
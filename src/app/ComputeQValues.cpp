@@ -123,6 +123,43 @@ vector< pair<double, bool> > ComputeQValues::getScoreVector(
   return scores;
 }
 
+// merge two worst-to-best score lists into the best-first vector that
+// getScoreVector would have sorted
+vector< pair<double, bool> > ComputeQValues::mergeScoreVector(
+  const vector<FLOAT_T>& targetScores,
+  const vector<FLOAT_T>& decoyScores,
+  bool ascending
+) {
+  vector< pair<double, bool> > scores;
+  scores.reserve(targetScores.size() + decoyScores.size());
+  vector<FLOAT_T>::const_reverse_iterator target = targetScores.rbegin();
+  vector<FLOAT_T>::const_reverse_iterator decoy = decoyScores.rbegin();
+  while (target != targetScores.rend() || decoy != decoyScores.rend()) {
+    bool takeTarget;
+    if (decoy == decoyScores.rend()) {
+      takeTarget = true;
+    } else if (target == targetScores.rend()) {
+      takeTarget = false;
+    } else if ((double)*target != (double)*decoy) {
+      takeTarget = ascending ? (double)*target < (double)*decoy
+                             : (double)*target > (double)*decoy;
+    } else {
+      // on ties, the pair order puts decoys first when ascending and
+      // targets first when descending
+      takeTarget = !ascending;
+    }
+    if (takeTarget) {
+      scores.push_back(make_pair((double)*target++, true));
+    } else {
+      scores.push_back(make_pair((double)*decoy++, false));
+    }
+  }
+  if (ascending) {
+    PosteriorEstimator::setReversed(true);
+  }
+  return scores;
+}
+
 double ComputeQValues::estimatePi0(
   const vector< pair<double, bool> >& scoreVector
 ) {
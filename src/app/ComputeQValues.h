@@ -48,6 +48,16 @@ class ComputeQValues: public CruxApplication {
     const std::vector<FLOAT_T>& decoyScores,
     bool ascending);
 
+  /**
+   * Same as getScoreVector, for target and decoy scores that are each
+   * already sorted from worst to best. The two lists are merged instead
+   * of being sorted again.
+   */
+  static std::vector< std::pair<double, bool> > mergeScoreVector(
+    const std::vector<FLOAT_T>& targetScores,
+    const std::vector<FLOAT_T>& decoyScores,
+    bool ascending);
+
   static double estimatePi0(const std::vector< std::pair<double, bool> >& scoreVector);
 
   /**
@@ -40,6 +40,7 @@
 #include "app/CascadeSearchApplication.h"
 #include "app/AssignConfidenceApplication.h"
 #include "app/SubtractIndexApplication.h"
+#include "app/MergeTideShardsApplication.h"
 
 using namespace std;
 
@@ -63,6 +64,7 @@ int CreateDocs::main(int argc, char** argv) {
   apps.add(new GeneratePeptides());
   apps.add(new GetMs2Spectrum());
   apps.add(new MakePinApplication());
+  apps.add(new MergeTideShardsApplication());
   apps.add(new LocalizeModificationApplication());
   apps.add(new ParamMedicApplication());
   apps.add(new PercolatorApplication());
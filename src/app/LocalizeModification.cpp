@@ -99,6 +99,7 @@ int LocalizeModificationApplication::main(int argc, char** argv) {
   tps.binOffset_ = binOffset;
 
   int topMatch = Params::GetInt("top-match");
+  const SearchConfig config;
   uint64_t curStep = 0;
   matchIter = new MatchIterator(matches);
   while (matchIter->hasNext()) {
@@ -141,7 +142,7 @@ int LocalizeModificationApplication::main(int argc, char** argv) {
     Results results(modTable);
     double neutralMass = match->getNeutralMass();
     int maxPrecursorMass = MassConstants::mass2bin(neutralMass + MAX_XCORR_OFFSET + 30) + 50;
-    vector<double> evidence = spectrum.CreateEvidenceVector(binWidth, binOffset, charge,
+    vector<double> evidence = spectrum.CreateEvidenceVector(config, binWidth, binOffset, charge,
       (MassConstants::mass2bin(cruxPeptide->calcModifiedMass()) - 0.5 + binOffset) * binWidth, maxPrecursorMass);
     for (vector<pb::Peptide>::const_iterator i = peptides.begin(); i != peptides.end(); i++) {
       Peptide peptide(*i, proteins);
@@ -150,7 +151,7 @@ int LocalizeModificationApplication::main(int argc, char** argv) {
 
       if (i == peptides.begin() + 1) {
         // After we've scored the unmodified peptide, create new evidence vector for scoring the modified peptides
-        evidence = spectrum.CreateEvidenceVector(binWidth, binOffset, charge,
+        evidence = spectrum.CreateEvidenceVector(config, binWidth, binOffset, charge,
           (MassConstants::mass2bin(neutralMass) - 0.5 + binOffset) * binWidth, maxPrecursorMass);
       }
 
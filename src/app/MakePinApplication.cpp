@@ -39,6 +39,13 @@ int MakePinApplication::main(int argc, char** argv) {
  * \runs make-pin application
  */
 int MakePinApplication::main(const vector<string>& paths) {
+  return main(paths, NULL);
+}
+
+/**
+ * \runs make-pin application, writing to out if it is not NULL
+ */
+int MakePinApplication::main(const vector<string>& paths, ostream* out) {
   //create MatchColletion 
   MatchCollectionParser parser;
 
@@ -97,17 +104,21 @@ int MakePinApplication::main(const vector<string>& paths) {
   }
 
   //prepare output file 
-  string output_filename = Params::GetString("output-file");
-  if (output_filename.empty()) {
-    string fileroot = Params::GetString("fileroot");
-    if (!fileroot.empty()) {
-      fileroot += ".";
+  PinWriter writer;
+  if (out != NULL) {
+    writer.openStream(out);
+  } else {
+    string output_filename = Params::GetString("output-file");
+    if (output_filename.empty()) {
+      string fileroot = Params::GetString("fileroot");
+      if (!fileroot.empty()) {
+        fileroot += ".";
+      }
+      output_filename = fileroot + "make-pin.pin";
     }
-    output_filename = fileroot + "make-pin.pin";
+    writer.openFile(output_filename, Params::GetString("output-dir"),
+                    Params::GetBool("overwrite"));
   }
-  PinWriter writer;
-  writer.openFile(output_filename, Params::GetString("output-dir"),
-                  Params::GetBool("overwrite"));
 
   for (int i = 1; i <= max_charge; i++) {
     writer.setEnabledStatus("Charge" + StringUtils::ToString(i), true);
@@ -39,6 +39,12 @@ class MakePinApplication: public CruxApplication {
    */
   static int main(const std::vector<std::string>& paths);
 
+  /**
+   * runs make-pin application, writing the pin to the given stream instead
+   * of a file if it is not NULL
+   */
+  static int main(const std::vector<std::string>& paths, std::ostream* out);
+
   /**
    * \returns the command name for MakePinApplication
    */
@@ -0,0 +1,285 @@
+/**
+ * \file MergeTideShardsApplication.cpp
+ * \brief Combines the outputs of mass-sharded tide-search runs.
+ ************************************************************/
+#include "MergeTideShardsApplication.h"
+#include "TideSearchApplication.h"
+#include "io/carp.h"
+#include "util/crux-utils.h"
+#include "util/FileUtils.h"
+#include "util/Params.h"
+#include "util/StringUtils.h"
+
+#include <fstream>
+#include "boost/filesystem.hpp"
+
+using namespace std;
+
+/**
+ * \returns a blank MergeTideShardsApplication object
+ */
+MergeTideShardsApplication::MergeTideShardsApplication() {
+}
+
+/**
+ * Destructor
+ */
+MergeTideShardsApplication::~MergeTideShardsApplication() {
+}
+
+/**
+ * main method for MergeTideShardsApplication
+ */
+int MergeTideShardsApplication::main(int argc, char** argv) {
+  carp(CARP_INFO, "Running merge-tide-shards...");
+
+  vector<string> fileroots;
+  vector<string> shards = orderShards(Params::GetStrings("tide-search shard directory"),
+                                      &fileroots);
+  bool overwrite = Params::GetBool("overwrite");
+  mergeFiles(shards, fileroots, "tide-search.target.txt", overwrite);
+  mergeFiles(shards, fileroots, "tide-search.decoy.txt", overwrite);
+  mergeFiles(shards, fileroots, "tide-search.txt", overwrite);
+  return 0;
+}
+
+/**
+ * \returns the name of a file written by a run with the given fileroot.
+ */
+static string shardFileName(const string& fileroot, const string& filename) {
+  return fileroot.empty() ? filename : fileroot + "." + filename;
+}
+
+/**
+ * Finds the tide-search parameter file in a shard directory. A shard run with
+ * --fileroot X names it X.tide-search.params.txt.
+ */
+static string findParamFile(const string& dir) {
+  const string suffix = "tide-search.params.txt";
+  if (!FileUtils::IsDir(dir)) {
+    carp(CARP_FATAL, "%s is not a directory.", dir.c_str());
+  }
+  string found;
+  boost::filesystem::directory_iterator end_itr;
+  for (boost::filesystem::directory_iterator i(dir); i != end_itr; ++i) {
+    if (!boost::filesystem::is_regular_file(i->status())) {
+      continue;
+    }
+    string filename = i->path().filename().generic_string();
+    if (filename != suffix && !StringUtils::EndsWith(filename, "." + suffix)) {
+      continue;
+    }
+    if (!found.empty()) {
+      carp(CARP_FATAL, "%s contains more than one tide-search parameter file "
+           "(%s and %s).", dir.c_str(), found.c_str(), filename.c_str());
+    }
+    found = filename;
+  }
+  if (found.empty()) {
+    carp(CARP_FATAL, "Could not find a tide-search parameter file in %s", dir.c_str());
+  }
+  return FileUtils::Join(dir, found);
+}
+
+vector<string> MergeTideShardsApplication::orderShards(
+  const vector<string>& dirs,
+  vector<string>* fileroots
+) {
+  vector<string> shards;
+  int num_shards = 0;
+  // Parameter lines of the first directory, which every other shard must match
+  vector<string> first_params;
+  for (vector<string>::const_iterator i = dirs.begin(); i != dirs.end(); i++) {
+    string param_file = findParamFile(*i);
+    ifstream in(param_file.c_str());
+    if (!in.good()) {
+      carp(CARP_FATAL, "Could not open %s", param_file.c_str());
+    }
+    string value;
+    string fileroot;
+    vector<string> params;
+    string line;
+    while (getline(in, line)) {
+      line = StringUtils::Trim(line);
+      if (StringUtils::StartsWith(line, "mass-shard=")) {
+        value = StringUtils::Trim(line.substr(line.find('=') + 1));
+      } else if (StringUtils::StartsWith(line, "fileroot=")) {
+        fileroot = StringUtils::Trim(line.substr(line.find('=') + 1));
+      } else if (!line.empty() && line[0] != '#' &&
+                 !StringUtils::StartsWith(line, "output-dir=")) {
+        params.push_back(line);
+      }
+    }
+    if (i == dirs.begin()) {
+      first_params = params;
+    } else if (params != first_params) {
+      // Report the first setting that differs
+      size_t j = 0;
+      while (j < params.size() && j < first_params.size() &&
+             params[j] == first_params[j]) {
+        j++;
+      }
+      string first = j < first_params.size() ? first_params[j] : "(none)";
+      string other = j < params.size() ? params[j] : "(none)";
+      carp(CARP_FATAL, "%s and %s were not searched with the same parameters "
+           "(%s vs. %s).", dirs.front().c_str(), i->c_str(),
+           first.c_str(), other.c_str());
+    }
+    if (FileUtils::BaseName(param_file) != shardFileName(fileroot, "tide-search.params.txt")) {
+      carp(CARP_FATAL, "The name of %s does not match its fileroot (%s).",
+           param_file.c_str(), fileroot.c_str());
+    }
+    int shard, n;
+    if (!TideSearchApplication::parseMassShard(value, &shard, &n)) {
+      carp(CARP_FATAL, "%s was not produced by a tide-search run with the "
+           "mass-shard option.", i->c_str());
+    }
+    if (shards.empty()) {
+      num_shards = n;
+      shards.resize(n);
+      fileroots->assign(n, "");
+    } else if (n != num_shards) {
+      carp(CARP_FATAL, "%s contains shard %d of %d, but other directories "
+           "contain shards of %d.", i->c_str(), shard + 1, n, num_shards);
+    }
+    if (!shards[shard].empty()) {
+      carp(CARP_FATAL, "Shard %d of %d was given twice (%s and %s).",
+           shard + 1, num_shards, shards[shard].c_str(), i->c_str());
+    }
+    shards[shard] = *i;
+    (*fileroots)[shard] = fileroot;
+  }
+  for (size_t i = 0; i < shards.size(); i++) {
+    if (shards[i].empty()) {
+      carp(CARP_FATAL, "Shard %d of %d is missing.", i + 1, num_shards);
+    }
+  }
+  return shards;
+}
+
+void MergeTideShardsApplication::mergeFiles(
+  const vector<string>& shards,
+  const vector<string>& fileroots,
+  const string& filename,
+  bool overwrite
+) {
+  if (!FileUtils::Exists(FileUtils::Join(shards.front(),
+                                         shardFileName(fileroots.front(), filename)))) {
+    return;
+  }
+  string out_file = make_file_path(filename);
+  carp(CARP_INFO, "Writing %s", out_file.c_str());
+  ofstream* out = create_stream_in_path(out_file.c_str(), NULL, overwrite);
+  string header;
+  for (size_t i = 0; i < shards.size(); i++) {
+    string in_file = FileUtils::Join(shards[i], shardFileName(fileroots[i], filename));
+    ifstream in(in_file.c_str(), ios::binary);
+    if (!in.good()) {
+      carp(CARP_FATAL, "Could not open %s", in_file.c_str());
+    }
+    string line;
+    getline(in, line);
+    if (i == 0) {
+      header = line;
+      *out << header << endl;
+    } else if (line != header) {
+      carp(CARP_FATAL, "The columns of %s do not match those of the first shard.",
+           in_file.c_str());
+    }
+    // The shards cover consecutive precursor mass ranges, so the rows are
+    // grouped by shard rather than in the order a single search writes them.
+    if (in.peek() != EOF) {
+      *out << in.rdbuf();
+    }
+  }
+  out->close();
+  if (!*out) {
+    carp(CARP_FATAL, "Error writing %s", out_file.c_str());
+  }
+  delete out;
+}
+
+/**
+ * \returns the command name for MergeTideShardsApplication
+ */
+string MergeTideShardsApplication::getName() const {
+  return "merge-tide-shards";
+}
+
+/**
+ * \returns the description for MergeTideShardsApplication
+ */
+string MergeTideShardsApplication::getDescription() const {
+  return "[[html:<p>This command combines the results of several tide-search runs "
+    "that were each run with the mass-shard option into one set of tide-search "
+    "tab-delimited output files. Every shard of the search must be given "
+    "exactly once; the shards are ordered using the mass-shard value in their "
+    "parameter files, and each shard's files are found using the fileroot it "
+    "was run with. All shards must have been run with the same parameters, "
+    "apart from mass-shard, fileroot and output-dir. The rows of each file are grouped by shard, in mass-shard "
+    "order, so they are not in the same order as the output of a single "
+    "search. Other output formats can be produced from the merged files "
+    "using psm-convert.</p>]]"
+    "[[nohtml:Combine the tab-delimited outputs of tide-search runs with the "
+    "mass-shard option.]]";
+}
+
+/**
+ * \returns the command arguments
+ */
+vector<string> MergeTideShardsApplication::getArgs() const {
+  string arr[] = {
+    "tide-search shard directory+"
+  };
+  return vector<string>(arr, arr + sizeof(arr) / sizeof(string));
+}
+
+/**
+ * \returns the command options
+ */
+vector<string> MergeTideShardsApplication::getOptions() const {
+  string arr[] = {
+    "fileroot",
+    "output-dir",
+    "overwrite",
+    "parameter-file",
+    "verbosity"
+  };
+  return vector<string>(arr, arr + sizeof(arr) / sizeof(string));
+}
+
+/**
+ * \returns the command outputs
+ */
+vector< pair<string, string> > MergeTideShardsApplication::getOutputs() const {
+  vector< pair<string, string> > outputs;
+  outputs.push_back(make_pair("tide-search.target.txt",
+    "a tab-delimited text file containing the target PSMs of all shards. See <a href=\""
+    "../file-formats/txt-format.html\">txt file format</a> for a list of the fields."));
+  outputs.push_back(make_pair("tide-search.decoy.txt",
+    "a tab-delimited text file containing the decoy PSMs of all shards. This file "
+    "will only be created if the shards contain decoy PSMs."));
+  outputs.push_back(make_pair("merge-tide-shards.params.txt",
+    "a file containing the name and value of all parameters/options for the "
+    "current operation. Not all parameters in the file may have been used in "
+    "the operation. The resulting file can be used with the --parameter-file "
+    "option for other Crux programs."));
+  outputs.push_back(make_pair("merge-tide-shards.log.txt",
+    "a log file containing a copy of all messages that were printed to the "
+    "screen during execution."));
+  return outputs;
+}
+
+/**
+ * \returns whether the application needs the output directory or not.
+ */
+bool MergeTideShardsApplication::needsOutputDirectory() const {
+  return true;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
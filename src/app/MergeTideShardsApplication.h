@@ -0,0 +1,96 @@
+/**
+ * \file MergeTideShardsApplication.h
+ * \brief Combines the tab-delimited outputs of tide-search runs that each
+ * searched one mass shard (see the mass-shard option) into a single set of
+ * tide-search output files.
+ ***********************************************************/
+#ifndef MERGETIDESHARDSAPPLICATION_H
+#define MERGETIDESHARDSAPPLICATION_H
+
+#include "CruxApplication.h"
+#include <string>
+#include <vector>
+
+class MergeTideShardsApplication: public CruxApplication {
+
+ public:
+
+  /**
+   * \returns a blank MergeTideShardsApplication object
+   */
+  MergeTideShardsApplication();
+
+  /**
+   * Destructor
+   */
+  ~MergeTideShardsApplication();
+
+  /**
+   * main method for MergeTideShardsApplication
+   */
+  virtual int main(int argc, char** argv);
+
+  /**
+   * \returns the command name for MergeTideShardsApplication
+   */
+  virtual std::string getName() const;
+
+  /**
+   * \returns the description for MergeTideShardsApplication
+   */
+  virtual std::string getDescription() const;
+
+  /**
+   * \returns the command arguments
+   */
+  virtual std::vector<std::string> getArgs() const;
+
+  /**
+   * \returns the command options
+   */
+  virtual std::vector<std::string> getOptions() const;
+
+  /**
+   * \returns the command outputs
+   */
+  virtual std::vector< std::pair<std::string, std::string> > getOutputs() const;
+
+  /**
+   * \returns whether the application needs the output directory or not.
+   */
+  virtual bool needsOutputDirectory() const;
+
+ protected:
+
+  /**
+   * Orders the shard directories by the mass-shard value in their parameter
+   * files, and checks that every shard is present exactly once. The fileroot
+   * each shard was run with is returned in fileroots, in the same order.
+   */
+  static std::vector<std::string> orderShards(
+    const std::vector<std::string>& dirs,
+    std::vector<std::string>* fileroots
+  );
+
+  /**
+   * Concatenates the file with the given name from each shard directory,
+   * keeping only the first header line. The name is prefixed with each
+   * shard's fileroot. Does nothing if the shards do not contain the file.
+   */
+  static void mergeFiles(
+    const std::vector<std::string>& shards,
+    const std::vector<std::string>& fileroots,
+    const std::string& filename,
+    bool overwrite
+  );
+
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
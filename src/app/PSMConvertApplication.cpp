@@ -27,6 +27,13 @@ PSMConvertApplication::~PSMConvertApplication() {
 }
 
 void PSMConvertApplication::convertFile(string input_format, string output_format, string input_file, string output_file_base, string database_file, bool distinct_matches) {
+  convertFile(input_format, vector<string>(1, output_format), input_file, output_file_base, database_file, distinct_matches);
+}
+
+void PSMConvertApplication::convertFile(string input_format, const vector<string>& output_formats, string input_file, string output_file_base, string database_file, bool distinct_matches) {
+  if (output_formats.empty()) {
+    return;
+  }
   Database* data;
   if (database_file.empty()) {
     data = new Database();
@@ -98,47 +105,65 @@ void PSMConvertApplication::convertFile(string input_format, string output_forma
   
   carp(CARP_INFO, "Successfully read %d PSMs.", collection->getMatchTotal());
   
-  // What will be used when PSMWriter is finished.
-  
-  PSMWriter* writer;
-  stringstream output_file_name_builder;
-  output_file_name_builder << output_file_base;
-  
-  if (output_format == "tsv") {
-    output_file_name_builder << "txt";
-    writer = new PMCDelimitedFileWriter();
-  } else if (output_format == "html") {
-    output_file_name_builder << "html";
-    writer = new HTMLWriter();
-  } else if (output_format == "sqt") {
-    output_file_name_builder << "sqt";
-    writer = new PMCSQTWriter();
-  } else if (output_format == "pin") {
-    output_file_name_builder << "pin";
-    writer = new PinWriter();
-  } else if (output_format == "pepxml") {
-    output_file_name_builder << "pep.xml";
-    writer = new PMCPepXMLWriter();
-  } else if (output_format == "mzidentml") {
-    output_file_name_builder << "mzid";
-    writer = new MzIdentMLWriter();
-  } else if (output_format == "barista-xml") {
-    carp(CARP_FATAL, "Barista-XML format has not been implemented yet");
-  } else {
-    carp(CARP_FATAL, "Invalid output format.  Valid formats are: tsv, html, "
-         "sqt, pin, pepxml, mzidentml, barista-xml.");
+  // The PepXML and SQT writers both regroup the PSMs by protein; do that once.
+  ProteinMatchCollection* protein_collection = NULL;
+
+  for (vector<string>::const_iterator format = output_formats.begin();
+       format != output_formats.end();
+       format++) {
+    const string& output_format = *format;
+    PSMWriter* writer;
+    stringstream output_file_name_builder;
+    output_file_name_builder << output_file_base;
+
+    if (output_format == "tsv") {
+      output_file_name_builder << "txt";
+      writer = new PMCDelimitedFileWriter();
+    } else if (output_format == "html") {
+      output_file_name_builder << "html";
+      writer = new HTMLWriter();
+    } else if (output_format == "sqt") {
+      output_file_name_builder << "sqt";
+      writer = new PMCSQTWriter();
+    } else if (output_format == "pin") {
+      output_file_name_builder << "pin";
+      writer = new PinWriter();
+    } else if (output_format == "pepxml") {
+      output_file_name_builder << "pep.xml";
+      writer = new PMCPepXMLWriter();
+    } else if (output_format == "mzidentml") {
+      output_file_name_builder << "mzid";
+      writer = new MzIdentMLWriter();
+    } else if (output_format == "barista-xml") {
+      carp(CARP_FATAL, "Barista-XML format has not been implemented yet");
+    } else {
+      carp(CARP_FATAL, "Invalid output format.  Valid formats are: tsv, html, "
+           "sqt, pin, pepxml, mzidentml, barista-xml.");
+    }
+
+    string output_file_name = make_file_path(output_file_name_builder.str());
+
+    writer->openFile(this, output_file_name, PSMWriter::PSMS);
+    if (output_format == "sqt" || output_format == "pepxml") {
+      if (protein_collection == NULL) {
+        protein_collection = new ProteinMatchCollection(collection);
+      }
+      if (output_format == "sqt") {
+        ((PMCSQTWriter*)writer)->write(protein_collection, database_file);
+      } else {
+        ((PMCPepXMLWriter*)writer)->write(protein_collection);
+      }
+    } else {
+      writer->write(collection, database_file);
+    }
+    writer->closeFile();
+    delete writer;
   }
-  
-  string output_file_name = make_file_path(output_file_name_builder.str());
-  
-  writer->openFile(this, output_file_name, PSMWriter::PSMS);
-  writer->write(collection, database_file);
-  writer->closeFile();
-  
+
   // Clean Up
+  delete protein_collection;
   delete collection;
   delete reader;
-  delete writer;
 
 }
 
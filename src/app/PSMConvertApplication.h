@@ -34,6 +34,12 @@ class PSMConvertApplication : public CruxApplication {
    * Perform Convert
    */
   virtual void convertFile(string input_format, string output_format, string input_file, string output_file_base, string database_file, bool distinct_matches);
+
+  /**
+   * Converts a file to several output formats, reading the input and the
+   * database only once and writing each format from the same PSMs
+   */
+  virtual void convertFile(string input_format, const vector<string>& output_formats, string input_file, string output_file_base, string database_file, bool distinct_matches);
   
   /**
    * Returns the command name
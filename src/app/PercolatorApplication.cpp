@@ -12,7 +12,9 @@
 #include <sstream>
 #include <iomanip>
 #include <ios>
+#include <boost/bind.hpp>
 #include "util/CarpStreamBuf.h"
+#include "util/PipeBuffer.h"
 #include "util/FileUtils.h"
 #include "util/Params.h"
 #include "util/StringUtils.h"
@@ -99,6 +101,8 @@ int PercolatorApplication::main(int argc, char** argv) {
           }
         }
       }
+    } else if (Params::GetBool("in-memory-pin")) {
+      return mainStreamingPin(result_files);
     } else {
       carp(CARP_INFO, "Converting input to pin format.");
       if (MakePinApplication::main(result_files) != 0 || !FileUtils::Exists(input_pin)) {
@@ -117,6 +121,56 @@ int PercolatorApplication::main(int argc, char** argv) {
 int PercolatorApplication::main(
   const string& input_pin ///< file path of pin to process.
   ) {
+  return runPercolator(input_pin, NULL);
+}
+
+/**
+ * Runs make-pin, writing into the pipe, then closes the writing end.
+ */
+static void writePin(
+  const vector<string>* result_files,
+  PipeBuffer* pipe,
+  int* status
+) {
+  ostream out(pipe->writeBuf());
+  *status = MakePinApplication::main(*result_files, &out);
+  out.flush();
+  pipe->closeWrite();
+}
+
+/**
+ * \brief runs make-pin on a separate thread and streams its output to
+ * percolator through a bounded pipe, so the pin is never held in full
+ * \returns whether percolator was successful or not
+ */
+int PercolatorApplication::mainStreamingPin(
+  const vector<string>& result_files ///< search results to convert
+  ) {
+  carp(CARP_INFO, "Converting input to pin format while running Percolator.");
+  PipeBuffer pipe;
+  int make_pin_status = 0;
+  boost::thread make_pin(boost::bind(&writePin, &result_files, &pipe, &make_pin_status));
+  istream pin(pipe.readBuf());
+  int ret;
+  try {
+    ret = runPercolator("", &pin);
+  } catch (...) {
+    pipe.closeRead();
+    make_pin.join();
+    throw;
+  }
+  pipe.closeRead();
+  make_pin.join();
+  if (make_pin_status != 0) {
+    carp(CARP_FATAL, "make-pin failed.");
+  }
+  return ret;
+}
+
+int PercolatorApplication::runPercolator(
+  const string& input_pin_file,
+  istream* input_pin
+  ) {
   /* build argument list */
   vector<string> perc_args_vec;
   perc_args_vec.push_back("percolator");
@@ -356,7 +410,11 @@ int PercolatorApplication::main(
     perc_args_vec.push_back("--train-best-positive");
   }
 
-  perc_args_vec.push_back(input_pin);
+  if (input_pin != NULL) {
+    perc_args_vec.push_back("--stdinput-tab");
+  } else {
+    perc_args_vec.push_back(input_pin_file);
+  }
 
   /* build argv line */
 
@@ -375,23 +433,39 @@ int PercolatorApplication::main(
   CarpStreamBuf buffer;
   streambuf* old = std::cerr.rdbuf();
   std::cerr.rdbuf(&buffer);
+  /* Feed an in-memory pin to Percolator as its standard input. */
+  streambuf* old_in = std::cin.rdbuf();
+  if (input_pin != NULL) {
+    std::cin.rdbuf(input_pin->rdbuf());
+  }
 
   /* Call percolatorMain */
   PercolatorAdapter pCaller;
+  bool options_parsed = false;
   try {
     int retVal;
-    if (pCaller.parseOptions(perc_args_vec.size(), (char**)&perc_argv.front()) &&
+    options_parsed = pCaller.parseOptions(perc_args_vec.size(), (char**)&perc_argv.front());
+    if (options_parsed &&
         (retVal = pCaller.run()) != 1) { // Percolator return value 1 means success
       carp(CARP_FATAL, "Error running percolator:%d", retVal);
     }
   } catch (const std::exception& e) {
-    /* Recover stderr */
+    /* Recover stderr and stdin */
     std::cerr.rdbuf(old);
+    std::cin.rdbuf(old_in);
     throw runtime_error(e.what());
   }
 
-  /* Recover stderr */
+  /* Recover stderr and stdin */
   std::cerr.rdbuf(old);
+  std::cin.rdbuf(old_in);
+
+  // Without its options Percolator never reads the in-memory pin, and would
+  // otherwise leave no results behind but a warning.
+  if (!options_parsed && input_pin != NULL) {
+    carp(CARP_FATAL, "Percolator did not accept the options for reading an "
+         "in-memory pin:%s", perc_cmd.c_str());
+  }
   
   // get percolator score information into crux objects
   ProteinMatchCollection* target_pmc = pCaller.getProteinMatchCollection();
@@ -529,6 +603,7 @@ vector<string> PercolatorApplication::getOptions() const {
     "max-charge-feature",
     "maxiter",
     "mzid-output",
+    "in-memory-pin",
     "only-psms",
     "output-dir",
     "output-weights",
@@ -11,6 +11,7 @@
 
 #include <string>
 #include <fstream>
+#include <vector>
 
 
 class PercolatorApplication: public CruxApplication {
@@ -77,6 +78,25 @@ class PercolatorApplication: public CruxApplication {
   int main(
     const std::string& input_pinxml ///< file path of spectra to process
   );
+
+  /**
+   * \brief runs make-pin on a separate thread and passes its output to
+   * Percolator as its standard input while it is being written
+   * \returns whether percolator was successful or not
+   */
+  int mainStreamingPin(
+    const std::vector<std::string>& result_files ///< search results to convert
+  );
+
+ protected:
+
+  /**
+   * \brief runs percolator on either a pin file or an in-memory pin
+   */
+  int runPercolator(
+    const std::string& input_pin_file,
+    std::istream* input_pin
+  );
   
 };
 
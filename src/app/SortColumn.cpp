@@ -5,11 +5,17 @@
  *****************************************************************************/
 #include "SortColumn.h"
 
-#include "io/DelimitedFile.h"
-
-#include "fdstream.hpp"
+#include "util/StringUtils.h"
 
+#include <algorithm>
 #include <errno.h>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include "util/WinCrux.h"
 #include "util/Params.h"
 
@@ -40,137 +46,136 @@ int SortColumn::main(int argc, char** argv) {
   ascending_ = Params::GetBool("ascending");
   delimiter_ = get_delimiter_parameter("delimiter");
   header_ = Params::GetBool("header");
+  num_threads_ = Params::GetInt("num-threads");
+  if (num_threads_ < 1) {
+    num_threads_ = boost::thread::hardware_concurrency();
+  }
+  if (num_threads_ < 1) {
+    num_threads_ = 1;
+  }
+
+  ifstream file;
+  istream* in = &cin;
+  if (delimited_filename_ != "-") {
+    file.open(delimited_filename_.c_str(), ios::in | ios::binary);
+    if (!file.good()) {
+      carp(CARP_FATAL, "Could not open %s", delimited_filename_.c_str());
+    }
+    in = &file;
+  }
 
-  DelimitedFileReader delimited_file(delimited_filename_, true, delimiter_);
-  
-  int col_sort_idx = delimited_file.findColumn(column_name_string_);
+  string header;
+  getline(*in, header);
+  vector<string> column_names = StringUtils::Split(header, delimiter_);
+  int col_sort_idx = -1;
+  for (unsigned int col_idx = 0; col_idx < column_names.size(); col_idx++) {
+    if (column_names[col_idx] == column_name_string_) {
+      col_sort_idx = col_idx;
+      break;
+    }
+  }
 
   if (col_sort_idx == -1) {
+    ostringstream oss;
+    oss << "Available columns:" << endl;
+    for (unsigned int col_idx = 0; col_idx < column_names.size(); col_idx++) {
+      oss << col_idx << "  " << column_names[col_idx] << endl;
+    }
     carp(CARP_ERROR, "column not found:%s\n\n%s", 
       column_name_string_.c_str(),
-      delimited_file.getAvailableColumnsString().c_str());
+      oss.str().c_str());
     return -1;
   }
 
   col_sort_idx_ = (unsigned int)col_sort_idx;
 
   /*
-   * So to be able to handle sorting large files without reading the
-   * whole file into memory, we implement a divide-then-merge approach.  
-   * Meaning that we read in a maximum number of rows, sort these, 
-   * then write out the sorted delimited file to a temporary file.  
-   * After processing all of the rows in the original file, we then
-   * merge all the temporary files created, printing out the full sorted file.  
+   * So to be able to handle sorting files larger than memory, we
+   * implement an external merge sort. We read rows into a text buffer of
+   * bounded size, parsing only the key of each row, sort the keys of this
+   * run on several threads, then write the sorted rows of the run out to
+   * a temporary file. After processing all of the rows in the original
+   * file, we merge the temporary files using a heap, printing out the
+   * full sorted file.
    */
-  vector<int> temp_file_descriptors;
-  vector<boost::fdostream*> temp_file_streams;
   vector<string> temp_filenames;
 
-  DelimitedFile* temp_delimited = new DelimitedFile(delimiter_);
-  for (unsigned int col_idx=0;col_idx < delimited_file.numCols();col_idx++) {
-    temp_delimited->addColumn(delimited_file.getColumnName(col_idx));
-  }
-
-  //Maximum number of rows to read before sorting then saving to a temporary file.
-  //In the future, we can set this number to be based upon how much memory
-  //is available on the system.  We want to make it large enough so that we
-  //don't have to create/merge too many temporary files, but small enough so
-  //that sort-by-column doesn't crash from not enough memory or affect the
-  //other processes on the computer.
-  int max_rows = 200000;
-
-  int current_count = 0;
-
-  while(delimited_file.hasNext()) {
-
-    unsigned int new_row = temp_delimited->addRow();
-    for (unsigned int col_idx = 0;col_idx < delimited_file.numCols();col_idx++) {
-      temp_delimited->setString(col_idx, new_row, delimited_file.getString(col_idx));
-    }
-
-    current_count++;
-
-    if (current_count >= max_rows) {
-      carp(CARP_DEBUG, "Sorting %i rows", max_rows);
-      sortDelimited(temp_delimited);
-
-      char ctemp_filename[50] = "SortColumn_XXXXXX";
-    
-      int fd = mkstemp(ctemp_filename);
-      if (fd == -1) {
-        carp(CARP_ERROR, "Error creating temp file!\n "
-                         "Error: %s", strerror(errno));
-        return(-1);
+  //Maximum number of bytes a run may allocate, for its text buffer and its
+  //RunRow array, before it is sorted and saved to a temporary file. We want
+  //to make it large enough so that we don't have to create/merge too many
+  //temporary files, but small enough so that sort-by-column doesn't crash
+  //from not enough memory or affect the other processes on the computer.
+  //The buffer and the array may grow to twice their contents, so the run
+  //ends when the contents reach half of this.
+  const size_t max_run_bytes = (size_t)1 << 28;
+
+  string buffer;
+  vector<RunRow> rows;
+  string line;
+  bool more = true;
+  while (more) {
+    more = static_cast<bool>(getline(*in, line));
+    if (more) {
+      if (line.empty()) {
+        continue;
       }
-      
-      string temp_filename(ctemp_filename);
-  
-      boost::fdostream* out = new boost::fdostream(fd);
-  
-      (*out) << (*temp_delimited);
-      temp_file_streams.push_back(out);
-      temp_file_descriptors.push_back(fd);
-      temp_filenames.push_back(temp_filename);
-      delete(temp_delimited);
-
-      //create a new delimited file.
-      temp_delimited = new DelimitedFile(delimiter_);
-
-      for (unsigned int col_idx = 0;col_idx < delimited_file.numCols();col_idx++) {
-        temp_delimited->setString(col_idx, new_row, delimited_file.getString(col_idx));
+      RunRow row;
+      row.row_start = buffer.length();
+      row.row_length = line.length();
+      parseKey(line.data(), line.length(), &row.key_start, &row.key_length, &row.value);
+      row.key_start += row.row_start;
+      buffer.append(line);
+      rows.push_back(row);
+    }
+    if (buffer.length() + rows.size() * sizeof(RunRow) < max_run_bytes / 2 && more) {
+      continue;
+    }
+    if (!more && temp_filenames.empty()) {
+      //no temporary files used, print out the sorted output.
+      sortRun(buffer, rows);
+      if (header_) {
+        cout << header << endl;
       }
-      //reset to count so that we can read in the next batch of rows.
-      current_count = 0;
-  
+      writeRun(buffer, rows, cout);
+      cout.flush();
+      break;
     }
+    if (rows.empty()) {
+      break;
+    }
+    carp(CARP_DEBUG, "Sorting %d rows", (int)rows.size());
+    sortRun(buffer, rows);
 
-    delimited_file.next();
-  } 
-
-  //done reading the file, now print out the sorted version.
-
-  if (temp_file_descriptors.size() == 0) {
-
-    //no temporary files used, print out the sorted output.
-    sortDelimited(temp_delimited);
-    cout << (*temp_delimited);
-    delete temp_delimited;
-  } else {
-
-    //sort the current and save to a temporary file. 
-    sortDelimited(temp_delimited);
     char ctemp_filename[50] = "SortColumn_XXXXXX";
-
     int fd = mkstemp(ctemp_filename);
-
     if (fd == -1) {
       carp(CARP_ERROR, "Error creating temp file!\n "
                        "Error: %s", strerror(errno));
-        return(-1);
+      return(-1);
     }
-
-    string temp_filename(ctemp_filename);
-
-    boost::fdostream* out = new boost::fdostream(fd);
-    (*out) << (*temp_delimited);
-    temp_file_streams.push_back(out);
-    temp_file_descriptors.push_back(fd);
-    temp_filenames.push_back(temp_filename);
-    delete(temp_delimited);
-
-    //flush everything.
-    for (unsigned int i=0; i < temp_file_descriptors.size(); i++) {
-      temp_file_streams[i]->flush();
+    close(fd);
+    temp_filenames.push_back(ctemp_filename);
+
+    ofstream out(ctemp_filename, ios::out | ios::binary);
+    writeRun(buffer, rows, out);
+    out.close();
+    if (!out) {
+      carp(CARP_FATAL, "Error writing temp file %s", ctemp_filename);
     }
+    string().swap(buffer);
+    vector<RunRow>().swap(rows);
+  }
 
+  if (!temp_filenames.empty()) {
+    if (header_) {
+      cout << header << endl;
+    }
     //merge the temporary files together, printing out the merged output.
-    mergeDelimitedFiles(temp_filenames);
+    mergeRuns(temp_filenames);
   }
-  
+
   //clean everything up
-  for (unsigned int idx=0; idx < temp_file_descriptors.size(); idx++) {
-    delete temp_file_streams[idx];
-    close(temp_file_descriptors[idx]);
+  for (unsigned int idx=0; idx < temp_filenames.size(); idx++) {
     remove(temp_filenames[idx].c_str());
   }
 
@@ -215,6 +220,7 @@ vector<string> SortColumn::getOptions() const {
     "header",
     "column-type",
     "ascending",
+    "num-threads",
     "verbosity"
   };
   return vector<string>(arr, arr + sizeof(arr) / sizeof(string));
@@ -232,133 +238,243 @@ vector< pair<string, string> > SortColumn::getOutputs() const {
 }
 
 /**
- * sorts the delimited file based upon the column type parameter
+ * orders the rows of a run by key; rows with equal keys are ordered
+ * by their position in the input, which is the order of row_start.
  */
-void SortColumn::sortDelimited(
-  DelimitedFile* delimited ///< delimited file to sort.
-  ) {
+struct SortColumn::RunRowLess {
+  const SortColumn* sort_;
+  const char* buffer_;
+  RunRowLess(const SortColumn* sort, const char* buffer) : sort_(sort), buffer_(buffer) {}
+  bool operator()(const RunRow& x, const RunRow& y) const {
+    int result = sort_->compare(buffer_ + x.key_start, x.key_length, x.value,
+                                buffer_ + y.key_start, y.key_length, y.value);
+    if (result == 0) {
+      return sort_->ascending_ ? x.row_start < y.row_start : x.row_start > y.row_start;
+    }
+    return sort_->ascending_ ? result < 0 : result > 0;
+  }
+};
 
-  switch(column_type_) {
+/**
+ * finds the sort column of a row and parses it according to the
+ * column type parameter.
+ */
+void SortColumn::parseKey(
+  const char* row, ///< the row's text
+  size_t row_length, ///< the length of the row
+  size_t* key_start, ///< offset of the key in the row -out
+  size_t* key_length, ///< length of the key -out
+  FLOAT_T* value ///< numeric value of the key -out
+  ) const {
+
+  size_t start = 0;
+  for (unsigned int col_idx = 0; col_idx < col_sort_idx_ && start <= row_length; col_idx++) {
+    const char* next = (const char*)memchr(row + start, delimiter_, row_length - start);
+    start = (next == NULL) ? row_length + 1 : next - row + 1;
+  }
+  if (start > row_length) {
+    //missing cells are empty.
+    start = row_length;
+  }
+  const char* end = (const char*)memchr(row + start, delimiter_, row_length - start);
+  *key_start = start;
+  *key_length = (end == NULL) ? row_length - start : end - row - start;
+  *value = 0;
+
+  if (column_type_ != COLTYPE_STRING && *key_length > 0) {
+    //strtod and strtol stop at the delimiter.
+    string key(row + start, *key_length);
+    if (column_type_ == COLTYPE_INT) {
+      *value = (FLOAT_T)atoi(key.c_str());
+    } else if (key == "Inf") {
+      *value = numeric_limits<FLOAT_T>::infinity();
+    } else if (key == "-Inf") {
+      *value = -numeric_limits<FLOAT_T>::infinity();
+    } else {
+      *value = (FLOAT_T)strtod(key.c_str(), NULL);
+    }
+  }
+}
 
-    case COLTYPE_STRING:
-      delimited->sortByStringColumn(column_name_string_, ascending_);
-      break;
-    case COLTYPE_INT:
-      delimited->sortByIntegerColumn(column_name_string_, ascending_);
-      break;
-    case COLTYPE_REAL:
-      delimited->sortByFloatColumn(column_name_string_, ascending_);
-      break;
-    case NUMBER_COLTYPES:
-    case COLTYPE_INVALID:
-      carp(CARP_FATAL, "Unknow column type");
+/**
+ * sorts one slice of a run; used as a thread function.
+ */
+template<typename Iterator, typename Less>
+static void sortSlice(Iterator first, Iterator last, Less less) {
+  sort(first, last, less);
+}
+
+/**
+ * sorts the rows of a run using num_threads_ threads. Each thread sorts
+ * a contiguous slice of the rows, then the slices are merged.
+ */
+void SortColumn::sortRun(
+  const string& buffer, ///< the text of the run's rows
+  vector<RunRow>& rows ///< the rows to sort
+  ) const {
+
+  RunRowLess less(this, buffer.data());
+  int num_slices = min(num_threads_, (int)(rows.size() / 10000) + 1);
+  if (num_slices <= 1) {
+    sort(rows.begin(), rows.end(), less);
+    return;
+  }
+
+  vector<size_t> bounds;
+  for (int slice = 0; slice <= num_slices; slice++) {
+    bounds.push_back(rows.size() * slice / num_slices);
+  }
+  boost::thread_group threads;
+  for (int slice = 0; slice < num_slices; slice++) {
+    threads.create_thread(boost::bind(
+      &sortSlice<vector<RunRow>::iterator, RunRowLess>,
+      rows.begin() + bounds[slice], rows.begin() + bounds[slice + 1], less));
+  }
+  threads.join_all();
+
+  //merge neighbouring slices until one is left.
+  for (size_t width = 1; width < (size_t)num_slices; width *= 2) {
+    for (size_t slice = 0; slice + width < (size_t)num_slices; slice += 2 * width) {
+      size_t last = min(slice + 2 * width, (size_t)num_slices);
+      inplace_merge(rows.begin() + bounds[slice], rows.begin() + bounds[slice + width],
+                    rows.begin() + bounds[last], less);
+    }
   }
 }
 
 /**
- * merges a list of sorted delimited files and prints 
- * out the resulting sorted file.  This method accomplishes this
- * by testing the current row of each temporary file against
- * the others.  If it's compare value is the smallest (or largest when descending)
- * then printout that temporary file's row and advance the next row.
- * Keep iterating until all rows for all temporary files are printed out.
+ * writes the rows of a run in sorted order.
+ */
+void SortColumn::writeRun(
+  const string& buffer, ///< the text of the run's rows
+  const vector<RunRow>& rows, ///< the sorted rows
+  ostream& out ///< the stream to write to
+  ) const {
+
+  for (vector<RunRow>::const_iterator i = rows.begin(); i != rows.end(); i++) {
+    out.write(buffer.data() + i->row_start, i->row_length);
+    out.put('\n');
+  }
+}
+
+/**
+ * The current row of one run file during the merge.
+ */
+struct SortColumnRun {
+  ifstream* file;
+  string row;
+  size_t key_start;
+  size_t key_length;
+  FLOAT_T value;
+};
+
+/**
+ * orders the runs by their current rows for a max-heap, so that the top
+ * of the heap is the row to print next. Rows with equal keys come from
+ * the earlier run when ascending and from the later run when descending,
+ * as they would in a single sort.
+ */
+struct SortColumn::MergeRowLess {
+  const SortColumn* sort_;
+  const vector<SortColumnRun>* runs_;
+  MergeRowLess(const SortColumn* sort, const vector<SortColumnRun>* runs)
+    : sort_(sort), runs_(runs) {}
+  bool operator()(int x, int y) const {
+    const SortColumnRun& run_x = (*runs_)[x];
+    const SortColumnRun& run_y = (*runs_)[y];
+    int result = sort_->compare(
+      run_x.row.data() + run_x.key_start, run_x.key_length, run_x.value,
+      run_y.row.data() + run_y.key_start, run_y.key_length, run_y.value);
+    if (result == 0) {
+      return sort_->ascending_ ? x > y : x < y;
+    }
+    return sort_->ascending_ ? result > 0 : result < 0;
+  }
+};
+
+/**
+ * merges a list of sorted run files and prints out the resulting sorted
+ * file. The runs are kept in a heap ordered by the key of their current
+ * row, so each row costs O(log(number of runs)) comparisons, and each
+ * key is parsed only once.
  */
-void SortColumn::mergeDelimitedFiles(
+void SortColumn::mergeRuns(
   vector<string>& temp_filenames
   ) {
 
-  //open the temporary delimited files using a reader.
-  vector<DelimitedFileReader*> delimited_files;
-  for (unsigned int idx=0;idx < temp_filenames.size();idx++) {
-    delimited_files.push_back(new DelimitedFileReader(temp_filenames[idx], delimiter_));
-  }
-  
-  //print out the header if requested.
-  if (header_) {
-    cout << delimited_files[0]->getHeaderString() << endl;
+  vector<SortColumnRun> runs(temp_filenames.size());
+  vector<int> heap;
+  for (unsigned int idx = 0; idx < temp_filenames.size(); idx++) {
+    runs[idx].file = new ifstream(temp_filenames[idx].c_str(), ios::in | ios::binary);
+    if (!runs[idx].file->good()) {
+      carp(CARP_FATAL, "Could not open temp file %s", temp_filenames[idx].c_str());
+    }
+    if (getline(*runs[idx].file, runs[idx].row)) {
+      parseKey(runs[idx].row.data(), runs[idx].row.length(),
+               &runs[idx].key_start, &runs[idx].key_length, &runs[idx].value);
+      heap.push_back(idx);
+    }
   }
 
-  int best_idx = -1;
-
-  do {
-    best_idx = -1;
-    //find the temporary file whose current row's column value is the
-    //smallest or largest.
-    for (unsigned int idx = 0;idx < delimited_files.size();idx++) {
-      if (delimited_files[idx]->hasNext()) {
-        if (best_idx == -1) {
-          best_idx = idx;
-        } else {
-          int compare_result = compare(delimited_files[idx], delimited_files[best_idx]);
-          if ((ascending_) && (compare_result == -1)) {
-            best_idx = idx;
-          } else if ((!ascending_) && (compare_result == 1)) {
-            best_idx = idx;
-          }
-        }
-      }
-  
-      //if a best was found, print out the row and advance to the
-      //next row.
-      if (best_idx != -1) {
-        cout << delimited_files[best_idx]->getString() << endl;
-        delimited_files[best_idx]->next();
-      }
+  MergeRowLess less(this, &runs);
+  make_heap(heap.begin(), heap.end(), less);
+  while (!heap.empty()) {
+    pop_heap(heap.begin(), heap.end(), less);
+    SortColumnRun& run = runs[heap.back()];
+    cout.write(run.row.data(), run.row.length());
+    cout.put('\n');
+    if (getline(*run.file, run.row)) {
+      parseKey(run.row.data(), run.row.length(), &run.key_start, &run.key_length, &run.value);
+      push_heap(heap.begin(), heap.end(), less);
+    } else {
+      heap.pop_back();
     }
-    //iterate until all rows of all temporary files are printed out.
-  } while (best_idx != -1);
+  }
+  cout.flush();
 
-  for (unsigned int idx = 0; idx < temp_filenames.size(); idx++) {
-    delete delimited_files[idx];
+  for (unsigned int idx = 0; idx < runs.size(); idx++) {
+    delete runs[idx].file;
   }
 }
 
 /**
- * \returns the result of comparing two file(s) current row and column: 
- * 1 : file1 > file2
- * -1 : file1 < file2
- * 0 : file1 = file2
+ * \returns the result of comparing two keys of the sort column:
+ * 1 : key1 > key2
+ * -1 : key1 < key2
+ * 0 : key1 = key2
  */
 int SortColumn::compare(
-  DelimitedFileReader* file1, 
-  DelimitedFileReader* file2
-  ) {
+  const char* key1, ///< the first key, if the column holds strings
+  size_t key1_length, ///< the length of the first key
+  FLOAT_T value1, ///< the first key, if the column holds numbers
+  const char* key2, ///< the second key, if the column holds strings
+  size_t key2_length, ///< the length of the second key
+  FLOAT_T value2 ///< the second key, if the column holds numbers
+  ) const {
 
-  bool isless = false;
-  bool isequal = false;
-  
   switch (column_type_) {
-    case COLTYPE_STRING:
-      isless = file1->getString(col_sort_idx_) < file2->getString(col_sort_idx_);
-      if (!isless) {
-        isequal = file1->getString(col_sort_idx_) == file2->getString(col_sort_idx_);
+    case COLTYPE_STRING: {
+      //same order as std::string::compare
+      int result = memcmp(key1, key2, min(key1_length, key2_length));
+      if (result == 0) {
+        result = (key1_length < key2_length) ? -1 : (key1_length > key2_length ? 1 : 0);
       }
-    break;
+      return (result < 0) ? -1 : (result > 0 ? 1 : 0);
+    }
     case COLTYPE_REAL:
-      isless = file1->getDouble(col_sort_idx_) < file2->getDouble(col_sort_idx_);
-      if (!isless) {
-        isequal = file1->getDouble(col_sort_idx_) == file2->getDouble(col_sort_idx_);
-      }
-    break;
     case COLTYPE_INT:
-      isless = file1->getInteger(col_sort_idx_) < file2->getInteger(col_sort_idx_);
-      if (!isless) {
-        isequal = file1->getInteger(col_sort_idx_) == file2->getInteger(col_sort_idx_);
+      if (value1 < value2) {
+        return -1;
+      } else if (value1 == value2) {
+        return 0;
+      } else {
+        return 1;
       }
-    break;
     case NUMBER_COLTYPES:
     case COLTYPE_INVALID:
       carp(CARP_FATAL, "Column type invalid!");
-
-  }
-
-  if (isless) {
-    return -1;
-  } else if (isequal) {
-    return 0;
-  } else {
-    return 1;
   }
+  return 0;
 }
 
 /*
@@ -11,6 +11,7 @@
 #include "CruxApplication.h"
 #include "io/DelimitedFileReader.h"
 
+#include <iostream>
 #include <string>
 #include <vector>
 
@@ -26,32 +27,77 @@ class SortColumn: public CruxApplication {
   bool header_;               ///<print out the header?
   unsigned int col_sort_idx_; ///<column index to sort by
 
+  int num_threads_;           ///<threads used to sort each run
+
+  /**
+   * A row of the run being sorted. The sort key is parsed once, when the
+   * row is read; string keys and the row itself are kept as offsets into
+   * the run's text buffer.
+   */
+  struct RunRow {
+    FLOAT_T value;      ///<key of an int or real column
+    size_t key_start;   ///<key of a string column
+    size_t key_length;
+    size_t row_start;   ///<row text, without the line terminator
+    size_t row_length;
+  };
+  struct RunRowLess;    ///<orders the rows of a run
+  struct MergeRowLess;  ///<orders the current rows of the run files
+
   //private methods.
   /**
-   * sorts the delimited file based upon the column type parameter
+   * finds the sort column of a row and parses it according to the
+   * column type parameter.
    */
-  void sortDelimited(
-    DelimitedFile* delimited
-  );
+  void parseKey(
+    const char* row,
+    size_t row_length,
+    size_t* key_start,
+    size_t* key_length,
+    FLOAT_T* value
+  ) const;
+
+  /**
+   * sorts the rows of a run using num_threads_ threads. Rows with equal
+   * keys keep the order of the input file (reversed when descending,
+   * as the in-memory sort of DelimitedFile does).
+   */
+  void sortRun(
+    const std::string& buffer,
+    std::vector<RunRow>& rows
+  ) const;
+
+  /**
+   * writes the rows of a run in sorted order.
+   */
+  void writeRun(
+    const std::string& buffer,
+    const std::vector<RunRow>& rows,
+    std::ostream& out
+  ) const;
 
   /**
-   * merges a list of sorted delimited files and prints 
+   * merges a list of sorted run files and prints
    * out the resulting sorted file.
    */
-  void mergeDelimitedFiles(
+  void mergeRuns(
     std::vector<std::string>& temp_filenames
   );
 
   /**
-   * /returns the result of comparing two file(s) current row and column: 
-   * 1 : file1 > file2
-   * -1 : file1 < file2
-   * 0 : file1 = file2
+   * /returns the result of comparing two keys of the sort column:
+   * 1 : key1 > key2
+   * -1 : key1 < key2
+   * 0 : key1 = key2
    */
   int compare(
-    DelimitedFileReader* file1,
-    DelimitedFileReader* file2
-  );
+    const char* key1,
+    size_t key1_length,
+    FLOAT_T value1,
+    const char* key2,
+    size_t key2_length,
+    FLOAT_T value2
+  ) const;
 
 
  public:
@@ -1,4 +1,8 @@
 #include <iterator>
+#include <queue>
+#include <boost/bind.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread.hpp>
 #include "SpectralCounts.h"
 #include "util/crux-utils.h"
 #include "util/Params.h"
@@ -170,9 +174,9 @@ void SpectralCounts::getProteinToMetaProtein() {
   // for every meta protein
   for (MetaMapping::iterator meta_protein_it = meta_mapping_.begin();
        meta_protein_it != meta_mapping_.end(); ++meta_protein_it) {
-    MetaProtein proteins = meta_protein_it->second;
+    const MetaProtein& proteins = meta_protein_it->second;
     // for every protein in the meta protein
-    for (MetaProtein::iterator proteins_it = proteins.begin();
+    for (MetaProtein::const_iterator proteins_it = proteins.begin();
          proteins_it != proteins.end(); ++proteins_it) {
       // create a mapping of protein to meta protein
       protein_meta_protein_.insert(make_pair((*proteins_it), proteins));
@@ -428,50 +432,135 @@ void SpectralCounts::computeEmpai() {
 }
 
 /**
- * For the spectrum associated with the match, sum the intensities of
- * all b and y ions that are not modified.
- * \return The sum of unmodified b and y ions.
+ * The peaks of one spectrum that Spectrum::getNearestPeak can return.
  */
-FLOAT_T SpectralCounts::sumMatchIntensity(Match* match,
-                                        Crux::SpectrumCollection* spectra) {
-  FLOAT_T match_intensity = 0;
-  char* peptide_seq = match->getSequence();
-  MODIFIED_AA_T* modified_sequence = match->getModSequence();
-  int charge = match->getCharge();
-  Spectrum* temp = match->getSpectrum();
-  int scan = temp->getFirstScan();
-
-  Spectrum* spectrum = spectra->getSpectrum(scan);
-
-  if (spectrum == NULL) {
-    carp(CARP_FATAL, "scan: %d doesn't exist or not found!");
-    return 0.0;
+struct BinnedSpectrum {
+  vector<int> bins;
+  vector<Peak*> peaks;
+};
+
+/**
+ * For the matches order[first..last-1], sums the intensities of the peaks
+ * nearest to each m/z in the match's ion ladder.
+ */
+static void sumLadderIntensities(
+  const vector<size_t>* order,
+  const vector<const vector<FLOAT_T>*>* ladders,
+  const vector<const BinnedSpectrum*>* spectra,
+  FLOAT_T bin_width,
+  size_t first,
+  size_t last,
+  vector<FLOAT_T>* intensities
+  ) {
+  for (size_t i = first; i < last; i++) {
+    size_t match_idx = (*order)[i];
+    const vector<FLOAT_T>& ladder = *(*ladders)[match_idx];
+    const BinnedSpectrum& spectrum = *(*spectra)[match_idx];
+    FLOAT_T match_intensity = 0;
+    for (size_t ion_idx = 0; ion_idx < ladder.size(); ion_idx++) {
+      Peak* peak = Spectrum::getNearestPeak(spectrum.bins, spectrum.peaks,
+                                            ladder[ion_idx], bin_width);
+      if (peak != NULL) {
+        match_intensity += peak->getIntensity();
+      }
+    }
+    (*intensities)[match_idx] = match_intensity;
   }
+}
 
-  Ion* ion;
-  SCORER_TYPE_T score_type = XCORR;
-  IonConstraint* ion_constraint =
-    IonConstraint::newIonConstraintSmart(score_type, charge);
-  IonSeries* ion_series = new IonSeries(ion_constraint, charge);
-  ion_series->update(peptide_seq, modified_sequence);
-  ion_series->predictIons();
-  for (IonIterator ion_it = ion_series->begin();
-       ion_it != ion_series->end(); ++ion_it) {
-    ion = (*ion_it);
-    if (ion -> getType() == B_ION || ion -> getType() == Y_ION) {
-      if (!ion->isModified()) {
-        Peak * peak = spectrum->getNearestPeak(ion->getMassZ(),
-                                                bin_width_);
-        if (peak != NULL) {
-          match_intensity += peak->getIntensity();
+/**
+ * For the spectrum associated with each match, sum the intensities of
+ * all b and y ions that are not modified. The intensities are in the
+ * order of matches_.
+ *
+ * Each distinct peptide/charge is fragmented once and each distinct
+ * spectrum is binned once. IonSeries is not thread-safe, so this is done
+ * first; the peak lookups are then split across num-threads threads, with
+ * the matches grouped by scan.
+ */
+void SpectralCounts::sumMatchIntensities(Crux::SpectrumCollection* spectra,
+                                         vector<FLOAT_T>* intensities) {
+  map<string, vector<FLOAT_T> > ladder_cache;
+  map<int, BinnedSpectrum> spectrum_cache;
+  vector<const vector<FLOAT_T>*> ladders;
+  vector<const BinnedSpectrum*> match_spectra;
+  vector<pair<int, size_t> > scan_order;
+
+  for (set<Match*>::iterator match_it = matches_.begin();
+       match_it != matches_.end(); ++match_it) {
+    Match* match = *match_it;
+    int charge = match->getCharge();
+    int scan = match->getSpectrum()->getFirstScan();
+
+    map<int, BinnedSpectrum>::iterator spectrum_it = spectrum_cache.find(scan);
+    if (spectrum_it == spectrum_cache.end()) {
+      Spectrum* spectrum = spectra->getSpectrum(scan);
+      if (spectrum == NULL) {
+        carp(CARP_FATAL, "scan: %d doesn't exist or not found!", scan);
+      }
+      spectrum_it = spectrum_cache.insert(make_pair(scan, BinnedSpectrum())).first;
+      spectrum->getBinnedPeaks(&spectrum_it->second.bins, &spectrum_it->second.peaks);
+    }
+
+    MODIFIED_AA_T* modified_sequence = match->getModSequence();
+    int length = match->getPeptide()->getLength();
+    string key((const char*)modified_sequence, length * sizeof(MODIFIED_AA_T));
+    key += (char)charge;
+    map<string, vector<FLOAT_T> >::iterator ladder_it = ladder_cache.find(key);
+    if (ladder_it == ladder_cache.end()) {
+      ladder_it = ladder_cache.insert(make_pair(key, vector<FLOAT_T>())).first;
+      char* peptide_seq = match->getSequence();
+      IonConstraint* ion_constraint =
+        IonConstraint::newIonConstraintSmart(XCORR, charge);
+      IonSeries* ion_series = new IonSeries(ion_constraint, charge);
+      ion_series->update(peptide_seq, modified_sequence);
+      ion_series->predictIons();
+      for (IonIterator ion_it = ion_series->begin();
+           ion_it != ion_series->end(); ++ion_it) {
+        Ion* ion = (*ion_it);
+        if ((ion->getType() == B_ION || ion->getType() == Y_ION) &&
+            !ion->isModified()) {
+          ladder_it->second.push_back(ion->getMassZ());
         }
       }
+      delete ion_series;
+      free(peptide_seq);
     }
+    free(modified_sequence);
+
+    scan_order.push_back(make_pair(scan, ladders.size()));
+    ladders.push_back(&ladder_it->second);
+    match_spectra.push_back(&spectrum_it->second);
   }
-  delete ion_series;
-  free(peptide_seq);
 
-  return match_intensity;
+  sort(scan_order.begin(), scan_order.end());
+  vector<size_t> order;
+  for (size_t i = 0; i < scan_order.size(); i++) {
+    order.push_back(scan_order[i].second);
+  }
+  intensities->assign(order.size(), 0);
+
+  int num_threads = Params::GetInt("num-threads");
+  if (num_threads < 1) {
+    num_threads = boost::thread::hardware_concurrency();
+  }
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+  num_threads = min(num_threads, (int)(order.size() / 1000) + 1);
+  if (num_threads <= 1) {
+    sumLadderIntensities(&order, &ladders, &match_spectra, bin_width_,
+                         0, order.size(), intensities);
+    return;
+  }
+  boost::thread_group threads;
+  for (int thread = 0; thread < num_threads; thread++) {
+    threads.create_thread(boost::bind(&sumLadderIntensities,
+      &order, &ladders, &match_spectra, bin_width_,
+      order.size() * thread / num_threads,
+      order.size() * (thread + 1) / num_threads, intensities));
+  }
+  threads.join_all();
 }
 
 
@@ -495,16 +584,22 @@ void SpectralCounts::getPeptideScores() {
     spectra = SpectrumCollectionFactory::create(Params::GetString("input-ms2"));
   }
 
+  // for sin, calculate total ion intensity for each match by
+  // summing up peak intensities
+  vector<FLOAT_T> match_intensities;
+  if (measure_ == MEASURE_SIN) {
+    sumMatchIntensities(spectra, &match_intensities);
+  }
+
+  size_t match_idx = 0;
   for(set<Match*>::iterator match_it = matches_.begin();
-      match_it != matches_.end(); ++match_it) {
+      match_it != matches_.end(); ++match_it, ++match_idx) {
 
     FLOAT_T match_intensity = 1; // for NSAF just count each for the peptide/
 
     Match* match = (*match_it);
-    // for sin, calculate total ion intensity for match by
-    // summing up peak intensities
     if (measure_ == MEASURE_SIN) {
-      match_intensity = sumMatchIntensity(match, spectra);
+      match_intensity = match_intensities[match_idx];
     }
 
     // add ion_intensity to peptide scores
@@ -826,28 +921,59 @@ bool SpectralCounts::sortRankedProteins(
   return y.get<1>()->getIdPointer().compare(x.get<1>()->getIdPointer()) > 0;
 }
 
+/**
+ * Numbers the peptides of peptide_scores_ in sequence order.
+ */
+void SpectralCounts::numberPeptides(vector<Peptide*>* peptides,
+                                    boost::unordered_map<Peptide*, int>* ids) {
+  peptides->clear();
+  ids->clear();
+  for (PeptideToScore::iterator pep_it = peptide_scores_.begin();
+       pep_it != peptide_scores_.end(); ++pep_it) {
+    ids->insert(make_pair(pep_it->first, (int)peptides->size()));
+    peptides->push_back(pep_it->first);
+  }
+}
+
 /**
  * Fills in the MetaMapping with entries of set of 
  * peptides that can be found in every protein in
  * the meta protein
  *
+ * Peptides in peptide_scores_ have distinct sequences, so two
+ * proteins have equal peptide sets exactly when the sorted ids of
+ * their peptides are equal; proteins are grouped by hashing those ids.
  */
 void SpectralCounts::getMetaMapping() {
   carp(CARP_DEBUG, "Creating a mapping of meta protein to peptides");
-  int count = 0;
+  vector<Peptide*> peptides;
+  boost::unordered_map<Peptide*, int> peptide_ids;
+  numberPeptides(&peptides, &peptide_ids);
+
+  boost::unordered_map<vector<int>, size_t, boost::hash< vector<int> > > groups;
+  vector<const PeptideSet*> group_peptides;
+  vector<MetaProtein> group_proteins;
+  vector<int> key;
   for(ProteinToPeptides::iterator prot_it = protein_supporting_peptides_.begin();
        prot_it != protein_supporting_peptides_.end(); ++prot_it) {
-    Protein* protein = prot_it->first;
-    PeptideSet pep_set = prot_it->second;
-
-    if (meta_mapping_.find(pep_set) == meta_mapping_.end()) {
-      MetaProtein meta_protein(protein_id_less_than);
-      count++;
-      meta_mapping_.insert(make_pair(pep_set, meta_protein));
+    key.clear();
+    for (PeptideSet::const_iterator pep_it = prot_it->second.begin();
+         pep_it != prot_it->second.end(); ++pep_it) {
+      key.push_back(peptide_ids[*pep_it]);
+    }
+    pair<boost::unordered_map<vector<int>, size_t,
+                              boost::hash< vector<int> > >::iterator, bool> group =
+      groups.insert(make_pair(key, group_proteins.size()));
+    if (group.second) {
+      group_peptides.push_back(&prot_it->second);
+      group_proteins.push_back(MetaProtein(protein_id_less_than));
     }
-    meta_mapping_[pep_set].insert(protein);
+    group_proteins[group.first->second].insert(prot_it->first);
   }
 
+  for (size_t group = 0; group < group_proteins.size(); group++) {
+    meta_mapping_.insert(make_pair(*group_peptides[group], group_proteins[group]));
+  }
 }
 
 /**
@@ -915,46 +1041,190 @@ void SpectralCounts::getMetaRanks() {
 
 }
 
+/**
+ * The bipartite graph between meta proteins and their peptides, as
+ * adjacency arrays in both directions. The peptides of meta protein m
+ * are meta_peptides[meta_starts[m]..meta_starts[m+1]), and likewise
+ * for the meta proteins of a peptide.
+ */
+struct MetaPeptideGraph {
+  vector<size_t> meta_starts;
+  vector<int> meta_peptides;
+  vector<size_t> peptide_starts;
+  vector<int> peptide_metas;
+};
+
+/**
+ * Runs the greedy cover on components first, first + step, ... of the
+ * graph. Each peptide is claimed by the meta protein that takes it.
+ * Components share no meta proteins or peptides, so they can be
+ * covered by different threads.
+ */
+static void greedyCoverComponents(
+  const MetaPeptideGraph* graph,
+  const vector<size_t>* component_starts,
+  const vector<int>* component_metas,
+  size_t first,
+  size_t step,
+  vector<int>* remaining, ///< the number of unclaimed peptides of each meta protein
+  vector<int>* claimed_by ///< the meta protein that claimed each peptide
+  ) {
+  for (size_t component = first; component + 1 < component_starts->size();
+       component += step) {
+    // largest number of unclaimed peptides first, ties to the earlier
+    // meta protein
+    priority_queue< pair<int, int> > queue;
+    for (size_t i = (*component_starts)[component];
+         i < (*component_starts)[component + 1]; i++) {
+      int meta = (*component_metas)[i];
+      queue.push(make_pair((*remaining)[meta], -meta));
+    }
+    while (!queue.empty()) {
+      pair<int, int> top = queue.top();
+      queue.pop();
+      int meta = -top.second;
+      if (top.first != (*remaining)[meta]) {
+        // some of its peptides were claimed since it was queued
+        queue.push(make_pair((*remaining)[meta], -meta));
+        continue;
+      }
+      if (top.first == 0) {
+        break; // do not enter anything without peptides
+      }
+      for (size_t i = graph->meta_starts[meta]; i < graph->meta_starts[meta + 1]; i++) {
+        int peptide = graph->meta_peptides[i];
+        if ((*claimed_by)[peptide] >= 0) {
+          continue;
+        }
+        (*claimed_by)[peptide] = meta;
+        for (size_t j = graph->peptide_starts[peptide];
+             j < graph->peptide_starts[peptide + 1]; j++) {
+          (*remaining)[graph->peptide_metas[j]]--;
+        }
+      }
+    }
+  }
+}
+
 /**
  * Greedily finds a peptide-to-protein mapping where each
  * peptide is only mapped to a single meta-protein. 
  *
- * Would of been better to implement with priority queue w/
- * adjancency lists: O(n*log(n)) but input size should be
- * small enough that performance should not be an issue.
+ * The meta proteins with the most unclaimed peptides are taken first,
+ * using a priority queue over adjacency arrays. Meta proteins that
+ * share no peptides, directly or through other meta proteins, do not
+ * affect each other, so the connected components of the graph are
+ * covered in parallel.
  */
 void SpectralCounts::performParsimonyAnalysis() {
   carp(CARP_DEBUG, "Performing Greedy Parsimony analysis");
-  MetaMapping result(comparePeptideSets);
-  vector< pair<PeptideSet, MetaProtein > > peps_vector;
-
-  // get all meta mappings into a vector 
+  vector<Peptide*> peptides;
+  boost::unordered_map<Peptide*, int> peptide_ids;
+  numberPeptides(&peptides, &peptide_ids);
+  int num_peptides = peptides.size();
+
+  // build the graph, numbering the meta proteins in map order
+  vector<MetaMapping::iterator> metas;
+  MetaPeptideGraph graph;
+  graph.meta_starts.push_back(0);
+  graph.peptide_starts.assign(num_peptides + 1, 0);
   for (MetaMapping::iterator meta_iter = meta_mapping_.begin();
        meta_iter != meta_mapping_.end(); ++meta_iter) {
-    peps_vector.push_back((*meta_iter));
+    metas.push_back(meta_iter);
+    for (PeptideSet::const_iterator pep_it = meta_iter->first.begin();
+         pep_it != meta_iter->first.end(); ++pep_it) {
+      int peptide = peptide_ids[*pep_it];
+      graph.meta_peptides.push_back(peptide);
+      graph.peptide_starts[peptide + 1]++;
+    }
+    graph.meta_starts.push_back(graph.meta_peptides.size());
+  }
+  int num_metas = metas.size();
+  for (int peptide = 0; peptide < num_peptides; peptide++) {
+    graph.peptide_starts[peptide + 1] += graph.peptide_starts[peptide];
+  }
+  graph.peptide_metas.resize(graph.meta_peptides.size());
+  vector<size_t> fill(graph.peptide_starts.begin(), graph.peptide_starts.end() - 1);
+  for (int meta = 0; meta < num_metas; meta++) {
+    for (size_t i = graph.meta_starts[meta]; i < graph.meta_starts[meta + 1]; i++) {
+      graph.peptide_metas[fill[graph.meta_peptides[i]]++] = meta;
+    }
+  }
+
+  // find the connected components; the meta proteins of each component
+  // are stored contiguously, in increasing order
+  vector<size_t> component_starts(1, 0);
+  vector<int> component_metas;
+  vector<bool> meta_seen(num_metas, false);
+  vector<bool> peptide_seen(num_peptides, false);
+  for (int start = 0; start < num_metas; start++) {
+    if (meta_seen[start]) {
+      continue;
+    }
+    size_t component_start = component_metas.size();
+    meta_seen[start] = true;
+    component_metas.push_back(start);
+    for (size_t next = component_start; next < component_metas.size(); next++) {
+      int meta = component_metas[next];
+      for (size_t i = graph.meta_starts[meta]; i < graph.meta_starts[meta + 1]; i++) {
+        int peptide = graph.meta_peptides[i];
+        if (peptide_seen[peptide]) {
+          continue;
+        }
+        peptide_seen[peptide] = true;
+        for (size_t j = graph.peptide_starts[peptide];
+             j < graph.peptide_starts[peptide + 1]; j++) {
+          int other = graph.peptide_metas[j];
+          if (!meta_seen[other]) {
+            meta_seen[other] = true;
+            component_metas.push_back(other);
+          }
+        }
+      }
+    }
+    sort(component_metas.begin() + component_start, component_metas.end());
+    component_starts.push_back(component_metas.size());
   }
 
+  vector<int> remaining(num_metas);
+  for (int meta = 0; meta < num_metas; meta++) {
+    remaining[meta] = graph.meta_starts[meta + 1] - graph.meta_starts[meta];
+  }
+  vector<int> claimed_by(num_peptides, -1);
+  int num_components = component_starts.size() - 1;
+  int num_threads = Params::GetInt("num-threads");
+  if (num_threads < 1) {
+    num_threads = boost::thread::hardware_concurrency();
+  }
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+  num_threads = min(num_threads, num_components / 100 + 1);
+  if (num_threads <= 1) {
+    greedyCoverComponents(&graph, &component_starts, &component_metas, 0, 1,
+                          &remaining, &claimed_by);
+  } else {
+    boost::thread_group threads;
+    for (int thread = 0; thread < num_threads; thread++) {
+      threads.create_thread(boost::bind(&greedyCoverComponents,
+        &graph, &component_starts, &component_metas,
+        (size_t)thread, (size_t)num_threads, &remaining, &claimed_by));
+    }
+    threads.join_all();
+  }
 
-  // greedy algorithm to pick off the meta proteins with
-  // most peptide mappings
-  while (!peps_vector.empty()) {
-    sort(peps_vector.begin(), peps_vector.end(), setsAreEqualSize);
-    pair<PeptideSet, MetaProtein> node = peps_vector.back();
-    peps_vector.pop_back();
-    if (node.first.size() == 0) { break; }// do not enter anything without peptide sizes
-    result.insert(node);
-    PeptideSet cur_peptides = node.first;
-    // update the peptide sets for the rest of meta proteins
-    for (vector< pair<PeptideSet, MetaProtein > >::iterator
-         iter = peps_vector.begin();
-         iter != peps_vector.end(); ++iter) {
-      PeptideSet peptides = (*iter).first;
-      PeptideSet difference(Peptide::lessThan);
-      set_difference(peptides.begin(), peptides.end(),
-                     cur_peptides.begin(), cur_peptides.end(),
-                     inserter(difference, difference.end()),
-                    Peptide::lessThan);
-      (*iter).first = difference;
+  // each meta protein that claimed peptides is kept with those peptides
+  vector<PeptideSet> claimed(num_metas, PeptideSet(Peptide::lessThan));
+  for (int peptide = 0; peptide < num_peptides; peptide++) {
+    if (claimed_by[peptide] >= 0) {
+      claimed[claimed_by[peptide]].insert(claimed[claimed_by[peptide]].end(),
+                                          peptides[peptide]);
+    }
+  }
+  MetaMapping result(comparePeptideSets);
+  for (int meta = 0; meta < num_metas; meta++) {
+    if (!claimed[meta].empty()) {
+      result.insert(make_pair(claimed[meta], metas[meta]->second));
     }
   }
   meta_mapping_ = result;
@@ -1080,7 +1350,8 @@ vector<string> SpectralCounts::getOptions() const {
     "custom-threshold-min",
     "mzid-use-pass-threshold",
     "protein-database",
-    "find-peptides"
+    "find-peptides",
+    "num-threads"
   };
   return vector<string>(arr, arr + sizeof(arr) / sizeof(string));
 }
@@ -1163,16 +1434,6 @@ bool SpectralCounts::compareMetaProteins(MetaProtein set_one,
   return set_one.size() < set_two.size();
 }
 
-/**
- * Compare the size of the PeptideSets in the two given pairs.
- * \returns True if the PeptideSets are the same size, else false.
- */
-bool SpectralCounts::setsAreEqualSize(
-  const pair<PeptideSet, MetaProtein>& peps_one ,
-  const pair<PeptideSet, MetaProtein>& peps_two) {
-  return ((peps_one).first.size() < (peps_two).first.size());
-}
-
 bool SpectralCounts::compareMetaScorePair(
   const std::pair<FLOAT_T, MetaProtein>& x,
   const std::pair<FLOAT_T, MetaProtein>& y) {
@@ -20,6 +20,7 @@
 #include "io/OutputFiles.h"
 
 #include "boost/tuple/tuple.hpp"
+#include "boost/unordered_map.hpp"
 
 class SpectralCounts: public CruxApplication { 
 
@@ -99,10 +100,12 @@ class SpectralCounts: public CruxApplication {
    */
   void checkProteinNormalization();
 
+  void numberPeptides(std::vector<Crux::Peptide*>* peptides,
+                      boost::unordered_map<Crux::Peptide*, int>* ids);
   void computeEmpai();
   void makeUniqueMapping();
-  FLOAT_T sumMatchIntensity(Crux::Match* match,
-                          Crux::SpectrumCollection* spectra);
+  void sumMatchIntensities(Crux::SpectrumCollection* spectra,
+                           std::vector<FLOAT_T>* intensities);
   SCORER_TYPE_T get_qval_type(MatchCollection* match_collection);
 
   void writeRankedPeptides();
@@ -178,8 +181,6 @@ class SpectralCounts: public CruxApplication {
   // comparison function declarations
   static bool comparePeptideSets(PeptideSet, PeptideSet);
   static bool compareMetaProteins(MetaProtein, MetaProtein);
-  static bool setsAreEqualSize(const std::pair<PeptideSet, MetaProtein>&,
-                               const std::pair<PeptideSet, MetaProtein>&);
   static bool compareMetaScorePair(const std::pair<FLOAT_T, MetaProtein>&,
                                    const std::pair<FLOAT_T, MetaProtein>&);
  
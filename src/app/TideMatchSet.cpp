@@ -20,12 +20,14 @@ string TideMatchSet::CleavageType;
 char TideMatchSet::match_collection_loc_[] = {0};
 char TideMatchSet::decoy_match_collection_loc_[] = {0};
 
-TideMatchSet::TideMatchSet(Arr* matches, double max_mz)
-  : matches_(matches), max_mz_(max_mz), exact_pval_search_(false), elution_window_(0) {
+TideMatchSet::TideMatchSet(Arr* matches, double max_mz, const SearchConfig& config)
+  : matches_(matches), max_mz_(max_mz), config_(config),
+    exact_pval_search_(false), elution_window_(0) {
 }
 
-TideMatchSet::TideMatchSet(Peptide* peptide, double max_mz)
-  : peptide_(peptide), max_mz_(max_mz), exact_pval_search_(false), elution_window_(0) {
+TideMatchSet::TideMatchSet(Peptide* peptide, double max_mz, const SearchConfig& config)
+  : peptide_(peptide), max_mz_(max_mz), config_(config),
+    exact_pval_search_(false), elution_window_(0) {
 }
 
 TideMatchSet::~TideMatchSet() {
@@ -44,104 +46,99 @@ void TideMatchSet::report(
   const vector<const pb::AuxLocation*>& locations,  ///< auxiliary locations
   bool compute_sp ///< whether to compute sp or not
 ) {
-  if (peptide_->spectrum_matches_array.empty()) {
+  int nHit = peptide_->NumHits();
+  int nKept = peptide_->NumHitsKept();
+  if (nKept == 0) {
     return;
   }
 
   carp(CARP_DETAILED_DEBUG, "TideMatchSet reporting top %d of %d peptide centric matches",
-       top_matches, peptide_->spectrum_matches_array.size());
+       top_matches, nHit);
 
-  int charge;
+  // Only the best hits may have been kept (see Peptide::InitHits()), but the
+  // number of distinct matches reported is the number of hits seen.
+  Peptide::spectrum_matches* hits = peptide_->Hits();
   double score;
   double d_cn = 0.0;
-  int nHit = peptide_->spectrum_matches_array.size();
 
-  if (nHit < top_matches) {
-      top_matches = nHit;
+  if (nKept < top_matches) {
+      top_matches = nKept;
   }
   if (exact_pval_search_) {
-    sort(peptide_->spectrum_matches_array.begin(),
-         peptide_->spectrum_matches_array.end(),
-         Peptide::spectrum_matches::compPV);
+    sort(hits, hits + nKept, Peptide::spectrum_matches::compPV);
   } else {
-    sort(peptide_->spectrum_matches_array.begin(),
-         peptide_->spectrum_matches_array.end(),
-         Peptide::spectrum_matches::compSC);
+    sort(hits, hits + nKept, Peptide::spectrum_matches::compSC);
   }
 
-  for (int cnt = 0; cnt < nHit; ++cnt) {
+  for (int cnt = 0; cnt < nKept; ++cnt) {
     d_cn = 0.0;
     if (exact_pval_search_ == true) {
-      score = peptide_->spectrum_matches_array[cnt].score1_;
-      if (cnt < nHit-1) {
-        d_cn = (double)((log10(peptide_->spectrum_matches_array[cnt+1].score1_)
-                       - log10(peptide_->spectrum_matches_array[cnt].score1_))
-                       /max((FLOAT_T)(-1*log10(peptide_->spectrum_matches_array[cnt].score1_)), FLOAT_T(1)));
+      score = hits[cnt].score1_;
+      if (cnt < nKept-1) {
+        d_cn = (double)((log10(hits[cnt+1].score1_)
+                       - log10(hits[cnt].score1_))
+                       /max((FLOAT_T)(-1*log10(hits[cnt].score1_)), FLOAT_T(1)));
       }
     } else {
-      score = (double)(peptide_->spectrum_matches_array[cnt].score1_ / 100000000.0);
-      if (cnt < nHit-1) {
+      score = (double)(hits[cnt].score1_ / 100000000.0);
+      if (cnt < nKept-1) {
         d_cn = (double)( score
-                      - (double)(peptide_->spectrum_matches_array[cnt+1].score1_ / 100000000.0)
+                      - (double)(hits[cnt+1].score1_ / 100000000.0)
                       / (double)max((FLOAT_T)score , FLOAT_T(1)));
       }
     }
-    peptide_->spectrum_matches_array[cnt].score1_ = score;
-    peptide_->spectrum_matches_array[cnt].d_cn_ = d_cn;
-    peptide_->spectrum_matches_array[cnt].score3_ = nHit;
+    hits[cnt].score1_ = score;
+    hits[cnt].d_cn_ = d_cn;
+    hits[cnt].score3_ = nHit;
   }
   //smoothing primary scores in the elution window, only in DIA mode.
   if (elution_window_ > 0) {
-    sort(peptide_->spectrum_matches_array.begin(),
-         peptide_->spectrum_matches_array.end(),
-         Peptide::spectrum_matches::compRT);
+    sort(hits, hits + nKept, Peptide::spectrum_matches::compRT);
     int cnt;
     double mean = 1.0;
 
     //initialize sliding window
     int flank = (int)((double)((elution_window_)/2) + 1);
-    flank = flank > nHit ? nHit : flank;
+    flank = flank > nKept ? nKept : flank;
 
     for (cnt = 0; cnt < flank; ++cnt) {
-      mean *= peptide_->spectrum_matches_array[cnt].score1_;
+      mean *= hits[cnt].score1_;
     }
     int top = flank;
     int bottom = 0;
-    for (cnt = 0; cnt < nHit; ++cnt) {
-      peptide_->spectrum_matches_array[cnt].elution_score_ = pow(mean, 1.0/(top-bottom));
-      if (top < nHit) {
-        mean *= peptide_->spectrum_matches_array[top].score1_;
+    for (cnt = 0; cnt < nKept; ++cnt) {
+      hits[cnt].elution_score_ = pow(mean, 1.0/(top-bottom));
+      if (top < nKept) {
+        mean *= hits[top].score1_;
         ++top;
       }
       if (cnt >= flank-1) {
-        mean /= peptide_->spectrum_matches_array[bottom].score1_;
+        mean /= hits[bottom].score1_;
         ++bottom;
       }
     }
     //reorder PSMs according to the smoothed p-value
-    sort(peptide_->spectrum_matches_array.begin(),
-         peptide_->spectrum_matches_array.end(),
-         Peptide::spectrum_matches::compES);
+    sort(hits, hits + nKept, Peptide::spectrum_matches::compES);
   }
-  peptide_->spectrum_matches_array.resize(top_matches);
+  peptide_->TruncateHits(top_matches);
   if (compute_sp) {
     vector<pair<double, int> > spScoreRank;
     spScoreRank.reserve(top_matches);
     for (int cnt = 0; cnt < top_matches; ++cnt) {
-      SpScorer sp_scorer(proteins, *peptide_->spectrum_matches_array[cnt].spectrum_,
-                         peptide_->spectrum_matches_array[cnt].charge_, max_mz_);
+      SpScorer sp_scorer(proteins, *hits[cnt].spectrum_,
+                         hits[cnt].charge_, max_mz_);
       pb::Peptide* pb_peptide = getPbPeptide(*peptide_);
-      sp_scorer.Score(*pb_peptide, peptide_->spectrum_matches_array[cnt].spData_);
-      spScoreRank.push_back(make_pair(-1*peptide_->spectrum_matches_array[cnt].spData_.sp_score, cnt));
+      sp_scorer.Score(*pb_peptide, hits[cnt].spData_);
+      spScoreRank.push_back(make_pair(-1*hits[cnt].spData_.sp_score, cnt));
     }
     sort(spScoreRank.begin(), spScoreRank.end());
     for (size_t i = 0; i < spScoreRank.size(); ++i) {
-      peptide_->spectrum_matches_array[spScoreRank[i].second].spData_.sp_rank = i;
+      hits[spScoreRank[i].second].spData_.sp_rank = i;
     }
   }
   // target peptide or concat search
   ofstream* file =
-    (Params::GetBool("concat") || !peptide_->IsDecoy()) ? target_file : decoy_file;
+    (config_.concat || !peptide_->IsDecoy()) ? target_file : decoy_file;
   writeToFile(file, peptides, proteins, locations, compute_sp);
 }
 
@@ -169,7 +166,7 @@ void TideMatchSet::writeToFile(
   getFlankingAAs(peptide, protein, pos, &n_term, &c_term);
   flankingAAs = n_term + c_term;
 
-  int precision = Params::GetInt("precision");
+  int precision = config_.precision;
 
   // look for other locations
   if (peptide->HasAuxLocationsIndex()) {
@@ -186,9 +183,9 @@ void TideMatchSet::writeToFile(
   }
 
   Crux::Peptide cruxPep = getCruxPeptide(peptide);
-  for (vector<Peptide::spectrum_matches>::const_iterator
-        i = peptide_->spectrum_matches_array.begin();
-        i != peptide_->spectrum_matches_array.end();
+  const Peptide::spectrum_matches* hits = peptide_->Hits();
+  for (const Peptide::spectrum_matches* i = hits;
+        i != hits + peptide_->NumHitsKept();
         ++i) {
     Spectrum* spectrum = i->spectrum_;
 
@@ -223,7 +220,7 @@ void TideMatchSet::writeToFile(
     }
     *file << i->score3_ << '\t';
 
-    if (Params::GetBool("concat")) {
+    if (config_.concat) {
       *file << peptides->ActiveTargets() + peptides->ActiveDecoys() << '\t';
     } else {
       *file << (!peptide->IsDecoy() ? peptides->ActiveTargets() : peptides->ActiveDecoys()) << '\t';
@@ -239,7 +236,7 @@ void TideMatchSet::writeToFile(
       const string& residues = protein->residues();
       *file << '\t'
             << residues.substr(residues.length() - peptide->Len());
-    } else if (Params::GetBool("concat") && !TideSearchApplication::proteinLevelDecoys()) {
+    } else if (config_.concat && !TideSearchApplication::proteinLevelDecoys()) {
       *file << '\t'
             << cruxPep.getUnshuffledSequence();
     }
@@ -278,8 +275,8 @@ void TideMatchSet::report(
 
   map<Arr::iterator, FLOAT_T> delta_cn_map;
   map<Arr::iterator, FLOAT_T> delta_lcn_map;
-  computeDeltaCns(targets, &delta_cn_map, &delta_lcn_map);
-  computeDeltaCns(decoys, &delta_cn_map, &delta_lcn_map);
+  computeDeltaCns(config_, targets, &delta_cn_map, &delta_lcn_map);
+  computeDeltaCns(config_, decoys, &delta_cn_map, &delta_lcn_map);
 
   map<Arr::iterator, pair<const SpScorer::SpScoreData, int> > sp_map;
   if (compute_sp) {
@@ -318,10 +315,10 @@ void TideMatchSet::writeToFile(
     return;
   }
 
-  int massPrecision = Params::GetInt("mass-precision");
-  int precision = Params::GetInt("precision");
+  int massPrecision = config_.mass_precision;
+  int precision = config_.precision;
 
-  const bool concat = Params::GetBool("concat");
+  const bool concat = config_.concat;
   const int concatDistinctMatches = peptides->ActiveTargets() + peptides->ActiveDecoys();
   map<int, int> decoyWriteCount;
 
@@ -373,7 +370,7 @@ void TideMatchSet::writeToFile(
     const SpScorer::SpScoreData* sp_data = sp_map ? &(sp_map->at(i).first) : NULL;
 
     rwlock->lock();
-    if (Params::GetBool("file-column")) {
+    if (config_.file_column) {
       *file << spectrum_filename << '\t';
     }
     *file << spectrum->SpectrumNumber() << '\t'
@@ -399,7 +396,7 @@ void TideMatchSet::writeToFile(
         *file << StringUtils::ToString(i->xcorr_score, precision, true) << '\t';
       }
       //Added for tailor score calibration method by AKF
-      if (Params::GetBool("use-tailor-calibration")){
+      if (config_.use_tailor_calibration){
         *file << StringUtils::ToString(i->tailor, precision, true) << '\t';
       }
       break;
@@ -426,7 +423,7 @@ void TideMatchSet::writeToFile(
             << sp_data->total_ions << '\t';
     }
 
-    if (Params::GetBool("concat")) {
+    if (config_.concat) {
       *file << concatDistinctMatches << '\t';
     } else {
       *file << (!peptide->IsDecoy() ? peptides->ActiveTargets() : peptides->ActiveDecoys()) << '\t';
@@ -447,7 +444,7 @@ void TideMatchSet::writeToFile(
       const string& residues = protein->residues();
       *file << '\t'
             << residues.substr(residues.length() - peptide->Len());
-    } else if (Params::GetBool("concat") && !TideSearchApplication::proteinLevelDecoys()) {
+    } else if (config_.concat && !TideSearchApplication::proteinLevelDecoys()) {
       *file << '\t'
             << cruxPep.getUnshuffledSequence();
     }
@@ -625,7 +622,7 @@ void TideMatchSet::gatherTargetsAndDecoys(
   }
 
   map<int, int> decoyWriteCount;
-  const bool concat = Params::GetBool("concat");
+  const bool concat = config_.concat;
   const int gatherSize = top_n + 1;
 
   // decoys but not concat, populate targets and decoys
@@ -723,6 +720,7 @@ void TideMatchSet::getFlankingAAs(
 }
 
 void TideMatchSet::computeDeltaCns(
+  const SearchConfig& config,
   const vector<Arr::iterator>& vec, // xcorr*100000000.0, high to low
   map<Arr::iterator, FLOAT_T>* delta_cn_map, // map to add delta cn scores to
   map<Arr::iterator, FLOAT_T>* delta_lcn_map // map to add delta cn scores to
@@ -730,16 +728,16 @@ void TideMatchSet::computeDeltaCns(
   // get vectore of scores
   vector<FLOAT_T> scores;
   for (vector<Arr::iterator>::const_iterator i = vec.begin(); i != vec.end(); i++) {
-    if (Params::GetBool("exact-p-value")) { // p-value scores
-      if (Params::GetString("score-function") == "both") {
+    if (config.exact_pval_search) { // p-value scores
+      if (config.score_function == BOTH_SCORE) {
         scores.push_back((*i)->combinedPval);
-      } else if (Params::GetString("score-function") == "residue-evidence") {
+      } else if (config.score_function == RESIDUE_EVIDENCE_MATRIX) {
         scores.push_back((*i)->resEv_pval);
       } else {
         scores.push_back((*i)->xcorr_pval);
       }
     } else { // non p-value scores
-      if (Params::GetString("score-function") == "residue-evidence") {
+      if (config.score_function == RESIDUE_EVIDENCE_MATRIX) {
         scores.push_back((*i)->resEv_score);
       } else {
         scores.push_back((*i)->xcorr_score);
@@ -749,16 +747,16 @@ void TideMatchSet::computeDeltaCns(
 
   // calculate DeltaCns
   vector< pair<FLOAT_T, FLOAT_T> > deltaCns;
-  if (Params::GetBool("exact-p-value")) { // p-value scores
-    if (Params::GetString("score-function") == "both") {
+  if (config.exact_pval_search) { // p-value scores
+    if (config.score_function == BOTH_SCORE) {
       deltaCns = MatchCollection::calculateDeltaCns(scores,BOTH_PVALUE);
-    } else if (Params::GetString("score-function") == "residue-evidence") {
+    } else if (config.score_function == RESIDUE_EVIDENCE_MATRIX) {
       deltaCns = MatchCollection::calculateDeltaCns(scores,RESIDUE_EVIDENCE_PVAL);
     } else {
       deltaCns = MatchCollection::calculateDeltaCns(scores,TIDE_SEARCH_EXACT_PVAL);
     }
   } else { // non p-value scores
-    if (Params::GetString("score-function") == "residue-evidence") {
+    if (config.score_function == RESIDUE_EVIDENCE_MATRIX) {
       deltaCns = MatchCollection::calculateDeltaCns(scores,RESIDUE_EVIDENCE_SCORE);
     } else {
       deltaCns = MatchCollection::calculateDeltaCns(scores,XCORR);
@@ -11,6 +11,7 @@
 #include "tide/peptide.h"
 #include "tide/sp_scorer.h"
 #include "tide/spectrum_collection.h"
+#include "tide/search_config.h"
 
 #include "model/Modification.h"
 #include "model/PostProcessProtein.h"
@@ -49,11 +50,13 @@ class TideMatchSet {
   // counter in the matches buffer by decrementing the counter.
   TideMatchSet(
     Arr* matches,
-    double max_mz
+    double max_mz,
+    const SearchConfig& config
   );
   TideMatchSet(
     Peptide* peptide,
-    double max_mz
+    double max_mz,
+    const SearchConfig& config
   );
 
   ~TideMatchSet();
@@ -107,6 +110,7 @@ class TideMatchSet {
   Arr2* matches2_;
   Peptide* peptide_;
   double max_mz_;
+  const SearchConfig& config_;
 
   // For allocation
   static char match_collection_loc_[sizeof(MatchCollection)];
@@ -222,6 +226,7 @@ class TideMatchSet {
   );
 
   static void computeDeltaCns(
+    const SearchConfig& config,
     const vector<Arr::iterator>& vec, // xcorr*100000000.0, high to low
     map<Arr::iterator, FLOAT_T>* delta_cn_map, // map to add delta cn scores to
     map<Arr::iterator, FLOAT_T>* delta_lcn_map
@@ -14,6 +14,7 @@
 #include "util/Params.h"
 #include "util/FileUtils.h"
 #include "util/StringUtils.h"
+#include "boost/filesystem.hpp"
 #include <math.h> //Added by Andy Lin
 #include <map> //Added by Andy Lin
 
@@ -36,7 +37,8 @@ const double TideSearchApplication::XCORR_SCALING = 100000000.0;
 const double TideSearchApplication::RESCALE_FACTOR = 20.0;
 
 TideSearchApplication::TideSearchApplication():
-  exact_pval_search_(false), remove_index_(""), spectrum_flag_(NULL) {
+  exact_pval_search_(false), remove_index_(""), spectrum_flag_(NULL),
+  checkpoint_interval_(0), mass_shard_(0), num_mass_shards_(1) {
 }
 
 TideSearchApplication::~TideSearchApplication() {
@@ -159,6 +161,10 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
     carp(CARP_INFO, "Setting compute-sp=T because SQT output is enabled.");
   }
 
+  // Snapshot of the parameters used while searching, so that the search does
+  // not need to look them up by name for every spectrum and match.
+  const SearchConfig config;
+
   vector<int> negative_isotope_errors = getNegativeIsotopeErrors();
 
   ProteinVec proteins;
@@ -209,7 +215,7 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
                         bin_width_, bin_offset_);
 
     ActivePeptideQueue* active_peptide_queue =
-      new ActivePeptideQueue(aaf_peptide_reader.Reader(), proteins);
+      new ActivePeptideQueue(aaf_peptide_reader.Reader(), proteins, config);
 
     nAARes = active_peptide_queue->CountAAFrequencyRes(bin_width_, bin_offset_,
                                                        dAAFreqN, dAAFreqI, dAAFreqC, dAAMass);
@@ -232,7 +238,7 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
                         bin_width_, bin_offset_);
 
     ActivePeptideQueue* active_peptide_queue =
-      new ActivePeptideQueue(aaf_peptide_reader.Reader(), proteins);
+      new ActivePeptideQueue(aaf_peptide_reader.Reader(), proteins, config);
 
     nAA = active_peptide_queue->CountAAFrequency(bin_width_, bin_offset_,
                                                  &aaFreqN, &aaFreqI, &aaFreqC, &aaMass);
@@ -276,6 +282,45 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
   TideMatchSet::initModMap(pepHeader.nterm_mods(), PEPTIDE_N);
   TideMatchSet::initModMap(pepHeader.cterm_mods(), PEPTIDE_C);
 
+  // Check mass-shard parameter
+  mass_shard_ = 0;
+  num_mass_shards_ = 1;
+  if (parseMassShard(Params::GetString("mass-shard"), &mass_shard_, &num_mass_shards_)) {
+    if (Params::GetBool("peptide-centric-search")) {
+      carp(CARP_FATAL, "--mass-shard cannot be used with --peptide-centric-search T");
+    }
+    carp(CARP_INFO, "Searching mass shard %d of %d", mass_shard_ + 1, num_mass_shards_);
+  }
+
+  // Checkpoints are only written by a stand-alone tide-search; cascade-search
+  // runs several searches into the same output directory.
+  Checkpoint checkpoint;
+  bool resume = false;
+  checkpoint_file_.clear();
+  checkpoint_interval_ = Params::GetInt("checkpoint-interval");
+  if (spectrum_flag_ == NULL &&
+      (checkpoint_interval_ > 0 || Params::GetBool("resume"))) {
+    checkpoint_file_ = make_file_path("tide-search.checkpoint.txt");
+  }
+  if (!checkpoint_file_.empty() && Params::GetBool("resume")) {
+    if (!readCheckpoint(checkpoint_file_, &checkpoint)) {
+      carp(CARP_WARNING, "No checkpoint found at %s, starting a new search.",
+           checkpoint_file_.c_str());
+    } else if (checkpoint.index != index ||
+               checkpoint.num_files != (int)input_files.size() ||
+               checkpoint.file_index > checkpoint.num_files) {
+      carp(CARP_FATAL, "The checkpoint %s was written by a search of a "
+           "different index or set of spectrum files.", checkpoint_file_.c_str());
+    } else {
+      resume = true;
+      carp(CARP_INFO, "Resuming search at spectrum file %d of %d, "
+           "spectrum-charge %d.", checkpoint.file_index + 1,
+           checkpoint.num_files, checkpoint.position);
+    }
+  }
+  checkpoint.index = index;
+  checkpoint.num_files = input_files.size();
+
   ofstream* target_file = NULL;
   ofstream* decoy_file = NULL;
 
@@ -285,24 +330,30 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
   TideMatchSet::CleavageType = ss.str();
   if (!Params::GetBool("concat")) {
     string target_file_name = make_file_path("tide-search.target.txt");
-    target_file = create_stream_in_path(target_file_name.c_str(), NULL, overwrite);
+    target_file = openOutputFile(target_file_name, overwrite, resume,
+                                 checkpoint.target_offset);
     output_file_name_ = target_file_name;
     if (HAS_DECOYS) {
       string decoy_file_name = make_file_path("tide-search.decoy.txt");
-      decoy_file = create_stream_in_path(decoy_file_name.c_str(), NULL, overwrite);
+      decoy_file = openOutputFile(decoy_file_name, overwrite, resume,
+                                  checkpoint.decoy_offset);
     }
   } else {
     string concat_file_name = make_file_path("tide-search.txt");
-    target_file = create_stream_in_path(concat_file_name.c_str(), NULL, overwrite);
+    target_file = openOutputFile(concat_file_name, overwrite, resume,
+                                 checkpoint.target_offset);
     output_file_name_ = concat_file_name;
   }
 
-  if (target_file) {
+  if (target_file && !resume) {
     TideMatchSet::writeHeaders(target_file, false, decoysPerTarget > 1, compute_sp);
     TideMatchSet::writeHeaders(decoy_file, true, decoysPerTarget > 1, compute_sp);
   }
 
-  vector<InputFile> sr = getInputFiles(input_files);
+  // Files that were completely searched before the checkpoint are not read
+  // (or converted to spectrumrecords) again.
+  vector<InputFile> sr = getInputFiles(vector<string>(
+    input_files.begin() + checkpoint.file_index, input_files.end()));
 
   // Loop through spectrum files
   for (vector<InputFile>::const_iterator f = sr.begin(); f != sr.end(); f++) {
@@ -314,7 +365,7 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
 
     vector<ActivePeptideQueue*> active_peptide_queue;
     for (int i = 0; i < NUM_THREADS; i++) {
-      active_peptide_queue.push_back(new ActivePeptideQueue(peptide_reader[i]->Reader(), proteins));
+      active_peptide_queue.push_back(new ActivePeptideQueue(peptide_reader[i]->Reader(), proteins, config));
       active_peptide_queue[i]->SetBinSize(bin_width_, bin_offset_);
     }
 
@@ -342,7 +393,7 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
     if (spectrum_flag_ == NULL) {
       resetMods();
     }
-    search(f->OriginalName, spectra->SpecCharges(), active_peptide_queue, proteins,
+    search(config, f->OriginalName, spectra->SpecCharges(), active_peptide_queue, proteins,
            locations, Params::GetDouble("precursor-window"),
            string_to_window_type(Params::GetString("precursor-window-type")),
            Params::GetDouble("spectrum-min-mz"), Params::GetDouble("spectrum-max-mz"),
@@ -352,13 +403,11 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
            nAA, aaFreqN, aaFreqI, aaFreqC, aaMass,
            nAARes, dAAFreqN, dAAFreqI, dAAFreqC, dAAMass,
            pepHeader.mods(), pepHeader.nterm_mods(), pepHeader.cterm_mods(),
-           decoysPerTarget, &negative_isotope_errors);
+           decoysPerTarget, &negative_isotope_errors, &checkpoint);
 
     if (spectraIter == spectra_.end()) {
       delete spectra;
     }
-    // convert tab delimited to other file formats.
-    convertResults();
 
     // Delete temporary spectrumrecords file
     if (!f->Keep) {
@@ -373,6 +422,10 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
       peptide_reader[i] = NULL;
     }
 
+    ++checkpoint.file_index;
+    checkpoint.position = 0;
+    checkpoint.candidates = 0;
+    writeCheckpoint(&checkpoint, target_file, decoy_file);
   } // End of spectrum file loop
 
   for (ProteinVec::iterator i = proteins.begin(); i != proteins.end(); ++i) {
@@ -384,6 +437,10 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
       delete decoy_file;
     }
   }
+  // convert tab delimited to other file formats, once all spectrum files
+  // have been searched and the files are closed.
+  convertResults();
+
   delete[] aaFreqN;
   delete[] aaFreqI;
   delete[] aaFreqC;
@@ -392,6 +449,121 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
   return 0;
 }
 
+/**
+ * Opens a tab-delimited output file. When resuming, the file is cut back to
+ * the length recorded in the checkpoint, discarding matches that were written
+ * after it, and reopened for appending.
+ */
+ofstream* TideSearchApplication::openOutputFile(
+  const string& path,
+  bool overwrite,
+  bool resume,
+  streamoff offset
+) {
+  if (!resume) {
+    return create_stream_in_path(path.c_str(), NULL, overwrite);
+  }
+  if (!FileUtils::Exists(path) ||
+      (streamoff)boost::filesystem::file_size(path) < offset) {
+    carp(CARP_FATAL, "Cannot resume search: %s is missing or shorter than "
+         "recorded in the checkpoint.", path.c_str());
+  }
+  boost::filesystem::resize_file(path, offset);
+  return new ofstream(path.c_str(), ios::out | ios::app);
+}
+
+void TideSearchApplication::writeCheckpoint(
+  Checkpoint* checkpoint,
+  ofstream* target_file,
+  ofstream* decoy_file
+) const {
+  if (checkpoint_file_.empty()) {
+    return;
+  }
+  if (target_file) {
+    target_file->flush();
+    checkpoint->target_offset = target_file->tellp();
+  }
+  if (decoy_file) {
+    decoy_file->flush();
+    checkpoint->decoy_offset = decoy_file->tellp();
+  }
+  // Write to a temporary file first so that an interrupted write leaves the
+  // previous checkpoint intact.
+  string tmp_file = checkpoint_file_ + ".tmp";
+  ofstream out(tmp_file.c_str());
+  out << "index\t" << checkpoint->index << endl
+      << "files\t" << checkpoint->num_files << endl
+      << "file\t" << checkpoint->file_index << endl
+      << "position\t" << checkpoint->position << endl
+      << "candidates\t" << checkpoint->candidates << endl
+      << "target-offset\t" << checkpoint->target_offset << endl
+      << "decoy-offset\t" << checkpoint->decoy_offset << endl;
+  out.close();
+  if (!out) {
+    carp(CARP_FATAL, "Error writing checkpoint %s", tmp_file.c_str());
+  }
+  FileUtils::Rename(tmp_file, checkpoint_file_);
+}
+
+bool TideSearchApplication::readCheckpoint(
+  const string& path,
+  Checkpoint* checkpoint
+) {
+  ifstream in(path.c_str());
+  if (!in.good()) {
+    return false;
+  }
+  string line;
+  while (getline(in, line)) {
+    size_t tab = line.find('\t');
+    if (tab == string::npos) {
+      carp(CARP_FATAL, "Invalid line in checkpoint %s: %s",
+           path.c_str(), line.c_str());
+    }
+    string key = line.substr(0, tab);
+    string value = line.substr(tab + 1);
+    if (key == "index") {
+      checkpoint->index = value;
+    } else if (key == "files") {
+      checkpoint->num_files = StringUtils::FromString<int>(value);
+    } else if (key == "file") {
+      checkpoint->file_index = StringUtils::FromString<int>(value);
+    } else if (key == "position") {
+      checkpoint->position = StringUtils::FromString<int>(value);
+    } else if (key == "candidates") {
+      checkpoint->candidates = StringUtils::FromString<int>(value);
+    } else if (key == "target-offset") {
+      checkpoint->target_offset = StringUtils::FromString<streamoff>(value);
+    } else if (key == "decoy-offset") {
+      checkpoint->decoy_offset = StringUtils::FromString<streamoff>(value);
+    }
+  }
+  return true;
+}
+
+bool TideSearchApplication::parseMassShard(
+  const string& shard,
+  int* shard_index,
+  int* num_shards
+) {
+  if (shard.empty()) {
+    return false;
+  }
+  vector<string> fields = StringUtils::Split(shard, '/');
+  int i, n;
+  if (fields.size() != 2 ||
+      !StringUtils::TryFromString(fields[0], &i) ||
+      !StringUtils::TryFromString(fields[1], &n) ||
+      n < 1 || i < 1 || i > n) {
+    carp(CARP_FATAL, "Invalid mass-shard value '%s'. Must be of the form "
+         "<shard>/<number of shards>, e.g. 1/4.", shard.c_str());
+  }
+  *shard_index = i - 1;
+  *num_shards = n;
+  return true;
+}
+
 vector<int> TideSearchApplication::getNegativeIsotopeErrors() const {
   string isotope_errors_string = Params::GetString("isotope-error");
   if (isotope_errors_string[0] == ',') {
@@ -524,13 +696,14 @@ void TideSearchApplication::search(void* threadarg) {
   int* total_candidate_peptides = my_data->total_candidate_peptides;
 
   // params
-  bool peptide_centric = Params::GetBool("peptide-centric-search");
-  bool use_neutral_loss_peaks = Params::GetBool("use-neutral-loss-peaks");
-  bool use_flanking_peaks = Params::GetBool("use-flanking-peaks");
-  int max_charge = Params::GetInt("max-precursor-charge");
+  const SearchConfig& config = *(my_data->config);
+  bool peptide_centric = config.peptide_centric;
+  bool use_neutral_loss_peaks = config.use_neutral_loss_peaks;
+  bool use_flanking_peaks = config.use_flanking_peaks;
+  int max_charge = config.max_charge;
   // Added by Andy Lin on 2/9/2016
   // Determines which score function to use for scoring PSMs and store in SCORE_FUNCTION enum
-  SCORE_FUNCTION_T curScoreFunction = string_to_score_function_type(Params::GetString("score-function"));
+  SCORE_FUNCTION_T curScoreFunction = config.score_function;
 
   // This is the main search loop.
   ObservedPeakSet observed(bin_width, bin_offset,
@@ -545,10 +718,10 @@ void TideSearchApplication::search(void* threadarg) {
 
   // cycle through spectrum-charge pairs, sorted by neutral mass
   FLOAT_T sc_total = (FLOAT_T)spec_charges->size();
-  int print_interval = Params::GetInt("print-search-progress");
+  int print_interval = config.print_interval;
 
-  for (vector<SpectrumCollection::SpecCharge>::const_iterator sc = spec_charges->begin()+thread_num;
-       sc < spec_charges->begin() + (spec_charges->size());
+  for (vector<SpectrumCollection::SpecCharge>::const_iterator sc = spec_charges->begin() + my_data->sc_begin + thread_num;
+       sc < spec_charges->begin() + my_data->sc_end;
        sc = sc + num_threads) {
     locks_array[LOCK_REPORTING]->lock();
     ++(*sc_index);
@@ -596,7 +769,7 @@ void TideSearchApplication::search(void* threadarg) {
       // Normalize the observed spectrum and compute the cache of
       // frequently-needed values for taking dot products with theoretical
       // spectra.
-      observed.PreprocessSpectrum(*spectrum, charge, &num_range_skipped,
+      observed.PreprocessSpectrum(config, *spectrum, charge, &num_range_skipped,
                                   &num_precursors_skipped,
                                   &num_isotopes_skipped, &num_retained);
       int nCandPeptide = active_peptide_queue->SetActiveRange(
@@ -633,7 +806,7 @@ void TideSearchApplication::search(void* threadarg) {
       } else {  //spectrum centric match report.
         //Implementation of the Tailor score calibration method, by AKF
         double quantile_score = 1.0;
-        if (Params::GetBool("use-tailor-calibration")){
+        if (config.use_tailor_calibration) {
           vector<double> scores;
           double quantile_th = 0.01;
           // Collect the scores for the score tail distribution
@@ -659,14 +832,14 @@ void TideSearchApplication::search(void* threadarg) {
             curScore.xcorr_score = (double)(it->first / XCORR_SCALING);
             curScore.rank = it->second;
             //Added for tailor score calibration method by AKF
-            if (Params::GetBool("use-tailor-calibration")){
+            if (config.use_tailor_calibration) {
               curScore.tailor = ((double)(it->first / XCORR_SCALING) + 5.0) / quantile_score;
             }            
             match_arr.push_back(curScore);
           }
         }
 
-        TideMatchSet matches(&match_arr, highest_mz);
+        TideMatchSet matches(&match_arr, highest_mz, config);
         matches.exact_pval_search_ = exact_pval_search;
         matches.cur_score_function_ = curScoreFunction;
 
@@ -697,8 +870,8 @@ void TideSearchApplication::search(void* threadarg) {
         }
       }
       int maxPrecurMassBin = floor(MaxBin::Global().CacheBinEnd() + 50.0);
-      double fragTol = Params::GetDouble("fragment-tolerance");
-      int granularityScale = Params::GetInt("evidence-granularity");
+      double fragTol = config.fragment_tolerance;
+      int granularityScale = config.evidence_granularity;
 
       //TODO look at this
       int minDeltaMass;
@@ -803,7 +976,7 @@ void TideSearchApplication::search(void* threadarg) {
           //preprocess to create one integerized evidence vector for each cluster of masses among selected peptides
           double pepMassMonoMean = (pepMaInt - 0.5 + bin_offset_) * bin_width_;
           evidenceObs[pe] = spectrum->CreateEvidenceVectorDiscretized(
-            bin_width, bin_offset, charge, pepMassMonoMean, maxPrecurMassBin,
+            config, bin_width, bin_offset, charge, pepMassMonoMean, maxPrecurMassBin,
             &num_range_skipped, &num_precursors_skipped, &num_isotopes_skipped, &num_retained);
         }
         //END XCORR
@@ -814,7 +987,7 @@ void TideSearchApplication::search(void* threadarg) {
           // aaMassDouble contains amino acids masses in float form
           // aaMass contains amino acid asses in integer form
           // precursorMass is the neutral mass
-          observed.CreateResidueEvidenceMatrix(*spectrum, charge, maxPrecurMassBin, precursorMass,
+          observed.CreateResidueEvidenceMatrix(config, *spectrum, charge, maxPrecurMassBin, precursorMass,
                                                nAARes, aaMassDouble, fragTol, granularityScale,
                                                nTermMass, cTermMass,&num_range_skipped, 
                                                &num_precursors_skipped, &num_isotopes_skipped, &num_retained,
@@ -1085,7 +1258,7 @@ void TideSearchApplication::search(void* threadarg) {
         // matches will arrange the results in a heap by score, return the top
         // few, and recover the association between counter and peptide. We output
         // the top matches.
-        TideMatchSet matches(&match_arr, highest_mz);
+        TideMatchSet matches(&match_arr, highest_mz, config);
         matches.exact_pval_search_ = exact_pval_search_;
         matches.cur_score_function_ = curScoreFunction;
 
@@ -1105,34 +1278,14 @@ void TideSearchApplication::search(void* threadarg) {
     delete candidatePeptideStatus;
   }
 
-  if (!Params::GetBool("skip-preprocessing")) {
-    locks_array[LOCK_REPORTING]->lock();
-    if (curScoreFunction == BOTH_SCORE) {
-      num_precursors_skipped = num_precursors_skipped / 2;
-      num_isotopes_skipped = num_isotopes_skipped / 2;
-      num_range_skipped = num_range_skipped / 2;
-      num_retained = num_retained / 2;
-    }
-
-    long int total_peaks = num_precursors_skipped + num_isotopes_skipped + num_range_skipped + num_retained;
-    if (total_peaks == 0) {
-      carp(CARP_INFO, "[Thread %d]: Warning: no peaks found.", thread_num);
-    } else {
-      carp(CARP_INFO,
-           "[Thread %d]: Deleted %d precursor, %d isotope and %d out-of-range peaks.",
-           thread_num, num_precursors_skipped, num_isotopes_skipped, num_range_skipped);
-    }
-    if (num_retained == 0) {
-      carp(CARP_INFO, "[Thread %d]: Warning: no peaks retained.", thread_num);
-    } else {
-      carp(CARP_INFO, "[Thread %d]: Retained %g%% of peaks.",
-           thread_num, (100.0 * num_retained) / total_peaks);
-    }
-    locks_array[LOCK_REPORTING]->unlock();
-  }
+  my_data->num_range_skipped += num_range_skipped;
+  my_data->num_precursors_skipped += num_precursors_skipped;
+  my_data->num_isotopes_skipped += num_isotopes_skipped;
+  my_data->num_retained += num_retained;
 }
 
 void TideSearchApplication::search(
+  const SearchConfig& config,
   const string& spectrum_filename,
   const vector<SpectrumCollection::SpecCharge>* spec_charges,
   vector<ActivePeptideQueue*> active_peptide_queue,
@@ -1165,7 +1318,8 @@ void TideSearchApplication::search(
   const pb::ModTable& nterm_mod_table,
   const pb::ModTable& cterm_mod_table,
   int numDecoys,
-  vector<int>* negative_isotope_errors
+  vector<int>* negative_isotope_errors,
+  Checkpoint* checkpoint
 ) {
   // Create an array of locks.
   vector<boost::mutex *> locks_array;
@@ -1173,13 +1327,27 @@ void TideSearchApplication::search(
     locks_array.push_back(new boost::mutex());
   }
 
-  int elution_window = Params::GetInt("elution-window-size");
-  bool peptide_centric = Params::GetBool("peptide-centric-search");
+  int elution_window = config.elution_window;
+  bool peptide_centric = config.peptide_centric;
+
+  // The spectrum-charge combinations are sorted by neutral mass. With
+  // --mass-shard i/N, only the i-th of N consecutive runs of roughly equal
+  // size is searched, i.e. a contiguous precursor mass range.
+  int sc_count = spec_charges->size();
+  int sc_first = (int)((int64_t)sc_count * mass_shard_ / num_mass_shards_);
+  int sc_last = (int)((int64_t)sc_count * (mass_shard_ + 1) / num_mass_shards_);
+  if (num_mass_shards_ > 1 && sc_first < sc_last) {
+    carp(CARP_INFO, "Mass shard %d of %d: searching spectrum-charge combinations "
+         "%d to %d (neutral mass %.4f to %.4f).", mass_shard_ + 1, num_mass_shards_,
+         sc_first + 1, sc_last, (*spec_charges)[sc_first].neutral_mass,
+         (*spec_charges)[sc_last - 1].neutral_mass);
+  }
+  int sc_start = max(checkpoint->position, sc_first);
 
   // initialize fields required for output
-  int* sc_index = new int(-1);
-  int* total_candidate_peptides = new int(0);
-  FLOAT_T sc_total = (FLOAT_T)spec_charges->size();
+  int* sc_index = new int(sc_start - 1);
+  int* total_candidate_peptides = new int(checkpoint->candidates);
+  FLOAT_T sc_total = (FLOAT_T)(sc_last - sc_first);
 
   if (peptide_centric == false) {
     elution_window = 0;
@@ -1212,7 +1380,7 @@ void TideSearchApplication::search(
 
   vector<thread_data> thread_data_array;
   for (int i= 0; i < NUM_THREADS; i++) {
-      thread_data_array.push_back(thread_data(spectrum_filename, spec_charges, active_peptide_queue[i],
+      thread_data_array.push_back(thread_data(&config, spectrum_filename, spec_charges, active_peptide_queue[i],
       proteins, locations, precursor_window, window_type, spectrum_min_mz,
       spectrum_max_mz, min_scan, max_scan, min_peaks, search_charge, top_matches,
       highest_mz, target_file, decoy_file, compute_sp,
@@ -1222,19 +1390,72 @@ void TideSearchApplication::search(
       bin_width_, bin_offset_, exact_pval_search_, spectrum_flag_, sc_index, total_candidate_peptides, negative_isotope_errors));
   }
 
-  boost::thread_group threadgroup;
+  // Search the spectrum-charge combinations in blocks of checkpoint-interval,
+  // writing a checkpoint after each block. Peptide-centric search only
+  // reports a peptide's matches once it leaves the active window, so there
+  // the whole file is a single block.
+  int block_size = max(sc_last - sc_start, 1);
+  if (!checkpoint_file_.empty() && checkpoint_interval_ > 0 && !peptide_centric) {
+    block_size = checkpoint_interval_;
+  }
+  for (int sc_begin = sc_start; sc_begin < sc_last; sc_begin += block_size) {
+    int sc_end = min(sc_begin + block_size, sc_last);
+    for (int i = 0; i < NUM_THREADS; i++) {
+      thread_data_array[i].sc_begin = sc_begin;
+      thread_data_array[i].sc_end = sc_end;
+    }
+
+    boost::thread_group threadgroup;
+
+    // Launch threads
+    for (int64_t t = 1; t < NUM_THREADS; t++) {
+      boost::thread * currthread = new boost::thread(boost::bind(&TideSearchApplication::search, this, (void *) &(thread_data_array[t])));
+      threadgroup.add_thread(currthread);
+    }
+
+    // Searches through part of the spec charge vector while waiting for threads are busy
+    search( (void *) &(thread_data_array[0]) );
+
+    // Join threads
+    threadgroup.join_all();
 
-  // Launch threads
-  for (int64_t t = 1; t < NUM_THREADS; t++) {
-    boost::thread * currthread = new boost::thread(boost::bind(&TideSearchApplication::search, this, (void *) &(thread_data_array[t])));
-    threadgroup.add_thread(currthread);
+    if (sc_end < sc_last) {
+      checkpoint->position = sc_end;
+      checkpoint->candidates = *total_candidate_peptides;
+      writeCheckpoint(checkpoint, target_file, decoy_file);
+    }
   }
 
-  // Searches through part of the spec charge vector while waiting for threads are busy
-  search( (void *) &(thread_data_array[0]) );
+  if (!config.skip_preprocessing) {
+    for (int i = 0; i < NUM_THREADS; i++) {
+      const thread_data& data = thread_data_array[i];
+      long int num_precursors_skipped = data.num_precursors_skipped;
+      long int num_isotopes_skipped = data.num_isotopes_skipped;
+      long int num_range_skipped = data.num_range_skipped;
+      long int num_retained = data.num_retained;
+      if (config.score_function == BOTH_SCORE) {
+        num_precursors_skipped = num_precursors_skipped / 2;
+        num_isotopes_skipped = num_isotopes_skipped / 2;
+        num_range_skipped = num_range_skipped / 2;
+        num_retained = num_retained / 2;
+      }
 
-  // Join threads
-  threadgroup.join_all();
+      long int total_peaks = num_precursors_skipped + num_isotopes_skipped + num_range_skipped + num_retained;
+      if (total_peaks == 0) {
+        carp(CARP_INFO, "[Thread %d]: Warning: no peaks found.", i);
+      } else {
+        carp(CARP_INFO,
+             "[Thread %d]: Deleted %d precursor, %d isotope and %d out-of-range peaks.",
+             i, num_precursors_skipped, num_isotopes_skipped, num_range_skipped);
+      }
+      if (num_retained == 0) {
+        carp(CARP_INFO, "[Thread %d]: Warning: no peaks retained.", i);
+      } else {
+        carp(CARP_INFO, "[Thread %d]: Retained %g%% of peaks.",
+             i, (100.0 * num_retained) / total_peaks);
+      }
+    }
+  }
 
   carp(CARP_INFO, "Time per spectrum-charge combination: %lf s.", wall_clock() / (1e6*sc_total));
   carp(CARP_INFO, "Average number of candidates per spectrum-charge combination: %lf ",
@@ -1365,51 +1586,36 @@ void TideSearchApplication::collectScoresCompiled(
 #endif
 
 void TideSearchApplication::convertResults() const {
+  vector<string> formats;
+  if (Params::GetBool("pin-output")) {
+    formats.push_back("pin");
+  }
+  if (Params::GetBool("pepxml-output")) {
+    formats.push_back("pepxml");
+  }
+  if (Params::GetBool("mzid-output")) {
+    formats.push_back("mzidentml");
+  }
+  if (Params::GetBool("sqt-output")) {
+    formats.push_back("sqt");
+  }
+  if (formats.empty()) {
+    return;
+  }
+
+  // Each tab-delimited file is parsed once and written in every format.
   PSMConvertApplication converter;
+  string database = Params::GetString("protein-database");
   if (!Params::GetBool("concat")) {
-    string target_file_name = make_file_path("tide-search.target.txt");
-    if (Params::GetBool("pin-output")) {
-      converter.convertFile("tsv", "pin", target_file_name, "tide-search.target.", Params::GetString("protein-database"), true);
-    }
-    if (Params::GetBool("pepxml-output")) {
-      converter.convertFile("tsv", "pepxml", target_file_name, "tide-search.target.", Params::GetString("protein-database"), true);
-    }
-    if (Params::GetBool("mzid-output")) {
-      converter.convertFile("tsv", "mzidentml", target_file_name, "tide-search.target.", Params::GetString("protein-database"), true);
-    }
-    if (Params::GetBool("sqt-output")) {
-      converter.convertFile("tsv", "sqt", target_file_name, "tide-search.target.", Params::GetString("protein-database"), true);
-    }
-
+    converter.convertFile("tsv", formats, make_file_path("tide-search.target.txt"),
+                          "tide-search.target.", database, true);
     if (HAS_DECOYS) {
-      string decoy_file_name = make_file_path("tide-search.decoy.txt");
-      if (Params::GetBool("pin-output")) {
-        converter.convertFile("tsv", "pin", decoy_file_name, "tide-search.decoy.", Params::GetString("protein-database"), true);
-      }
-      if (Params::GetBool("pepxml-output")) {
-        converter.convertFile("tsv", "pepxml", decoy_file_name, "tide-search.decoy.", Params::GetString("protein-database"), true);
-      }
-      if (Params::GetBool("mzid-output")) {
-        converter.convertFile("tsv", "mzidentml", decoy_file_name, "tide-search.decoy.", Params::GetString("protein-database"), true);
-      }
-      if (Params::GetBool("sqt-output")) {
-        converter.convertFile("tsv", "sqt", decoy_file_name, "tide-search.decoy.", Params::GetString("protein-database"), true);
-      }
+      converter.convertFile("tsv", formats, make_file_path("tide-search.decoy.txt"),
+                            "tide-search.decoy.", database, true);
     }
   } else {
-    string concat_file_name = make_file_path("tide-search.txt");
-    if (Params::GetBool("pin-output")) {
-      converter.convertFile("tsv", "pin", concat_file_name, "tide-search.", Params::GetString("protein-database"), true);
-    }
-    if (Params::GetBool("pepxml-output")) {
-      converter.convertFile("tsv", "pepxml", concat_file_name, "tide-search.", Params::GetString("protein-database"), true);
-    }
-    if (Params::GetBool("mzid-output")) {
-      converter.convertFile("tsv", "mzidentml", concat_file_name, "tide-search.", Params::GetString("protein-database"), true);
-    }
-    if (Params::GetBool("sqt-output")) {
-      converter.convertFile("tsv", "sqt", concat_file_name, "tide-search.", Params::GetString("protein-database"), true);
-    }
+    converter.convertFile("tsv", formats, make_file_path("tide-search.txt"),
+                          "tide-search.", database, true);
   }
 }
 
@@ -1516,6 +1722,7 @@ vector<string> TideSearchApplication::getOptions() const {
   string arr[] = {
     "auto-mz-bin-width",
     "auto-precursor-window",
+    "checkpoint-interval",
     "compute-sp",
     "concat",
     "deisotope",
@@ -1525,6 +1732,7 @@ vector<string> TideSearchApplication::getOptions() const {
     "fileroot",
     "isotope-error",
     "mass-precision",
+    "mass-shard",
     "max-precursor-charge",
     "min-peaks",
     "mod-precision",
@@ -1559,6 +1767,7 @@ vector<string> TideSearchApplication::getOptions() const {
     "print-search-progress",
     "remove-precursor-peak",
     "remove-precursor-tolerance",
+    "resume",
     "scan-number",
     "skip-preprocessing",
     "spectrum-charge",
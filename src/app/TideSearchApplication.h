@@ -12,6 +12,7 @@
 #include "spectrum.pb.h"
 #include "tide/theoretical_peak_set.h"
 #include "tide/max_mz.h"
+#include "tide/search_config.h"
 
 using namespace std;
 
@@ -61,6 +62,7 @@ private:
   );
 
   friend class SubtractIndexApplication;
+  friend class MergeTideShardsApplication;
 
  protected:
 
@@ -74,6 +76,26 @@ private:
       OriginalName(name), SpectrumRecords(spectrumrecords), Keep(keep) {}
   };
 
+  /**
+   * Progress of a search, as recorded in tide-search.checkpoint.txt.
+   * position is the index of the first spectrum-charge combination of
+   * input file file_index that has not been searched; the offsets are the
+   * lengths of the tab-delimited output files once everything before that
+   * point had been written.
+   */
+  struct Checkpoint {
+    std::string index;
+    int num_files;
+    int file_index;
+    int position;
+    int candidates;
+    std::streamoff target_offset;
+    std::streamoff decoy_offset;
+    Checkpoint():
+      num_files(0), file_index(0), position(0), candidates(0),
+      target_offset(0), decoy_offset(0) {}
+  };
+
   /**
   brief This variable is used with Cascade Search.
   This map contains a flag for each spectrum whether
@@ -90,9 +112,39 @@ private:
   static bool PROTEIN_LEVEL_DECOYS;
 
   vector<int> getNegativeIsotopeErrors() const;
+
+  /**
+   * Parses the mass-shard parameter ("i/N") into a zero-based shard index
+   * and the number of shards. Returns false if the parameter is empty.
+   */
+  static bool parseMassShard(const string& shard, int* shard_index, int* num_shards);
   vector<InputFile> getInputFiles(const vector<string>& filepaths) const;
   static SpectrumCollection* loadSpectra(const std::string& file);
 
+  /**
+   * Flushes the output files, records their lengths in the checkpoint and
+   * replaces the checkpoint file with it. Does nothing if checkpoints are
+   * disabled.
+   */
+  void writeCheckpoint(
+    Checkpoint* checkpoint,
+    ofstream* target_file,
+    ofstream* decoy_file
+  ) const;
+
+  /**
+   * Reads a checkpoint written by writeCheckpoint. Returns false if the file
+   * does not exist.
+   */
+  static bool readCheckpoint(const string& path, Checkpoint* checkpoint);
+
+  static ofstream* openOutputFile(
+    const string& path,
+    bool overwrite,
+    bool resume,
+    streamoff offset
+  );
+
   /**
    * Function that contains the search algorithm and performs the search
    */
@@ -111,6 +163,7 @@ private:
     *                           -> search(void* threadarg)
     */
   void search(
+    const SearchConfig& config,
     const string& spectrum_filename,
     const vector<SpectrumCollection::SpecCharge>* spec_charges,
     vector<ActivePeptideQueue*> active_peptide_queue,
@@ -143,7 +196,8 @@ private:
     const pb::ModTable& nterm_mod_table,
     const pb::ModTable& cterm_mod_table,
     int numDecoys,
-    vector<int>* negative_isotope_errors
+    vector<int>* negative_isotope_errors,
+    Checkpoint* checkpoint
   );
 
   void collectScoresCompiled(
@@ -183,6 +237,14 @@ private:
 
   std::string remove_index_;
 
+  // Checkpoint file, empty if checkpoints are disabled
+  std::string checkpoint_file_;
+  int checkpoint_interval_;
+
+  // Zero-based index of the mass shard to search, and the number of shards
+  int mass_shard_;
+  int num_mass_shards_;
+
   // this map can be used to preload spectra
   // <spectrumrecords file> -> SpectrumCollection
   // the SpectrumCollection must be sorted
@@ -256,6 +318,7 @@ private:
    */
   struct thread_data {
 
+    const SearchConfig* config;
     string spectrum_filename;
     const vector<SpectrumCollection::SpecCharge>* spec_charges;
     ActivePeptideQueue* active_peptide_queue;
@@ -298,8 +361,16 @@ private:
     int* sc_index;
     int* total_candidate_peptides;
     vector<int>* negative_isotope_errors;
-
-    thread_data (const string& spectrum_filename_, const vector<SpectrumCollection::SpecCharge>* spec_charges_,
+    // Range of spec_charges searched by the current call to search(threadarg)
+    int sc_begin;
+    int sc_end;
+    // Observed peaks filtered out by this thread
+    long int num_range_skipped;
+    long int num_precursors_skipped;
+    long int num_isotopes_skipped;
+    long int num_retained;
+
+    thread_data (const SearchConfig* config_, const string& spectrum_filename_, const vector<SpectrumCollection::SpecCharge>* spec_charges_,
             ActivePeptideQueue* active_peptide_queue_, ProteinVec proteins_,
             vector<const pb::AuxLocation*> locations_, double precursor_window_,
             WINDOW_TYPE_T window_type_, double spectrum_min_mz_, double spectrum_max_mz_,
@@ -313,7 +384,7 @@ private:
             vector<boost::mutex*> locks_array_, double bin_width_, double bin_offset_, bool exact_pval_search_,
             map<pair<string, unsigned int>, bool>* spectrum_flag_, int* sc_index_, int* total_candidate_peptides_,
             vector<int>* negative_isotope_errors_) :
-            spectrum_filename(spectrum_filename_), spec_charges(spec_charges_), active_peptide_queue(active_peptide_queue_),
+            config(config_), spectrum_filename(spectrum_filename_), spec_charges(spec_charges_), active_peptide_queue(active_peptide_queue_),
             proteins(proteins_), locations(locations_), precursor_window(precursor_window_), window_type(window_type_),
             spectrum_min_mz(spectrum_min_mz_), spectrum_max_mz(spectrum_max_mz_), min_scan(min_scan_), max_scan(max_scan_),
             min_peaks(min_peaks_), search_charge(search_charge_), top_matches(top_matches_), highest_mz(highest_mz_),
@@ -322,7 +393,8 @@ private:
             aaMass(aaMass_), nAARes(nAARes_), dAAFreqN(dAAFreqN_), dAAFreqI(dAAFreqI_), dAAFreqC(dAAFreqC_), dAAMass(dAAMass_),
             mod_table(mod_table_), nterm_mod_table(nterm_mod_table_), cterm_mod_table(cterm_mod_table_), decoysPerTarget(decoysPerTarget_),
             locks_array(locks_array_), bin_width(bin_width_), bin_offset(bin_offset_), exact_pval_search(exact_pval_search_),
-            spectrum_flag(spectrum_flag_), sc_index(sc_index_), total_candidate_peptides(total_candidate_peptides_), negative_isotope_errors(negative_isotope_errors_) {}
+            spectrum_flag(spectrum_flag_), sc_index(sc_index_), total_candidate_peptides(total_candidate_peptides_), negative_isotope_errors(negative_isotope_errors_),
+            sc_begin(0), sc_end(0), num_range_skipped(0), num_precursors_skipped(0), num_isotopes_skipped(0), num_retained(0) {}
   };
 
   int calcScoreCount(
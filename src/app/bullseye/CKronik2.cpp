@@ -126,40 +126,19 @@ bool CKronik2::loadHK(char* in){
   return true;
 }
 
-bool CKronik2::processHK(char*  in, char* out) {
+bool CKronik2::processHK(char*  in, const char* out) {
 	FILE *hkr;
 	sScan scan;
 	sPep pep;
 	double td;
 	char tag;
 	bool firstScan;
-  int sIndex,pIndex;
-  int i,j,k,k1,k2;
 
 	char line[256];
 	char* tok;
 
-	int pepCount=0;
   vector<sScan> allScans;
 
-  double mass;
-  double ppm;
-  int charge;
-  int gap;
-  int matchCount;
-  bool bMatch;
-
-  sPepProfile s;
-  sProfileData p;
-
-  //for tracking which peptides
-  iTwo t;
-  vector<iTwo> vLeft;
-  vector<iTwo> vRight;
-
-  //clear data
-  vPeps.clear();
-
   //Read in the Hardklor results
   firstScan=true;
 	hkr = fopen(in,"rt");
@@ -185,7 +164,6 @@ bool CKronik2::processHK(char*  in, char* out) {
 			strcpy(scan.file,tok);
       //fscanf(hkr,"\t%d\t%f%s\n",&scan.scanNum,&scan.rTime,scan.file);
 		} else {
-			pepCount++;
 			fscanf(hkr,"\t%lf\t%d\t%f\t%lf\t%lf-%lf\t%lf\t%s\t%lf\n", &pep.monoMass,&pep.charge,&pep.intensity,&pep.basePeak,&td,&td,&td,pep.mods,&pep.xCorr);
 			scan.vPep->push_back(pep);
 		}
@@ -193,6 +171,38 @@ bool CKronik2::processHK(char*  in, char* out) {
   allScans.push_back(scan);
 	fclose(hkr);
 
+  return processScans(allScans,out);
+}
+
+//Finds the persistent peptide signals in Hardklor results that are already in
+//memory, one sScan per analyzed scan in scan order. The peptides are removed
+//from allScans as they are assigned to profiles.
+bool CKronik2::processScans(vector<sScan>& allScans, const char* out) {
+  int sIndex,pIndex;
+  int i,j,k,k1,k2;
+
+	int pepCount=0;
+
+  double mass;
+  double ppm;
+  int charge;
+  int gap;
+  int matchCount;
+  bool bMatch;
+
+  sPepProfile s;
+  sProfileData p;
+
+  //for tracking which peptides
+  iTwo t;
+  vector<iTwo> vLeft;
+  vector<iTwo> vRight;
+
+  //clear data
+  vPeps.clear();
+
+  for(i=0;i<allScans.size();i++) pepCount+=allScans[i].vPep->size();
+
   cout << pepCount << " peptides from " << allScans.size() << " scans." << endl;
 
   for(i=0;i<allScans.size();i++) allScans[i].sortIntRev();
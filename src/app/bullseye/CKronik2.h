@@ -286,7 +286,8 @@ public:
   //Automation
   int getPercent();
   bool loadHK(char* in);
-  bool processHK(char* in, char* out="\0");
+  bool processHK(char* in, const char* out="");
+  bool processScans(vector<sScan>& allScans, const char* out="");
 
   //Tools
   bool getRT(int scanNum, float& rt);
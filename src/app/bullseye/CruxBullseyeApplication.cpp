@@ -4,6 +4,8 @@
  *****************************************************************************/
 #include "CruxBullseyeApplication.h"
 #include "app/hardklor/CruxHardklorApplication.h"
+#include "app/hardklor/HardklorTypes.h"
+#include "CKronik2.h"
 #include "util/CarpStreamBuf.h"
 #include "io/DelimitedFileWriter.h"
 
@@ -17,7 +19,8 @@ using namespace std;
 /**
  * \returns a blank CruxBullseyeApplication object
  */
-CruxBullseyeApplication::CruxBullseyeApplication() {
+CruxBullseyeApplication::CruxBullseyeApplication()
+  : hardklor_scans_(NULL) {
 }
 
 /**
@@ -54,16 +57,38 @@ int CruxBullseyeApplication::main(
 ) {
   /* Get parameters. */
   string hardklor_output = Params::GetString("hardklor-file");
+  vector<sScan> hardklor_scans;
   if (hardklor_output.empty()) {
-    hardklor_output = make_file_path("hardklor.mono.txt");
-    if (Params::GetBool("overwrite") || (!FileUtils::Exists(hardklor_output))) {
-      carp(CARP_DEBUG, "Calling hardklor");
-      bool ret = CruxHardklorApplication::main(input_ms1);
-      if (ret != 0) {
-        carp(CARP_WARNING, "Hardklor failed:%d", ret);
-        return ret;
+    // Hardklor's results are handed to bullseye in memory, so no hardklor
+    // file is written and parsed again.
+    carp(CARP_DEBUG, "Calling hardklor");
+    vector<hkScan> scans;
+    vector<hkMem> results;
+    int ret = CruxHardklorApplication::main(input_ms1, &scans, &results);
+    if (ret != 0) {
+      carp(CARP_WARNING, "Hardklor failed:%d", ret);
+      return ret;
+    }
+    hardklor_scans.resize(scans.size());
+    for (size_t i = 0; i < scans.size(); i++) {
+      sScan& scan = hardklor_scans[i];
+      scan.scanNum = scans[i].scan;
+      scan.rTime = scans[i].rTime;
+      strncpy(scan.file, input_ms1.c_str(), sizeof(scan.file) - 1);
+      scan.file[sizeof(scan.file) - 1] = '\0';
+      int last = (i + 1 < scans.size()) ? scans[i + 1].firstResult : results.size();
+      for (int j = scans[i].firstResult; j < last; j++) {
+        sPep pep;
+        pep.charge = results[j].charge;
+        pep.intensity = results[j].intensity;
+        pep.monoMass = results[j].monoMass;
+        pep.basePeak = results[j].mz;
+        pep.xCorr = results[j].corr;
+        strcpy(pep.mods, results[j].mods);
+        scan.vPep->push_back(pep);
       }
     }
+    hardklor_scans_ = &hardklor_scans;
   }
 
   /* build argument list */
@@ -128,6 +153,7 @@ int CruxBullseyeApplication::main(
 
   /* Call bullseyeMain */
   int ret = bullseyeMain(be_argc, be_argv);
+  hardklor_scans_ = NULL;
 
   // Recover stream
   cout.rdbuf(old);
@@ -230,9 +256,6 @@ vector< pair<string, string> > CruxBullseyeApplication::getOutputs() const {
   outputs.push_back(make_pair("bullseye.no-pid.<format>",
     "a file containing the fragmentation spectra for which accurate masses "
     "were not inferred."));
-  outputs.push_back(make_pair("hardklor.mono.txt",
-    "a tab-delimited text file containing one line for each isotope "
-    "distribution, as described <a href=\"hardklor.html\">here</a>."));
   outputs.push_back(make_pair("bullseye.params.txt",
     "a file containing the name and value of all parameters/options for the "
     "current operation. Not all parameters in the file may have been used in "
@@ -11,11 +11,18 @@
 
 #include <string>
 #include <fstream>
+#include <vector>
+
+struct sScan;
 
 class CruxBullseyeApplication: public CruxApplication {
 
  protected:
 
+  //Hardklor results kept in memory, used instead of reading a hardklor file
+  //when not NULL
+  std::vector<sScan>* hardklor_scans_;
+
   //Calls the main method in bullseye
   int bullseyeMain(int argc, char* argv[]);
 
@@ -4,13 +4,23 @@
 #ifdef CRUX
 #include "CruxBullseyeApplication.h"
 #endif
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <vector>
 
 using namespace MSToolkit;
 
+//Precursor isolation window of a persistent peptide
+typedef struct sWindow{
+  double lowMass;
+  double highMass;
+  int index;
+} sWindow;
+
 MSFileFormat getFileFormat(char* c);
+bool compareWindowLow(const sWindow& a, const sWindow& b);
+double roundMass(double d);
 void matchMS2(CKronik2& p, char* ms2File, char* outFile, char* outFile2);
 void usage();
 
@@ -91,7 +101,12 @@ int main(int argc, char* argv[]){
 		}
 	}
 
+#ifdef CRUX
+	if(hardklor_scans_!=NULL) p1.processScans(*hardklor_scans_);
+	else p1.processHK(argv[argc-4]);
+#else
 	p1.processHK(argv[argc-4]);
+#endif
 	if (p1.size() == 0) {
 		cout << "No analysis results, exiting..." << endl;
 		exit(0);
@@ -128,7 +143,7 @@ void matchMS2(CKronik2& p, char* ms2File, char* outFile, char* outFile2){
   int i,j;
   int fragCount=0;
   int lookup[8001];
-  double lowMass, highMass,ppm;
+  double ppm;
   int x,z;
   int a,b;
   int c=0;
@@ -137,14 +152,17 @@ void matchMS2(CKronik2& p, char* ms2File, char* outFile, char* outFile2){
   int index;
   vector<int> vI;
   vector<int> vHit;
+  vector<int> vCand;
+  vector<sWindow> vWin;
+  vector<double> vRound;
+  sWindow w;
+  double maxWidth;
+  unsigned int k;
   MSFileFormat posFF, negFF;
 
   int ch[10];
   for(i=0;i<10;i++) ch[i]=0;
 
-  char str1[16];
-  char str2[16];
-
   //Check file formats for output. Make sure the user specifies the appropriate format
   posFF=getFileFormat(outFile);
   negFF=getFileFormat(outFile2);
@@ -193,6 +211,30 @@ void matchMS2(CKronik2& p, char* ms2File, char* outFile, char* outFile2){
     }
     lookup[i]=j;
   }
+
+  //Index the isolation windows by their lower bound. No window is wider than
+  //maxWidth, so a precursor m/z can only be in windows starting less than
+  //maxWidth below it.
+  vWin.clear();
+  maxWidth=0;
+  for(i=0;i<p.size();i++){
+    w.index=i;
+    w.lowMass = (p.at(i).monoMass+p.at(i).charge*1.00727649)/p.at(i).charge-0.05;
+    switch(p.at(i).charge){
+      case 1:
+        w.highMass = (p.at(i).monoMass+p.at(i).charge*1.00727649)/p.at(i).charge + 3.10;
+        break;
+      case 2:
+        w.highMass = (p.at(i).monoMass+p.at(i).charge*1.00727649)/p.at(i).charge + 2.10;
+        break;
+      default:
+        w.highMass = (p.at(i).monoMass+p.at(i).charge*1.00727649)/p.at(i).charge + 4/p.at(i).charge +0.05;
+        break;
+    }
+    if(w.highMass-w.lowMass>maxWidth) maxWidth=w.highMass-w.lowMass;
+    vWin.push_back(w);
+  }
+  sort(vWin.begin(),vWin.end(),compareWindowLow);
   cout << "Done!" << endl;
 
   //Read in the data
@@ -238,27 +280,25 @@ void matchMS2(CKronik2& p, char* ms2File, char* outFile, char* outFile2){
 
     //if base peak wasn't enough, perhaps a different peak was isolated
     if(!bMatchPrecursorOnly){
-      for(i=0;i<p.size();i++){
-        lowMass = (p.at(i).monoMass+p.at(i).charge*1.00727649)/p.at(i).charge-0.05;
-        switch(p.at(i).charge){
-          case 1:
-            highMass = (p.at(i).monoMass+p.at(i).charge*1.00727649)/p.at(i).charge + 3.10;
-            break;
-          case 2:
-            highMass = (p.at(i).monoMass+p.at(i).charge*1.00727649)/p.at(i).charge + 2.10;
-            break;
-          default:
-            highMass = (p.at(i).monoMass+p.at(i).charge*1.00727649)/p.at(i).charge + 4/p.at(i).charge +0.05;
-            break;
-        }
-        if( s.getMZ() > lowMass &&
-            s.getMZ() < highMass &&
+      vCand.clear();
+      w.lowMass=s.getMZ()-maxWidth-0.000001;
+      k=lower_bound(vWin.begin(),vWin.end(),w,compareWindowLow)-vWin.begin();
+      while(k<vWin.size() && s.getMZ() > vWin[k].lowMass){
+        i=vWin[k].index;
+        if( s.getMZ() < vWin[k].highMass &&
             s.getRTime() > p.at(i).firstRTime-rtTolerance &&
             s.getRTime() < p.at(i).lastRTime+rtTolerance ) {
-          x++;
-          index=i;
-          vHit.push_back(i);
+          vCand.push_back(i);
         }
+        k++;
+      }
+
+      //report hits in the order of the peptides, as a scan over all of them would
+      sort(vCand.begin(),vCand.end());
+      for(k=0;k<vCand.size();k++){
+        x++;
+        index=vCand[k];
+        vHit.push_back(vCand[k]);
       }
     }
 
@@ -291,19 +331,17 @@ void matchMS2(CKronik2& p, char* ms2File, char* outFile, char* outFile2){
     } else {
       while(s.sizeZ()>0) s.eraseZ(0);
 
-      //erase redundancies in multiple hit list
+      //erase redundancies in multiple hit list; hits are redundant if they
+      //have the same charge and the same M+H to two decimal places
+      vRound.clear();
+      for(i=0;i<vHit.size();i++) vRound.push_back(roundMass(p.at(vHit[i]).monoMass+1.00727649));
       for(i=0;i<vHit.size()-1;i++){
         for(j=i+1;j<vHit.size();j++){
-          if(p.at(vHit[i]).charge == p.at(vHit[j]).charge) {
-            sprintf(str1,"%.2f\n",p.at(vHit[i]).monoMass+1.00727649);
-            sprintf(str2,"%.2f\n",p.at(vHit[j]).monoMass+1.00727649);
-
-            if(strcmp(str1,str2)==0) {
-              if(p.at(vHit[i]).intensity < p.at(vHit[j]).intensity) vHit[i]=vHit[j];
-              vHit.erase(vHit.begin()+j);
-              j--;
-            }
-
+          if(p.at(vHit[i]).charge == p.at(vHit[j]).charge && vRound[i]==vRound[j]) {
+            if(p.at(vHit[i]).intensity < p.at(vHit[j]).intensity) vHit[i]=vHit[j];
+            vHit.erase(vHit.begin()+j);
+            vRound.erase(vRound.begin()+j);
+            j--;
           }
         }
       }
@@ -463,3 +501,12 @@ void usage(){
 	cout << "\nPlease read the README.txt file for more information on Bullseye." << endl;
 
 }
+
+bool compareWindowLow(const sWindow& a, const sWindow& b){
+  return a.lowMass<b.lowMass;
+}
+
+//Rounds a mass to two decimal places
+double roundMass(double d){
+  return floor(d*100.0+0.5);
+}
@@ -173,6 +173,7 @@ void CHardklor::Analyze(Spectrum* s) {
   int winCount=0;
 
   vResults.clear();
+  vScans.clear();
 
   //Ouput file info to user
 	if(bEcho){
@@ -286,13 +287,18 @@ void CHardklor::Analyze(Spectrum* s) {
 
 		//Write scan information to output file.
 		if(curSpec.getScanNumber()!=0){	
+		  if(cs.scan.iUpper>0 && curSpec.getScanNumber()>cs.scan.iUpper) break;
       if(!bMem){
-			  if(cs.scan.iUpper>0 && curSpec.getScanNumber()>cs.scan.iUpper) break;
 			  if(cs.reducedOutput) WriteScanLine(curSpec,fptr,2);
 			  else if(cs.xml) WriteScanLine(curSpec,fptr,1);
 			  else WriteScanLine(curSpec,fptr,0);
       } else {
         currentScanNumber = curSpec.getScanNumber();
+        hkScan hks;
+        hks.scan = currentScanNumber;
+        hks.rTime = curSpec.getRTime();
+        hks.firstResult = vResults.size();
+        vScans.push_back(hks);
       }
 		} else {
 			break; //exit if there is no spectrum left to analyze
@@ -2270,6 +2276,14 @@ int CHardklor::Size(){
   return vResults.size();
 }
 
+int CHardklor::SizeScans(){
+  return vScans.size();
+}
+
+hkScan& CHardklor::GetScan(const int& index){
+  return vScans[index];
+}
+
 void CHardklor::SetResultsToMemory(bool b){
   bMem=b;
 }
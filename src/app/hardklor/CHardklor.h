@@ -60,11 +60,13 @@ class CHardklor{
 
   //Methods:
 	void Echo(bool b);
+  hkScan& GetScan(const int& index);
   int GoHardklor(CHardklorSetting sett, Spectrum* s=NULL);
 	void SetAveragine(CAveragine *a);
 	void SetMercury(CMercury8 *m);
   void SetResultsToMemory(bool b);
   int Size();
+  int SizeScans();
 
  protected:
 
@@ -109,8 +111,9 @@ class CHardklor{
 	//Vector for holding peptide list of distribution
   vector<CHardklorVariant> pepVariants;
 
-  //Vector for holding results in memory should that be needed
+  //Vectors for holding results in memory should that be needed
   vector<hkMem> vResults;
+  vector<hkScan> vScans;
 
   //Temporary Data Members:
   char bestCh[200];
@@ -1,4 +1,11 @@
 #include "CHardklor2.h"
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+//Scans analyzed together by one thread
+static const int SCANS_PER_BATCH=4;
+//Batches that may be read ahead of the output, per analysis thread
+static const int BATCHES_PER_THREAD=4;
 
 CHardklor2::CHardklor2(CAveragine *a, CMercury8 *m, CModelLibrary *lib){
   averagine=a;
@@ -7,6 +14,7 @@ CHardklor2::CHardklor2(CAveragine *a, CMercury8 *m, CModelLibrary *lib){
 	bEcho=true;
   bMem=false;
 	PT=NULL;
+	threads=1;
 }
 
 CHardklor2::~CHardklor2(){
@@ -16,6 +24,7 @@ CHardklor2::~CHardklor2(){
 	if(PT!=NULL) {
 		PT=NULL;
 	}
+	for(size_t i=0;i<vFreeBatches.size();i++) delete vFreeBatches[i];
 }
 
 hkMem& CHardklor2::operator[](const int& index){
@@ -30,7 +39,8 @@ int CHardklor2::GoHardklor(CHardklorSetting sett, Spectrum* s){
 	
 	//Member variables
 	MSReader r;
-	Spectrum curSpec,c;
+	Spectrum curSpec;
+	vector<Spectrum> curWin;
 	vector<int> v;
 	FILE* fout;
 	int TotalScans;
@@ -38,7 +48,11 @@ int CHardklor2::GoHardklor(CHardklorSetting sett, Spectrum* s){
 	int iPercent;
 	int minutes, seconds;
 	int i;
-	vector<pepHit> vPeps;
+	int numThreads;
+	hkBatch* b;
+	boost::thread_group tg;
+	bool bFirst;
+	bool bLast;
 
 	//initialize variables
 	cs=sett;
@@ -52,6 +66,7 @@ int CHardklor2::GoHardklor(CHardklorSetting sett, Spectrum* s){
 	getTimerFrequency(timerFrequency);
 
   vResults.clear();
+  vScans.clear();
 
 	//For noise reduction
 	CNoiseReduction nr(&r,cs);
@@ -88,14 +103,10 @@ int CHardklor2::GoHardklor(CHardklorSetting sett, Spectrum* s){
       else if(cs.scan.iLower>0) r.readFile(&cs.inFile[0],curSpec,cs.scan.iLower);
 	    else r.readFile(&cs.inFile[0],curSpec);
 	  } else {
-		  if(cs.boxcarFilter==0){
-        if(!nr.DeNoiseD(curSpec)) curSpec.setScanNumber(0);
-			  //if(!nr.DeNoise(curSpec)) curSpec.setScanNumber(0);
-			  //do something about this...
-
-		  } else {
-        if(!nr.DeNoiseC(curSpec)) curSpec.setScanNumber(0);
-		  }
+		  //Only the boxcar window is read here; it is averaged with the rest of its batch.
+		  //A boxcarFilter of 0 does not filter (DeNoiseD), otherwise DeNoiseC is used.
+		  if(nr.ReadWindow(curWin,cs.boxcarFilter>0)) curSpec.setScanNumber(curWin[0].getScanNumber());
+		  else curSpec.setScanNumber(0);
     }
   }
 
@@ -115,49 +126,90 @@ int CHardklor2::GoHardklor(CHardklorSetting sett, Spectrum* s){
     return -2;
   }
 
-	//Write scan information to output file.
-  if(!bMem){
-    if(cs.reducedOutput) WriteScanLine(curSpec,fout,2);
-    else if(cs.xml) WriteScanLine(curSpec,fout,1);
-    else WriteScanLine(curSpec,fout,0);
-  } else {
-    currentScanNumber = curSpec.getScanNumber();
-  }
-
 	//Output progress indicator
 	if(bEcho) cout << iPercent;
-  
+
+	//Scans are read in batches on this thread and analyzed on the analysis threads,
+	//which are started once for the whole file, so reading the next batch overlaps
+	//the analysis of the previous ones. Analyzed batches wait in mDoneBatches until
+	//the batches before them are done, so results are exported in scan order and
+	//the output does not depend on the number of threads.
+	numThreads=(threads>1 ? threads : 1);
+	nextBatchIn=0;
+	nextBatchOut=0;
+	bStopThreads=false;
+	for(i=0;i<numThreads;i++){
+		tg.create_thread(boost::bind(&CHardklor2::AnalysisThread,this,&nr));
+	}
+	bFirst=true;
+	bLast=false;
+
   //While there is still data to read in the file.
-  while(true){
+  while(!bLast){
 
+		//Fill the batch. curSpec always holds the next scan to analyze; with boxcar
+		//averaging it only carries the scan number, and curWin holds the window.
 		getExactTime(startTime);
-		TotalScans++;
-		
-		//Smooth if requested
-		if(cs.smooth>0) SG_Smooth(curSpec,cs.smooth,4);
+		if(vFreeBatches.empty()) {
+			b=new hkBatch();
+			b->vSpec.resize(SCANS_PER_BATCH);
+			b->vCent.resize(SCANS_PER_BATCH);
+			b->vPeps.resize(SCANS_PER_BATCH);
+			b->vWin.resize(SCANS_PER_BATCH);
+		} else {
+			b=vFreeBatches.back();
+			vFreeBatches.pop_back();
+		}
+		b->index=nextBatchIn;
+		b->count=0;
+		while(true){
+			if(cs.boxcar>0) b->vWin[b->count].swap(curWin);
+			b->vSpec[b->count++]=curSpec;
+
+			if(s!=NULL) {
+				bLast=true;
+				break;
+			}
 
-		//Centroid if needed; notice that this copy wastes a bit of time.
-		//TODO: make this more efficient
-		if(cs.boxcar==0 && !cs.centroid) Centroid(curSpec,c);
-		else c=curSpec;
+			//Check if any user limits were made and met
+			if( (cs.scan.iUpper == cs.scan.iLower) && (cs.scan.iLower != 0) ){
+				bLast=true;
+				break;
+			} else if( (cs.scan.iLower < cs.scan.iUpper) && (curSpec.getScanNumber() >= cs.scan.iUpper) ){
+				bLast=true;
+				break;
+			}
 
-		//There is a bug when using noise reduction that results in out of order m/z values
-		//TODO: fix noise reduction so sorting isn't needed
-		if(c.size()>0) c.sortMZ();
-
-		//Analyze
-		QuickHardklor(c,vPeps);
-
-		//export results
-		for(i=0;i<(int)vPeps.size();i++){
-      if(!bMem){
-			  if(cs.reducedOutput) WritePepLine(vPeps[i],c,fout,2);
-			  else if(cs.xml) WritePepLine(vPeps[i],c,fout,1);
-			  else WritePepLine(vPeps[i],c,fout,0);
-      } else {
-        ResultToMem(vPeps[i],c);
-      }
+			//Read next spectrum from file.
+			if(cs.boxcar==0) {
+				r.readFile(NULL,curSpec);
+			} else {
+				if(nr.ReadWindow(curWin,cs.boxcarFilter>0)) curSpec.setScanNumber(curWin[0].getScanNumber());
+				else curSpec.setScanNumber(0);
+			}
+			if(curSpec.getScanNumber()==0){
+				bLast=true;
+				break;
+			}
+			if(b->count==SCANS_PER_BATCH) break;
 		}
+		getExactTime(stopTime);
+		tmpTime1=toMicroSec(stopTime);
+		tmpTime2=toMicroSec(startTime);
+		loadTime+=(tmpTime1-tmpTime2);
+
+		//Queue the batch for analysis, then export the batches that are done. Reading
+		//stops while too many batches are waiting, and after the last one is read
+		//every batch is exported.
+		getExactTime(startTime);
+		TotalScans+=b->count;
+		{
+			boost::mutex::scoped_lock lock(batchMutex);
+			qBatches.push_back(b);
+			nextBatchIn++;
+			batchQueued.notify_one();
+		}
+		ExportBatches(fout,bFirst,bLast ? 0 : numThreads*BATCHES_PER_THREAD-1);
 
 		//Update progress
 		if(bEcho){
@@ -175,49 +227,14 @@ int CHardklor2::GoHardklor(CHardklorSetting sett, Spectrum* s){
     tmpTime1=toMicroSec(stopTime);
     tmpTime2=toMicroSec(startTime);
     analysisTime+=tmpTime1-tmpTime2;
-    
-    if(s!=NULL) break;
-
-		//Check if any user limits were made and met
-		if( (cs.scan.iUpper == cs.scan.iLower) && (cs.scan.iLower != 0) ){
-			break;
-		} else if( (cs.scan.iLower < cs.scan.iUpper) && (curSpec.getScanNumber() >= cs.scan.iUpper) ){
-			break;
-		}
-
-		//Read next spectrum from file.
-		getExactTime(startTime);
-		if(cs.boxcar==0) {
-			r.readFile(NULL,curSpec);
-		} else {
-			if(cs.boxcarFilter==0){
-				//possible to not filter?
-        nr.DeNoiseD(curSpec);
-			} else {
-			//case 5: nr.DeNoise(curSpec); break; //this is for filtering without boxcar
-				nr.DeNoiseC(curSpec);
-			}
-		}
-
-		getExactTime(stopTime);
-		tmpTime1=toMicroSec(stopTime);
-		tmpTime2=toMicroSec(startTime);
-		loadTime+=(tmpTime1-tmpTime2);
+	}
 
-		if(curSpec.getScanNumber()!=0){
-			//Write scan information to output file.
-			if(cs.reducedOutput){
-				WriteScanLine(curSpec,fout,2);
-			} else if(cs.xml) {
-				fprintf(fout,"</Spectrum>\n");
-				WriteScanLine(curSpec,fout,1);
-			} else {
-				WriteScanLine(curSpec,fout,0);
-			}
-		} else {
-			break;
-		}
+	{
+		boost::mutex::scoped_lock lock(batchMutex);
+		bStopThreads=true;
+		batchQueued.notify_all();
 	}
+	tg.join_all();
 
 	if(!bMem) fclose(fout);
 
@@ -379,8 +396,110 @@ void CHardklor2::Centroid(Spectrum& s, Spectrum& out){
 
 }
 
+//Smooths, centroids and analyzes the scans of a batch. Each scan only touches
+//its own entries of the batch. With boxcar averaging, the scan's window is
+//averaged here first.
+void CHardklor2::AnalyzeBatch(hkBatch& b, CNoiseReduction* nr){
+	for(int i=0;i<b.count;i++){
+
+		if(!b.vWin[i].empty()){
+			nr->DeNoiseWindow(b.vSpec[i],b.vWin[i],cs.boxcarFilter>0);
+			b.vWin[i].clear();
+		}
+
+		//Smooth if requested
+		if(cs.smooth>0) SG_Smooth(b.vSpec[i],cs.smooth,4);
+
+		//Centroid if needed; notice that this copy wastes a bit of time.
+		//TODO: make this more efficient
+		if(cs.boxcar==0 && !cs.centroid) Centroid(b.vSpec[i],b.vCent[i]);
+		else b.vCent[i]=b.vSpec[i];
+
+		//There is a bug when using noise reduction that results in out of order m/z values
+		//TODO: fix noise reduction so sorting isn't needed
+		if(b.vCent[i].size()>0) b.vCent[i].sortMZ();
+
+		QuickHardklor(b.vCent[i],b.vPeps[i]);
+	}
+}
+
+//Runs on each analysis thread: analyzes queued batches in the order they were
+//read, and hands them back keyed by batch index, until told to stop.
+void CHardklor2::AnalysisThread(CNoiseReduction* nr){
+	hkBatch* b;
+	while(true){
+		{
+			boost::mutex::scoped_lock lock(batchMutex);
+			while(qBatches.empty() && !bStopThreads) batchQueued.wait(lock);
+			if(qBatches.empty()) return;
+			b=qBatches.front();
+			qBatches.pop_front();
+		}
+		AnalyzeBatch(*b,nr);
+		boost::mutex::scoped_lock lock(batchMutex);
+		mDoneBatches[b->index]=b;
+		batchDone.notify_one();
+	}
+}
+
+//Exports analyzed batches in batch order, waiting for the next one in order
+//while more than maxPending batches have not been exported yet.
+void CHardklor2::ExportBatches(FILE* fout, bool& bFirst, int maxPending){
+	hkBatch* b;
+	while(true){
+		{
+			boost::mutex::scoped_lock lock(batchMutex);
+			while(mDoneBatches.empty() || mDoneBatches.begin()->first!=nextBatchOut){
+				if(nextBatchIn-nextBatchOut<=maxPending) return;
+				batchDone.wait(lock);
+			}
+			b=mDoneBatches.begin()->second;
+			mDoneBatches.erase(mDoneBatches.begin());
+		}
+		WriteBatch(*b,fout,bFirst);
+		nextBatchOut++;
+		vFreeBatches.push_back(b);
+	}
+}
+
+//Writes the results of an analyzed batch to the output file, or to memory.
+void CHardklor2::WriteBatch(hkBatch& b, FILE* fout, bool& bFirst){
+	int i,j;
+	for(j=0;j<b.count;j++){
+		if(!bMem){
+			//Write scan information to output file.
+			if(cs.reducedOutput){
+				WriteScanLine(b.vSpec[j],fout,2);
+			} else if(cs.xml) {
+				if(!bFirst) fprintf(fout,"</Spectrum>\n");
+				WriteScanLine(b.vSpec[j],fout,1);
+			} else {
+				WriteScanLine(b.vSpec[j],fout,0);
+			}
+		} else {
+			currentScanNumber = b.vSpec[j].getScanNumber();
+			hkScan hks;
+			hks.scan = currentScanNumber;
+			hks.rTime = b.vSpec[j].getRTime();
+			hks.firstResult = vResults.size();
+			vScans.push_back(hks);
+		}
+		bFirst=false;
+
+		for(i=0;i<(int)b.vPeps[j].size();i++){
+			if(!bMem){
+				if(cs.reducedOutput) WritePepLine(b.vPeps[j][i],b.vCent[j],fout,2);
+				else if(cs.xml) WritePepLine(b.vPeps[j][i],b.vCent[j],fout,1);
+				else WritePepLine(b.vPeps[j][i],b.vCent[j],fout,0);
+			} else {
+				ResultToMem(b.vPeps[j][i],b.vCent[j]);
+			}
+		}
+	}
+}
+
 //returns whether or not the peak is still valid. true if peak still exists, false if peak was solved already.
-bool CHardklor2::CheckForPeak(vector<Result>& vMR, Spectrum& s, int index){
+bool CHardklor2::CheckForPeak(vector<Result>& vMR, Spectrum& s, Spectrum& mask, int index){
 	double dif=100.0;
 	double massDif;
 	bool match=false;
@@ -606,7 +725,7 @@ bool CHardklor2::MatchSubSpectrum(Spectrum& s, int peakIndex, pepHit& pep){
 
 }
 
-double CHardklor2::PeakMatcher(vector<Result>& vMR, Spectrum& s, double lower, double upper, double deltaM, int matchIndex, int& matchCount, int& indexOverlap, vector<int>& vMatchIndex, vector<float>& vMatchIntensity){
+double CHardklor2::PeakMatcher(vector<Result>& vMR, Spectrum& s, Spectrum& mask, double lower, double upper, double deltaM, int matchIndex, int& matchCount, int& indexOverlap, vector<int>& vMatchIndex, vector<float>& vMatchIntensity){
 
 	vMatchIndex.clear();
 	vMatchIntensity.clear();
@@ -925,8 +1044,8 @@ void CHardklor2::QuickHardklor(Spectrum& s, vector<pepHit>& vPeps) {
 	Spectrum refSpec=s;
 	Spectrum tmpSpec;
 
-	//create mask
-	mask.clear();
+	//create mask; it is local so that scans can be analyzed concurrently
+	Spectrum mask;
 	for(i=0;i<s.size();i++) mask.add(s[i].mz,0);
 
 	//find lowest intensity;
@@ -1055,13 +1174,13 @@ void CHardklor2::QuickHardklor(Spectrum& s, vector<pepHit>& vPeps) {
 					highIndex=BinarySearch(s,upper,false);
 
 					//if max peak shifts to already solved peak, skip
-					if(!CheckForPeak(vMR,s,thisMaxIndex)){
+					if(!CheckForPeak(vMR,s,mask,thisMaxIndex)){
 						n++;
 						continue;
 					}
 
 					//Match predictions to the observed peaks and record them in the proper array.
-					corr=PeakMatcher(vMR,s,lower,upper,deltaM/2,maxIndex,matchCount,indexOverlap,vMatchIndex,vMatchPeak);
+					corr=PeakMatcher(vMR,s,mask,lower,upper,deltaM/2,maxIndex,matchCount,indexOverlap,vMatchIndex,vMatchPeak);
 					//cout << "ii.i\t" << s[maxIndex].mz << " " << s[maxIndex].intensity << "\t" << charges[i] << "\t" << matchCount << "\t" << corr << "\t" << indexOverlap << "\t" << maxIndex << "\tn" << n << endl;
 
 					//check any overlap with observed peptides. Overlap indicates deconvolution may be necessary.
@@ -1118,7 +1237,7 @@ void CHardklor2::QuickHardklor(Spectrum& s, vector<pepHit>& vPeps) {
 							}
 
 							//solve merged models
-							corr3=PeakMatcher(vMR,refSpec,lower,upper,deltaM/2,maxIndex,matchCount2,indexOverlap,vMatchIndex2,vMatchPeak2);
+							corr3=PeakMatcher(vMR,refSpec,mask,lower,upper,deltaM/2,maxIndex,matchCount2,indexOverlap,vMatchIndex2,vMatchPeak2);
 							//cout << "iii.ii\tCorr3: " << s[maxIndex].mz << " " << s[maxIndex].intensity << "\t" << charges[i] << "\t" << matchCount2 << "\t" << corr3 << "\t" << indexOverlap << endl;
 
 							//keep the new model if it is better than the old one.
@@ -1358,10 +1477,23 @@ void CHardklor2::SetResultsToMemory(bool b){
   bMem=b;
 }
 
+void CHardklor2::SetThreads(int n){
+  if(n<1) n=1;
+  threads=n;
+}
+
 int CHardklor2::Size(){
   return vResults.size();
 }
 
+int CHardklor2::SizeScans(){
+  return vScans.size();
+}
+
+hkScan& CHardklor2::GetScan(const int& index){
+  return vScans[index];
+}
+
 void CHardklor2::WritePepLine(pepHit& ph, Spectrum& s, FILE* fptr, int format){
   int i,j;
 
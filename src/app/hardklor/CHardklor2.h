@@ -5,6 +5,8 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <deque>
+#include <map>
 #include <cmath>
 
 #include "MSObject.h"
@@ -16,6 +18,9 @@
 #include "CHardklor.h"
 #include "CModelLibrary.h"
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 #ifdef _MSC_VER
 
 #else
@@ -36,27 +41,46 @@ class CHardklor2{
 
   //Methods:
   void  Echo(bool b);
+  hkScan& GetScan(const int& index);
   int   GoHardklor(CHardklorSetting sett, Spectrum* s=NULL);
   void    QuickCharge(Spectrum& s, int index, vector<int>& v);
   void  SetResultsToMemory(bool b);
+  void  SetThreads(int n);
   int   Size();
+  int   SizeScans();
 
  protected:
 
  private:
+  //Consecutive scans analyzed together by one thread, one entry per scan: the
+  //spectrum as read, the spectrum that was analyzed, and its results. With boxcar
+  //averaging, the scans of each window are kept until the window is averaged.
+  struct hkBatch {
+    int index;
+    int count;
+    vector<Spectrum> vSpec;
+    vector<Spectrum> vCent;
+    vector< vector<pepHit> > vPeps;
+    vector< vector<Spectrum> > vWin;
+  };
+
   //Methods:
+  void    AnalysisThread(CNoiseReduction* nr);
+  void    AnalyzeBatch(hkBatch& b, CNoiseReduction* nr);
   int     BinarySearch(Spectrum& s, double mz, bool floor);
   double  CalcFWHM(double mz,double res,int iType);
   void    Centroid(Spectrum& s, Spectrum& out);
-  bool    CheckForPeak(vector<Result>& vMR, Spectrum& s, int index);
+  bool    CheckForPeak(vector<Result>& vMR, Spectrum& s, Spectrum& mask, int index);
   int     CompareData(const void*, const void*);
+  void    ExportBatches(FILE* fout, bool& bFirst, int maxPending);
   double  LinReg(vector<float>& mer, vector<float>& obs);
   bool    MatchSubSpectrum(Spectrum& s, int peakIndex, pepHit& pep);
-  double  PeakMatcher(vector<Result>& vMR, Spectrum& s, double lower, double upper, double deltaM, int matchIndex, int& matchCount, int& indexOverlap, vector<int>& vMatchIndex, vector<float>& vMatchIntensity);
+  double  PeakMatcher(vector<Result>& vMR, Spectrum& s, Spectrum& mask, double lower, double upper, double deltaM, int matchIndex, int& matchCount, int& indexOverlap, vector<int>& vMatchIndex, vector<float>& vMatchIntensity);
   double  PeakMatcherB(vector<Result>& vMR, Spectrum& s, double lower, double upper, double deltaM, int matchIndex, int& matchCount, vector<int>& vMatchIndex, vector<float>& vMatchIntensity);
   void    QuickHardklor(Spectrum& s, vector<pepHit>& vPeps);
   void    RefineHits(vector<pepHit>& vPeps, Spectrum& s);
   void    ResultToMem(pepHit& ph, Spectrum& s);
+  void    WriteBatch(hkBatch& b, FILE* fout, bool& bFirst);
   void    WritePepLine(pepHit& ph, Spectrum& s, FILE* fptr, int format=0); 
   void    WriteScanLine(Spectrum& s, FILE* fptr, int format=0); 
 
@@ -68,14 +92,27 @@ class CHardklor2{
   CMercury8*        mercury;
   CModelLibrary*    models;
   CPeriodicTable*   PT;
-  Spectrum          mask;
   hkMem             hkm;
   bool              bEcho;
   bool              bMem;
   int               currentScanNumber;
-
-  //Vector for holding results in memory should that be needed
+  int               threads;
+
+  //Batches waiting for the analysis threads, batches analyzed but not yet
+  //exported (by batch index), and exported batches kept for reuse.
+  boost::mutex      batchMutex;
+  boost::condition_variable batchQueued;
+  boost::condition_variable batchDone;
+  deque<hkBatch*>   qBatches;
+  map<int,hkBatch*> mDoneBatches;
+  vector<hkBatch*>  vFreeBatches;
+  int               nextBatchIn;
+  int               nextBatchOut;
+  bool              bStopThreads;
+
+  //Vectors for holding results in memory should that be needed
   vector<hkMem> vResults;
+  vector<hkScan> vScans;
 
   //Temporary Data Members:
   char bestCh[200];
@@ -1,9 +1,62 @@
 #include "CModelLibrary.h"
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifndef _MSC_VER
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+//Layout of the model cache file: a cacheHeader, the key (padded to a multiple
+//of 8 bytes), one cacheModel per charge, variant and mass bin, and then the
+//peaks of all models. The file is only used if everything in the header and
+//the key match the current run exactly.
+static const char CACHE_MAGIC[8]={'H','K','M','O','D','E','L','\0'};
+static const int CACHE_VERSION=1;
+
+typedef struct cacheHeader{
+	char magic[8];
+	int version;
+	int peakSize;
+	int chargeMin;
+	int chargeCount;
+	int varCount;
+	int merCount;
+	long long keyLength;
+} cacheHeader;
+
+typedef struct cacheModel{
+	double zeroMass;
+	float area;
+	int size;
+	long long first;	//index of the model's first peak in the peak array
+} cacheModel;
+
+static size_t cacheKeyEnd(size_t keyLength){
+	return sizeof(cacheHeader)+(keyLength+7)/8*8;
+}
+
+//Appends the name and the contents of a data file to str
+static void addDataFile(const char* fn, string& str){
+	str+=fn;
+	str+="\n";
+	if(fn==NULL || fn[0]=='\0') return;
+	ifstream in(fn,ios::in|ios::binary);
+	if(!in.good()) return;
+	str.append(istreambuf_iterator<char>(in),istreambuf_iterator<char>());
+	str+="\n";
+}
 
 CModelLibrary::CModelLibrary(CAveragine* avg, CMercury8* mer){
 	averagine=avg;
 	mercury=mer;
   libModel=NULL;
+	bMapped=false;
+	mapAddress=NULL;
+	mapSize=0;
 
 	chargeMin=0;
 	chargeCount=0;
@@ -18,6 +71,7 @@ CModelLibrary::~CModelLibrary(){
 		eraseLibrary();
 		libModel=NULL;
 	}
+	unmapCache();
 }
 
 bool CModelLibrary::buildLibrary(int lowCharge, int highCharge, vector<CHardklorVariant>& pepVariants){
@@ -30,6 +84,7 @@ bool CModelLibrary::buildLibrary(int lowCharge, int highCharge, vector<CHardklor
 	float da;
 	double mass;
 	char av[64];
+	string key;
 
 	if(libModel!=NULL) {
 		cout << "library memory already in use." << endl;
@@ -42,6 +97,12 @@ bool CModelLibrary::buildLibrary(int lowCharge, int highCharge, vector<CHardklor
 	varCount=pepVariants.size();
 	merCount=1000;
 
+	//Reuse the models of an earlier run with the same settings
+	if(cacheFile.size()>0){
+		key=cacheKey(lowCharge,highCharge,pepVariants);
+		if(loadCache(key)) return true;
+	}
+
 	libModel = new mercuryModel**[chargeCount];
 	for(i=chargeMin;i<chargeCount;i++){
 
@@ -86,6 +147,8 @@ bool CModelLibrary::buildLibrary(int lowCharge, int highCharge, vector<CHardklor
 		}
 	}
 
+	if(cacheFile.size()>0) saveCache(key);
+
 	return true;
 
 }
@@ -98,8 +161,10 @@ void CModelLibrary::eraseLibrary(){
 
 	for(i=chargeMin;i<chargeCount;i++){
 		for(j=0;j<varCount;j++){
-			for(k=0;k<merCount;k++){
-				delete [] libModel[i][j][k].peaks;
+			if(!bMapped){
+				for(k=0;k<merCount;k++){
+					delete [] libModel[i][j][k].peaks;
+				}
 			}
 			delete [] libModel[i][j];
 		}
@@ -108,6 +173,7 @@ void CModelLibrary::eraseLibrary(){
 	delete [] libModel;
 
 	libModel=NULL;
+	unmapCache();
 	
 }
 
@@ -116,4 +182,196 @@ mercuryModel* CModelLibrary::getModel(int charge, int var, double mz){
 	int intMZ=(int)(mz/5);
 	return &libModel[charge][var][intMZ];
 
-}
\ No newline at end of file
+}
+
+//Sets the file in which models are cached between runs. The isotope and
+//periodic table data files are part of the cache key, so editing them causes
+//the models to be recomputed.
+void CModelLibrary::setCacheFile(const char* fn, const char* isoFile, const char* hkFile){
+	cacheFile=fn;
+	dataFiles.clear();
+	addDataFile(isoFile,dataFiles);
+	addDataFile(hkFile,dataFiles);
+}
+
+string CModelLibrary::cacheKey(int lowCharge, int highCharge, vector<CHardklorVariant>& pepVariants){
+
+	int i;
+	unsigned int j;
+	char str[256];
+	string key;
+
+	sprintf(str,"charge %d-%d, %d bins\n",lowCharge,highCharge,merCount);
+	key=str;
+	for(j=0;j<pepVariants.size();j++){
+		key+="variant";
+		for(i=0;i<pepVariants[j].sizeAtom();i++){
+			sprintf(str," %d:%d",pepVariants[j].atAtom(i).iLower,pepVariants[j].atAtom(i).iUpper);
+			key+=str;
+		}
+		for(i=0;i<pepVariants[j].sizeEnrich();i++){
+			sprintf(str," %d:%d:%.6lf",pepVariants[j].atEnrich(i).atomNum,pepVariants[j].atEnrich(i).isotope,pepVariants[j].atEnrich(i).ape);
+			key+=str;
+		}
+		key+="\n";
+	}
+	key+=dataFiles;
+	return key;
+
+}
+
+//Memory-maps the cache file and points the models at the peaks in it.
+//Returns false, leaving the library empty, if the file is missing or was
+//made with other settings.
+bool CModelLibrary::loadCache(string& key){
+
+	int i,j,k;
+	size_t n;
+	struct stat fileInfo;
+
+	if(stat(cacheFile.c_str(),&fileInfo)!=0) return false;
+	mapSize=(size_t)fileInfo.st_size;
+	if(mapSize<sizeof(cacheHeader)) return false;
+
+#ifdef _MSC_VER
+	mapAddress=stub_mmap(cacheFile.c_str(),&unmapInfo);
+	if(mapAddress==NULL) return false;
+#else
+	int fd=open(cacheFile.c_str(),O_RDONLY);
+	if(fd<0) return false;
+	mapAddress=mmap(NULL,mapSize,PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+	if(mapAddress==MAP_FAILED) {
+		mapAddress=NULL;
+		return false;
+	}
+#endif
+	bMapped=true;
+
+	char* data=(char*)mapAddress;
+	cacheHeader* h=(cacheHeader*)data;
+	size_t modelCount=(size_t)(chargeCount-chargeMin)*varCount*merCount;
+	size_t keyEnd=cacheKeyEnd(key.size());
+	size_t peakStart=keyEnd+modelCount*sizeof(cacheModel);
+	if(memcmp(h->magic,CACHE_MAGIC,sizeof(CACHE_MAGIC))!=0 ||
+		h->version!=CACHE_VERSION ||
+		h->peakSize!=(int)sizeof(Peak_T) ||
+		h->chargeMin!=chargeMin ||
+		h->chargeCount!=chargeCount ||
+		h->varCount!=varCount ||
+		h->merCount!=merCount ||
+		h->keyLength!=(long long)key.size() ||
+		mapSize<peakStart ||
+		memcmp(data+sizeof(cacheHeader),key.data(),key.size())!=0) {
+		unmapCache();
+		return false;
+	}
+
+	//Check that every model lies inside the file before using any of them
+	cacheModel* rec=(cacheModel*)(data+keyEnd);
+	Peak_T* peaks=(Peak_T*)(data+peakStart);
+	long long peakCount=(long long)((mapSize-peakStart)/sizeof(Peak_T));
+	for(n=0;n<modelCount;n++){
+		if(rec[n].size<0 || rec[n].first<0 || rec[n].first+rec[n].size>peakCount){
+			cout << "Model library cache " << cacheFile << " is damaged; rebuilding it." << endl;
+			unmapCache();
+			return false;
+		}
+	}
+
+	libModel = new mercuryModel**[chargeCount];
+	for(i=chargeMin;i<chargeCount;i++){
+		libModel[i] = new mercuryModel*[varCount];
+		for(j=0;j<varCount;j++){
+			libModel[i][j] = new mercuryModel[merCount];
+			for(k=0;k<merCount;k++){
+				libModel[i][j][k].area = rec->area;
+				libModel[i][j][k].size = rec->size;
+				libModel[i][j][k].zeroMass = rec->zeroMass;
+				libModel[i][j][k].peaks = (rec->size>0 ? peaks+rec->first : NULL);
+				rec++;
+			}
+		}
+	}
+
+	return true;
+
+}
+
+//Writes the library to the cache file. The file is written under a temporary
+//name first, so that other runs never map a partly written file.
+bool CModelLibrary::saveCache(string& key){
+
+	int i,j,k;
+	cacheHeader h;
+	cacheModel rec;
+	char pad[8];
+	bool ok;
+
+	string tmpFile=cacheFile+".tmp";
+	FILE* f=fopen(tmpFile.c_str(),"wb");
+	if(f==NULL){
+		cout << "Cannot write model library cache " << cacheFile << endl;
+		return false;
+	}
+
+	memset(&h,0,sizeof(cacheHeader));
+	memcpy(h.magic,CACHE_MAGIC,sizeof(CACHE_MAGIC));
+	h.version=CACHE_VERSION;
+	h.peakSize=sizeof(Peak_T);
+	h.chargeMin=chargeMin;
+	h.chargeCount=chargeCount;
+	h.varCount=varCount;
+	h.merCount=merCount;
+	h.keyLength=key.size();
+	fwrite(&h,sizeof(cacheHeader),1,f);
+	fwrite(key.data(),1,key.size(),f);
+	memset(pad,0,sizeof(pad));
+	fwrite(pad,1,cacheKeyEnd(key.size())-sizeof(cacheHeader)-key.size(),f);
+
+	memset(&rec,0,sizeof(cacheModel));
+	rec.first=0;
+	for(i=chargeMin;i<chargeCount;i++){
+		for(j=0;j<varCount;j++){
+			for(k=0;k<merCount;k++){
+				rec.zeroMass=libModel[i][j][k].zeroMass;
+				rec.area=libModel[i][j][k].area;
+				rec.size=libModel[i][j][k].size;
+				fwrite(&rec,sizeof(cacheModel),1,f);
+				rec.first+=rec.size;
+			}
+		}
+	}
+	for(i=chargeMin;i<chargeCount;i++){
+		for(j=0;j<varCount;j++){
+			for(k=0;k<merCount;k++){
+				if(libModel[i][j][k].size>0) fwrite(libModel[i][j][k].peaks,sizeof(Peak_T),libModel[i][j][k].size,f);
+			}
+		}
+	}
+
+	ok=(ferror(f)==0);
+	if(fclose(f)!=0) ok=false;
+	if(ok){
+		remove(cacheFile.c_str());
+		ok=(rename(tmpFile.c_str(),cacheFile.c_str())==0);
+	}
+	if(!ok){
+		remove(tmpFile.c_str());
+		cout << "Cannot write model library cache " << cacheFile << endl;
+	}
+	return ok;
+
+}
+
+void CModelLibrary::unmapCache(){
+	if(!bMapped) return;
+#ifdef _MSC_VER
+	stub_unmmap(&unmapInfo);
+#else
+	munmap(mapAddress,mapSize);
+#endif
+	mapAddress=NULL;
+	mapSize=0;
+	bMapped=false;
+}
@@ -5,7 +5,11 @@
 #include "CAveragine.h"
 #include "CMercury8.h"
 #include "CHardklorVariant.h"
+#include <string>
 #include <vector>
+#ifdef _MSC_VER
+#include "util/WinCrux.h"
+#endif
 
 using namespace std;
 
@@ -20,11 +24,18 @@ public:
 	bool buildLibrary(int lowCharge, int highCharge, vector<CHardklorVariant>& pepVariants);
 	void eraseLibrary();
 	mercuryModel* getModel(int charge, int var, double mz);
+	void setCacheFile(const char* fn, const char* isoFile, const char* hkFile);
 
 protected:
 
 private:
 
+	//Methods
+	string cacheKey(int lowCharge, int highCharge, vector<CHardklorVariant>& pepVariants);
+	bool loadCache(string& key);
+	bool saveCache(string& key);
+	void unmapCache();
+
 	//Data Members
 	int chargeMin;
 	int chargeCount;
@@ -35,6 +46,19 @@ private:
 	CMercury8* mercury;
 	mercuryModel*** libModel;
 
+	//Cache file holding the models of a previous run, and the contents of the
+	//data files the models were computed from
+	string cacheFile;
+	string dataFiles;
+
+	//Set when the model peaks point into the memory-mapped cache file
+	bool bMapped;
+	void* mapAddress;
+	size_t mapSize;
+#ifdef _MSC_VER
+	SIMPLE_UNMMAP unmapInfo;
+#endif
+
 };
 
 #endif
\ No newline at end of file
@@ -3,6 +3,7 @@
 CNoiseReduction::CNoiseReduction(){
   pos=0;
   posA=0;
+  lastScan=0;
   strcpy(lastFile,"");
 }
 
@@ -11,6 +12,7 @@ CNoiseReduction::CNoiseReduction(MSReader* msr, CHardklorSetting& hs){
   cs=hs;
   pos=0;
   posA=0;
+  lastScan=0;
   strcpy(lastFile,"");
 }
 
@@ -516,35 +518,36 @@ bool CNoiseReduction::ScanAverage(Spectrum& sp, char* file, int width, float cut
 }
 
 bool CNoiseReduction::NewScanAverage(Spectrum& sp, char* file, int width, float cutoff, int scanNum){
+  vector<Spectrum> win;
+
+  sp.clear();
+  if(!NextWindow(win,file,width,false,scanNum)) return false;
+  AverageWindow(sp,win);
+  return true;
+}
+
+//Reads the pivot scan of the next window, followed by up to width neighbors on
+//each side. Neighbors must have the same raw filter as the pivot if bFilter is
+//set, otherwise the same MS level as the settings. If file is not null, a new
+//buffer is started at scanNum (or the first scan).
+//Every scan is decoded only once: scans stay in the buffer until no later window
+//can use them, and the reader is only repositioned when it is not already sitting
+//at the end of the buffer.
+bool CNoiseReduction::NextWindow(vector<Spectrum>& win, char* file, int width, bool bFilter, int scanNum){
   
   Spectrum ts;
 
-  vector<int> vPos;
-   
   int i;
-  int j;
-  int k;
-  int m;
   int widthCount=0;
-  int numScans=1;
-  double dif;
-  double prec;
-  double dt;
-  double c;
 
   bool bLeft=true;
   int posLeft;
   int posRight;
   int index;
   char cFilter1[256];
-  //char cFilter2[256];
-
-  //double slope;
-  //double intercept;
+  char cFilter2[256];
 
-  sp.clear();
-  Spectrum* specs;
-  specs = new Spectrum[width*2+1];
+  win.clear();
 
   //if file is not null, create new buffer
   if(file!=NULL){
@@ -552,25 +555,19 @@ bool CNoiseReduction::NewScanAverage(Spectrum& sp, char* file, int width, float
     bs.clear();
     if(scanNum>0) r->readFile(file,ts,scanNum);
     else r->readFile(file,ts);
-    if(ts.getScanNumber()==0) {
-      delete [] specs;
-      return false;
-    }
+    lastScan=ts.getScanNumber();
+    if(ts.getScanNumber()==0) return false;
     bs.push_back(ts);
-    specs[0]=bs[0];
-    c=CParam(specs[0],3);
     posA=0;
   } else {
     posA++;
-    if(posA>=(int)bs.size()) { //end of buffer, no more data
-      delete [] specs;
-      return false; 
-    }
-    specs[0]=bs[posA];
-    c=CParam(specs[0],3);
+    if(posA>=(int)bs.size()) return false; //end of buffer, no more data
   }
 
-  specs[0].getRawFilter(cFilter1,256);
+  //set our pivot spectrum
+  win.reserve(width*2+1);
+  win.push_back(bs[posA]);
+  win[0].getRawFilter(cFilter1,256);
 
   posLeft=posA;
   posRight=posA;
@@ -591,6 +588,7 @@ bool CNoiseReduction::NewScanAverage(Spectrum& sp, char* file, int width, float
             i--;
             if(i==0) break;
             r->readFile(lastFile,ts,i);
+            lastScan=ts.getScanNumber();
             if(ts.getScanNumber()==0) continue;
             else break;
           }
@@ -599,14 +597,14 @@ bool CNoiseReduction::NewScanAverage(Spectrum& sp, char* file, int width, float
           posA++;
           posRight++;
           posLeft=0;
-          //ts.getRawFilter(cFilter2,256);
-          if(ts.getMsLevel()==cs.msLevel) {
+          if(bFilter) ts.getRawFilter(cFilter2,256);
+          if(bFilter ? strcmp(cFilter1,cFilter2)==0 : ts.getMsLevel()==cs.msLevel) {
             index=posLeft;
             break;
           }
         } else {
-          //bs[posLeft].getRawFilter(cFilter2,256);
-          if(bs[posLeft].getMsLevel()==cs.msLevel) {
+          if(bFilter) bs[posLeft].getRawFilter(cFilter2,256);
+          if(bFilter ? strcmp(cFilter1,cFilter2)==0 : bs[posLeft].getMsLevel()==cs.msLevel) {
             index=posLeft;
             break;
           }
@@ -620,21 +618,22 @@ bool CNoiseReduction::NewScanAverage(Spectrum& sp, char* file, int width, float
       while(true){
         posRight++;
         if(posRight>=(int)bs.size()) { //buffer is too short on right, add spectra
-          r->readFile(lastFile,ts,bs[bs.size()-1].getScanNumber());
+          if(lastScan!=bs.back().getScanNumber()) r->readFile(lastFile,ts,bs.back().getScanNumber());
           r->readFile(NULL,ts);
+          lastScan=ts.getScanNumber();
           if(ts.getScanNumber()==0) {
             posRight--;
             break;
           }
           bs.push_back(ts);
-          //ts.getRawFilter(cFilter2,256);
-          if(ts.getMsLevel()==cs.msLevel) {
+          if(bFilter) ts.getRawFilter(cFilter2,256);
+          if(bFilter ? strcmp(cFilter1,cFilter2)==0 : ts.getMsLevel()==cs.msLevel) {
             index=posRight;
             break;
           }
         } else {
-          //bs[posRight].getRawFilter(cFilter2,256);
-          if(bs[posRight].getMsLevel()==cs.msLevel) {
+          if(bFilter) bs[posRight].getRawFilter(cFilter2,256);
+          if(bFilter ? strcmp(cFilter1,cFilter2)==0 : bs[posRight].getMsLevel()==cs.msLevel) {
             index=posRight;
             break;
           }
@@ -643,76 +642,88 @@ bool CNoiseReduction::NewScanAverage(Spectrum& sp, char* file, int width, float
     }
 
     if(index==-1)  continue;
-    specs[numScans++]=bs[index];
+    win.push_back(bs[index]);
 
   }
-  
+
+  //clear unused buffer
+  while(posLeft>0){
+    bs.pop_front();
+    posLeft--;
+    posA--;
+  }
+
+  return true;
+}
+
+//Averages every scan of the window with the matching points of the scans that
+//follow it. Matched points are used up, so the window is modified. Only the
+//settings are read, so several windows can be averaged at once on different threads.
+void CNoiseReduction::AverageWindow(Spectrum& sp, vector<Spectrum>& win){
+
+  vector<int> vPos;
+  vector<int> vSize;
+  vector<Peak_T*> vPeaks;
+
+  int i;
+  int j;
+  int k;
+  int m;
+  int numScans=(int)win.size();
+  int mzcount;
+  double dif;
+  double prec;
+  double dt;
+  double c;
   double tmz;
-  int mzcount=0;
+  char cFilter1[256];
+  Peak_T* p;
+  Peak_T* q;
 
-  /* Ledford equation correction
-  double freq;
-  double conA=0.0;
-  double conB=0.0;
+  sp.clear();
+  if(numScans==0) return;
 
-  for(m=0;m<numScans;m++){
-    conA+=specs[m].getConversionA();
-    conB+=specs[m].getConversionB();
-  }
-  conA/=numScans;
-  conB/=numScans;
+  c=CParam(win[0],3);
+  win[0].getRawFilter(cFilter1,256);
 
-  printf("%.10lf, %.10lf\n",conA,conB);
+  //The points of each scan are in m/z order, so they are merged with one cursor
+  //per neighbor, walking the peak arrays directly.
+  vSize.resize(numScans);
+  vPeaks.resize(numScans);
   for(k=0;k<numScans;k++){
-    for(j=0;j<specs[k].size();j++){
-      freq = sqrt(specs[k].getConversionA()*specs[k].getConversionA() - (4*specs[k].at(j).mz*(-specs[k].getConversionB())));
-      freq += specs[k].getConversionA();
-      freq /= (2*specs[k].at(j).mz);
-
-      specs[k].at(j).mz = conA/freq + conB/(freq*freq);
-    }
+    vSize[k]=win[k].size();
+    vPeaks[k]=(vSize[k]>0 ? &win[k].at(0) : NULL);
   }
-  */
 
   //Match peaks between pivot scan (0) and neighbors (the rest)
   for(m=0;m<numScans;m++){
     
-    vPos.clear();
-    for(i=0;i<numScans;i++) vPos.push_back(0);
+    vPos.assign(numScans,0);
 
-    for(i=0;i<specs[m].size();i++){ //iterate all points
-      if(specs[m].at(i).intensity<0.1) continue;
-      tmz=specs[m].at(i).mz;
+    for(i=0;i<vSize[m];i++){ //iterate all points
+      p=&vPeaks[m][i];
+      if(p->intensity<0.1) continue;
+      tmz=p->mz;
       mzcount=1;
       prec = c * tmz * tmz / 2;
       
       for(k=m+1;k<numScans;k++){ //iterate all neighbors
         dif=100000.0;
 
-        for(j=vPos[k];j<specs[k].size();j++){ //check if point is a match
-          if(specs[k].at(j).intensity<0.1) continue; //skip meaningless datapoints to speed along
-          dt=fabs(tmz-specs[k].at(j).mz);
+        for(j=vPos[k];j<vSize[k];j++){ //check if point is a match
+          q=&vPeaks[k][j];
+          if(q->intensity<0.1) continue; //skip meaningless datapoints to speed along
+          dt=fabs(tmz-q->mz);
 
           if(dt<=dif) {
             if(dt<prec) {
-              //linear interpolate
-              //if(specs[k].at(j).mz<tmz && j<specs[k].size()-1){
-              //  slope=(specs[k].at(j+1).intensity-specs[k].at(j).intensity)/(specs[k].at(j+1).mz-specs[k].at(j).mz);
-              //  intercept=specs[k].at(j).intensity-specs[k].at(j).mz*slope;
-              //  specs[m].at(i).intensity+=(tmz*slope+intercept);
-              //} else if(specs[k].at(j).mz>tmz && j>0) {
-              //  slope=(specs[k].at(j).intensity-specs[k].at(j-1).intensity)/(specs[k].at(j).mz-specs[k].at(j-1).mz);
-              //  intercept=specs[k].at(j).intensity-specs[k].at(j).mz*slope;
-              //  specs[m].at(i).intensity+=(tmz*slope+intercept);
-              //} else {
-              specs[m].at(i).intensity += specs[k].at(j).intensity;
-              //}
+              p->intensity += q->intensity;
 
               //Averaging the mz values appears equivalent to realigning all spectra against
               //an average Ledford correction.
-              specs[m].at(i).mz += specs[k].at(j).mz;
+              p->mz += q->mz;
               vPos[k]=j+1;
-              specs[k].at(j).intensity=-1.0;
+              q->intensity=-1.0;
               mzcount++;
               break;
             }
@@ -724,26 +735,16 @@ bool CNoiseReduction::NewScanAverage(Spectrum& sp, char* file, int width, float
         }
       }//for k
 
-      sp.add(specs[m].at(i).mz/mzcount,specs[m].at(i).intensity/numScans);
+      sp.add(p->mz/mzcount,p->intensity/numScans);
 
     } //next i
   } //next m
 
   if(sp.size()>0) sp.sortMZ();
-  sp.setScanNumber(specs[0].getScanNumber());
-  sp.setScanNumber(specs[0].getScanNumber(true),true);
-  sp.setRTime(specs[0].getRTime());
+  sp.setScanNumber(win[0].getScanNumber());
+  sp.setScanNumber(win[0].getScanNumber(true),true);
+  sp.setRTime(win[0].getRTime());
   sp.setRawFilter(cFilter1);
-
-  if(posLeft>0){
-    while(posLeft>0){
-      bs.pop_front();
-      posLeft--;
-      posA--;
-    }
-  }
-  delete [] specs;
-  return true;
 }
 
 /*
@@ -1340,51 +1341,50 @@ bool CNoiseReduction::DeNoiseB(Spectrum& sp){
 }
 
 bool CNoiseReduction::DeNoiseC(Spectrum& sp){
-
-  Spectrum tmpSpec;  
-  vector<int> v;
+  vector<Spectrum> win;
 
   sp.clear();
-
-  if(pos==0){
-    if(cs.scan.iLower>0) {
-      if(!NewScanAveragePlusDeNoise(sp,cs.inFile,(int)(cs.boxcar/2),0.1f,cs.scan.iLower)) return false;
-    } else {
-      NewScanAveragePlusDeNoise(sp,cs.inFile,(int)(cs.boxcar/2),0.1f);
-    }
-    pos=1;
-  } else {
-    NewScanAveragePlusDeNoise(sp,NULL,(int)(cs.boxcar/2),0.1f);
-  }
-
-  if(sp.getScanNumber()==0) return false;
-  FirstDerivativePeaks(sp,1);
-  return true;
-
+  if(!ReadWindow(win,true)) return false;
+  return DeNoiseWindow(sp,win,true);
 }
 
 bool CNoiseReduction::DeNoiseD(Spectrum& sp){
-
-  Spectrum tmpSpec;  
-  vector<int> v;
+  vector<Spectrum> win;
 
   sp.clear();
+  if(!ReadWindow(win,false)) return false;
+  return DeNoiseWindow(sp,win,false);
+}
+
+//Reads the next boxcar window for DeNoiseC (bFilter=true) or DeNoiseD (bFilter=false).
+//Windows must be read in scan order, but can then be handed to DeNoiseWindow in
+//any order, or on several threads.
+bool CNoiseReduction::ReadWindow(vector<Spectrum>& win, bool bFilter){
+  bool b;
 
   if(pos==0){
     if(cs.scan.iLower>0) {
-      if(!NewScanAverage(sp,cs.inFile,(int)(cs.boxcar/2),0.1f,cs.scan.iLower)) return false;
+      if(!NextWindow(win,cs.inFile,(int)(cs.boxcar/2),bFilter,cs.scan.iLower)) return false;
+      b=true;
     } else {
-      NewScanAverage(sp,cs.inFile,(int)(cs.boxcar/2),0.1f);
+      b=NextWindow(win,cs.inFile,(int)(cs.boxcar/2),bFilter);
     }
     pos=1;
   } else {
-    NewScanAverage(sp,NULL,(int)(cs.boxcar/2),0.1f);
+    b=NextWindow(win,NULL,(int)(cs.boxcar/2),bFilter);
   }
+  return b;
+}
+
+//Averages a window from ReadWindow and picks its peaks. Thread safe.
+bool CNoiseReduction::DeNoiseWindow(Spectrum& sp, vector<Spectrum>& win, bool bFilter){
+  sp.clear();
+  if(bFilter) AverageWindowPlusDeNoise(sp,win);
+  else AverageWindow(sp,win);
 
   if(sp.getScanNumber()==0) return false;
   FirstDerivativePeaks(sp,1);
   return true;
-
 }
 
 double CNoiseReduction::CParam(Spectrum& sp, int tot){
@@ -1411,216 +1411,91 @@ double CNoiseReduction::CParam(Spectrum& sp, int tot){
 }
 
 bool CNoiseReduction::NewScanAveragePlusDeNoise(Spectrum& sp, char* file, int width, float cutoff, int scanNum){
-  
-  Spectrum ts;
+  vector<Spectrum> win;
+
+  sp.clear();
+  if(!NextWindow(win,file,width,true,scanNum)) return false;
+  AverageWindowPlusDeNoise(sp,win);
+  return true;
+}
+
+//Averages the pivot scan (0) of the window with its neighbors, keeping only points
+//seen in enough scans (boxcarFilter). Like AverageWindow, the window is modified
+//and only the settings are read.
+void CNoiseReduction::AverageWindowPlusDeNoise(Spectrum& sp, vector<Spectrum>& win){
 
   vector<int> vPos;
- 
+  vector<int> vSize;
+  vector<Peak_T*> vPeaks;
+
   int i;
   int j;
   int k;
-  int m;
-  int widthCount=0;
-  int numScans=1;
+  int numScans=(int)win.size();
   int match;
   double dif;
   double prec;
   double dt;
   double c;
-
-  bool bLeft=true;
-  int posLeft;
-  int posRight;
-  int index;
   char cFilter1[256];
-  char cFilter2[256];
+  Peak_T* p;
+  Peak_T* q;
 
   sp.clear();
+  if(numScans==0) return;
 
-  Spectrum* specs;
-  specs = new Spectrum[width*2+1];
+  c=CParam(win[0],3);
+  win[0].getRawFilter(cFilter1,256);
 
-  //if file is not null, create new buffer
-  if(file!=NULL){
-    strcpy(lastFile,file);
-    bs.clear();
-    if(scanNum>0) r->readFile(file,ts,scanNum);
-    else r->readFile(file,ts);
-    if(ts.getScanNumber()==0) {
-      delete [] specs;
-      return false;
-    }
-    bs.push_back(ts);
-    specs[0]=bs[0];
-    c=CParam(specs[0],3);
-    posA=0;
-  } else {
-    posA++;
-    if(posA>=(int)bs.size()) { //end of buffer, no more data
-      delete [] specs;
-      return false; 
-    }
-    specs[0]=bs[posA];
-    c=CParam(specs[0],3);
+  vSize.resize(numScans);
+  vPeaks.resize(numScans);
+  for(k=0;k<numScans;k++){
+    vSize[k]=win[k].size();
+    vPeaks[k]=(vSize[k]>0 ? &win[k].at(0) : NULL);
   }
+  vPos.assign(numScans,0);
 
-  //set our pivot spectrum
-  specs[0].getRawFilter(cFilter1,256);
-
-  posLeft=posA;
-  posRight=posA;
-  while(widthCount<(width*2)){
-
-    index=-1;
-
-    //Alternate looking left and right
-    if(bLeft){
-      bLeft=false;
-      widthCount++;
-      
-      while(true){
-        posLeft--;
-        if(posLeft<0) { //buffer is too short on left, add spectra
-          i=bs[0].getScanNumber();
-          while(true){
-            i--;
-            if(i==0) break;
-            r->readFile(lastFile,ts,i);
-            if(ts.getScanNumber()==0) continue;
-            else break;
-          }
-          if(i==0) break;
-          bs.push_front(ts);
-          posA++;
-          posRight++;
-          posLeft=0;
-          ts.getRawFilter(cFilter2,256);
-          if(strcmp(cFilter1,cFilter2)==0) {
-            index=posLeft;
-            break;
-          }
-        } else {
-          bs[posLeft].getRawFilter(cFilter2,256);
-          if(strcmp(cFilter1,cFilter2)==0) {
-            index=posLeft;
-            break;
-          }
-        }
-      }
+  //Match peaks between pivot scan (0) and neighbors (the rest)
+  for(i=0;i<vSize[0];i++){ //iterate all points
+    p=&vPeaks[0][i];
+    if(p->intensity<0.1) continue;
+    prec = c * p->mz * p->mz / 2;
+    match=1;
 
-    } else {
-      bLeft=true;
-      widthCount++;
+    for(k=1;k<numScans;k++){ //iterate all neighbors
+      dif=100000.0;
 
-      while(true){
-        posRight++;
-        if(posRight>=(int)bs.size()) { //buffer is too short on right, add spectra
-          r->readFile(lastFile,ts,bs[bs.size()-1].getScanNumber());
-          r->readFile(NULL,ts);
-          if(ts.getScanNumber()==0) {
-            posRight--;
-            break;
-          }
-          bs.push_back(ts);
-          ts.getRawFilter(cFilter2,256);
-          if(strcmp(cFilter1,cFilter2)==0) {
-            index=posRight;
+      for(j=vPos[k];j<vSize[k];j++){ //check if point is a match
+        q=&vPeaks[k][j];
+        if(q->intensity<0.1) continue; //skip meaningless datapoints to speed along
+        dt=fabs(p->mz-q->mz);
+        if(dt<=dif) {
+          if(dt<prec) {
+            p->intensity+=q->intensity;
+            vPos[k]=j+1;
+            q->intensity=-1.0;
+            match++;
             break;
           }
+          dif=dt;
         } else {
-          bs[posRight].getRawFilter(cFilter2,256);
-          if(strcmp(cFilter1,cFilter2)==0) {
-            index=posRight;
-            break;
-          }
+          vPos[k]=j-1;
+          break;
         }
       }
-    }
-
-    if(index==-1)  continue;
-   
-    //ts=bs[index];
-    specs[numScans++]=bs[index];
-
-    //cout << "NumScans: " << numScans << endl;
-
-  }
-
-  //Match peaks between pivot scan (0) and neighbors (the rest)
-  //for(m=0;m<cs.ppMatch && m<numScans;m++){
-  for(m=0;m<1;m++){
-
-    //cout << "m " << m << " = " << specs[m].getScanNumber() << endl;
-    
-    vPos.clear();
-    for(i=0;i<numScans;i++) vPos.push_back(0);
-    //cout << "Checking " << m << " of " << numScans << " points remaining: " << specs[m].size() << endl;
-
-    for(i=0;i<specs[m].size();i++){ //iterate all points
-      if(specs[m].at(i).intensity<0.1) continue;
-      prec = c * specs[m].at(i).mz * specs[m].at(i).mz / 2;
-      match=1;
-
-      for(k=m+1;k<numScans;k++){ //iterate all neighbors
-        dif=100000.0;
-
-        for(j=vPos[k];j<specs[k].size();j++){ //check if point is a match
-          //cout << "Checking " << j << " of " << specs[k].size() << endl;
-          if(specs[k].at(j).intensity<0.1) continue; //skip meaningless datapoints to speed along
-          dt=fabs(specs[m].at(i).mz-specs[k].at(j).mz);
-          //dt=specs[m].at(i).mz-specs[k].at(j).mz;
-          //if(dt<0.0)dt=-dt;
-          if(dt<=dif) {
-            if(dt<prec) {
-              specs[m].at(i).intensity+=specs[k].at(j).intensity;
-              vPos[k]=j+1;
-              specs[k].at(j).intensity=-1.0;
-              match++;
-              break;
-            }
-            dif=dt;
-          } else {
-            vPos[k]=j-1;
-            break;
-          }
-        }
-
-      }//for k
 
-      //if data point was not visible across enough scans, set it to 0
-			if(match<cs.boxcarFilter && match<numScans) {
-        //ignore point
-        //cout << "BAH! " << specs[m].at(i).mz << " has " << match << " matches." << endl;
-      } else {
-        //add to temp spectrum
-        //cout << specs[m].at(i).mz << " has " << match << " matches." << endl;
-        //sp.add(specs[m].at(i).mz,specs[m].at(i).intensity/numScans);
-        sp.add(specs[m].at(i).mz,specs[m].at(i).intensity/match);
-      }
+    }//for k
 
-    } //next i
+    //if data point was not visible across enough scans, ignore it
+    if(match>=cs.boxcarFilter || match>=numScans) sp.add(p->mz,p->intensity/match);
 
-  } //next m
+  } //next i
 
   //sort
-  //cout << "Done " << sp.size() << endl;
   if(sp.size()>0) sp.sortMZ();
-  sp.setScanNumber(specs[0].getScanNumber());
-  sp.setScanNumber(specs[0].getScanNumber(true),true);
-  sp.setRTime(specs[0].getRTime());
+  sp.setScanNumber(win[0].getScanNumber());
+  sp.setScanNumber(win[0].getScanNumber(true),true);
+  sp.setRTime(win[0].getRTime());
   sp.setRawFilter(cFilter1);
-
-  //clear unused buffer
-  if(posLeft>0){
-    while(posLeft>0){
-      bs.pop_front();
-      posLeft--;
-      posA--;
-    }
-  }
-
-  delete [] specs;
-
-  return true;
 }
 
@@ -7,6 +7,7 @@
 #include <cmath>
 #include <iostream>
 #include <deque>
+#include <vector>
 
 #define GC 5.5451774444795623
 
@@ -29,6 +30,7 @@ public:
   bool DeNoiseB(Spectrum& sp);
   bool DeNoiseC(Spectrum& sp);
   bool DeNoiseD(Spectrum& sp);
+  bool DeNoiseWindow(Spectrum& sp, vector<Spectrum>& win, bool bFilter);
   int NearestPeak(Spectrum& sp, double mz);
   bool ScanAverage(Spectrum& sp, char* file, int width, float cutoff);
   bool NewScanAverage(Spectrum& sp, char* file, int width, float cutoff, int scanNum=0);
@@ -37,16 +39,20 @@ public:
   //bool ScanAverageBuffered(Spectrum& sp, char* file, int width, float cutoff, int scanNum=0);
   bool ScanAveragePlusDeNoise(Spectrum& sp, char* file, int width, float cutoff, int scanNum=0);
   bool NewScanAveragePlusDeNoise(Spectrum& sp, char* file, int width, float cutoff, int scanNum=0);
+  bool ReadWindow(vector<Spectrum>& win, bool bFilter);
 
   int pos;
 
 private:
   //Functions
-  
+  void AverageWindow(Spectrum& sp, vector<Spectrum>& win);
+  void AverageWindowPlusDeNoise(Spectrum& sp, vector<Spectrum>& win);
+  bool NextWindow(vector<Spectrum>& win, char* file, int width, bool bFilter, int scanNum=0);
   
   //Data Members
   //int pos;
   int posA;
+  int lastScan; //scan number the reader last returned
   char lastFile[256];
   CHardklorSetting cs;
   MSReader* r;
@@ -15,6 +15,8 @@
 #include "util/StringUtils.h"
 #include "io/DelimitedFileWriter.h"
 
+#include <boost/thread.hpp>
+
 using namespace std;
 
 CruxHardklorApplication::CruxHardklorApplication() {
@@ -27,7 +29,32 @@ int CruxHardklorApplication::main(int argc, char** argv) {
   return main(Params::GetString("spectra"));
 }
 
+/**
+ * Appends the scans and results that a Hardklor run kept in memory.
+ */
+template<typename T>
+static void collectResults(T& h, vector<hkScan>* scans, vector<hkMem>* results) {
+  int offset = results->size();
+  for (int i = 0; i < h.SizeScans(); i++) {
+    hkScan scan = h.GetScan(i);
+    scan.firstResult += offset;
+    scans->push_back(scan);
+  }
+  for (int i = 0; i < h.Size(); i++) {
+    results->push_back(h[i]);
+  }
+}
+
 int CruxHardklorApplication::main(const string& ms1) {
+  return main(ms1, NULL, NULL);
+}
+
+int CruxHardklorApplication::main(
+  const string& ms1,
+  vector<hkScan>* scans,
+  vector<hkMem>* results
+) {
+  bool inMemory = (scans != NULL && results != NULL);
   carp(CARP_INFO, "Hardklor v2.19, April 10 2015");
   carp(CARP_INFO, "Mike Hoopmann, Mike MacCoss");
   carp(CARP_INFO, "Copyright 2007-2015");
@@ -95,7 +122,7 @@ int CruxHardklorApplication::main(const string& ms1) {
   }
 
   // Create all the output files that will be used
-  for (int i = 0; i< hp.size(); i++) {
+  for (int i = 0; i < hp.size() && !inMemory; i++) {
     const char* out = &hp.queue(i).outFile[0];
     if (FileUtils::Exists(out) && !Params::GetBool("overwrite")) {
       carp(CARP_FATAL, "The file '%s' already exists and cannot be overwritten. "
@@ -115,9 +142,20 @@ int CruxHardklorApplication::main(const string& ms1) {
   CAveragine* averagine = new CAveragine(hp.queue(0).MercuryFile, hp.queue(0).HardklorFile);
   CMercury8* mercury = new CMercury8(hp.queue(0).MercuryFile);
   CModelLibrary* models = new CModelLibrary(averagine, mercury);
+  string modelCache = Params::GetString("hardklor-model-cache");
+  if (!modelCache.empty()) {
+    models->setCacheFile(modelCache.c_str(), hp.queue(0).MercuryFile, hp.queue(0).HardklorFile);
+  }
 
   CHardklor h(averagine, mercury);
   CHardklor2 h2(averagine, mercury, models);
+  int numThreads = Params::GetInt("num-threads");
+  if (numThreads < 1) {
+    numThreads = boost::thread::hardware_concurrency();
+  }
+  h2.SetThreads(numThreads);
+  h.SetResultsToMemory(inMemory);
+  h2.SetResultsToMemory(inMemory);
   vector<CHardklorVariant> pepVariants;
   CHardklorVariant hkv;
 
@@ -133,8 +171,14 @@ int CruxHardklorApplication::main(const string& ms1) {
       models->eraseLibrary();
       models->buildLibrary(hp.queue(i).minCharge, hp.queue(i).maxCharge, pepVariants);
       h2.GoHardklor(hp.queue(i));
+      if (inMemory) {
+        collectResults(h2, scans, results);
+      }
     } else {
       h.GoHardklor(hp.queue(i));
+      if (inMemory) {
+        collectResults(h, scans, results);
+      }
     }
   }
 
@@ -235,6 +279,7 @@ vector<string> CruxHardklorApplication::getOptions() const {
     "depth",
     "distribution-area",
     "hardklor-data-file",
+    "hardklor-model-cache",
     "instrument",
     "isotope-data-file",
     "max-features",
@@ -250,6 +295,7 @@ vector<string> CruxHardklorApplication::getOptions() const {
     "smooth",
     "sn-window",
     "static-sn",
+    "num-threads",
     "parameter-file",
     "verbosity"
   };
@@ -11,6 +11,10 @@
 
 #include <string>
 #include <fstream>
+#include <vector>
+
+struct hkScan;
+struct hkMem;
 
 class CruxHardklorApplication: public CruxApplication {
 
@@ -57,6 +61,17 @@ class CruxHardklorApplication: public CruxApplication {
   static int main(
     const std::string& ms1 ///< file path of spectra to process
   );
+
+  /**
+   * \brief runs hardklor on the input spectra, keeping the results in memory
+   * instead of writing them to hardklor.mono.txt
+   * \returns whether hardklor was successful or not
+   */
+  static int main(
+    const std::string& ms1, ///< file path of spectra to process
+    std::vector<hkScan>* scans, ///< gets one entry per scan analyzed
+    std::vector<hkMem>* results ///< gets the isotope distributions found
+  );
   
  protected:
   static void addArg(
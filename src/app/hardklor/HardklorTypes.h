@@ -137,4 +137,12 @@ typedef struct hkMem{
   char mods[32];
 } hkMem;
 
+//for storing scans to memory for modular Hardklor runs. The results of a scan
+//start at firstResult and end where the results of the next scan start.
+typedef struct hkScan{
+  int scan;
+  float rTime;
+  int firstResult;
+} hkScan;
+
 #endif
@@ -4,6 +4,9 @@
 #include "app/ComputeQValues.h"
 #include "util/Params.h"
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
 using namespace std; 
 double Barista :: check_gradients_hinge_one_net(int protind, int label){
   int num_pep = d.protind2num_pep(protind);
@@ -269,15 +272,50 @@ double Barista :: check_gradients_hinge_clones(int protind, int label)
 }
 
 /**********************************************************/
-int Barista :: getOverFDRPSM(PSMScores &s, NeuralNet &n,double fdr)
+/*
+ * Scores every psm with net n, splitting the psms among num_threads threads.
+ * The scores are the same as those of n.fprop.
+ */
+void Barista :: score_psms(NeuralNet &n, vector<double> &scores)
 {
-  double* featVec;
-  for(int i = 0; i < s.size(); i++)
+  int num_psms = d.get_num_psms();
+  scores.resize(num_psms);
+  if((int)psm_rows.size() != num_psms)
+    {
+      psm_rows.resize(num_psms);
+      for(int i = 0; i < num_psms; i++)
+	psm_rows[i] = i;
+    }
+  if(num_psms == 0)
+    return;
+  int nthreads = min(num_threads, 1 + num_psms/4096);
+  if(nthreads <= 1)
+    {
+      n.fprop_block(d.psmind2features(0), &psm_rows[0], num_psms, &scores[0]);
+      return;
+    }
+  boost::thread_group threads;
+  for(int t = 0; t < nthreads; t++)
     {
-      featVec = d.psmind2features(s[i].psmind);
-      double *r = n.fprop(featVec);
-      s[i].score = r[0];
+      int first = (int)((long long)num_psms*t/nthreads);
+      int last = (int)((long long)num_psms*(t+1)/nthreads);
+      threads.create_thread(boost::bind(&NeuralNet::fprop_block, &n, d.psmind2features(0),
+					&psm_rows[first], last-first, &scores[first]));
     }
+  threads.join_all();
+}
+
+int Barista :: getOverFDRPSM(PSMScores &s, NeuralNet &n,double fdr)
+{
+  vector<double> scores;
+  score_psms(n, scores);
+  return getOverFDRPSM(s, scores, fdr);
+}
+
+int Barista :: getOverFDRPSM(PSMScores &s, const vector<double> &scores, double fdr)
+{
+  for(int i = 0; i < s.size(); i++)
+    s[i].score = scores[s[i].psmind];
 
   int overFDR = s.calcOverFDR(fdr);
  
@@ -321,15 +359,42 @@ double Barista :: get_peptide_score(int pepind, NeuralNet &n)
   return max_sc;
 }
 
+double Barista :: get_peptide_score(int pepind, const vector<double> &scores)
+{
+  int num_psm = d.pepind2num_psm(pepind);
+  int *psminds = d.pepind2psminds(pepind);
+  double max_sc = -100000000.0;
+  int max_ind = 0;
+  for(int i = 0; i < num_psm; i++)
+    {
+      double sc = scores[psminds[i]];
+      if(max_sc < sc)
+	{
+	  max_sc = sc;
+	  max_ind = i;
+	}
+    }
+  if((int)pepind_to_max_psmind.size() == d.get_num_peptides())
+    pepind_to_max_psmind[pepind] = psminds[max_ind];
+  return max_sc;
+}
+
 
 int Barista :: getOverFDRPep(PepScores &s, NeuralNet &n,double fdr)
+{
+  vector<double> scores;
+  score_psms(n, scores);
+  return getOverFDRPep(s, scores, fdr);
+}
+
+int Barista :: getOverFDRPep(PepScores &s, const vector<double> &scores, double fdr)
 {
   int pepind = 0;
   int label = 0;
   for(int i = 0; i < s.size(); i++)
     {
       pepind = s[i].pepind;
-      double sc = get_peptide_score(pepind,n);
+      double sc = get_peptide_score(pepind,scores);
       s[i].score = sc;
     }
 
@@ -383,6 +448,11 @@ void Barista :: clear()
   psmtrainset.clear();
   psmtestset.clear();
   delete[] net_clones; net_clones = 0;
+  for(unsigned int i = 0; i < shards.size(); i++)
+    delete shards[i];
+  shards.clear();
+  psm_scores.clear();
+  psm_rows.clear();
   max_psm_inds.clear();
   max_psm_scores.clear();
   used_peptides.clear();
@@ -1924,19 +1994,21 @@ void Barista :: report_prot_fdr_counts(vector<double> &qvals, ofstream &of)
 
 void Barista :: report_psm_fdr_counts(vector<double> &qvals, ofstream &of)
 {
+  vector<double> scores;
+  score_psms(max_net_prot, scores);
   for(unsigned int count = 0; count < qvals.size(); count++)
     {
       double q = qvals[count];
       if(psmtrainset.size() > 0)
 	{
-	  int fdr_trn = getOverFDRPSM(psmtrainset,max_net_prot,q);
+	  int fdr_trn = getOverFDRPSM(psmtrainset,scores,q);
 	  of << q << " " << fdr_trn;
 	  cout << q << " " << fdr_trn;
 	}
       
       if(psmtestset.size() > 0)
 	{
-	  int fdr_tst = getOverFDRPSM(psmtestset,max_net_prot,q);
+	  int fdr_tst = getOverFDRPSM(psmtestset,scores,q);
 	  of << " " << fdr_tst;
 	  cout << " " << fdr_tst;
 	}
@@ -1948,19 +2020,21 @@ void Barista :: report_psm_fdr_counts(vector<double> &qvals, ofstream &of)
 
 void Barista :: report_pep_fdr_counts(vector<double> &qvals, ofstream &of)
 {
+  vector<double> scores;
+  score_psms(max_net_prot, scores);
   for(unsigned int count = 0; count < qvals.size(); count++)
     {
       double q = qvals[count];
       if(peptrainset.size() > 0)
 	{
-	  int fdr_trn = getOverFDRPep(peptrainset,max_net_prot,q);
+	  int fdr_trn = getOverFDRPep(peptrainset,scores,q);
 	  of << q << " " << fdr_trn;
 	  cout << q << " " << fdr_trn;
 	}
       
       if(psmtestset.size() > 0)
 	{
-	  int fdr_tst = getOverFDRPep(peptestset,max_net_prot,q);
+	  int fdr_tst = getOverFDRPep(peptestset,scores,q);
 	  of << " " << fdr_tst;
 	  cout << " " << fdr_tst;
 	}
@@ -2045,13 +2119,46 @@ double Barista :: get_protein_score(int protind, NeuralNet &n)
   return sm;
 }
 
+double Barista :: get_protein_score(int protind, const vector<double> &scores)
+{
+  int num_pep = d.protind2num_pep(protind);
+  int num_all_pep = d.protind2num_all_pep(protind);
+  int *pepinds = d.protind2pepinds(protind);
+  double sm = 0.0;
+  double div = pow(num_all_pep,alpha);
+
+  for (int i = 0; i < num_pep; i++)
+    {
+      int pepind = pepinds[i];
+      int num_psms = d.pepind2num_psm(pepind);
+      int *psminds = d.pepind2psminds(pepind);
+      double max_sc = -1000000.0;
+
+      for (int j = 0; j < num_psms; j++)
+	{
+	  if(scores[psminds[j]] > max_sc)
+	    max_sc = scores[psminds[j]];
+	}
+      sm += max_sc;
+    }
+  sm /= div;
+  return sm;
+}
+
 int Barista :: getOverFDRProt(ProtScores &set, NeuralNet &n, double fdr)
+{
+  vector<double> scores;
+  score_psms(n, scores);
+  return getOverFDRProt(set, scores, fdr);
+}
+
+int Barista :: getOverFDRProt(ProtScores &set, const vector<double> &scores, double fdr)
 {
   double r = 0.0;
   for(int i = 0; i < set.size(); i++)
     {
       int protind = set[i].protind;
-      r = get_protein_score(protind,n);
+      r = get_protein_score(protind,scores);
       set[i].score = r;
     }
   return set.calcOverFDR(fdr);
@@ -2072,12 +2179,18 @@ int Barista :: getOverFDRProt(ProtScores &set, double fdr)
 }
 
 double Barista :: get_protein_score(int protind)
+{
+  return get_protein_score(protind, net_clones, max_psm_inds, max_psm_scores);
+}
+
+double Barista :: get_protein_score(int protind, NeuralNet *clones, vector<int> &psm_inds,
+				    vector<double> &psm_sc)
 {
   int num_pep = d.protind2num_pep(protind);
   int num_all_pep = d.protind2num_all_pep(protind);
   int *pepinds = d.protind2pepinds(protind);
-  max_psm_inds.erase(max_psm_inds.begin(),max_psm_inds.end());
-  max_psm_scores.erase(max_psm_scores.begin(),max_psm_scores.end());
+  psm_inds.erase(psm_inds.begin(),psm_inds.end());
+  psm_sc.erase(psm_sc.begin(),psm_sc.end());
   int psm_count = 0;
   for (int i = 0; i < num_pep; i++)
     {
@@ -2089,7 +2202,7 @@ double Barista :: get_protein_score(int protind)
       for (int j = 0; j < num_psms; j++)
 	{
 	  double *feat = d.psmind2features(psminds[j]);
-	  double *sc = net_clones[psm_count].fprop(feat);
+	  double *sc = clones[psm_count].fprop(feat);
 	  if(sc[0] > max_sc)
 	    {
 	      max_sc = sc[0];
@@ -2097,21 +2210,26 @@ double Barista :: get_protein_score(int protind)
 	    }
 	  psm_count++;
 	}
-      max_psm_inds.push_back(max_ind);
-      max_psm_scores.push_back(max_sc);
+      psm_inds.push_back(max_ind);
+      psm_sc.push_back(max_sc);
     }
-  assert((int)max_psm_inds.size() == num_pep);
-  assert((int)max_psm_scores.size() == num_pep);
+  assert((int)psm_inds.size() == num_pep);
+  assert((int)psm_sc.size() == num_pep);
   
   double sm = 0.0;
   double n = pow(num_all_pep,alpha);
-  for(unsigned int i = 0; i < max_psm_inds.size() ; i++)
-    sm+= max_psm_scores[i];
+  for(unsigned int i = 0; i < psm_inds.size() ; i++)
+    sm+= psm_sc[i];
   sm /= n;
   return sm;
 }
 
 void Barista :: calc_gradients(int protind, int label)
+{
+  calc_gradients(protind, label, net_clones, max_psm_inds);
+}
+
+void Barista :: calc_gradients(int protind, int label, NeuralNet *clones, vector<int> &psm_inds)
 {
   int num_pep = d.protind2num_pep(protind);
   int num_all_pep = d.protind2num_all_pep(protind);
@@ -2125,8 +2243,8 @@ void Barista :: calc_gradients(int protind, int label)
     {
       int pepind = pepinds[i];
       int num_psms = d.pepind2num_psm(pepind);
-      int clone_ind = psm_count+max_psm_inds[i];
-      net_clones[clone_ind].bprop(gc);
+      int clone_ind = psm_count+psm_inds[i];
+      clones[clone_ind].bprop(gc);
       psm_count += num_psms;
     }
   delete[] gc;
@@ -2166,6 +2284,100 @@ double Barista :: train_hinge_psm(int psmind, int label)
   return err;
 }
 
+/*
+ * One epoch of minibatch training: the examples of each minibatch are drawn
+ * from the global random number generator, as in online training, and split
+ * into NUM_TRAIN_SHARDS fixed shards whose gradients are computed on
+ * num_threads threads and summed in shard order before the weights are
+ * updated. The result therefore depends on the random seed and on
+ * minibatch_size, but not on the number of threads. If interval > 0, each
+ * protein is paired with one of the first interval psms of psmtrainset.
+ */
+double Barista :: train_minibatches(int interval)
+{
+  double err_sum = 0.0;
+  int num_shards = shards.size();
+  int nthreads = min(num_threads, num_shards);
+  for(int first = 0; first < trainset.size(); first += minibatch_size)
+    {
+      int m = min(minibatch_size, trainset.size()-first);
+      batch_protinds.clear();
+      batch_prot_labels.clear();
+      batch_psminds.clear();
+      batch_psm_labels.clear();
+      for(int i = 0; i < m; i++)
+	{
+	  int ind = myrandom_limit(trainset.size());
+	  batch_protinds.push_back(trainset[ind].protind);
+	  batch_prot_labels.push_back(trainset[ind].label);
+	  if(interval > 0)
+	    {
+	      ind = myrandom_limit(interval);
+	      batch_psminds.push_back(psmtrainset[ind].psmind);
+	      batch_psm_labels.push_back(psmtrainset[ind].label);
+	    }
+	}
+      for(int k = 0; k < num_shards; k++)
+	{
+	  shards[k]->first = m*k/num_shards;
+	  shards[k]->last = m*(k+1)/num_shards;
+	}
+      if(nthreads <= 1)
+	train_shards(0, 1);
+      else
+	{
+	  boost::thread_group threads;
+	  for(int t = 0; t < nthreads; t++)
+	    threads.create_thread(boost::bind(&Barista::train_shards, this, t, nthreads));
+	  threads.join_all();
+	}
+      net.clear_gradients();
+      for(int k = 0; k < num_shards; k++)
+	{
+	  net.add_gradients(shards[k]->net);
+	  err_sum += shards[k]->err_sum;
+	}
+      net.update(mu);
+    }
+  return err_sum;
+}
+
+/*
+ * Computes the gradients of shards first_shard, first_shard+step, ... of
+ * the current minibatch with respect to the weights of net.
+ */
+void Barista :: train_shards(int first_shard, int step)
+{
+  for(unsigned int k = first_shard; k < shards.size(); k += step)
+    {
+      TrainShard *shard = shards[k];
+      shard->net.copy(net);
+      shard->net.clear_gradients();
+      shard->err_sum = 0.0;
+      for(int i = shard->first; i < shard->last; i++)
+	{
+	  int protind = batch_protinds[i];
+	  int label = batch_prot_labels[i];
+	  double sm = get_protein_score(protind, shard->clones, shard->max_psm_inds,
+					shard->max_psm_scores);
+	  shard->err_sum += max(0.0,1.0-sm*label);
+	  if(sm*label < 1)
+	    calc_gradients(protind, label, shard->clones, shard->max_psm_inds);
+
+	  if(i < (int)batch_psminds.size())
+	    {
+	      label = batch_psm_labels[i];
+	      double *c = shard->net.fprop(d.psmind2features(batch_psminds[i]));
+	      if(c[0]*label < 1)
+		{
+		  double gc = -1*label;
+		  shard->net.bprop(&gc);
+		}
+	    }
+	}
+    }
+}
+
 void Barista :: train_net(double selectionfdr)
 {
   for (int k = 0; k < nepochs; k++)
@@ -2173,21 +2385,27 @@ void Barista :: train_net(double selectionfdr)
     if(verbose > 0)
 	cout << "epoch " << k << endl;
       double err_sum = 0.0;
-      for(int i = 0; i < trainset.size(); i++)
-	{
-	  int ind = myrandom_limit(trainset.size());
-	  int protind = trainset[ind].protind;
-	  int label = trainset[ind].label;
-	  err_sum += train_hinge(protind,label);
-	}      
-      int fdr_trn = getOverFDRProt(trainset,selectionfdr);
+      if(minibatch_size > 1)
+	err_sum = train_minibatches(0);
+      else
+	for(int i = 0; i < trainset.size(); i++)
+	  {
+	    int ind = myrandom_limit(trainset.size());
+	    int protind = trainset[ind].protind;
+	    int label = trainset[ind].label;
+	    err_sum += train_hinge(protind,label);
+	  }
+      //the weights do not change until the next epoch, so all the
+      //evaluations below share one scoring pass over the psms
+      score_psms(net, psm_scores);
+      int fdr_trn = getOverFDRProt(trainset,psm_scores,selectionfdr);
       
       if(verbose > 0)
 	{
 	  cout << "err " << err_sum << "  ";
 	  cout << selectionfdr << " " << fdr_trn;
 	  if(testset.size() > 0)
-	    cout << " " << getOverFDRProt(testset,net,selectionfdr);
+	    cout << " " << getOverFDRProt(testset,psm_scores,selectionfdr);
 	  cout << endl;
 	}
 	if(fdr_trn > max_fdr)
@@ -2200,7 +2418,7 @@ void Barista :: train_net(double selectionfdr)
 	      if(testset.size() > 0)
 		carp(CARP_INFO, "q<%.2f: max non-parsimonious so far %d %d",
 		     selectionfdr, max_fdr,
-		     getOverFDRProt(testset,max_net_prot,selectionfdr));
+		     getOverFDRProt(testset,psm_scores,selectionfdr));
 	      else
 		carp(CARP_INFO, "q<%.2f: max non-parsimonious so far %d",
 		     selectionfdr, max_fdr);
@@ -2215,7 +2433,7 @@ void Barista :: train_net(double selectionfdr)
 	}
       if(1)
 	{
-	  int fdr_trn_psm = getOverFDRPSM(psmtrainset, net, selectionfdr); 
+	  int fdr_trn_psm = getOverFDRPSM(psmtrainset, psm_scores, selectionfdr); 
 	  if(fdr_trn_psm > max_fdr_psm)
 	    {
 	      max_net_psm = net;
@@ -2224,7 +2442,7 @@ void Barista :: train_net(double selectionfdr)
 	}
       if(1)
 	{
-	  int fdr_trn_pep = getOverFDRPep(peptrainset, net, selectionfdr); 
+	  int fdr_trn_pep = getOverFDRPep(peptrainset, psm_scores, selectionfdr); 
 	  if(fdr_trn_pep > max_fdr_pep)
 	    {
 	      max_net_pep = net;
@@ -2248,19 +2466,25 @@ void Barista :: train_net_multi_task(double selectionfdr, int interval)
     if(verbose > 0)
 	cout << "epoch " << k << endl;
       double err_sum = 0.0;
-      for(int i = 0; i < trainset.size(); i++)
-	{
-	  int ind = myrandom_limit(trainset.size());
-	  int protind = trainset[ind].protind;
-	  int label = trainset[ind].label;
-	  err_sum += train_hinge(protind,label);
-
-	  ind = myrandom_limit(interval);
-	  int psmind = psmtrainset[ind].psmind;
-	  label = psmtrainset[ind].label;
-	  train_hinge_psm(psmind,label);	
-	}      
-      int fdr_trn = getOverFDRProt(trainset,selectionfdr);
+      if(minibatch_size > 1)
+	err_sum = train_minibatches(interval);
+      else
+	for(int i = 0; i < trainset.size(); i++)
+	  {
+	    int ind = myrandom_limit(trainset.size());
+	    int protind = trainset[ind].protind;
+	    int label = trainset[ind].label;
+	    err_sum += train_hinge(protind,label);
+
+	    ind = myrandom_limit(interval);
+	    int psmind = psmtrainset[ind].psmind;
+	    label = psmtrainset[ind].label;
+	    train_hinge_psm(psmind,label);	
+	  }
+      //the weights do not change until the next epoch, so all the
+      //evaluations below share one scoring pass over the psms
+      score_psms(net, psm_scores);
+      int fdr_trn = getOverFDRProt(trainset,psm_scores,selectionfdr);
       
       if(verbose > 0)
 	{
@@ -2268,7 +2492,7 @@ void Barista :: train_net_multi_task(double selectionfdr, int interval)
 	    cout << "err " << err_sum << "  ";
 	  cout << selectionfdr << " " << fdr_trn;
 	  if(testset.size() > 0)
-	    cout << " " << getOverFDRProt(testset,net,selectionfdr);
+	    cout << " " << getOverFDRProt(testset,psm_scores,selectionfdr);
 	  cout << endl;
 	}
 	if(fdr_trn > max_fdr)
@@ -2280,7 +2504,7 @@ void Barista :: train_net_multi_task(double selectionfdr, int interval)
 	      if(testset.size() > 0)
 		carp(CARP_INFO, "q<%.2f: max non-parsimonious so far %d %d",
 		     selectionfdr, max_fdr,
-		     getOverFDRProt(testset,max_net_prot,selectionfdr));
+		     getOverFDRProt(testset,psm_scores,selectionfdr));
 	      else
 		carp(CARP_INFO, "q<%.2f: max non-parsimonious so far %d",
 		     selectionfdr, max_fdr);
@@ -2295,7 +2519,7 @@ void Barista :: train_net_multi_task(double selectionfdr, int interval)
 	}
       if(1)
 	{
-	  int fdr_trn_psm = getOverFDRPSM(psmtrainset, net, selectionfdr); 
+	  int fdr_trn_psm = getOverFDRPSM(psmtrainset, psm_scores, selectionfdr); 
 	  if(fdr_trn_psm > max_fdr_psm)
 	    {
 	      max_net_psm = net;
@@ -2304,7 +2528,7 @@ void Barista :: train_net_multi_task(double selectionfdr, int interval)
 	}
       if(1)
 	{
-	  int fdr_trn_pep = getOverFDRPep(peptrainset, net, selectionfdr); 
+	  int fdr_trn_pep = getOverFDRPep(peptrainset, psm_scores, selectionfdr); 
 	  if(fdr_trn_pep > max_fdr_pep)
 	    {
 	      max_net_pep = net;
@@ -2397,6 +2621,23 @@ void Barista :: setup_for_training(int trn_to_tst)
   net_clones = new NeuralNet[max_psms_in_prot];
   for (int i = 0; i < max_psms_in_prot;i++)
     net_clones[i].clone(net);
+
+  //create the shards for minibatch training, each with its own copy of the net
+  if(minibatch_size > 1 && shards.empty())
+    {
+      int num_shards = min(minibatch_size, (int)NUM_TRAIN_SHARDS);
+      for (int k = 0; k < num_shards; k++)
+	{
+	  TrainShard *shard = new TrainShard();
+	  shard->net = net;
+	  shard->clones = new NeuralNet[max_psms_in_prot];
+	  for (int i = 0; i < max_psms_in_prot; i++)
+	    shard->clones[i].clone(shard->net);
+	  shard->max_psm_inds.reserve(max_peptides);
+	  shard->max_psm_scores.reserve(max_peptides);
+	  shards.push_back(shard);
+	}
+    }
 }
 
 
@@ -2512,6 +2753,13 @@ int Barista :: crux_set_command_line_options(int argc, char *argv[])
 
   opt_type = Params::GetString("optimization");
 
+  num_threads = Params::GetInt("num-threads");
+  if(num_threads < 1)
+    num_threads = boost::thread::hardware_concurrency();
+  if(num_threads < 1)
+    num_threads = 1;
+  minibatch_size = Params::GetInt("minibatch-size");
+
   fileroot = Params::GetString("fileroot");
   if(!fileroot.empty()) {
     fileroot.append(".");
@@ -2772,6 +3020,8 @@ vector<string> Barista::getOptions() const {
     "list-of-files",
     "feature-file-out",
     "optimization",
+    "minibatch-size",
+    "num-threads",
     "spectrum-parser"
   };
   return vector<string>(arr, arr + sizeof(arr) / sizeof(string));
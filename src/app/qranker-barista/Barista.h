@@ -56,6 +56,8 @@ class Barista : public CruxApplication
     max_peptides(0),   
     max_fdr_psm(0),
     max_fdr_pep(0),
+    num_threads(1),
+    minibatch_size(1),
     parser(NULL){}
   ~Barista(){clear();}
   void clear();
@@ -74,12 +76,19 @@ class Barista : public CruxApplication
   void train_net_multi_task(double selectionfdr, int interval);
 
   void calc_gradients(int protind, int label);
+  void calc_gradients(int protind, int label, NeuralNet *clones, vector<int> &psm_inds);
+  double train_minibatches(int interval);
+  void train_shards(int first_shard, int step);
+  void score_psms(NeuralNet &n, vector<double> &scores);
 
   int getOverFDRProt(ProtScores &set, NeuralNet &n, double fdr);
   int getOverFDRProt(ProtScores &set, double fdr);
+  int getOverFDRProt(ProtScores &set, const vector<double> &scores, double fdr);
 
   double get_protein_score(int protind);
+  double get_protein_score(int protind, NeuralNet *clones, vector<int> &psm_inds, vector<double> &psm_sc);
   double get_protein_score(int protind, NeuralNet &n);
+  double get_protein_score(int protind, const vector<double> &scores);
   double get_protein_score_parsimonious(int protind, NeuralNet &n);
   int getOverFDRProtParsimonious(ProtScores &set, NeuralNet &n, double fdr);
   void computePEP();
@@ -115,8 +124,11 @@ class Barista : public CruxApplication
   void print_protein_ids(vector<string> &proteins,ofstream &os,int psmind);  
 
   int getOverFDRPSM(PSMScores &set, NeuralNet &n, double fdr);
+  int getOverFDRPSM(PSMScores &set, const vector<double> &scores, double fdr);
   double get_peptide_score(int pepind, NeuralNet &n);
+  double get_peptide_score(int pepind, const vector<double> &scores);
   int getOverFDRPep(PepScores &set, NeuralNet &n, double fdr);
+  int getOverFDRPep(PepScores &set, const vector<double> &scores, double fdr);
 
   inline void set_input_dir(string input_dir) {in_dir = input_dir; d.set_input_dir(input_dir);}
   inline void set_output_dir(string output_dir){out_dir = output_dir;}
@@ -138,6 +150,21 @@ class Barista : public CruxApplication
   FILE_FORMAT_T check_file_format(string filename);
   string file_extension(string str); 
  protected:
+  //one shard of a minibatch: a copy of the net that collects the gradients
+  //of examples first..last-1 of the minibatch, with its own clones
+  struct TrainShard {
+    TrainShard() : clones(0), first(0), last(0), err_sum(0.0) {}
+    ~TrainShard() {delete[] clones;}
+    NeuralNet net;
+    NeuralNet *clones;
+    vector<int> max_psm_inds;
+    vector<double> max_psm_scores;
+    int first;
+    int last;
+    double err_sum;
+  };
+  static const int NUM_TRAIN_SHARDS = 16;
+
   SQTParser* parser;
   int verbose;
   int skip_cleanup_flag;
@@ -186,7 +213,18 @@ class Barista : public CruxApplication
   PepScores peptrainset,peptestset;
   NeuralNet max_net_pep;
   int max_fdr_pep;
-  
+
+  //psm scores of the current net, shared by the evaluations of an epoch
+  vector<double> psm_scores;
+  vector<int> psm_rows;
+  int num_threads;
+  int minibatch_size;
+  vector<TrainShard*> shards;
+  vector<int> batch_protinds;
+  vector<int> batch_prot_labels;
+  vector<int> batch_psminds;
+  vector<int> batch_psm_labels;
+
   string file_format_; 
   ofstream fdebug;
 
@@ -144,6 +144,17 @@ void Linear :: clear_gradients()
     memset(dbias,0,sizeof(double)*num_neurons);
 }
 
+void Linear :: add_gradients(Linear &L)
+{
+  assert(L.num_neurons == num_neurons);
+  assert(L.num_features == num_features);
+  for(int k = 0; k < num_neurons*num_features; k++)
+    dw[k] += L.dw[k];
+  if(has_bias)
+    for(int k = 0; k < num_neurons; k++)
+      dbias[k] += L.dbias[k];
+}
+
 void Linear :: fprop(State &down, State &up)
 {
   for(int k = 0; k < num_neurons; k++)
@@ -158,6 +169,25 @@ void Linear :: fprop(State &down, State &up)
     }
 }
 
+void Linear :: fprop_block(double **x, int n, double *up)
+{
+  //each row of weights stays in cache while the whole block is scored
+  for(int k = 0; k < num_neurons; k++)
+    {
+      const double *wk = w+k*num_features;
+      for(int b = 0; b < n; b++)
+	{
+	  const double *xb = x[b];
+	  double d = 0.0;
+	  for(int j = 0; j < num_features; j++)
+	    d += wk[j]*xb[j];
+	  if(has_bias)
+	    d += bias[k];
+	  up[b*num_neurons+k] = d;
+	}
+    }
+}
+
 
 void Linear :: bprop(State &down, State &up)
 {
@@ -307,6 +337,36 @@ double* NeuralNet :: fprop(double *x)
 
 }
 
+void NeuralNet :: fprop_block(double *features, const int *rows, int n, double *out)
+{
+  const int block = 64;
+  int num_features = lin1.get_num_features();
+  int num_hu = lin1.get_num_neurons();
+  double *x[block];
+  double *h[block];
+  double *hidden = new double[block*num_hu];
+  for(int b = 0; b < block; b++)
+    h[b] = hidden+b*num_hu;
+
+  for(int first = 0; first < n; first += block)
+    {
+      int m = n-first < block ? n-first : block;
+      for(int b = 0; b < m; b++)
+	x[b] = features+(long)rows[first+b]*num_features;
+      if(is_linear)
+	lin1.fprop_block(x,m,out+first);
+      else
+	{
+	  lin1.fprop_block(x,m,hidden);
+	  //same as sigm1.fprop
+	  for(int k = 0; k < m*num_hu; k++)
+	    hidden[k] = 1.0/(1.0+exp(-hidden[k]));
+	  lin2.fprop_block(h,m,out+first);
+	}
+    }
+  delete[] hidden;
+}
+
 
 void NeuralNet :: clear_gradients()
 {
@@ -315,6 +375,14 @@ void NeuralNet :: clear_gradients()
     lin2.clear_gradients();
 }
 
+void NeuralNet :: add_gradients(NeuralNet &N)
+{
+  assert(is_linear == N.is_linear);
+  lin1.add_gradients(N.lin1);
+  if(!is_linear)
+    lin2.add_gradients(N.lin2);
+}
+
 
 double* NeuralNet :: bprop(double *dx)
 {
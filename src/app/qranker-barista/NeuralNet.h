@@ -91,8 +91,12 @@ class Linear
   void read_from_file(ifstream &infile);
  
   void fprop(State &down, State &up);
+  //fprop for n inputs at once; up[b*num_neurons+k] is neuron k for input x[b]
+  void fprop_block(double **x, int n, double *up);
   void bprop(State &down, State &up);
   void clear_gradients();
+  //adds the gradients of L, which must have the same size
+  void add_gradients(Linear &L);
   void update(double mu, double weight_decay=0.0);
   void update1(double mu, double weight_decay = 0.0);
   
@@ -123,7 +127,12 @@ class NeuralNet {
   void make_random();
 
   double* fprop(double *down);
+  //scores the rows of a feature matrix (num_features columns) in blocks;
+  //does not use the net's states, so threads can share a net for scoring
+  void fprop_block(double *features, const int *rows, int n, double *out);
   void clear_gradients();
+  //adds the gradients of a copy of this net, e.g. one trained on another thread
+  void add_gradients(NeuralNet &N);
   double* bprop(double *up);
   void update(double mu, double weight_decay=0.0);
   void update1(double mu, double weight_decay=0.0);
@@ -4,6 +4,22 @@
 #include "util/Params.h"
 #include "app/ComputeQValues.h"
 
+#include <boost/bind.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/thread.hpp>
+
+/**
+ * Returns an integer in [0, max) from the given random stream, or from the
+ * global one if rng is NULL.
+ */
+static int random_limit(boost::random::mt19937 *rng, int max)
+{
+  if(rng == NULL)
+    return myrandom_limit(max);
+  boost::random::uniform_int_distribution<> dist(0, UNIFORM_INT_DISTRIBUTION_MAX);
+  return dist(*rng) % max;
+}
+
 QRanker::QRanker() :  
   seed(0),
   selectionfdr(0.01),
@@ -48,19 +64,24 @@ int QRanker :: getOverFDR(PSMScores &set, NeuralNet &n, double fdr)
 
 void QRanker :: getMultiFDR(PSMScores &set, NeuralNet &n, vector<double> &qvalues)
 {
-  double *r;
-  double* featVec;
-   
+  getMultiFDR(set, n, qvalues, overFDRmulti);
+}
+
+void QRanker :: getMultiFDR(PSMScores &set, NeuralNet &n, vector<double> &qvalues,
+			    vector<int> &overFDR)
+{
+  vector<int> rows(set.size());
+  vector<double> scores(set.size());
   for(int i = 0; i < set.size(); i++)
-    {
-      featVec = d.psmind2features(set[i].psmind);
-      r = n.fprop(featVec);
-      set[i].score = r[0];
-    }
+    rows[i] = set[i].psmind;
+  if(!rows.empty())
+    n.fprop_block(d.psmind2features(0), &rows[0], rows.size(), &scores[0]);
+  for(int i = 0; i < set.size(); i++)
+    set[i].score = scores[i];
  
   for(unsigned int ct = 0; ct < qvalues.size(); ct++)
-    overFDRmulti[ct] = 0;
-  set.calcMultiOverFDR(qvalues, overFDRmulti);
+    overFDR[ct] = 0;
+  set.calcMultiOverFDR(qvalues, overFDR);
 }
 
 void QRanker :: getMultiFDRXCorr(PSMScores &set, vector<double> &qvalues)
@@ -554,6 +575,12 @@ void QRanker :: train_net_hinge(PSMScores &set, int interval)
 
 
 void QRanker :: train_net_ranking(PSMScores &set, int interval)
+{
+  train_net_ranking(set, interval, net, nets, NULL);
+}
+
+void QRanker :: train_net_ranking(PSMScores &set, int interval, NeuralNet &n,
+				  NeuralNet *pair_nets, boost::random::mt19937 *rng)
 {
   double *r1;
   double *r2;
@@ -570,7 +597,7 @@ void QRanker :: train_net_ranking(PSMScores &set, int interval)
       if(interval == 0)
 	ind1 = 0;
       else
-	ind1 = myrandom_limit(interval);
+	ind1 = random_limit(rng, interval);
       if(ind1>set.size()-1) continue;
       if(set[ind1].label == 1)
 	label_flag = -1;
@@ -580,20 +607,20 @@ void QRanker :: train_net_ranking(PSMScores &set, int interval)
       int cn = 0;
       while(1)
 	{
-	  ind2 = myrandom_limit(interval);
+	  ind2 = random_limit(rng, interval);
 	  if(ind2>set.size()-1) continue;
 	  if(set[ind2].label == label_flag) break;
 	  if(cn > 1000)
 	    {
-	      ind2 = myrandom_limit(set.size());
+	      ind2 = random_limit(rng, set.size());
 	      break;
 	    }
 	  cn++;
 	}
       
       //pass both through the net
-      r1 = nets[0].fprop(d.psmind2features(set[ind1].psmind));
-      r2 = nets[1].fprop(d.psmind2features(set[ind2].psmind));
+      r1 = pair_nets[0].fprop(d.psmind2features(set[ind1].psmind));
+      r2 = pair_nets[1].fprop(d.psmind2features(set[ind2].psmind));
       diff = r1[0]-r2[0];
       
 
@@ -607,12 +634,12 @@ void QRanker :: train_net_ranking(PSMScores &set, int interval)
 	{
 	  if(label*diff<1)
 	    {
-	      net.clear_gradients();
+	      n.clear_gradients();
 	      gc[0] = -1.0*label;
-	      nets[0].bprop(gc);
+	      pair_nets[0].bprop(gc);
 	      gc[0] = 1.0*label;
-	      nets[1].bprop(gc);
-	      net.update(mu,weightDecay);
+	      pair_nets[1].bprop(gc);
+	      n.update(mu,weightDecay);
 	    }
 	  
 	}
@@ -728,62 +755,113 @@ void QRanker :: train_many_general_nets()
 
 }
 
-void QRanker :: train_many_target_nets()
+void QRanker :: log_multi_fdr(const char* name, vector<int> &overFDR, const char* end)
 {
-
-  int  thr_count = num_qvals-1;
-  while (thr_count > 0)
+  ostringstream line;
+  line << name << " ";
+  for(int count = 0; count < num_qvals; count++)
     {
-      net.copy(max_net_gen[thr_count]);
-        
-      carp(CARP_INFO, "training threshold %d", thr_count);
-      //cout << "training thresh " << thr_count  << "\n";
-      //interval = getOverFDR(trainset, net, qvals[thr_count]);
-      interval = max_overFDR[thr_count];
-      for(int i=switch_iter;i<niter;i++) {
-		
-	//sorts the examples in the training set according to the current net scores
-	getMultiFDR(trainset,net,qvals);
-	train_net_ranking(trainset, interval);
-			
-	for(int count = 0; count < num_qvals;count++)
-	  {
-	    if(overFDRmulti[count] > max_overFDR[count])
-	      {
-		max_overFDR[count] = overFDRmulti[count];
-		max_net_targ[count] = net;
-	      }
-	  }
+      char buf[32];
+      sprintf(buf, "%.2f:%d ", qvals[count], overFDR[count]);
+      line << buf;
+    }
+  carp(CARP_INFO, "%s%s", line.str().c_str(), end);
+}
+
+/**
+ * Trains the target nets of one q-value threshold, starting from the best
+ * general net for that threshold. Only touches the task's own state.
+ */
+void QRanker :: train_target_nets(TargetNetTask* task)
+{
+  vector<int> overFDR(num_qvals, 0);
+  int thr_interval = task->max_overFDR[task->thr_count];
+  for(int i=switch_iter;i<niter;i++) {
 
-	if((i % 3) == 0)
+    //sorts the examples in the training set according to the current net scores
+    getMultiFDR(task->trainset,task->net,qvals,overFDR);
+    train_net_ranking(task->trainset, thr_interval, task->net, task->nets, &task->rng);
+
+    for(int count = 0; count < num_qvals;count++)
+      {
+	if(overFDR[count] > task->max_overFDR[count])
 	  {
-	    carp(CARP_INFO, "Iteration %d :", i);
-	    getMultiFDR(trainset,net,qvals);
-	    carp(CARP_INFO, "trainset %.2f:%d %.2f:%d %.2f:%d  %.2f:%d %.2f:%d %.2f:%d %.2f:%d %.2f:%d %.2f:%d  %.2f:%d %.2f:%d %.2f:%d %.2f:%d %.2f:%d ", 
-		 qvals[0], overFDRmulti[0], qvals[1], overFDRmulti[1], qvals[2], overFDRmulti[2],
-		 qvals[3], overFDRmulti[3], qvals[4], overFDRmulti[4], qvals[5], overFDRmulti[5],
-		 qvals[6], overFDRmulti[6], qvals[7], overFDRmulti[7], qvals[8], overFDRmulti[8],
-		 qvals[9], overFDRmulti[9], qvals[10], overFDRmulti[10], qvals[11], overFDRmulti[11],
-		 qvals[12], overFDRmulti[12], qvals[13], overFDRmulti[13]);
-	    getMultiFDR(testset,net,qvals);
-	    carp(CARP_INFO, "testset %.2f:%d %.2f:%d %.2f:%d  %.2f:%d %.2f:%d %.2f:%d %.2f:%d %.2f:%d %.2f:%d  %.2f:%d %.2f:%d %.2f:%d %.2f:%d %.2f:%d\n ", 
-		 qvals[0], overFDRmulti[0], qvals[1], overFDRmulti[1], qvals[2], overFDRmulti[2],
-		 qvals[3], overFDRmulti[3], qvals[4], overFDRmulti[4], qvals[5], overFDRmulti[5],
-		 qvals[6], overFDRmulti[6], qvals[7], overFDRmulti[7], qvals[8], overFDRmulti[8],
-		 qvals[9], overFDRmulti[9], qvals[10], overFDRmulti[10], qvals[11], overFDRmulti[11],
-		 qvals[12], overFDRmulti[12], qvals[13], overFDRmulti[13]);
-	    
-	    /*
-	    cout << "Iteration " << i << " : \n";
-	    getMultiFDR(testset,net,qvals);
-	    cout << "testset: ";
-	    printNetResults(overFDRmulti);
-	    cout << "\n";
-	    */
+	    task->max_overFDR[count] = overFDR[count];
+	    task->max_nets[count].copy(task->net);
 	  }
+      }
 
+    if((i % 3) == 0)
+      {
+	task->log_iterations.push_back(i);
+	getMultiFDR(task->trainset,task->net,qvals,overFDR);
+	task->log_train.push_back(overFDR);
+	getMultiFDR(task->testset,task->net,qvals,overFDR);
+	task->log_test.push_back(overFDR);
       }
-      thr_count -= 3;
+  }
+}
+
+void QRanker :: train_many_target_nets()
+{
+  // Each threshold continues from its own general net, so the thresholds are
+  // trained in parallel; the best net per q-value is then taken over all
+  // thresholds, in the order they used to be trained.
+  vector<TargetNetTask*> tasks;
+  for(int thr_count = num_qvals-1; thr_count > 0; thr_count -= 3)
+    {
+      TargetNetTask* task = new TargetNetTask();
+      task->thr_count = thr_count;
+      task->net = max_net_gen[thr_count];
+      task->nets[0].clone(task->net);
+      task->nets[1].clone(task->net);
+      task->max_nets = new NeuralNet[num_qvals];
+      for(int count = 0; count < num_qvals; count++)
+	task->max_nets[count] = max_net_targ[count];
+      task->max_overFDR = max_overFDR;
+      task->trainset = trainset;
+      task->testset = testset;
+      task->rng.seed((unsigned int)myrandom());
+      tasks.push_back(task);
+    }
+
+  int num_threads = Params::GetInt("num-threads");
+  if(num_threads < 1)
+    num_threads = boost::thread::hardware_concurrency();
+  if(num_threads < 1)
+    num_threads = 1;
+  if(num_threads > (int)tasks.size())
+    num_threads = tasks.size();
+  carp(CARP_INFO, "Training %d thresholds using %d threads", (int)tasks.size(), num_threads);
+
+  for(unsigned int first = 0; first < tasks.size(); first += num_threads)
+    {
+      boost::thread_group threads;
+      for(unsigned int t = first; t < tasks.size() && t < first + num_threads; t++)
+	threads.create_thread(boost::bind(&QRanker::train_target_nets, this, tasks[t]));
+      threads.join_all();
+    }
+
+  for(unsigned int t = 0; t < tasks.size(); t++)
+    {
+      TargetNetTask* task = tasks[t];
+      carp(CARP_INFO, "training threshold %d", task->thr_count);
+      for(unsigned int j = 0; j < task->log_iterations.size(); j++)
+	{
+	  carp(CARP_INFO, "Iteration %d :", task->log_iterations[j]);
+	  log_multi_fdr("trainset", task->log_train[j], "");
+	  log_multi_fdr("testset", task->log_test[j], "\n");
+	}
+      for(int count = 0; count < num_qvals; count++)
+	{
+	  if(task->max_overFDR[count] > max_overFDR[count])
+	    {
+	      max_overFDR[count] = task->max_overFDR[count];
+	      max_net_targ[count].copy(task->max_nets[count]);
+	    }
+	}
+      delete[] task->max_nets;
+      delete task;
     }
 }
 
@@ -1187,6 +1265,7 @@ vector<string> QRanker::getOptions() const {
     "parameter-file",
     "verbosity",
      "list-of-files",
+    "num-threads",
     "feature-file-out",
     "spectrum-parser"
   };
@@ -10,6 +10,7 @@
 #include <map>
 #include <string>
 #include <math.h>
+#include <boost/random/mersenne_twister.hpp>
 using namespace std;
 
 #include "app/CruxApplication.h"
@@ -45,6 +46,8 @@ public:
   int run();
   void train_net_sigmoid(PSMScores &set, int interval);
   void train_net_ranking(PSMScores &set, int interval);
+  void train_net_ranking(PSMScores &set, int interval, NeuralNet &n, NeuralNet *pair_nets,
+			 boost::random::mt19937 *rng);
   void train_net_hinge(PSMScores &set, int interval);
   void count_pairs(PSMScores &set, int interval);
   void train_many_general_nets();
@@ -53,6 +56,7 @@ public:
     
   int getOverFDR(PSMScores &set, NeuralNet &n, double fdr);
   void getMultiFDR(PSMScores &set, NeuralNet &n, vector<double> &qval);
+  void getMultiFDR(PSMScores &set, NeuralNet &n, vector<double> &qval, vector<int> &overFDR);
   void getMultiFDRXCorr(PSMScores &set, vector<double> &qval);
   void printNetResults(vector<int> &scores);
   void write_results();
@@ -89,6 +93,30 @@ public:
 
 protected:
 
+    /**
+     * Everything one q-value threshold needs to train its target nets
+     * independently of the other thresholds: its own net, copies of the
+     * training and test sets (scoring reorders them) and its own random
+     * stream, so that the thresholds can be trained in parallel threads
+     * with reproducible results.
+     */
+    struct TargetNetTask {
+      int thr_count;
+      NeuralNet net;
+      NeuralNet nets[2];
+      NeuralNet* max_nets;
+      vector<int> max_overFDR;
+      PSMScores trainset;
+      PSMScores testset;
+      boost::random::mt19937 rng;
+      // overFDR on the train and test sets at the logged iterations
+      vector<int> log_iterations;
+      vector< vector<int> > log_train;
+      vector< vector<int> > log_test;
+    };
+    void train_target_nets(TargetNetTask* task);
+    void log_multi_fdr(const char* name, vector<int> &overFDR, const char* end);
+
     Dataset d;
     string res_prefix;
 
@@ -17,9 +17,11 @@ DEFINE_int32(fifo_page_size, 1, "Page size for FIFO allocator, in megs");
 
 ActivePeptideQueue::ActivePeptideQueue(RecordReader* reader,
                                        const vector<const pb::Protein*>&
-                                       proteins)
+                                       proteins,
+                                       const SearchConfig& config)
   : reader_(reader),
     proteins_(proteins),
+    config_(config),
     theoretical_peak_set_(2000),   // probably overkill, but no harm
     theoretical_b_peak_set_(200),  // probably overkill, but no harm
     active_targets_(0), active_decoys_(0),
@@ -30,6 +32,7 @@ ActivePeptideQueue::ActivePeptideQueue(RecordReader* reader,
   compiler_prog1_ = new TheoreticalPeakCompiler(&fifo_alloc_prog1_);
   compiler_prog2_ = new TheoreticalPeakCompiler(&fifo_alloc_prog2_);
   peptide_centric_ = false;
+  exact_pval_search_ = false;
   elution_window_ = 0;
 }
 
@@ -45,6 +48,18 @@ ActivePeptideQueue::~ActivePeptideQueue() {
   delete compiler_prog2_;
 }
 
+// In peptide-centric search, reserve room for the peptide's best hits right
+// behind it in fifo_alloc_peptides_, so that they are released together. One
+// hit more than is reported is kept, for the delta Cn of the last one.
+// Elution window smoothing ranks hits using all of them, so in that case
+// they are not bounded.
+void ActivePeptideQueue::InitHits(Peptide* peptide) {
+  if (peptide_centric_ && elution_window_ == 0) {
+    peptide->InitHits(&fifo_alloc_peptides_, top_matches_ + 1,
+                      exact_pval_search_);
+  }
+}
+
 // Compute the theoretical peaks of the peptide in the "back" of the queue
 // (i.e. the one most recently read from disk -- the heaviest).
 void ActivePeptideQueue::ComputeTheoreticalPeaksBack() {
@@ -68,7 +83,7 @@ bool ActivePeptideQueue::isWithinIsotope(vector<double>* min_mass, vector<double
 
 int ActivePeptideQueue::SetActiveRange(vector<double>* min_mass, vector<double>* max_mass, double min_range, double max_range, vector<bool>* candidatePeptideStatus) {
   int min_candidates = 0;  //Added for tailor score calibration method by AKF
-  if (Params::GetBool("use-tailor-calibration")){
+  if (config_.use_tailor_calibration){
     min_candidates = 30;
   }
   //min_range and max_range have been introduced to fix a bug
@@ -83,8 +98,7 @@ int ActivePeptideQueue::SetActiveRange(vector<double>* min_mass, vector<double>*
     Peptide* peptide = queue_.front();
     //print hits in peptide-centric search
     ReportPeptideHits(peptide);
-    peptide->spectrum_matches_array.clear();
-    vector<Peptide::spectrum_matches>().swap(peptide->spectrum_matches_array);
+    peptide->ClearHits();
     // would delete peptide's underlying pb::Peptide;
     queue_.pop_front();
 //    delete peptide;
@@ -124,6 +138,7 @@ int ActivePeptideQueue::SetActiveRange(vector<double>* min_mass, vector<double>*
       }
       Peptide* peptide = new(&fifo_alloc_peptides_)
         Peptide(current_pb_peptide_, proteins_, &fifo_alloc_peptides_);
+      InitHits(peptide);
       queue_.push_back(peptide);
       //Modified for tailor score calibration method by AKF
       if (peptide->Mass() > max_range && queue_.size() > min_candidates) {
@@ -145,12 +160,12 @@ int ActivePeptideQueue::SetActiveRange(vector<double>* min_mass, vector<double>*
   iter_ = queue_.begin();
   while (iter_ != queue_.end() && (*iter_)->Mass() < min_mass->front()) {
     ++iter_;
-    if (Params::GetBool("use-tailor-calibration")){ //Added by AKF
+    if (config_.use_tailor_calibration){ //Added by AKF
       candidatePeptideStatus->push_back(false);  
     }
   }
   end_ = iter_;
-  if (Params::GetBool("use-tailor-calibration")){ //Added by AKF
+  if (config_.use_tailor_calibration){ //Added by AKF
     iter_ = queue_.begin();
   }
   int* isotope_idx = new int(0);
@@ -175,7 +190,7 @@ int ActivePeptideQueue::SetActiveRange(vector<double>* min_mass, vector<double>*
     return 0;
   }
   //Added for tailor score calibration method by AKF
-  if (Params::GetBool("use-tailor-calibration")){
+  if (config_.use_tailor_calibration){
     while (end_ != queue_.end()) {  //Added by AKF
       if ((*end_)->Prog(1) == NULL || candidatePeptideStatus->size() >= min_candidates-1) {
         break;
@@ -206,8 +221,7 @@ int ActivePeptideQueue::SetActiveRangeBIons(vector<double>* min_mass, vector<dou
     Peptide* peptide = queue_.front();
     // would delete peptide's underlying pb::Peptide;
     ReportPeptideHits(peptide);
-    peptide->spectrum_matches_array.clear();
-    vector<Peptide::spectrum_matches>().swap(peptide->spectrum_matches_array);
+    peptide->ClearHits();
     queue_.pop_front();
     b_ion_queue_.pop_front();
 //    delete peptide;
@@ -235,6 +249,7 @@ int ActivePeptideQueue::SetActiveRangeBIons(vector<double>* min_mass, vector<dou
       }
       Peptide* peptide = new(&fifo_alloc_peptides_)
         Peptide(current_pb_peptide_, proteins_, &fifo_alloc_peptides_);
+      InitHits(peptide);
       queue_.push_back(peptide);
       ComputeBTheoreticalPeaksBack();
       if (peptide->Mass() > max_range) {
@@ -437,7 +452,7 @@ void ActivePeptideQueue::ReportPeptideHits(Peptide* peptide) {
     }
 
     current_peptide_ = peptide;
-    TideMatchSet matches(peptide, highest_mz_);
+    TideMatchSet matches(peptide, highest_mz_, config_);
     matches.exact_pval_search_ = exact_pval_search_;
     matches.elution_window_ = elution_window_;
 
@@ -20,6 +20,7 @@
 #include "theoretical_peak_set.h"
 #include "fifo_alloc.h"
 #include "spectrum_collection.h"
+#include "search_config.h"
 #include "io/OutputFiles.h"
 
 //#include "sp_scorer.h"
@@ -31,7 +32,8 @@ class TheoreticalPeakCompiler;
 class ActivePeptideQueue {
  public:
   ActivePeptideQueue(RecordReader* reader,
-            const vector<const pb::Protein*>& proteins);
+            const vector<const pb::Protein*>& proteins,
+            const SearchConfig& config);
 
   ~ActivePeptideQueue();
 
@@ -105,6 +107,7 @@ class ActivePeptideQueue {
   // IMPLEMENTATION DETAILS
 
   // See .cc file.
+  void InitHits(Peptide* peptide);
   void ComputeTheoreticalPeaksBack();
   void ComputeBTheoreticalPeaksBack();
 
@@ -114,6 +117,8 @@ class ActivePeptideQueue {
   // All amino acid sequences from which the peptides are drawn.
   const vector<const pb::Protein*>& proteins_; 
 
+  const SearchConfig& config_;
+
   // Workspace for computing theoretical peaks for a single peptide.
   // Gets reused for each new peptide.
   ST_TheoreticalPeakSet theoretical_peak_set_;
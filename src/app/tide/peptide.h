@@ -25,6 +25,8 @@
 
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <new>
 #include "raw_proteins.pb.h"
 #include "peptides.pb.h"
 #include "theoretical_peak_pair.h"
@@ -76,7 +78,9 @@ class Peptide {
     has_aux_locations_index_(peptide.has_aux_locations_index()),
     aux_locations_index_(peptide.aux_locations_index()),
     mods_(NULL), num_mods_(0), decoyIdx_(peptide.has_decoy_index() ? peptide.decoy_index() : -1),
-    prog1_(NULL), prog2_(NULL) {
+    prog1_(NULL), prog2_(NULL),
+    hits_(NULL), hits_capacity_(0), num_hits_kept_(0), num_hits_(0),
+    low_score_best_(false) {
     // Set residues_ by pointing to the first occurrence in proteins.
     residues_ = proteins[first_loc_protein_id_]->residues().data() 
                     + first_loc_pos_;
@@ -134,12 +138,73 @@ class Peptide {
         return a.elution_score_ < b.elution_score_;
       }
   };
+  // Hits collected for peptide-centric search.
+  //
+  // After InitHits(), only the best capacity hits are kept, in a block
+  // allocated from fifo_alloc right behind the peptide itself. The block is
+  // therefore released together with the peptide and adding a hit never
+  // allocates. The kept hits are maintained as a heap with the worst kept hit
+  // at the front. Without InitHits(), every hit is appended to
+  // spectrum_matches_array; this is needed when the ranking depends on all
+  // hits, as with elution window smoothing.
+  //
+  // Either way, Hits() and NumHitsKept() give the stored hits and NumHits()
+  // the number of hits added, including those that were dropped.
   vector<spectrum_matches> spectrum_matches_array;
+
+  void InitHits(FifoAllocator* fifo_alloc, int capacity, bool low_score_best) {
+    hits_ = (spectrum_matches*) fifo_alloc->New(sizeof(spectrum_matches) * capacity);
+    hits_capacity_ = capacity;
+    low_score_best_ = low_score_best;
+  }
+
   void AddHit(Spectrum* spectrum, double score1, double score2,
           int score3, int charge) {
+    ++num_hits_;
+    if (hits_ == NULL) {
+      spectrum_matches_array.push_back(spectrum_matches(spectrum,
+                                       score1, score2, score3, charge));
+      num_hits_kept_ = spectrum_matches_array.size();
+      return;
+    }
+    bool (*better)(const spectrum_matches&, const spectrum_matches&) =
+      low_score_best_ ? spectrum_matches::compPV : spectrum_matches::compSC;
+    if (num_hits_kept_ < hits_capacity_) {
+      new(hits_ + num_hits_kept_) spectrum_matches(spectrum,
+                                                   score1, score2, score3, charge);
+      push_heap(hits_, hits_ + ++num_hits_kept_, better);
+      return;
+    }
+    spectrum_matches hit(spectrum, score1, score2, score3, charge);
+    if (better(hit, hits_[0])) {
+      pop_heap(hits_, hits_ + num_hits_kept_, better);
+      hits_[num_hits_kept_ - 1] = hit;
+      push_heap(hits_, hits_ + num_hits_kept_, better);
+    }
+  }
 
-    spectrum_matches_array.push_back(spectrum_matches(spectrum,
-                                     score1, score2, score3, charge));
+  spectrum_matches* Hits() {
+    return hits_ != NULL ? hits_ :
+      (spectrum_matches_array.empty() ? NULL : &spectrum_matches_array[0]);
+  }
+  int NumHitsKept() const { return num_hits_kept_; }
+  int NumHits() const { return num_hits_; }
+
+  // Keeps only the first num hits of Hits().
+  void TruncateHits(int num) {
+    if (num < num_hits_kept_) {
+      num_hits_kept_ = num;
+      if (hits_ == NULL) {
+        spectrum_matches_array.resize(num);
+      }
+    }
+  }
+
+  // Frees the memory held by spectrum_matches_array, which is not released
+  // with the FIFO allocator.
+  void ClearHits() {
+    vector<spectrum_matches>().swap(spectrum_matches_array);
+    num_hits_kept_ = num_hits_ = 0;
   }
 
   // CAUTION: We do NOT expect this destructor to get called when FIFO 
@@ -240,6 +305,12 @@ class Peptide {
 
   void* prog1_;
   void* prog2_;
+
+  spectrum_matches* hits_;
+  int hits_capacity_;
+  int num_hits_kept_;
+  int num_hits_;
+  bool low_score_best_;
 };
 
 #endif // PEPTIDE_H
@@ -0,0 +1,370 @@
+// See .h file.
+//
+// The AVX2 versions are compiled with the target attribute rather than with
+// a global compiler flag, so the same binary runs on CPUs without AVX2. They
+// must not be contracted into fused multiply-adds, which round differently;
+// CMakeLists.txt compiles this file with -ffp-contract=off.
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "preprocess_kernels.h"
+#include "theoretical_peak_pair.h"
+#include "max_mz.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PREPROCESS_KERNELS_AVX2
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+bool PreprocessKernels::vectorized_ = true;
+
+static inline int round_to_int(double x) {
+  if (x >= 0)
+    return int(x + 0.5);
+  return int(x - 0.5);
+}
+
+static void SqrtTransformScalar(double* values, int n) {
+  for (int i = 0; i < n; ++i)
+    values[i] = sqrt(values[i]);
+}
+
+static void ThresholdScalar(double* values, int begin, int end, double cutoff) {
+  for (int i = begin; i < end; ++i) {
+    if (values[i] <= cutoff)
+      values[i] = 0;
+  }
+}
+
+static double RegionMaxScalar(const double* values, int begin, int end,
+                              double highest) {
+  for (int i = begin; i < end; ++i) {
+    if (values[i] > highest)
+      highest = values[i];
+  }
+  return highest;
+}
+
+static void ScaleScalar(double* values, int begin, int end, double normalizer) {
+  for (int i = begin; i < end; ++i) {
+    if (values[i] != 0)
+      values[i] *= normalizer;
+  }
+}
+
+static void SubtractBackgroundScalar(double* values, int begin, int end, int n,
+                                     double multiplier, bool include_self,
+                                     const double* partial_sums) {
+  for (int i = begin; i < end; ++i) {
+    int right_index = min(n, i + MAX_XCORR_OFFSET);
+    int left_index = max(0, i - MAX_XCORR_OFFSET - 1);
+    if (include_self) {
+      values[i] -= multiplier * (partial_sums[right_index] - partial_sums[left_index]);
+    } else {
+      values[i] -= multiplier * (partial_sums[right_index] - partial_sums[left_index] - values[i]);
+    }
+  }
+}
+
+static void FillPeakCacheScalar(const double* peaks, int begin, int end,
+                                int* cache) {
+  // Instead of computing 10 * x, 25 * x, and 50 * x, we compute 2 * x, 5 * x
+  // and 10 * x. See ObservedPeakSet::ComputeCache().
+  for (int i = begin; i < end; ++i) {
+    int* bin = cache + i * NUM_PEAK_TYPES;
+    int x = round_to_int(peaks[i] * 50000);
+    int y = x + x;
+    int z = y + y + x;
+    bin[PeakMain] = x;
+    bin[LossPeak] = y;
+    bin[FlankingPeak] = z;
+    bin[PrimaryPeak] = z + z;
+  }
+}
+
+static void CombinePeakCacheScalar(int* cache, int begin, int end,
+                                   int cache_bin_end, bool flanking_peaks,
+                                   bool neutral_loss_peaks,
+                                   int bin_nh3, int bin_h2o) {
+  for (int i = begin; i < end; ++i) {
+    int* bin = cache + i * NUM_PEAK_TYPES;
+    int flanks = bin[PrimaryPeak];
+    if (flanking_peaks) {
+      if (i > 0) {
+        flanks += bin[FlankingPeak - NUM_PEAK_TYPES];
+      }
+      if (i < cache_bin_end - 1) {
+        flanks += bin[FlankingPeak + NUM_PEAK_TYPES];
+      }
+    }
+    int Y1 = flanks;
+    if (neutral_loss_peaks) {
+      if (i > bin_nh3) {
+        Y1 += bin[LossPeak - bin_nh3 * NUM_PEAK_TYPES];
+      }
+      if (i > bin_h2o) {
+        Y1 += bin[LossPeak - bin_h2o * NUM_PEAK_TYPES];
+      }
+    }
+    bin[PeakCombinedY1] = Y1;
+    bin[PeakCombinedB1] = Y1;
+    bin[PeakCombinedY2] = flanks;
+    bin[PeakCombinedB2] = flanks;
+  }
+}
+
+#ifdef PREPROCESS_KERNELS_AVX2
+
+static bool CpuHasAvx2() {
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+}
+
+__attribute__((target("avx2")))
+static void SqrtTransformAvx2(double* values, int n) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(values + i, _mm256_sqrt_pd(_mm256_loadu_pd(values + i)));
+  SqrtTransformScalar(values + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void ThresholdAvx2(double* values, int n, double cutoff) {
+  const __m256d cut = _mm256_set1_pd(cutoff);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d v = _mm256_loadu_pd(values + i);
+    // keep the values that are not <= cutoff, including NaN
+    __m256d keep = _mm256_cmp_pd(v, cut, _CMP_NLE_UQ);
+    _mm256_storeu_pd(values + i, _mm256_and_pd(v, keep));
+  }
+  ThresholdScalar(values, i, n, cutoff);
+}
+
+__attribute__((target("avx2")))
+static double RegionMaxAvx2(const double* values, int n) {
+  __m256d highest = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    // maxpd returns its second operand when the first is NaN, as the scalar
+    // comparison does.
+    highest = _mm256_max_pd(_mm256_loadu_pd(values + i), highest);
+  }
+  double lanes[4];
+  _mm256_storeu_pd(lanes, highest);
+  double result = RegionMaxScalar(lanes, 0, 4, 0);
+  return RegionMaxScalar(values, i, n, result);
+}
+
+__attribute__((target("avx2")))
+static void ScaleAvx2(double* values, int n, double normalizer) {
+  // Zero entries stay zero when multiplied, so no test is needed.
+  const __m256d scale = _mm256_set1_pd(normalizer);
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(values + i, _mm256_mul_pd(_mm256_loadu_pd(values + i), scale));
+  ScaleScalar(values, i, n, normalizer);
+}
+
+// Handles the bins in [begin, end), whose windows lie entirely within the
+// array, four at a time. Returns the first bin not handled.
+__attribute__((target("avx2")))
+static int SubtractBackgroundAvx2(double* values, int begin, int end,
+                                   double multiplier, bool include_self,
+                                   const double* partial_sums) {
+  const __m256d mult = _mm256_set1_pd(multiplier);
+  int i = begin;
+  for (; i + 4 <= end; i += 4) {
+    __m256d right = _mm256_loadu_pd(partial_sums + i + MAX_XCORR_OFFSET);
+    __m256d left = _mm256_loadu_pd(partial_sums + i - MAX_XCORR_OFFSET - 1);
+    __m256d v = _mm256_loadu_pd(values + i);
+    __m256d window = _mm256_sub_pd(right, left);
+    if (!include_self)
+      window = _mm256_sub_pd(window, v);
+    _mm256_storeu_pd(values + i, _mm256_sub_pd(v, _mm256_mul_pd(mult, window)));
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+static void FillPeakCacheAvx2(const double* peaks, int n, int* cache) {
+  const __m256d scale = _mm256_set1_pd(50000);
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d half = _mm256_set1_pd(0.5);
+  const __m256d minus_half = _mm256_set1_pd(-0.5);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d x = _mm256_mul_pd(_mm256_loadu_pd(peaks + i), scale);
+    __m256d rounding = _mm256_blendv_pd(minus_half, half,
+                                     _mm256_cmp_pd(x, zero, _CMP_GE_OQ));
+    __m128i peak = _mm256_cvttpd_epi32(_mm256_add_pd(x, rounding));
+    __m128i loss = _mm_add_epi32(peak, peak);
+    __m128i flanking = _mm_add_epi32(_mm_add_epi32(loss, loss), peak);
+    __m128i primary = _mm_add_epi32(flanking, flanking);
+    // Transpose so each row holds the four peak types of one bin.
+    __m128i t0 = _mm_unpacklo_epi32(peak, loss);
+    __m128i t1 = _mm_unpacklo_epi32(flanking, primary);
+    __m128i t2 = _mm_unpackhi_epi32(peak, loss);
+    __m128i t3 = _mm_unpackhi_epi32(flanking, primary);
+    int* bin = cache + i * NUM_PEAK_TYPES;
+    _mm_storeu_si128((__m128i*)bin, _mm_unpacklo_epi64(t0, t1));
+    _mm_storeu_si128((__m128i*)(bin + NUM_PEAK_TYPES), _mm_unpackhi_epi64(t0, t1));
+    _mm_storeu_si128((__m128i*)(bin + 2 * NUM_PEAK_TYPES), _mm_unpacklo_epi64(t2, t3));
+    _mm_storeu_si128((__m128i*)(bin + 3 * NUM_PEAK_TYPES), _mm_unpackhi_epi64(t2, t3));
+  }
+  FillPeakCacheScalar(peaks, i, n, cache);
+}
+
+// Handles the bins in [begin, end), all of whose neighbors exist, four at a
+// time. Returns the first bin not handled.
+__attribute__((target("avx2")))
+static int CombinePeakCacheAvx2(int* cache, int begin, int end,
+                                bool flanking_peaks, bool neutral_loss_peaks,
+                                int bin_nh3, int bin_h2o) {
+  const __m128i stride = _mm_setr_epi32(0, NUM_PEAK_TYPES, 2 * NUM_PEAK_TYPES,
+                                        3 * NUM_PEAK_TYPES);
+  int i = begin;
+  for (; i + 4 <= end; i += 4) {
+    const int* bin = cache + i * NUM_PEAK_TYPES;
+    __m128i flanks = _mm_i32gather_epi32(bin + PrimaryPeak, stride, 4);
+    if (flanking_peaks) {
+      flanks = _mm_add_epi32(flanks, _mm_i32gather_epi32(
+        bin + FlankingPeak - NUM_PEAK_TYPES, stride, 4));
+      flanks = _mm_add_epi32(flanks, _mm_i32gather_epi32(
+        bin + FlankingPeak + NUM_PEAK_TYPES, stride, 4));
+    }
+    __m128i y1 = flanks;
+    if (neutral_loss_peaks) {
+      y1 = _mm_add_epi32(y1, _mm_i32gather_epi32(
+        bin + LossPeak - bin_nh3 * NUM_PEAK_TYPES, stride, 4));
+      y1 = _mm_add_epi32(y1, _mm_i32gather_epi32(
+        bin + LossPeak - bin_h2o * NUM_PEAK_TYPES, stride, 4));
+    }
+    // PeakCombinedB1, PeakCombinedY1, PeakCombinedB2, PeakCombinedY2 are
+    // adjacent: store (Y1, Y1, flanks, flanks) for each bin.
+    __m128i lo = _mm_unpacklo_epi32(y1, flanks);
+    __m128i hi = _mm_unpackhi_epi32(y1, flanks);
+    int* out = cache + i * NUM_PEAK_TYPES + PeakCombinedB1;
+    _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi32(lo, _MM_SHUFFLE(1, 1, 0, 0)));
+    _mm_storeu_si128((__m128i*)(out + NUM_PEAK_TYPES), _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 3, 2, 2)));
+    _mm_storeu_si128((__m128i*)(out + 2 * NUM_PEAK_TYPES), _mm_shuffle_epi32(hi, _MM_SHUFFLE(1, 1, 0, 0)));
+    _mm_storeu_si128((__m128i*)(out + 3 * NUM_PEAK_TYPES), _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 3, 2, 2)));
+  }
+  return i;
+}
+
+#endif // PREPROCESS_KERNELS_AVX2
+
+bool PreprocessKernels::Vectorized() {
+#ifdef PREPROCESS_KERNELS_AVX2
+  return vectorized_ && CpuHasAvx2();
+#else
+  return false;
+#endif
+}
+
+void PreprocessKernels::SetVectorized(bool vectorized) {
+  vectorized_ = vectorized;
+}
+
+void PreprocessKernels::SqrtTransform(double* values, int n) {
+#ifdef PREPROCESS_KERNELS_AVX2
+  if (Vectorized()) {
+    SqrtTransformAvx2(values, n);
+    return;
+  }
+#endif
+  SqrtTransformScalar(values, n);
+}
+
+void PreprocessKernels::Threshold(double* values, int n, double cutoff) {
+#ifdef PREPROCESS_KERNELS_AVX2
+  if (Vectorized()) {
+    ThresholdAvx2(values, n, cutoff);
+    return;
+  }
+#endif
+  ThresholdScalar(values, 0, n, cutoff);
+}
+
+void PreprocessKernels::NormalizeRegion(double* values, int n, double cutoff,
+                                        double max_intensity) {
+  double highest;
+#ifdef PREPROCESS_KERNELS_AVX2
+  if (Vectorized()) {
+    ThresholdAvx2(values, n, cutoff);
+    highest = RegionMaxAvx2(values, n);
+    if (highest != 0)
+      ScaleAvx2(values, n, max_intensity / highest);
+    return;
+  }
+#endif
+  ThresholdScalar(values, 0, n, cutoff);
+  highest = RegionMaxScalar(values, 0, n, 0);
+  if (highest != 0)
+    ScaleScalar(values, 0, n, max_intensity / highest);
+}
+
+void PreprocessKernels::SubtractBackground(double* values, int n,
+                                           double multiplier, bool include_self,
+                                           vector<double>* partial_sums) {
+  // operation is as follows: new_observed = observed -
+  // average_within_window but average is computed as if the array
+  // extended infinitely: denominator is same throughout array, even
+  // near edges (where fewer elements have been summed)
+  partial_sums->resize(n + 1);
+  double* sums = &(*partial_sums)[0];
+  double total = 0;
+  for (int i = 0; i < n; ++i)
+    sums[i] = (total += values[i]);
+  sums[n] = total;
+
+#ifdef PREPROCESS_KERNELS_AVX2
+  // Bins in [begin, end) have windows that are not clipped.
+  int begin = MAX_XCORR_OFFSET + 1;
+  int end = n - MAX_XCORR_OFFSET + 1;
+  if (Vectorized() && begin < end) {
+    SubtractBackgroundScalar(values, 0, begin, n, multiplier, include_self, sums);
+    int done = SubtractBackgroundAvx2(values, begin, end, multiplier,
+                                      include_self, sums);
+    SubtractBackgroundScalar(values, done, n, n, multiplier, include_self, sums);
+    return;
+  }
+#endif
+  SubtractBackgroundScalar(values, 0, n, n, multiplier, include_self, sums);
+}
+
+void PreprocessKernels::FillPeakCache(const double* peaks, int n, int* cache) {
+#ifdef PREPROCESS_KERNELS_AVX2
+  if (Vectorized()) {
+    FillPeakCacheAvx2(peaks, n, cache);
+    return;
+  }
+#endif
+  FillPeakCacheScalar(peaks, 0, n, cache);
+}
+
+void PreprocessKernels::CombinePeakCache(int* cache, int cache_bin_end,
+                                         bool flanking_peaks,
+                                         bool neutral_loss_peaks,
+                                         int bin_nh3, int bin_h2o) {
+#ifdef PREPROCESS_KERNELS_AVX2
+  // Bins in [begin, end) have all of their neighbors within the cache.
+  int begin = max(1, max(bin_nh3, bin_h2o) + 1);
+  int end = cache_bin_end - 1;
+  if (Vectorized() && begin < end) {
+    CombinePeakCacheScalar(cache, 0, begin, cache_bin_end, flanking_peaks,
+                           neutral_loss_peaks, bin_nh3, bin_h2o);
+    int done = CombinePeakCacheAvx2(cache, begin, end, flanking_peaks,
+                                    neutral_loss_peaks, bin_nh3, bin_h2o);
+    CombinePeakCacheScalar(cache, done, cache_bin_end, cache_bin_end,
+                           flanking_peaks, neutral_loss_peaks, bin_nh3, bin_h2o);
+    return;
+  }
+#endif
+  CombinePeakCacheScalar(cache, 0, cache_bin_end, cache_bin_end, flanking_peaks,
+                         neutral_loss_peaks, bin_nh3, bin_h2o);
+}
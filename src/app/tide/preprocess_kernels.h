@@ -0,0 +1,68 @@
+// Vectorized kernels for the XCorr preprocessing pipeline.
+//
+// ObservedPeakSet::PreprocessSpectrum() (spectrum_preprocess2.cc) and
+// Spectrum::CreateEvidenceVector() (spectrum_collection.cc) share the same
+// dense per-bin operations: square-root transform, per-region max
+// normalization, partial-sum background subtraction and, for the XCorr cache,
+// integerization and the linear combinations described in
+// spectrum_preprocess.h. PreprocessKernels provides one implementation of
+// each of these, used by both paths.
+//
+// Every kernel has a scalar version, which is the reference implementation,
+// and where it pays off an AVX2 version selected at run time when the CPU
+// supports it. The AVX2 versions perform exactly the same floating point
+// operations in the same order as the scalar versions, so results are
+// bit-identical regardless of which version runs. SetVectorized(false) forces
+// the scalar versions, e.g. for testing and benchmarking.
+
+#ifndef PREPROCESS_KERNELS_H
+#define PREPROCESS_KERNELS_H
+
+#include <vector>
+
+using namespace std;
+
+class PreprocessKernels {
+ public:
+  // Replaces each of the n values with its square root.
+  static void SqrtTransform(double* values, int n);
+
+  // Sets each of the n values that is <= cutoff to zero.
+  static void Threshold(double* values, int n, double cutoff);
+
+  // Sets each of the n values that is <= cutoff to zero, then scales the
+  // region so that its highest value becomes max_intensity. A region whose
+  // values are all zero is left untouched.
+  static void NormalizeRegion(double* values, int n, double cutoff,
+                              double max_intensity);
+
+  // Subtracts from each value the sum of the values within MAX_XCORR_OFFSET
+  // bins of it, times multiplier. If include_self is false the value itself
+  // is left out of the sum. partial_sums is scratch space, reused across
+  // calls to avoid reallocation.
+  static void SubtractBackground(double* values, int n, double multiplier,
+                                 bool include_self,
+                                 vector<double>* partial_sums);
+
+  // Rounds each of the n peaks, scaled by 50000, to an integer x and writes
+  // x, 2x, 5x and 10x to the PeakMain, LossPeak, FlankingPeak and
+  // PrimaryPeak entries of the corresponding bin of cache.
+  static void FillPeakCache(const double* peaks, int n, int* cache);
+
+  // Fills the PeakCombined* entries of cache for bins [0, cache_bin_end)
+  // from the entries written by FillPeakCache().
+  static void CombinePeakCache(int* cache, int cache_bin_end,
+                               bool flanking_peaks, bool neutral_loss_peaks,
+                               int bin_nh3, int bin_h2o);
+
+  // Whether the AVX2 kernels are in use.
+  static bool Vectorized();
+  // Enables or disables the AVX2 kernels. They are enabled by default and are
+  // only ever used if the CPU supports them.
+  static void SetVectorized(bool vectorized);
+
+ private:
+  static bool vectorized_;
+};
+
+#endif // PREPROCESS_KERNELS_H
@@ -0,0 +1,118 @@
+// Microbenchmark for PreprocessKernels (see preprocess_kernels.h).
+//
+// Runs the dense part of ObservedPeakSet::PreprocessSpectrum() -- region
+// normalization, background subtraction and computation of the XCorr cache --
+// over a set of synthetic spectra, once with the scalar kernels and once with
+// the vectorized kernels, and reports the time per spectrum for each. Also
+// checks that both produce identical caches.
+//
+// Usage: preprocess-kernels-benchmark [num_spectra] [max_mz] [repeats]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "preprocess_kernels.h"
+#include "theoretical_peak_pair.h"
+#include "max_mz.h"
+
+using namespace std;
+
+// Bins between the ion and its NH3 and H2O losses at the default bin width.
+static const int kBinNH3 = 17;
+static const int kBinH2O = 18;
+
+static void MakeSpectra(int num_spectra, int num_bins, vector<double>* peaks) {
+  mt19937 rng(1);
+  uniform_int_distribution<int> num_peaks(50, 400);
+  uniform_int_distribution<int> bin(0, num_bins - 1);
+  lognormal_distribution<double> intensity(8.0, 1.5);
+  peaks->assign((size_t)num_spectra * num_bins, 0);
+  for (int s = 0; s < num_spectra; ++s) {
+    double* spectrum = &(*peaks)[(size_t)s * num_bins];
+    for (int p = num_peaks(rng); p > 0; --p) {
+      double value = sqrt(intensity(rng));
+      int b = bin(rng);
+      if (value > spectrum[b])
+        spectrum[b] = value;
+    }
+  }
+}
+
+static void Preprocess(const double* spectrum, int num_bins, int cache_bin_end,
+                       double* peaks, int* cache, vector<double>* partial_sums) {
+  memcpy(peaks, spectrum, sizeof(double) * num_bins);
+  double highest = 0;
+  int largest_mz = 0;
+  for (int i = 0; i < num_bins; ++i) {
+    if (peaks[i] > 0)
+      largest_mz = i;
+    if (peaks[i] > highest)
+      highest = peaks[i];
+  }
+  int region_size = largest_mz / 10 + 1;
+  for (int i = 0; i < 10; ++i)
+    PreprocessKernels::NormalizeRegion(peaks + i * region_size, region_size,
+                                       highest * 0.05, 50.0);
+  PreprocessKernels::SubtractBackground(peaks, num_bins,
+                                        1.0 / (MAX_XCORR_OFFSET * 2), false,
+                                        partial_sums);
+  PreprocessKernels::FillPeakCache(peaks, num_bins, cache);
+  memset(cache + num_bins * NUM_PEAK_TYPES, 0,
+         sizeof(int) * (cache_bin_end - num_bins) * NUM_PEAK_TYPES);
+  PreprocessKernels::CombinePeakCache(cache, cache_bin_end, true, true,
+                                      kBinNH3, kBinH2O);
+}
+
+static double Run(const vector<double>& spectra, int num_spectra, int num_bins,
+                  int repeats, vector<int>* caches) {
+  int cache_bin_end = num_bins + 30;
+  // Region normalization may run up to ten bins beyond the last peak.
+  vector<double> peaks(num_bins + 10);
+  vector<double> partial_sums;
+  caches->assign((size_t)num_spectra * cache_bin_end * NUM_PEAK_TYPES, 0);
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (int r = 0; r < repeats; ++r) {
+    for (int s = 0; s < num_spectra; ++s) {
+      Preprocess(&spectra[(size_t)s * num_bins], num_bins, cache_bin_end,
+                 &peaks[0], &(*caches)[(size_t)s * cache_bin_end * NUM_PEAK_TYPES],
+                 &partial_sums);
+    }
+  }
+  chrono::nanoseconds elapsed = chrono::steady_clock::now() - start;
+  return (double)elapsed.count() / ((double)num_spectra * repeats);
+}
+
+int main(int argc, char** argv) {
+  int num_spectra = argc > 1 ? atoi(argv[1]) : 1000;
+  int max_mz = argc > 2 ? atoi(argv[2]) : 2000;
+  int repeats = argc > 3 ? atoi(argv[3]) : 20;
+  if (num_spectra <= 0 || max_mz <= 0 || repeats <= 0) {
+    fprintf(stderr, "Usage: %s [num_spectra] [max_mz] [repeats]\n", argv[0]);
+    return 1;
+  }
+  int num_bins = max_mz + MAX_XCORR_OFFSET + 1;
+
+  vector<double> spectra;
+  MakeSpectra(num_spectra, num_bins, &spectra);
+
+  vector<int> scalar_caches, vector_caches;
+  PreprocessKernels::SetVectorized(false);
+  double scalar_ns = Run(spectra, num_spectra, num_bins, repeats, &scalar_caches);
+  PreprocessKernels::SetVectorized(true);
+  bool vectorized = PreprocessKernels::Vectorized();
+  double vector_ns = Run(spectra, num_spectra, num_bins, repeats, &vector_caches);
+
+  printf("spectra: %d, bins: %d, repeats: %d\n", num_spectra, num_bins, repeats);
+  printf("scalar:     %10.1f ns/spectrum\n", scalar_ns);
+  printf("vectorized: %10.1f ns/spectrum%s\n", vector_ns,
+         vectorized ? "" : " (AVX2 unavailable; scalar kernels used)");
+  if (scalar_caches != vector_caches) {
+    printf("ERROR: scalar and vectorized caches differ\n");
+    return 1;
+  }
+  return 0;
+}
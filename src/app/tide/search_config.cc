@@ -0,0 +1,25 @@
+#include "search_config.h"
+#include "util/crux-utils.h"
+#include "util/Params.h"
+
+SearchConfig::SearchConfig()
+  : score_function(string_to_score_function_type(Params::GetString("score-function"))),
+    exact_pval_search(Params::GetBool("exact-p-value")),
+    use_tailor_calibration(Params::GetBool("use-tailor-calibration")),
+    use_neutral_loss_peaks(Params::GetBool("use-neutral-loss-peaks")),
+    use_flanking_peaks(Params::GetBool("use-flanking-peaks")),
+    fragment_tolerance(Params::GetDouble("fragment-tolerance")),
+    evidence_granularity(Params::GetInt("evidence-granularity")),
+    skip_preprocessing(Params::GetBool("skip-preprocessing")),
+    remove_precursor_peak(Params::GetBool("remove-precursor-peak")),
+    remove_precursor_tolerance(Params::GetDouble("remove-precursor-tolerance")),
+    deisotope_threshold(Params::GetDouble("deisotope")),
+    peptide_centric(Params::GetBool("peptide-centric-search")),
+    max_charge(Params::GetInt("max-precursor-charge")),
+    elution_window(Params::GetInt("elution-window-size")),
+    print_interval(Params::GetInt("print-search-progress")),
+    concat(Params::GetBool("concat")),
+    file_column(Params::GetBool("file-column")),
+    precision(Params::GetInt("precision")),
+    mass_precision(Params::GetInt("mass-precision")) {
+}
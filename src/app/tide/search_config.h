@@ -0,0 +1,50 @@
+// SearchConfig is a typed snapshot of the parameters that tide-search consults
+// while it scores spectra and writes matches.
+//
+// Params stores everything in string-keyed maps, so every Params::GetBool()
+// and friends costs a map lookup and a string comparison chain. That is fine
+// at start-up, but several of these parameters used to be read once per
+// spectrum, per SetActiveRange() call or per reported match. A SearchConfig
+// is built once, after the parameters have been processed, and then passed by
+// const reference into the search loop, ActivePeptideQueue, TideMatchSet and
+// the spectrum preprocessing code. All members are const; to pick up changed
+// parameter values, construct a new SearchConfig.
+
+#ifndef SEARCH_CONFIG_H
+#define SEARCH_CONFIG_H
+
+#include "model/objects.h"
+
+struct SearchConfig {
+  // Reads the current values from Params.
+  SearchConfig();
+
+  // Scoring
+  const SCORE_FUNCTION_T score_function;
+  const bool exact_pval_search;
+  const bool use_tailor_calibration;
+  const bool use_neutral_loss_peaks;
+  const bool use_flanking_peaks;
+  const double fragment_tolerance;
+  const int evidence_granularity;
+
+  // Spectrum preprocessing
+  const bool skip_preprocessing;
+  const bool remove_precursor_peak;
+  const double remove_precursor_tolerance;
+  const double deisotope_threshold;
+
+  // Search
+  const bool peptide_centric;
+  const int max_charge;
+  const int elution_window;
+  const int print_interval;
+
+  // Output
+  const bool concat;
+  const bool file_column;
+  const int precision;
+  const int mass_precision;
+};
+
+#endif // SEARCH_CONFIG_H
@@ -0,0 +1,98 @@
+// Microbenchmark for SearchConfig (see search_config.h).
+//
+// Replays the parameter reads that tide-search made per spectrum before
+// SearchConfig existed -- spectrum preprocessing, ActivePeptideQueue::
+// SetActiveRange() and TideMatchSet::report() with its per-match writes --
+// once through the Params lookups the old code used and once through a
+// SearchConfig, and reports the time per spectrum for each. Also checks that
+// both read the same values.
+//
+// Usage: search-config-benchmark [num_spectra] [matches_per_spectrum]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "search_config.h"
+#include "util/Params.h"
+
+using namespace std;
+
+// Folds every value read into a checksum, so that no read is optimized away.
+struct Checksum {
+  Checksum() : value(0) {}
+  void Add(bool b) { value = value * 31 + (b ? 1 : 0); }
+  void Add(int i) { value = value * 31 + (double)i; }
+  void Add(double d) { value = value * 31 + d; }
+  double value;
+};
+
+static double RunParams(int num_spectra, int matches, Checksum* sum) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (int s = 0; s < num_spectra; ++s) {
+    // ObservedPeakSet::PreprocessSpectrum()
+    sum->Add(Params::GetBool("skip-preprocessing"));
+    sum->Add(Params::GetBool("remove-precursor-peak"));
+    sum->Add(Params::GetDouble("remove-precursor-tolerance"));
+    sum->Add(Params::GetDouble("deisotope"));
+    // ActivePeptideQueue::SetActiveRange()
+    sum->Add(Params::GetBool("use-tailor-calibration"));
+    // TideMatchSet::report() and writeToFile()
+    sum->Add(Params::GetBool("concat"));
+    sum->Add(Params::GetInt("mass-precision"));
+    sum->Add(Params::GetInt("precision"));
+    sum->Add(Params::GetBool("concat"));
+    for (int m = 0; m < matches; ++m) {
+      sum->Add(Params::GetBool("file-column"));
+      sum->Add(Params::GetBool("use-tailor-calibration"));
+      sum->Add(Params::GetBool("concat"));
+    }
+  }
+  chrono::nanoseconds elapsed = chrono::steady_clock::now() - start;
+  return (double)elapsed.count() / num_spectra;
+}
+
+static double RunConfig(int num_spectra, int matches, Checksum* sum) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  const SearchConfig config;
+  for (int s = 0; s < num_spectra; ++s) {
+    sum->Add(config.skip_preprocessing);
+    sum->Add(config.remove_precursor_peak);
+    sum->Add(config.remove_precursor_tolerance);
+    sum->Add(config.deisotope_threshold);
+    sum->Add(config.use_tailor_calibration);
+    sum->Add(config.concat);
+    sum->Add(config.mass_precision);
+    sum->Add(config.precision);
+    sum->Add(config.concat);
+    for (int m = 0; m < matches; ++m) {
+      sum->Add(config.file_column);
+      sum->Add(config.use_tailor_calibration);
+      sum->Add(config.concat);
+    }
+  }
+  chrono::nanoseconds elapsed = chrono::steady_clock::now() - start;
+  return (double)elapsed.count() / num_spectra;
+}
+
+int main(int argc, char** argv) {
+  int num_spectra = argc > 1 ? atoi(argv[1]) : 100000;
+  int matches = argc > 2 ? atoi(argv[2]) : 5;
+  if (num_spectra <= 0 || matches < 0) {
+    fprintf(stderr, "Usage: %s [num_spectra] [matches_per_spectrum]\n", argv[0]);
+    return 1;
+  }
+
+  Checksum params_sum, config_sum;
+  double params_ns = RunParams(num_spectra, matches, &params_sum);
+  double config_ns = RunConfig(num_spectra, matches, &config_sum);
+
+  printf("spectra: %d, matches per spectrum: %d\n", num_spectra, matches);
+  printf("Params lookups: %10.1f ns/spectrum\n", params_ns);
+  printf("SearchConfig:   %10.1f ns/spectrum (including its construction)\n",
+         config_ns);
+  if (params_sum.value != config_sum.value) {
+    printf("ERROR: Params and SearchConfig read different values\n");
+    return 1;
+  }
+  return 0;
+}
@@ -11,10 +11,10 @@
 #include "spectrum_collection.h"
 #include "mass_constants.h"
 #include "max_mz.h"
+#include "preprocess_kernels.h"
 #include "records.h"
 #include "records_to_vector-inl.h"
 #include "util/mass.h"
-#include "util/Params.h"
 
 using namespace std;
 using google::protobuf::uint64;
@@ -172,6 +172,7 @@ bool Spectrum::Deisotope(int index, double deisotope_threshold) const {
  * Ported to and integrated with Tide by Jeff Howbert, November, 2013.
  */
 vector<double> Spectrum::CreateEvidenceVector(
+  const SearchConfig& config,
   double binWidth,
   double binOffset,
   int charge,
@@ -196,10 +197,10 @@ vector<double> Spectrum::CreateEvidenceVector(
   double maxIonIntens = 0.0;
 
   // Find max ion mass and max ion intensity
-  bool skipPreprocess = Params::GetBool("skip-preprocessing");
-  bool remove_precursor = !skipPreprocess && Params::GetBool("remove-precursor-peak");
-  double precursorMZExclude = Params::GetDouble("remove-precursor-tolerance");
-  double deisotope_threshold = Params::GetDouble("deisotope");
+  bool skipPreprocess = config.skip_preprocessing;
+  bool remove_precursor = !skipPreprocess && config.remove_precursor_peak;
+  double precursorMZExclude = config.remove_precursor_tolerance;
+  double deisotope_threshold = config.deisotope_threshold;
   set<int> peakSkip;
   for (int ion = 0; ion < numPeaks; ion++) {
     double ionMass = M_Z(ion);
@@ -238,7 +239,6 @@ vector<double> Spectrum::CreateEvidenceVector(
   // 10 bin intensity normalization 
   int regionSelector = (int)floor(MassConstants::mass2bin(maxIonMass) / (double)NUM_SPECTRUM_REGIONS);
   vector<double> intensObs(maxPrecurMass, 0);
-  vector<int> intensRegion(maxPrecurMass, -1);
   for (int ion = 0; ion < numPeaks; ion++) {
     if (peakSkip.find(ion) != peakSkip.end()) {
       continue;
@@ -246,57 +246,38 @@ vector<double> Spectrum::CreateEvidenceVector(
     double ionMass = M_Z(ion);
     double ionIntens = Intensity(ion);
     int ionBin = MassConstants::mass2bin(ionMass);
-    int region = (int)floor((double)(ionBin) / (double)regionSelector);
-    if (region >= NUM_SPECTRUM_REGIONS) {
-      region = NUM_SPECTRUM_REGIONS - 1;
-    }
-    intensRegion[ionBin] = region;
     if (intensObs[ionBin] < ionIntens) {
       intensObs[ionBin] = ionIntens;
     }
   }
 
   maxIonIntens = sqrt(maxIonIntens);
-  for (vector<double>::iterator i = intensObs.begin(); i != intensObs.end(); i++) {
-    *i = sqrt(*i);
-    if (*i <= 0.05 * maxIonIntens) {
-      *i = 0.0;
-    }
-  }
-
-  vector<double> maxRegion(NUM_SPECTRUM_REGIONS, 0);
-  for (int i = 0; i < maxPrecurMass; i++) {
-    int reg = intensRegion[i];
-    if (reg >= 0 && maxRegion[reg] < intensObs[i]) {
-      maxRegion[reg] = intensObs[i];
-    }
-  }
-  for (int i = 0; i < maxPrecurMass; i++) {
-    int reg = intensRegion[i];
-    if (reg >= 0 && maxRegion[reg] > 0.0) {
-      intensObs[i] *= (maxIntensPerRegion / maxRegion[reg]);
+  PreprocessKernels::SqrtTransform(intensObs.data(), maxPrecurMass);
+  double intensCutoff = 0.05 * maxIonIntens;
+  if (regionSelector > 0) {
+    // Region i holds bins [i * regionSelector, (i + 1) * regionSelector); the
+    // last region also holds everything above it.
+    for (int i = 0; i < NUM_SPECTRUM_REGIONS; i++) {
+      int regionBegin = std::min(i * regionSelector, maxPrecurMass);
+      int regionEnd = (i == NUM_SPECTRUM_REGIONS - 1) ? maxPrecurMass :
+        std::min((i + 1) * regionSelector, maxPrecurMass);
+      PreprocessKernels::NormalizeRegion(intensObs.data() + regionBegin, regionEnd - regionBegin,
+                                         intensCutoff, maxIntensPerRegion);
     }
+  } else {
+    PreprocessKernels::Threshold(intensObs.data(), maxPrecurMass, intensCutoff);
   }
 
   // ***** Adapted from tide/spectrum_preprocess2.cc.
-  // TODO replace, if possible, with call to
-  // static void SubtractBackground(double* observed, int end).
-  // Note numerous small changes from Tide code.
+  // Note small changes from Tide code: the peak itself is included in the
+  // window and counted in the denominator.
   vector<double> partial_sums;
-  partial_sums.reserve(maxPrecurMass);
-  double total = 0.0;
-  for (vector<double>::const_iterator i = intensObs.begin(); i != intensObs.end(); i++) {
-    partial_sums.push_back(total += *i);
-  }
-  const double multiplier = 1.0 / (MAX_XCORR_OFFSET * 2.0 + 1.0);
-  for (int i = 0; i < maxPrecurMass; ++i) {
-    int right = std::min(maxPrecurMass - 1, i + MAX_XCORR_OFFSET);
-    int left = std::max(0, i - MAX_XCORR_OFFSET - 1);
-    intensObs[i] -= multiplier * (partial_sums[right] - partial_sums[left]);
-  }
+  PreprocessKernels::SubtractBackground(intensObs.data(), maxPrecurMass,
+                                        1.0 / (MAX_XCORR_OFFSET * 2.0 + 1.0), true,
+                                        &partial_sums);
 
-  bool flankingPeaks = Params::GetBool("use-flanking-peaks");
-  bool nlPeaks = Params::GetBool("use-neutral-loss-peaks");
+  bool flankingPeaks = config.use_flanking_peaks;
+  bool nlPeaks = config.use_neutral_loss_peaks;
   int binFirst = MassConstants::mass2bin(30);
   int binLast = MassConstants::mass2bin(pepMassMonoMean - 47);
   vector<double> evidence(maxPrecurMass, 0);
@@ -369,6 +350,7 @@ vector<double> Spectrum::CreateEvidenceVector(
 }
 
 vector<int> Spectrum::CreateEvidenceVectorDiscretized(
+  const SearchConfig& config,
   double binWidth,
   double binOffset,
   int charge,
@@ -380,7 +362,7 @@ vector<int> Spectrum::CreateEvidenceVectorDiscretized(
   long int* num_retained
 ) const {
   vector<double> evidence =
-    CreateEvidenceVector(binWidth, binOffset, charge, pepMassMonoMean, maxPrecurMass,
+    CreateEvidenceVector(config, binWidth, binOffset, charge, pepMassMonoMean, maxPrecurMass,
                          num_range_skipped, num_precursors_skipped, num_isotopes_skipped, num_retained);
   vector<int> discretized;
   discretized.reserve(evidence.size());
@@ -24,6 +24,7 @@
 #include <vector>
 #include "header.pb.h"
 #include "spectrum.pb.h"
+#include "search_config.h"
 
 using namespace std;
 
@@ -68,6 +69,7 @@ class Spectrum {
   bool Deisotope(int index, double deisotope_threshold) const;
 
   std::vector<double> CreateEvidenceVector(
+    const SearchConfig& config,
     double binWidth,
     double binOffset,
     int charge,
@@ -78,6 +80,7 @@ class Spectrum {
     long int* num_isotopes_skipped = NULL,
     long int* num_retained = NULL) const;
   std::vector<int> CreateEvidenceVectorDiscretized(
+    const SearchConfig& config,
     double binWidth,
     double binOffset,
     int charge,
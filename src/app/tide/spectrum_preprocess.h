@@ -109,6 +109,7 @@
 #include "theoretical_peak_pair.h"
 #include "max_mz.h"
 #include "mass_constants.h"
+#include "search_config.h"
 
 using namespace std;
 
@@ -139,12 +140,15 @@ class ObservedPeakSet {
   int DebugDotProd(const TheoreticalPeakArr& theoretical);
 #endif
 
-  void PreprocessSpectrum(const Spectrum& spectrum, int charge) {
+  void PreprocessSpectrum(const SearchConfig& config,
+                          const Spectrum& spectrum, int charge) {
     long int dummy1, dummy2, dummy3, dummy4;
-    PreprocessSpectrum(spectrum, charge, &dummy1, &dummy2, &dummy3, &dummy4);
+    PreprocessSpectrum(config, spectrum, charge,
+                       &dummy1, &dummy2, &dummy3, &dummy4);
   }
 
-  void PreprocessSpectrum(const Spectrum& spectrum, int charge,
+  void PreprocessSpectrum(const SearchConfig& config,
+                          const Spectrum& spectrum, int charge,
                           long int* num_range_skipped,
                           long int* num_precursors_skipped,
                           long int* num_isotopes_skipped,
@@ -152,7 +156,8 @@ class ObservedPeakSet {
 
   // created by Andy Lin 2/11/2016
   // Method for creating residue evidence matrix from Spectrum
-  void CreateResidueEvidenceMatrix(const Spectrum& spectrum,
+  void CreateResidueEvidenceMatrix(const SearchConfig& config,
+                                   const Spectrum& spectrum,
                                    int charge,
                                    int maxPrecurMassBin,
                                    double precursorMass,
@@ -226,6 +231,7 @@ class ObservedPeakSet {
 
   double* peaks_;
   int* cache_;
+  vector<double> partial_sums_; // scratch space for background subtraction
 
   bool NL_;
   bool FP_;
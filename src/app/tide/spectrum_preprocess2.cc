@@ -22,8 +22,8 @@
 #include "spectrum_preprocess.h"
 #include "mass_constants.h" //added by Andy Lin
 #include "max_mz.h"
+#include "preprocess_kernels.h"
 #include "util/mass.h"
-#include "util/Params.h"
 #include <cmath>
 
 using namespace std;
@@ -33,31 +33,8 @@ DEFINE_int32(debug_spectrum_id, -1, "Spectrum number to debug");
 DEFINE_int32(debug_charge, 0, "Charge to debug. 0 for all");
 #endif
 
-// This computes that part of the XCORR function where an average value of the
-// peaks within a window surrounding each peak is subtracted from that peak.
-// This version is a linear-time implementation of the subtraction. Linearity is
-// accomplished by computing an array of partial sums.
-static void SubtractBackground(double* observed, int end) {
-  // operation is as follows: new_observed = observed -
-  // average_within_window but average is computed as if the array
-  // extended infinitely: denominator is same throughout array, even
-  // near edges (where fewer elements have been summed)
-  static const double multiplier = 1.0 / (MAX_XCORR_OFFSET * 2);
-
-  double total = 0;
-  vector<double> partial_sums(end+1);
-  for (int i = 0; i < end; ++i)
-    partial_sums[i] = (total += observed[i]);
-  partial_sums[end] = total;
-
-  for (int i = 0; i < end; ++i) {
-    int right_index = min(end, i + MAX_XCORR_OFFSET);
-    int left_index = max(0, i - MAX_XCORR_OFFSET - 1);
-    observed[i] -= multiplier * (partial_sums[right_index] - partial_sums[left_index] - observed[i]);
-  }
-}
-
-void ObservedPeakSet::PreprocessSpectrum(const Spectrum& spectrum, int charge,
+void ObservedPeakSet::PreprocessSpectrum(const SearchConfig& config,
+                                         const Spectrum& spectrum, int charge,
                                          long int* num_range_skipped,
                                          long int* num_precursors_skipped,
                                          long int* num_isotopes_skipped,
@@ -79,7 +56,7 @@ void ObservedPeakSet::PreprocessSpectrum(const Spectrum& spectrum, int charge,
 
   memset(peaks_, 0, sizeof(double) * MaxBin::Global().BackgroundBinEnd());
 
-  if (Params::GetBool("skip-preprocessing")) {
+  if (config.skip_preprocessing) {
     for (int i = 0; i < spectrum.Size(); ++i) {
       double peak_location = spectrum.M_Z(i);
       if (peak_location >= experimental_mass_cut_off) {
@@ -93,9 +70,9 @@ void ObservedPeakSet::PreprocessSpectrum(const Spectrum& spectrum, int charge,
       }
     }
   } else {
-    bool remove_precursor = Params::GetBool("remove-precursor-peak");
-    double precursor_tolerance = Params::GetDouble("remove-precursor-tolerance");
-    double deisotope_threshold = Params::GetDouble("deisotope");
+    bool remove_precursor = config.remove_precursor_peak;
+    double precursor_tolerance = config.remove_precursor_tolerance;
+    double deisotope_threshold = config.deisotope_threshold;
     int max_charge = spectrum.MaxCharge();
 
     // Fill peaks
@@ -141,31 +118,10 @@ void ObservedPeakSet::PreprocessSpectrum(const Spectrum& spectrum, int charge,
 
     double intensity_cutoff = highest_intensity * 0.05;
 
-    double normalizer = 0.0;
     int region_size = largest_mz / NUM_SPECTRUM_REGIONS + 1;
     for (int i = 0; i < NUM_SPECTRUM_REGIONS; ++i) {
-      highest_intensity = 0;
-      int high_index = i;
-      for (int j = 0; j < region_size; ++j) {
-        int index = i * region_size + j;
-        if (peaks_[index] <= intensity_cutoff) {
-          peaks_[index] = 0;
-        }
-        if (peaks_[index] > highest_intensity) {
-          highest_intensity = peaks_[index];
-          high_index = index;
-        }
-      }
-      if (highest_intensity == 0) {
-        continue;
-      }
-      normalizer = 50.0 / highest_intensity;
-      for (int j = 0; j < region_size; ++j) {
-        int index = i * region_size + j;
-        if (peaks_[index] != 0) {
-          peaks_[index] *= normalizer;
-        }
-      }
+      PreprocessKernels::NormalizeRegion(peaks_ + i * region_size, region_size,
+                                         intensity_cutoff, 50.0);
     }
 
 #ifdef DEBUG
@@ -179,7 +135,12 @@ void ObservedPeakSet::PreprocessSpectrum(const Spectrum& spectrum, int charge,
     }
 #endif
   }
-  SubtractBackground(peaks_, max_mz_.BackgroundBinEnd());
+  // This computes that part of the XCORR function where an average value of
+  // the peaks within a window surrounding each peak is subtracted from that
+  // peak.
+  PreprocessKernels::SubtractBackground(peaks_, max_mz_.BackgroundBinEnd(),
+                                        1.0 / (MAX_XCORR_OFFSET * 2), false,
+                                        &partial_sums_);
 
 #ifdef DEBUG
   if (debug)
@@ -193,65 +154,22 @@ void ObservedPeakSet::PreprocessSpectrum(const Spectrum& spectrum, int charge,
 #endif
 }
 
-inline int round_to_int(double x) {
-  if (x >= 0)
-    return int(x + 0.5);
-  return int(x - 0.5);
-}
-
 void ObservedPeakSet::MakeInteger() {
-  // essentially cheap fixed-point arithmetic for peak intensities
-  for(int i = 0; i < max_mz_.BackgroundBinEnd(); i++)
-    Peak(PeakMain, i) = round_to_int(peaks_[i]*50000);
+  // essentially cheap fixed-point arithmetic for peak intensities. This also
+  // fills in the LossPeak, FlankingPeak and PrimaryPeak entries of the cache.
+  PreprocessKernels::FillPeakCache(peaks_, max_mz_.BackgroundBinEnd(), cache_);
 }
 
 // See .h file. Computes and stores all transformations of the observed peak
 // set.
 void ObservedPeakSet::ComputeCache() {
-  for (int i = 0; i < max_mz_.BackgroundBinEnd(); ++i) {
-    // Instead of computing 10 * x, 25 * x, and 50 * x, we compute 2 *
-    // x, 5 * x and 10 * x. This results in dot products that are 5
-    // times too small, but the adjustments can be made at the last
-    // moment e.g. when results are displayed. These smaller
-    // multiplications allow us to use addition operations instead of
-    // multiplications.
-    int x = Peak(PeakMain, i);
-    int y = x+x;
-    Peak(LossPeak, i) = y;
-    int z = y+y+x;
-    Peak(FlankingPeak, i) = z;
-    Peak(PrimaryPeak, i) = z+z;
-  }
-
   for (int i = max_mz_.BackgroundBinEnd() * NUM_PEAK_TYPES; i < cache_end_; ++i) {
     cache_[i] = 0;
   }
 
-  for (int i = 0; i < max_mz_.CacheBinEnd(); ++i) {
-    int flanks = Peak(PrimaryPeak, i);
-    if ( FP_ == true) {
-        if (i > 0) {
-          flanks += Peak(FlankingPeak, i-1);
-        }
-        if (i < max_mz_.CacheBinEnd() - 1) {
-          flanks += Peak(FlankingPeak, i+1);
-        }
-    }
-    int Y1 = flanks;
-    if ( NL_ == true) {
-        if (i > MassConstants::BIN_NH3) {
-          Y1 += Peak(LossPeak, i-MassConstants::BIN_NH3);
-        }
-        if (i > MassConstants::BIN_H2O) {
-          Y1 += Peak(LossPeak, i-MassConstants::BIN_H2O);
-        }
-    }
-    Peak(PeakCombinedY1, i) = Y1;
-    int B1 = Y1;
-    Peak(PeakCombinedB1, i) = B1;
-    Peak(PeakCombinedY2, i) = flanks;
-    Peak(PeakCombinedB2, i) = flanks;
-  }
+  PreprocessKernels::CombinePeakCache(cache_, max_mz_.CacheBinEnd(), FP_, NL_,
+                                      (int)MassConstants::BIN_NH3,
+                                      (int)MassConstants::BIN_H2O);
 }
 
 // This dot product is replaced by calls to on-the-fly compiled code.
@@ -358,6 +276,7 @@ void ObservedPeakSet::addEvidToResEvMatrix(
 // Written by Andy Lin in Feb 2016
 // From an observed spectrum, calculate and populate the residue evidence matrix
 void ObservedPeakSet::CreateResidueEvidenceMatrix(
+  const SearchConfig& config,
   const Spectrum& spectrum,
   int charge,
   int maxPrecurMassBin,
@@ -395,10 +314,10 @@ void ObservedPeakSet::CreateResidueEvidenceMatrix(
   const double maxIntensPerRegion = 50.0;
 
   // Determining max ion mass and max ion intensity
-  bool skipPreprocess = Params::GetBool("skip-preprocessing");
-  bool remove_precursor = !skipPreprocess && Params::GetBool("remove-precursor-peak");
-  double precursorMZExclude = Params::GetDouble("remove-precursor-tolerance");
-  double deisotope_threshold = Params::GetDouble("deisotope");
+  bool skipPreprocess = config.skip_preprocessing;
+  bool remove_precursor = !skipPreprocess && config.remove_precursor_peak;
+  double precursorMZExclude = config.remove_precursor_tolerance;
+  double deisotope_threshold = config.deisotope_threshold;
   double maxIonIntens = 0.0;
   double maxIonMass = 0.0;
   set<int> peakSkip;
@@ -228,6 +228,7 @@ vector<string> SearchForXLinks::getOptions() const {
     "precursor-window-weibull",
     "precursor-window-type-weibull",
     "min-weibull-points",
+    "xlink-weibull-reuse-decoys",
     "use-a-ions",
     "use-b-ions",
     "use-c-ions",
@@ -252,6 +253,7 @@ vector<string> SearchForXLinks::getOptions() const {
     "use-z-line",
     "top-match",
     "print-search-progress",
+    "num-threads",
     "output-dir",
     "overwrite",
     "parameter-file",
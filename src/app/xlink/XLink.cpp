@@ -9,11 +9,13 @@
 
 #include <sstream>
 #include <iostream>
+#include "boost/thread/mutex.hpp"
 using namespace std;
 
 namespace XLink {
 
 set<Crux::Peptide*> allocated_peptides_; ///< tracker for allocated peptides
+boost::mutex allocated_peptides_mutex_; ///< decoys are shuffled on several threads
 
 bool testInterIntraKeep(
   Crux::Peptide *pep1,
@@ -143,6 +145,7 @@ void addAllocatedPeptide(
   Crux::Peptide* peptide ///< peptide to add
   ) {
 
+  boost::mutex::scoped_lock lock(allocated_peptides_mutex_);
   allocated_peptides_.insert(peptide);
 }
 
@@ -150,6 +153,7 @@ void addAllocatedPeptide(
  * delete all peptides that are allocated
  */
 void deleteAllocatedPeptides() {
+  boost::mutex::scoped_lock lock(allocated_peptides_mutex_);
   carp(CARP_DEBUG, "deleting %d peptides", allocated_peptides_.size());
   for (set<Crux::Peptide*>::iterator iter =
     allocated_peptides_.begin();
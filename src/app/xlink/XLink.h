@@ -90,7 +90,8 @@ void addAllocatedPeptide(
   );
 
 /**
- * delete all peptides that are allocated
+ * delete all peptides that are allocated. Only call this once no other
+ * thread is still using the candidates made from them.
  */
 void deleteAllocatedPeptides();
 
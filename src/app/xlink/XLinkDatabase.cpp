@@ -9,6 +9,28 @@
 
 using namespace std;
 
+/**
+ * Computes both masses of each entry, which are otherwise calculated and
+ * cached on first use, so that search threads only read the database.
+ */
+template<typename T>
+static void cacheMasses(vector<T>& entries) {
+  for (typename vector<T>::iterator iter = entries.begin(); iter != entries.end(); ++iter) {
+    iter->getMass(MONO);
+    iter->getMass(AVERAGE);
+  }
+}
+
+/**
+ * Also caches the modified sequence that predictIons uses.
+ */
+static void cacheLinkableValues(vector<XLinkablePeptide>& xpeptides) {
+  cacheMasses(xpeptides);
+  for (vector<XLinkablePeptide>::iterator iter = xpeptides.begin(); iter != xpeptides.end(); ++iter) {
+    iter->getModifiedSequencePtr();
+  }
+}
+
 Database* XLinkDatabase::protein_database_;
 XLinkBondMap XLinkDatabase::bondmap_;
 
@@ -214,6 +236,17 @@ void XLinkDatabase::initialize() {
     flattenLinkablePeptides(target_xlinkable_peptides_, target_xlinkable_peptides_flatten_);
   }
 
+  //From here on the database is read-only.
+  cacheMasses(target_linear_peptides_);
+  cacheMasses(decoy_linear_peptides_);
+  cacheMasses(target_monolink_peptides_);
+  cacheMasses(target_selfloop_peptides_);
+  cacheMasses(decoy_selfloop_peptides_);
+  cacheLinkableValues(target_xlinkable_peptides_);
+  cacheLinkableValues(decoy_xlinkable_peptides_);
+  cacheLinkableValues(target_xlinkable_peptides_flatten_);
+  cacheLinkableValues(decoy_xlinkable_peptides_flatten_);
+
   carp(CARP_INFO, "Done initializing database");
 }
 
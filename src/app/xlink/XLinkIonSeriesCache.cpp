@@ -1,7 +1,13 @@
 #include "XLinkIonSeriesCache.h"
 
+#include "boost/thread/mutex.hpp"
+
 using namespace std;
 
+//The cache is filled on demand by the threads searching spectra.
+static boost::mutex ion_series_mutex_;
+static boost::mutex ion_constraint_mutex_;
+
 vector<vector<IonSeries*> > XLinkIonSeriesCache::target_xlinkable_ion_series_;
 
 vector<vector<IonSeries*> > XLinkIonSeriesCache::decoy_xlinkable_ion_series_;
@@ -15,6 +21,7 @@ IonSeries* XLinkIonSeriesCache::getXLinkablePeptideIonSeries(
 
   IonSeries* ans = NULL;
   int xpep_idx = xpep.getIndex();
+  boost::mutex::scoped_lock lock(ion_series_mutex_);
 
   if (xpep_idx == -1) {
     //carp(CARP_DEBUG, "Unindexed xlinkable peptide. Returning NULL");
@@ -103,6 +110,7 @@ IonConstraint* XLinkIonSeriesCache::getXCorrIonConstraint(
   ) {
 
   int charge_idx = charge - 1;
+  boost::mutex::scoped_lock lock(ion_constraint_mutex_);
 
   while(xcorr_ion_constraint_.size() <= charge_idx) {
     xcorr_ion_constraint_.push_back(IonConstraint::newIonConstraintSmart(XCORR, (xcorr_ion_constraint_.size()+1)));
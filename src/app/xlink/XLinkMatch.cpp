@@ -16,6 +16,7 @@
 #include "XLinkPeptide.h"
 #include "XLinkablePeptide.h"
 #include "io/OutputFiles.h"
+#include "boost/thread/mutex.hpp"
 using namespace std;
 
 /**
@@ -194,9 +195,11 @@ string XLinkMatch::getCandidateTypeString(
 }
 
 vector<IonConstraint*> XLinkMatch::ion_constraint_xcorr_;
+static boost::mutex ion_constraint_xcorr_mutex_;
 
 IonConstraint* XLinkMatch::getIonConstraintXCORR(int charge) {
   int idx = charge-1;
+  boost::mutex::scoped_lock lock(ion_constraint_xcorr_mutex_);
   while(ion_constraint_xcorr_.size() < charge) {
     ion_constraint_xcorr_.push_back(NULL);
   }
@@ -14,6 +14,7 @@
 #include "XLinkablePeptideIterator.h"
 #include "XLinkablePeptideIteratorTopN.h"
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -21,8 +22,6 @@ using namespace std;
 
 FLOAT_T XLinkPeptide::linker_mass_ = 0;
 set<Crux::Peptide*> XLinkPeptide::allocated_peptides_;
-FLOAT_T XLinkPeptide::pmin_ = 0;
-bool XLinkPeptide::pmin_set_ = false;
 
 XLinkPeptide::XLinkPeptide() : XLinkMatch() {
   mass_calculated_[MONO] = false;
@@ -198,12 +197,10 @@ int XLinkPeptide::addCandidates(
   carp(CARP_DEBUG, "XLinkPeptide::addCandidates - min:%g", min_mass);
   carp(CARP_DEBUG, "XLinkPeptide::addCandidates - max:%g", max_mass);
 
-  if (!pmin_set_) {
-    pmin_ = XLinkDatabase::getXLinkableBegin()->getMass(GlobalParams::getIsotopicMass());
-    pmin_set_ = true;
-  }
-  FLOAT_T peptide1_min_mass = pmin_;
-  FLOAT_T peptide1_max_mass = max_mass-pmin_-linker_mass_;
+  //the lightest linkable peptide; the database is sorted by mass.
+  FLOAT_T pmin = XLinkDatabase::getXLinkableBegin()->getMassConst(GlobalParams::getIsotopicMass());
+  FLOAT_T peptide1_min_mass = pmin;
+  FLOAT_T peptide1_max_mass = max_mass-pmin-linker_mass_;
 
   carp(CARP_DEBUG, "peptide1_min:%g", peptide1_min_mass);
   carp(CARP_DEBUG, "peptide1_max:%g", peptide1_max_mass);
@@ -236,27 +233,65 @@ int XLinkPeptide::addXLinkPeptides(
   XLinkMatchCollection& candidates
   ) {
 
+  vector<int> missed1, missed2;
+  getMissedCleavagesPerSite(pep1, missed1);
+  getMissedCleavagesPerSite(pep2, missed2);
+  return(addXLinkPeptides(pep1, missed1, pep2, missed2, candidates));
+}
+
+int XLinkPeptide::addXLinkPeptides(
+  XLinkablePeptide& pep1,
+  const vector<int>& missed1,
+  XLinkablePeptide& pep2,
+  const vector<int>& missed2,
+  XLinkMatchCollection& candidates
+  ) {
+
   XLinkBondMap& bondmap = XLinkDatabase::getXLinkBondMap();
+  int max_missed = GlobalParams::getMissedCleavages();
   int num_candidates = 0;
   //for every linkable site, generate the candidate if it is legal.
   for (unsigned int link1_idx=0;link1_idx < pep1.numLinkSites(); link1_idx++) {
     for (unsigned int link2_idx=0;link2_idx < pep2.numLinkSites();link2_idx++) {
-      if (bondmap.canLink(pep1, pep2, link1_idx, link2_idx)) {
+      if (missed1[link1_idx] + missed2[link2_idx] <= max_missed &&
+          bondmap.canLink(pep1, pep2, link1_idx, link2_idx)) {
         //create the candidate
-        XLinkMatch* newCandidate = 
-          new XLinkPeptide(pep1, pep2, link1_idx, link2_idx);
-	if (newCandidate->getNumMissedCleavages() <= GlobalParams::getMissedCleavages()) {
-          candidates.add(newCandidate);
-          num_candidates++;
-	} else {
-	  delete newCandidate;
-	}
+        candidates.add(new XLinkPeptide(pep1, pep2, link1_idx, link2_idx));
+        num_candidates++;
       }
     }
   }
   return(num_candidates);
 }
 
+/**
+ * Finds the missed cleavages of a linkable peptide for each of its link
+ * sites. A lysine used by the link does not count as missed.
+ */
+void XLinkPeptide::getMissedCleavagesPerSite(
+  XLinkablePeptide& pep, ///< linkable peptide
+  vector<int>& missed ///< missed cleavages per link site -out
+  ) {
+
+  char missed_cleavage_link_site = 'K';
+  Crux::Peptide* peptide = pep.getPeptide();
+  char* seq = peptide->getSequencePointer();
+  set<int> skip;
+  int missed_all = peptide->getMissedCleavageSites(skip);
+
+  missed.resize(pep.numLinkSites());
+  for (size_t link_idx = 0; link_idx < pep.numLinkSites(); link_idx++) {
+    int link_site = pep.getLinkSite(link_idx);
+    if (seq[link_site] == missed_cleavage_link_site) {
+      skip.clear();
+      skip.insert(link_site);
+      missed[link_idx] = peptide->getMissedCleavageSites(skip);
+    } else {
+      missed[link_idx] = missed_all;
+    }
+  }
+}
+
 /**
  * adds crosslink candidates to the XLinkMatchCollection using
  * the passed in iterator for the 1st peptide
@@ -277,68 +312,75 @@ int XLinkPeptide::addCandidates(
   size_t xpeptide_count = linkable_peptides.size();
   if (xpeptide_count <= 0) { return 0;}
 
+  // the peptides are sorted by mass, so the partners of each peptide form
+  // a contiguous range that moves towards lighter peptides as the first
+  // peptide gets heavier.
+  vector<FLOAT_T> masses(xpeptide_count);
+  for (size_t idx = 0; idx < xpeptide_count; idx++) {
+    masses[idx] = linkable_peptides[idx].getMass(MONO);
+  }
+
+  // modification and missed cleavage counts, computed the first time a
+  // peptide is part of a pair in the mass range.
+  vector<int> mods(xpeptide_count, -1);
+  vector<vector<int> > missed(xpeptide_count);
+
   int num_candidates = 0;
-  
-  bool done = false;
+  size_t lo_idx2 = xpeptide_count;
+  size_t hi_idx2 = xpeptide_count;
 
   for (size_t pep_idx1=0;pep_idx1 < xpeptide_count-1;pep_idx1++) {
-    XLinkablePeptide& pep1 = linkable_peptides.at(pep_idx1);
-    carp(CARP_DEBUG, "pep_idx1:%d %d %f %s",
-         pep_idx1,
-         xpeptide_count-1,
-         linkable_peptides[pep_idx1].getMass(MONO),
-         pep1.getModifiedSequenceString().c_str()
-         );
-    FLOAT_T pep1_mass = pep1.getMass(MONO);
+    FLOAT_T pep1_mass = masses[pep_idx1];
     FLOAT_T pep2_min_mass = min_mass - pep1_mass - linker_mass_;
     FLOAT_T pep2_max_mass = max_mass - pep1_mass - linker_mass_;
-    int start_idx2 = pep_idx1+1;
+    size_t start_idx2 = pep_idx1+1;
       
-    if (pep1_mass + linker_mass_ + linkable_peptides[start_idx2].getMass(MONO) > max_mass) {
+    if (pep1_mass + linker_mass_ + masses[start_idx2] > max_mass) {
       break;
     }
-    for (size_t pep_idx2=start_idx2;pep_idx2 < xpeptide_count;pep_idx2++) {
-      
+    if (pep_idx1 == 0) {
+      lo_idx2 = lower_bound(masses.begin(), masses.end(), pep2_min_mass) - masses.begin();
+    }
+    while (lo_idx2 > 0 && masses[lo_idx2-1] >= pep2_min_mass) {
+      lo_idx2--;
+    }
+    while (hi_idx2 > 0 && masses[hi_idx2-1] > pep2_max_mass) {
+      hi_idx2--;
+    }
+    size_t end_idx2 = hi_idx2;
+    if (lo_idx2 > start_idx2) {
+      start_idx2 = lo_idx2;
+    }
+    if (start_idx2 >= end_idx2) {
+      continue;
+    }
+
+    XLinkablePeptide& pep1 = linkable_peptides[pep_idx1];
+    if (mods[pep_idx1] < 0) {
+      mods[pep_idx1] = pep1.getPeptide()->countModifiedAAs();
+      getMissedCleavagesPerSite(pep1, missed[pep_idx1]);
+    }
+    for (size_t pep_idx2=start_idx2;pep_idx2 < end_idx2;pep_idx2++) {
       XLinkablePeptide& pep2 = linkable_peptides[pep_idx2];
-      carp(CARP_DEBUG, "pep_idx2:%d %d %f %s",
-         pep_idx2,
-         xpeptide_count,
-         linkable_peptides[pep_idx2].getMass(MONO),
-         pep2.getModifiedSequenceString().c_str()
-         );
-      FLOAT_T current_mass = pep2.getMass(MONO);
-      if (current_mass > pep2_max_mass) {
-	      if (pep_idx2 == start_idx2) {
-	        //done = true;
-	      }
-	      break;
-      }
-      if (current_mass >= pep2_min_mass) {
-        XLINKMATCH_TYPE_T ctype = 
-          XLink::getCrossLinkCandidateType(pep1.getPeptide(), pep2.getPeptide());
+      XLINKMATCH_TYPE_T ctype = 
+        XLink::getCrossLinkCandidateType(pep1.getPeptide(), pep2.getPeptide());
             
-        if ((include_intra && ctype == XLINK_INTRA_CANDIDATE) || 
-            (include_inter_intra && ctype == XLINK_INTER_INTRA_CANDIDATE) ||
-            (include_inter && ctype == XLINK_INTER_CANDIDATE)) {
-		            carp(CARP_DEBUG, "considering %s %s", pep1.getModifiedSequenceString().c_str(), pep2.getModifiedSequenceString().c_str());
-	
-              int mods = pep1.getPeptide()->countModifiedAAs() + pep2.getPeptide()->countModifiedAAs();
-              if (mods <= max_mod_xlink) {
-		            carp(CARP_DEBUG, "considering2 %s %s", pep1.getModifiedSequenceString().c_str(), pep2.getModifiedSequenceString().c_str());
-                num_candidates += addXLinkPeptides(pep1, pep2, candidates);
-              } // if (mods <= max_mod_xlink ..     
-          }
-	      
+      if ((include_intra && ctype == XLINK_INTRA_CANDIDATE) || 
+          (include_inter_intra && ctype == XLINK_INTER_INTRA_CANDIDATE) ||
+          (include_inter && ctype == XLINK_INTER_CANDIDATE)) {
+        if (mods[pep_idx2] < 0) {
+          mods[pep_idx2] = pep2.getPeptide()->countModifiedAAs();
+          getMissedCleavagesPerSite(pep2, missed[pep_idx2]);
+        }
+        if (mods[pep_idx1] + mods[pep_idx2] <= max_mod_xlink) {
+          num_candidates += addXLinkPeptides(
+            pep1, missed[pep_idx1], pep2, missed[pep_idx2], candidates);
         }
       }
-      if (done) {
-        break;
-      }
-    
+    }
   }
    
-  carp(CARP_DEBUG, "Done searching");
-//  delete []tested;
+  carp(CARP_DEBUG, "Done searching, %d candidates", num_candidates);
   return(num_candidates);
 }
   
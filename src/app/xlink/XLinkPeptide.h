@@ -27,8 +27,6 @@ class XLinkPeptide : public XLinkMatch {
   
   XLinkPeptide* target_;
   
-  static FLOAT_T pmin_;  ///< contains the minimum mass that a peptide from a crosslink product can take
-  static bool pmin_set_; ///< has the pmin been set?
   /**
    * \returns the link position within each peptide
    */
@@ -46,6 +44,28 @@ class XLinkPeptide : public XLinkMatch {
     XLinkMatchCollection& candidates ///< XLinkable Candidates -out
   );
 
+  /*
+   * Same as above, with the missed cleavages of each peptide per link site
+   * given, so that only candidates within the missed cleavage limit are
+   * allocated.
+   */
+  static int addXLinkPeptides(
+    XLinkablePeptide& pep1, ///< First linkable peptide
+    const std::vector<int>& missed1, ///< missed cleavages of pep1 per link site
+    XLinkablePeptide& pep2, ///< Second linkable peptide
+    const std::vector<int>& missed2, ///< missed cleavages of pep2 per link site
+    XLinkMatchCollection& candidates ///< XLinkable Candidates -out
+  );
+
+  /**
+   * Finds the missed cleavages of a linkable peptide for each of its link
+   * sites, as getNumMissedCleavages counts them for one peptide of a link
+   */
+  static void getMissedCleavagesPerSite(
+    XLinkablePeptide& pep, ///< linkable peptide
+    std::vector<int>& missed ///< missed cleavages per link site -out
+  );
+
   /*
    * Is either of the participating peptides a decoy?
    */
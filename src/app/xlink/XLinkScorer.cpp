@@ -12,8 +12,9 @@
 #include "util/Params.h"
 #include "XLinkPeptide.h"
 #include "util/GlobalParams.h"
+#include "util/mass.h"
 
-
+#include <algorithm>
 #include <iostream>
 
 using namespace std;
@@ -159,6 +160,26 @@ FLOAT_T XLinkScorer::scoreCandidate(
         
     xcorr = xcorr1+xcorr2;
     candidate->setScore(XCORR, xcorr);
+  } else if (candidate->getCandidateType() == XLINK_INTER_CANDIDATE ||
+             candidate->getCandidateType() == XLINK_INTRA_CANDIDATE ||
+             candidate->getCandidateType() == XLINK_INTER_INTRA_CANDIDATE) {
+    // same ions as XLinkPeptide::predictIons
+    XLinkPeptide* xpep = (XLinkPeptide*)candidate;
+    XLinkablePeptide& xpep1 = xpep->getXLinkablePeptide(0);
+    XLinkablePeptide& xpep2 = xpep->getXLinkablePeptide(1);
+    MASS_TYPE_T fragment_mass_type = GlobalParams::getFragmentMass();
+    FLOAT_T link_mass = XLinkPeptide::getLinkerMass();
+    FLOAT_T mod_mass1 = xpep1.getMass(fragment_mass_type) + link_mass;
+    FLOAT_T mod_mass2 = xpep2.getMass(fragment_mass_type) + link_mass;
+
+    scorer_xcorr_->initXcorr(spectrum_, charge_);
+    FLOAT_T by_sum = 0, flank_sum = 0, loss_sum = 0;
+    addXLinkablePeptideIons(xpep1, xpep->getLinkIdx(0), mod_mass2,
+                            &by_sum, &flank_sum, &loss_sum);
+    addXLinkablePeptideIons(xpep2, xpep->getLinkIdx(1), mod_mass1,
+                            &by_sum, &flank_sum, &loss_sum);
+    xcorr = Scorer::combineXcorrSums(by_sum, flank_sum, loss_sum);
+    candidate->setScore(XCORR, xcorr);
   } else {
     candidate->predictIons(ion_series_xcorr_, charge_);
     xcorr = scorer_xcorr_->scoreSpectrumVIonSeries(spectrum_, ion_series_xcorr_);
@@ -190,15 +211,101 @@ FLOAT_T XLinkScorer::scoreCandidate(
   return xcorr;
 }
 
+/**
+ * \returns the xcorr of one peptide of a cross-link, with the other peptide
+ * and the linker attached at the link site as mod_mass
+ */
 FLOAT_T XLinkScorer::scoreXLinkablePeptide(
   XLinkablePeptide& xlpeptide,
   int link_idx,
   FLOAT_T mod_mass) {
 
-  xlpeptide.predictIons(ion_series_xcorr_, charge_, link_idx, mod_mass);
-  FLOAT_T xcorr = scorer_xcorr_->scoreSpectrumVIonSeries(spectrum_, ion_series_xcorr_);
-  return xcorr;
+  scorer_xcorr_->initXcorr(spectrum_, charge_);
+  FLOAT_T by_sum = 0, flank_sum = 0, loss_sum = 0;
+  addXLinkablePeptideIons(xlpeptide, link_idx, mod_mass,
+                          &by_sum, &flank_sum, &loss_sum);
+  return Scorer::combineXcorrSums(by_sum, flank_sum, loss_sum);
+}
 
+/**
+ * \returns the m/z of an ion with the given base mass, shifted by mod_mass
+ * the way XLinkablePeptide::predictIons shifts it
+ */
+static inline FLOAT_T xlinkIonMassZ(
+  FLOAT_T mass, ///< base mass of the ion
+  int charge, ///< charge of the ion
+  FLOAT_T h_mass, ///< mass of hydrogen
+  bool shift, ///< does the ion contain the link site?
+  FLOAT_T mod_mass ///< mass attached at the link site
+  ) {
+  FLOAT_T mass_z = (mass + (h_mass*(FLOAT_T)charge))/(FLOAT_T)charge;
+  if (shift) {
+    FLOAT_T shifted = (mass_z - MASS_PROTON) * (FLOAT_T)charge + mod_mass;
+    mass_z = (shifted + MASS_PROTON * (FLOAT_T)charge) / (FLOAT_T)charge;
+  }
+  return mass_z;
+}
+
+/**
+ * Adds the a, b and y ions of an xlinkable peptide to the XCorr sums. The
+ * ion masses are computed from the residue masses in the same order as
+ * IonSeries::predictIons, so the sums match scoring the predicted ion series.
+ */
+void XLinkScorer::addXLinkablePeptideIons(
+  XLinkablePeptide& xlpeptide, ///< peptide to score
+  int link_idx, ///< index of the link site
+  FLOAT_T mod_mass, ///< mass attached at the link site
+  FLOAT_T* by_sum, ///< sum at the b and y ion bins -in/out
+  FLOAT_T* flank_sum, ///< sum at the flanking bins -in/out
+  FLOAT_T* loss_sum ///< sum at the neutral loss and a ion bins -in/out
+  ) {
+
+  const MODIFIED_AA_T* mod_seq = xlpeptide.getModifiedSequencePtr();
+  int length = xlpeptide.getLength();
+  int link_pos = xlpeptide.getLinkSite(link_idx);
+  MASS_TYPE_T mass_type = ion_constraint_xcorr_->getMassType();
+  int max_charge = min(ion_constraint_xcorr_->getMaxCharge(), charge_);
+  int max_bin = scorer_xcorr_->getMaxBin();
+
+  FLOAT_T h_mass = MASS_H_MONO;
+  FLOAT_T co_mass = MASS_CO_MONO;
+  FLOAT_T h2o_mass = MASS_H2O_MONO;
+  if (mass_type == AVERAGE) {
+    h_mass = MASS_H_AVERAGE;
+    co_mass = MASS_CO_AVERAGE;
+    h2o_mass = MASS_H2O_AVERAGE;
+  }
+
+  // cumulative residue masses, as in IonSeries::createIonMassMatrix
+  mass_ladder_.resize(length + 1);
+  FLOAT_T* masses = &mass_ladder_[0];
+  masses[1] = get_mass_mod_amino_acid(mod_seq[0], mass_type);
+  for (int idx = 2; idx <= length; idx++) {
+    masses[idx] = masses[idx-1] + get_mass_mod_amino_acid(mod_seq[idx-1], mass_type);
+  }
+
+  for (int cleavage_idx = 1; cleavage_idx < length; cleavage_idx++) {
+    bool shift_forward = cleavage_idx > link_pos;
+    bool shift_reverse = cleavage_idx >= length - link_pos;
+    FLOAT_T b_mass = masses[cleavage_idx];
+    FLOAT_T y_mass = masses[length] - masses[length - cleavage_idx] + h2o_mass;
+
+    for (int charge = 1; charge <= max_charge; charge++) {
+      scorer_xcorr_->addXcorrIon(A_ION,
+        xlinkIonMassZ(b_mass - co_mass, charge, h_mass, shift_forward, mod_mass),
+        charge, max_bin, by_sum, flank_sum, loss_sum);
+    }
+    for (int charge = 1; charge <= max_charge; charge++) {
+      scorer_xcorr_->addXcorrIon(B_ION,
+        xlinkIonMassZ(b_mass, charge, h_mass, shift_forward, mod_mass),
+        charge, max_bin, by_sum, flank_sum, loss_sum);
+    }
+    for (int charge = 1; charge <= max_charge; charge++) {
+      scorer_xcorr_->addXcorrIon(Y_ION,
+        xlinkIonMassZ(y_mass, charge, h_mass, shift_reverse, mod_mass),
+        charge, max_bin, by_sum, flank_sum, loss_sum);
+    }
+  }
 }
 
 /*                                                                                                                                                                                                                          
@@ -10,6 +10,8 @@
 #include "model/objects.h"
 #include "XLinkMatch.h"
 
+#include <vector>
+
 class XLinkScorer {
  protected:
   Crux::Spectrum* spectrum_; ///< spectrum object
@@ -22,6 +24,7 @@ class XLinkScorer {
   IonSeries* ion_series_xcorr_; ///< current ion series xcorr
   IonSeries* ion_series_sp_; ///< current ion series sp
   bool compute_sp_; ///< calculate sp score
+  std::vector<FLOAT_T> mass_ladder_; ///< cumulative residue masses
  
   /**
    * initializes the object with the spectrum
@@ -33,6 +36,20 @@ class XLinkScorer {
     bool compute_sp ///< are we scoring sp?
     );
 
+  /**
+   * Adds the a, b and y ions of an xlinkable peptide to the XCorr sums,
+   * shifting the ions that contain the link site by mod_mass. Gives the
+   * same ions as XLinkablePeptide::predictIons without creating them.
+   */
+  void addXLinkablePeptideIons(
+    XLinkablePeptide& xlpeptide, ///< peptide to score
+    int link_idx, ///< index of the link site
+    FLOAT_T mod_mass, ///< mass attached at the link site
+    FLOAT_T* by_sum, ///< sum at the b and y ion bins -in/out
+    FLOAT_T* flank_sum, ///< sum at the flanking bins -in/out
+    FLOAT_T* loss_sum ///< sum at the neutral loss and a ion bins -in/out
+    );
+
  public:
   /**
    * default constructor
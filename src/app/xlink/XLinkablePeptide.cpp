@@ -404,6 +404,16 @@ Peptide* XLinkablePeptide::getPeptide() {
   return peptide_;
 }
 
+/**
+ * \returns the number of residues in the peptide
+ */
+int XLinkablePeptide::getLength() {
+  if (peptide_) {
+    return peptide_->getLength();
+  }
+  return strlen(sequence_);
+}
+
 /**
  * \returns the mass of the xlinkable peptide
  */
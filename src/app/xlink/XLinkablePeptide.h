@@ -196,6 +196,11 @@ class XLinkablePeptide : public CacheableMass {
    */
   Crux::Peptide* getPeptide();
 
+  /**
+   * \returns the number of residues in the peptide
+   */
+  int getLength();
+
   /**
    * \returns the mass of the xlinkable peptide
    */
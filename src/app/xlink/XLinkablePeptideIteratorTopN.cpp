@@ -12,6 +12,7 @@
 #include "XLinkScorer.h"
 #include "XLinkDatabase.h"
 #include "util/GlobalParams.h"
+#include <algorithm>
 #include <iostream>
 
 
@@ -73,6 +74,19 @@ XLinkablePeptideIteratorTopN::XLinkablePeptideIteratorTopN(
 
 }
 
+/**
+ * orders (xcorr, index) pairs by decreasing xcorr, and by index for ties
+ */
+static bool compareScoreIndex(
+  const pair<FLOAT_T, size_t>& a,
+  const pair<FLOAT_T, size_t>& b
+  ) {
+  if (a.first != b.first) {
+    return a.first > b.first;
+  }
+  return a.second < b.second;
+}
+
 void XLinkablePeptideIteratorTopN::scorePeptides(
   XLinkScorer& scorer, 
   FLOAT_T precursor_mass, 
@@ -81,23 +95,27 @@ void XLinkablePeptideIteratorTopN::scorePeptides(
   ) {
 
   scored_xlp_.clear();
-  while(biter != eiter) {
-    XLinkablePeptide& pep1 = *biter;
+  vector<pair<FLOAT_T, size_t> > scores;
+  scores.reserve(eiter - biter);
+  for (vector<XLinkablePeptide>::iterator iter = biter; iter != eiter; ++iter) {
+    XLinkablePeptide& pep1 = *iter;
     FLOAT_T delta_mass = precursor_mass - pep1.getMass(MONO);// - XLinkPeptide::getLinkerMass();
     FLOAT_T xcorr = scorer.scoreXLinkablePeptide(pep1, 0, delta_mass);
-    pep1.setXCorr(0, xcorr);
-    //pep1.getXCorr();
-    scored_xlp_.push_back(&pep1);
-    biter++;
+    scores.push_back(make_pair(xcorr, (size_t)(iter - biter)));
   }
-  if (scored_xlp_.size() > 0) {
-    sort(scored_xlp_.begin(), scored_xlp_.end(), compareXLinkableXCorrPtr);
+  size_t num_top = min((size_t)max(top_n_, 0), scores.size());
+  partial_sort(scores.begin(), scores.begin() + num_top, scores.end(), compareScoreIndex);
+
+  scored_xlp_.reserve(num_top);
+  for (size_t idx = 0; idx < num_top; idx++) {
+    scored_xlp_.push_back(*(biter + scores[idx].second));
+    scored_xlp_.back().setXCorr(0, scores[idx].first);
   }
  
   IF_CARP(CARP_DETAILED_DEBUG,
-    for (size_t idx = 0;idx < min((size_t)top_n_,scored_xlp_.size());idx++) {
-      string seq = scored_xlp_[idx]->getModifiedSequenceString();
-      carp(CARP_INFO,"%d %g %s", idx, scored_xlp_[idx]->getXCorr(), seq.c_str());
+    for (size_t idx = 0;idx < scored_xlp_.size();idx++) {
+      string seq = scored_xlp_[idx].getModifiedSequenceString();
+      carp(CARP_INFO,"%d %g %s", idx, scored_xlp_[idx].getXCorr(), seq.c_str());
     }
   );
 }
@@ -141,26 +159,13 @@ XLinkablePeptide& XLinkablePeptideIteratorTopN::next() {
     carp(CARP_FATAL, "next called on empty iterator!");
   }
 
-  XLinkablePeptide& ans = *scored_xlp_[current_count_-1];
+  XLinkablePeptide& ans = scored_xlp_[current_count_-1];
   //carp(CARP_INFO, "next peptide:%s %g", ans.getSequence(), ans.getXCorr());
   queueNextPeptide();
   //carp(CARP_INFO, "XLinkablePeptideIteratorTopN: returning reference");
   return ans;
 }
 
-XLinkablePeptide* XLinkablePeptideIteratorTopN::nextPtr() {
-  if (!has_next_) {
-    carp(CARP_FATAL, "next called on empty iterator!");
-  }
-  
-  XLinkablePeptide* ans = scored_xlp_[current_count_-1];
-  queueNextPeptide();
-  return ans;
-  
-}
-
-
-
 /*                                                                                                                                                                                                                          
  * Local Variables:                                                                                                                                                                                                         
  * mode: c                                                                                                                                                                                                                  
@@ -21,7 +21,7 @@ class XLinkablePeptideIteratorTopN: public XLinkablePeptideIterator {
  protected:
 
   //std::priority_queue<XLinkablePeptide, std::vector<XLinkablePeptide>, CompareXCorr> scored_xlp_;  
-  std::vector<XLinkablePeptide*> scored_xlp_; ///< sorted by highest XCorr score.
+  std::vector<XLinkablePeptide> scored_xlp_; ///< copies of the top-n, sorted by highest XCorr score.
   int current_count_;
   int top_n_; ///<set by kojak-top-n
   bool has_next_; ///< is there a next candidate
@@ -32,6 +32,11 @@ class XLinkablePeptideIteratorTopN: public XLinkablePeptideIterator {
    */
   void queueNextPeptide(); 
   
+  /**
+   * scores the database peptides between biter and eiter, and keeps
+   * copies of the top-n with their XCorr set. The database peptides
+   * themselves are not changed, so several spectra can be scored at once.
+   */
   void scorePeptides(
     XLinkScorer& scorer,
     FLOAT_T precursor_mass,
@@ -67,8 +72,6 @@ class XLinkablePeptideIteratorTopN: public XLinkablePeptideIterator {
    *\returns the next linkable peptide
    */
   XLinkablePeptide& next();
-  
-  XLinkablePeptide* nextPtr();
 
 };
 
@@ -18,8 +18,14 @@
 #include "model/FilteredSpectrumChargeIterator.h"
 #include "io/OutputFiles.h"
 #include "io/SpectrumCollectionFactory.h"
+#include "util/GlobalParams.h"
 #include "util/Params.h"
 #include "XLinkDatabase.h"
+#include "model/Ion.h"
+#include "model/IonSeries.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 
 //C++ Includes
@@ -36,6 +42,9 @@
 
 using namespace std;
 
+//spectra searched per thread in each batch
+static const size_t SPECTRA_PER_THREAD = 8;
+
 void buildArguments(
   vector<string>& args_vec, 
   int &argc, 
@@ -53,14 +62,32 @@ void buildArguments(
 
 }
 
-void writeTrainingCandidates(XLinkMatchCollection* training_candidates, int scan_num, Weibull& weibull) {
-  training_candidates->populateMatchRank(XCORR);
-  training_candidates->sort(XCORR);
+/**
+ * \returns true if the first match has the higher xcorr
+ */
+static bool compareXCorrDescending(XLinkMatch* match1, XLinkMatch* match2) {
+  return match1->getScore(XCORR) > match2->getScore(XCORR);
+}
+
+/**
+ * Appends the matches of a collection to a list of Weibull training points
+ */
+static void addTrainingMatches(
+  XLinkMatchCollection* candidates,
+  vector<XLinkMatch*>& training_candidates
+  ) {
+  for (int idx = 0; idx < candidates->getMatchTotal(); idx++) {
+    training_candidates.push_back((*candidates)[idx]);
+  }
+}
+
+void writeTrainingCandidates(vector<XLinkMatch*>& training_candidates, int scan_num, int charge, Weibull& weibull) {
+  sort(training_candidates.begin(), training_candidates.end(), compareXCorrDescending);
   string output_dir = Params::GetString("output-dir");
 
   string output_file = output_dir + "/" +
     "scan." + StringUtils::ToString(scan_num) + 
-    ".charge." + StringUtils::ToString(training_candidates->getCharge()) +
+    ".charge." + StringUtils::ToString(charge) +
     ".training.candidates.txt";
   //cerr<<"writing "<<output_file<<endl;
   DelimitedFileWriter writer(output_file.c_str());
@@ -80,17 +107,17 @@ void writeTrainingCandidates(XLinkMatchCollection* training_candidates, int scan
   writer.setColumnName("p-value ecdf", 10);
   writer.writeHeader();
 
-  for (size_t idx = 0 ;idx < training_candidates->getMatchTotal();idx++) {
+  for (size_t idx = 0 ;idx < training_candidates.size();idx++) {
     writer.setColumnCurrentRow(0, scan_num);
-    writer.setColumnCurrentRow(2, (*training_candidates)[idx]->isDecoy());
-    writer.setColumnCurrentRow(1, (*training_candidates)[idx]->getCharge());
-    writer.setColumnCurrentRow(3, (*training_candidates)[idx]->getSequenceString());
+    writer.setColumnCurrentRow(2, training_candidates[idx]->isDecoy());
+    writer.setColumnCurrentRow(1, training_candidates[idx]->getCharge());
+    writer.setColumnCurrentRow(3, training_candidates[idx]->getSequenceString());
     writer.setColumnCurrentRow(4, weibull.getEta());
     writer.setColumnCurrentRow(5, weibull.getBeta());
     writer.setColumnCurrentRow(6, weibull.getShift());
     writer.setColumnCurrentRow(7, weibull.getCorrelation());
-    writer.setColumnCurrentRow(8, (*training_candidates)[idx]->getScore(XCORR));
-    FLOAT_T score = (*training_candidates)[idx]->getScore(XCORR);
+    writer.setColumnCurrentRow(8, training_candidates[idx]->getScore(XCORR));
+    FLOAT_T score = training_candidates[idx]->getScore(XCORR);
     writer.setColumnCurrentRow(9, weibull.getWeibullPValue(score));
     writer.setColumnCurrentRow(10, weibull.getECDFPValue(score));
     writer.writeRow();
@@ -99,6 +126,264 @@ void writeTrainingCandidates(XLinkMatchCollection* training_candidates, int scan
 }
 
 
+/**
+ * The matches found for one charge state of a spectrum.
+ */
+struct XLinkChargeSearch {
+  SpectrumZState zstate;
+  unsigned seed; ///< seeds the decoy shuffles for this charge
+  XLinkMatchCollection* targets; ///< NULL if there were no candidates
+  XLinkMatchCollection* decoys;
+};
+
+/**
+ * A spectrum and the charge states it is searched with. The charge states
+ * of a spectrum stay on one thread, since scoring reads and caches data
+ * on the spectrum.
+ */
+struct XLinkSpectrumSearch {
+  Crux::Spectrum* spectrum;
+  vector<XLinkChargeSearch> charges;
+};
+
+/**
+ * Finds, scores and ranks the target and decoy candidates of one charge
+ * state of a spectrum, computing p-values if requested. The matches are
+ * left in search->targets and search->decoys for the caller to print.
+ */
+static void searchSpectrumCharge(
+  Crux::Spectrum* spectrum,
+  XLinkChargeSearch* search,
+  FLOAT_T min_pvalue,
+  Weibull& weibull ///< the calling worker's Weibull, reset before use
+  ) {
+
+  int top_match = Params::GetInt("top-match");
+  int min_weibull_points = Params::GetInt("min-weibull-points");
+  bool compute_pvalues = Params::GetBool("compute-p-values");
+  int scan_num = spectrum->getFirstScan();
+  SpectrumZState& zstate = search->zstate;
+
+  //every charge shuffles its decoys from its own seed, so the decoys do
+  //not depend on which thread searches it.
+  mysrandom_thread(search->seed);
+
+  search->decoys = NULL;
+  XLinkMatchCollection* target_candidates =
+    new XLinkMatchCollection(
+			     spectrum,
+			     zstate,
+			     false,
+			     false
+			     );
+
+  if (target_candidates->getMatchTotal() <= 0) {
+    delete target_candidates;
+    search->targets = NULL;
+    return;
+  }
+
+  // Score targets.
+  target_candidates->scoreSpectrum(spectrum);
+
+  // Score decoys.
+  XLinkMatchCollection* decoy_candidates = new XLinkMatchCollection();
+  target_candidates->shuffle(*decoy_candidates);
+  decoy_candidates->scoreSpectrum(spectrum);
+
+  if (compute_pvalues) {
+    //class for estimating pvalues.
+    weibull.reset();
+    vector<XLinkMatch*> training_candidates;
+    XLinkMatchCollection* target_train_candidates = NULL;
+    XLinkMatchCollection* train_candidates = NULL;
+    if (Params::GetBool("xlink-weibull-reuse-decoys")) {
+      //the targets and decoys are already scored, only shuffle more decoys
+      //if they are too few.
+      addTrainingMatches(target_candidates, training_candidates);
+      addTrainingMatches(decoy_candidates, training_candidates);
+      train_candidates = new XLinkMatchCollection();
+      while(training_candidates.size() + train_candidates->getMatchTotal() <
+            (size_t)min_weibull_points) {
+        target_candidates->shuffle(*train_candidates);
+      }
+      if (train_candidates->getMatchTotal() > 0) {
+        train_candidates->scoreSpectrum(spectrum);
+      }
+    } else {
+      target_train_candidates =
+        new XLinkMatchCollection(
+			         spectrum,
+			         zstate,
+			         false,
+			         true);
+      train_candidates =
+        new XLinkMatchCollection(
+			         spectrum,
+			         zstate,
+			         true,
+			         true
+			         );
+
+      for (size_t idx=0;idx < target_train_candidates->getMatchTotal();idx++) {
+        train_candidates->add(target_train_candidates->at(idx), true);
+      }
+      while(train_candidates->getMatchTotal() < min_weibull_points) {
+        target_train_candidates->shuffle(*train_candidates);
+      }
+      train_candidates->scoreSpectrum(spectrum);
+    }
+    addTrainingMatches(train_candidates, training_candidates);
+    for (size_t idx = 0;idx < training_candidates.size();idx++) {
+      const string& sequence = training_candidates[idx]->getSequenceStringConst();
+      FLOAT_T score = training_candidates[idx]->getScore(XCORR);
+      weibull.addPoint(sequence, score);
+    }
+    bool write_weibull_points = !weibull.fit();
+
+    target_candidates->sort(XCORR);
+
+    // Calculate pvalues.
+    int nprint = min(top_match,target_candidates->getMatchTotal());
+    for (int idx=0;idx < nprint;idx++) {
+      FLOAT_T score = (*target_candidates)[idx]->getScore(XCORR);
+      (*target_candidates)[idx]->setPValue(weibull.getPValue(score));
+    }
+
+    nprint = min(top_match, (int)decoy_candidates->getMatchTotal());
+    decoy_candidates->sort(XCORR);
+    for (int idx=0;idx < nprint;idx++) {
+      FLOAT_T score = (*decoy_candidates)[idx]->getScore(XCORR);
+      (*decoy_candidates)[idx]->setPValue(weibull.getPValue(score));
+      FLOAT_T wpvalue = weibull.getWeibullPValue(score);
+      FLOAT_T bpvalue = bonferroni_correction(wpvalue, decoy_candidates->getMatchTotal()) * 2.0;
+      if ((wpvalue == 0) || (wpvalue != wpvalue) || (bpvalue  < min_pvalue)) {
+	//If we have a bad fit, 0 or too low pvalue, print out the points.
+	write_weibull_points = true;
+      }
+    }
+
+    if (write_weibull_points || Params::GetBool("write-weibull-points")) {
+      writeTrainingCandidates(training_candidates, scan_num, zstate.getCharge(), weibull);
+    }
+    delete train_candidates;
+    delete target_train_candidates;
+  } // if (compute_p_values)
+
+  if (Params::GetBool("concat")) {
+    for (size_t idx=0;idx < decoy_candidates->getMatchTotal();idx++) {
+      target_candidates->add(decoy_candidates->at(idx), true);
+    }
+  } else {
+    if (decoy_candidates->getScoredType(SP) == true) {
+      decoy_candidates->populateMatchRank(SP);
+    }
+    decoy_candidates->populateMatchRank(XCORR);
+    decoy_candidates->sort(XCORR);
+  }
+
+  if (target_candidates->getScoredType(SP) == true) {
+    target_candidates->populateMatchRank(SP);
+  }
+  target_candidates->populateMatchRank(XCORR);
+  target_candidates->sort(XCORR);
+
+  search->targets = target_candidates;
+  search->decoys = decoy_candidates;
+}
+
+/**
+ * Worker threads that live for the whole search. Each batch of spectra is
+ * handed to all of them; they take spectra from it one at a time until it
+ * is used up, and search() returns once every spectrum has been searched.
+ * The decoys are shuffled with a generator owned by each thread, and the
+ * ion caches are per thread too, so these survive from batch to batch.
+ */
+class XLinkSearchWorkers {
+ public:
+  explicit XLinkSearchWorkers(size_t num_threads)
+    : batch_(NULL), next_(0), remaining_(0), min_pvalue_(0), stopping_(false) {
+    for (size_t idx = 0; idx < num_threads; idx++) {
+      threads_.create_thread(boost::bind(&XLinkSearchWorkers::run, this));
+    }
+  }
+
+  ~XLinkSearchWorkers() {
+    stop();
+  }
+
+  /**
+   * Ends the worker threads, which frees their per-thread caches.
+   */
+  void stop() {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (stopping_) {
+        return;
+      }
+      stopping_ = true;
+      work_ready_.notify_all();
+    }
+    threads_.join_all();
+  }
+
+  /**
+   * Searches every charge state of every spectrum in the batch.
+   */
+  void search(vector<XLinkSpectrumSearch>* batch, FLOAT_T min_pvalue) {
+    boost::mutex::scoped_lock lock(mutex_);
+    batch_ = batch;
+    next_ = 0;
+    remaining_ = batch->size();
+    min_pvalue_ = min_pvalue;
+    work_ready_.notify_all();
+    while (remaining_ > 0) {
+      batch_done_.wait(lock);
+    }
+    batch_ = NULL;
+  }
+
+ private:
+  void run() {
+    // fits the p-values of every spectrum this worker searches, so its
+    // score buffer is allocated once per run
+    Weibull weibull;
+    while (true) {
+      XLinkSpectrumSearch* search;
+      FLOAT_T min_pvalue;
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        while (!stopping_ && (batch_ == NULL || next_ >= batch_->size())) {
+          work_ready_.wait(lock);
+        }
+        if (stopping_) {
+          return;
+        }
+        search = &(*batch_)[next_++];
+        min_pvalue = min_pvalue_;
+      }
+      for (size_t charge_idx = 0; charge_idx < search->charges.size(); charge_idx++) {
+        searchSpectrumCharge(search->spectrum, &search->charges[charge_idx],
+                             min_pvalue, weibull);
+      }
+      boost::mutex::scoped_lock lock(mutex_);
+      if (--remaining_ == 0) {
+        batch_done_.notify_one();
+      }
+    }
+  }
+
+  vector<XLinkSpectrumSearch>* batch_; ///< the batch being searched, or NULL
+  size_t next_; ///< index of the next spectrum of the batch to search
+  size_t remaining_; ///< spectra of the batch not yet searched
+  FLOAT_T min_pvalue_;
+  bool stopping_;
+  boost::mutex mutex_;
+  boost::condition_variable work_ready_;
+  boost::condition_variable batch_done_;
+  boost::thread_group threads_;
+};
+
 /**
  * main method for SearchForXLinks that implements the refactored code
  */
@@ -113,14 +398,21 @@ int SearchForXLinks::xlinkSearchMain() {
 
   string input_file = Params::GetString("protein fasta file");
   string output_directory = Params::GetString("output-dir");
-  int top_match = Params::GetInt("top-match");
   XLinkPeptide::setLinkerMass(Params::GetDouble("link mass"));
-  int min_weibull_points = Params::GetInt("min-weibull-points");
   bool compute_pvalues = Params::GetBool("compute-p-values");
 
+  int num_threads = Params::GetInt("num-threads");
+  if (num_threads < 1) {
+    num_threads = boost::thread::hardware_concurrency();
+  }
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+
   /* Prepare input fasta  */
   carp(CARP_INFO, "Preparing database.");
   XLinkDatabase::initialize();
+  Ion::initializeModificationMasses(GlobalParams::getFragmentMass());
   Database* database = NULL;
   int num_proteins = 0;//prepare_protein_input(input_file, &database);
   carp(CARP_DETAILED_INFO, "Number of proteins: %d",num_proteins);
@@ -140,12 +432,15 @@ int SearchForXLinks::xlinkSearchMain() {
   OutputFiles output_files(this);
   output_files.writeHeaders(num_proteins);
 
+  // The search always runs on worker threads, since they own the decoy
+  // shuffling generators and the Weibull fits.
+  XLinkSearchWorkers workers(num_threads);
+
   for (vector<string>::iterator ms2_file_iter = ms2_files.begin();
        ms2_file_iter != ms2_files.end(); ++ms2_file_iter) { 
     string ms2_file = *ms2_file_iter;
     
     carp(CARP_INFO, "Loading spectra %s.", ms2_file.c_str());
-    Crux::Spectrum* spectrum = NULL;
     Crux::SpectrumCollection* spectra =
       SpectrumCollectionFactory::create(ms2_file);
     spectra->parse();
@@ -155,187 +450,92 @@ int SearchForXLinks::xlinkSearchMain() {
 
 
     // main loop over spectra in ms2 file
-    int scan_num = 0;
     int skipped_no_candidates = 0;
     int search_count = 0;
     FLOAT_T num_spectra = (FLOAT_T)spectra->getNumSpectra();
     FLOAT_T min_pvalue = 1.0 / num_spectra;
-    //class for estimating pvalues.
-    Weibull weibull;
   
     // for every observed spectrum 
     carp(CARP_INFO, "Beginning search.");
     int print_interval = Params::GetInt("print-search-progress");
 
+    // Spectra are searched in batches, a few per thread, and each batch is
+    // written in input order once all of its spectra have been searched.
+    size_t batch_size = (size_t)num_threads * SPECTRA_PER_THREAD;
     while (spectrum_iterator->hasNext()) {
 
-      spectrum = spectrum_iterator->next(zstate);
-      scan_num = spectrum->getFirstScan();
-      
-      if (print_interval > 0 && search_count > 0 && search_count % print_interval == 0) {
-	carp(CARP_INFO, 
-	     "%d spectrum-charge combinations searched, %.0f%% complete",
-	     search_count + spectrum_iterator->numSkipped(),
-	     (search_count + spectrum_iterator->numSkipped()) / num_spectra * 100);
-      }
-      search_count++;
-
-      FLOAT_T precursor_mz = spectrum->getPrecursorMz();
-
-      XLinkMatchCollection* target_candidates =
-	new XLinkMatchCollection(
-				 spectrum,
-				 zstate,
-				 false,
-				 false
-				 );
-
-      if (target_candidates->getMatchTotal() < 0) {
-	carp(CARP_ERROR, "Scan %d has %d candidates.", scan_num, 
-	     target_candidates->getMatchTotal());
-      } else if (target_candidates->getMatchTotal() == 0) {
-	skipped_no_candidates++;
-	carp(CARP_DETAILED_INFO, "Skipping scan %d charge %d mass %lg", 
-	     scan_num, 
-	     zstate.getCharge(),
-	     zstate.getNeutralMass()
-	     );
-	delete target_candidates;
-	//XLink::deleteAllocatedPeptides();
-	continue;
+      vector<XLinkSpectrumSearch> batch;
+      while (spectrum_iterator->hasNext() && batch.size() < batch_size) {
+        Crux::Spectrum* spectrum = spectrum_iterator->next(zstate);
+        if (batch.empty() || batch.back().spectrum != spectrum) {
+          batch.push_back(XLinkSpectrumSearch());
+          batch.back().spectrum = spectrum;
+        }
+        XLinkChargeSearch charge;
+        charge.zstate = zstate;
+        charge.seed = myrandom();
+        charge.targets = NULL;
+        charge.decoys = NULL;
+        batch.back().charges.push_back(charge);
       }
 
-      carp(CARP_DETAILED_INFO, "Scan=%d charge=%d mass=%lg candidates=%d", 
-	   scan_num, 
-	   zstate.getCharge(), 
-	   zstate.getNeutralMass(), 
-	   target_candidates->getMatchTotal());   
-
-      // Score targets.
-      target_candidates->scoreSpectrum(spectrum);
-
-      // Score decoys.
-      carp(CARP_DEBUG, "Getting decoy candidates.");
-      XLinkMatchCollection* decoy_candidates = new XLinkMatchCollection();
-      target_candidates->shuffle(*decoy_candidates);
-      carp(CARP_DEBUG, "Scoring decoys.");
-      decoy_candidates->scoreSpectrum(spectrum);
-      
-      if (compute_pvalues) {
-	weibull.reset();
-	XLinkMatchCollection *target_train_candidates =
-	  new XLinkMatchCollection(
-				   spectrum,
-				   zstate,
-				   false,
-				   true);
-	XLinkMatchCollection *train_candidates =
-	  new XLinkMatchCollection(
-				   spectrum,
-				   zstate,
-				   true,
-				   true
-				   );
-      
-	for (size_t idx=0;idx < target_train_candidates->getMatchTotal();idx++) {
-	  train_candidates->add(target_train_candidates->at(idx), true);
-	}
-	while(train_candidates->getMatchTotal() < min_weibull_points) {
-	  target_train_candidates->shuffle(*train_candidates);
-	}
-	train_candidates->scoreSpectrum(spectrum);
-	for (int idx = 0;idx < train_candidates->getMatchTotal();idx++) {
-	  const string& sequence = (*train_candidates)[idx]->getSequenceStringConst();
-	  FLOAT_T score = (*train_candidates)[idx]->getScore(XCORR);
-	  weibull.addPoint(sequence, score);
-	}
-	bool write_weibull_points = !weibull.fit();
-	
-	target_candidates->sort(XCORR);
-	
-	
-	// Calculate pvalues.
-	int nprint = min(top_match,target_candidates->getMatchTotal());
-	carp(CARP_DEBUG, "Calculating %d target p-values.", nprint);
-	for (int idx=0;idx < nprint;idx++) {
-	  FLOAT_T score = (*target_candidates)[idx]->getScore(XCORR);
-	  (*target_candidates)[idx]->setPValue(weibull.getPValue(score));
-	}
-	
-	nprint = min(top_match, (int)decoy_candidates->getMatchTotal());
-	carp(CARP_DEBUG, "Calculating %d decoy p-values.", nprint);
-	decoy_candidates->sort(XCORR);
-	for (int idx=0;idx < nprint;idx++) {
-	  FLOAT_T score = (*decoy_candidates)[idx]->getScore(XCORR);
-	  (*decoy_candidates)[idx]->setPValue(weibull.getPValue(score));
-	  FLOAT_T wpvalue = weibull.getWeibullPValue(score);
-	  FLOAT_T bpvalue = bonferroni_correction(wpvalue, decoy_candidates->getMatchTotal()) * 2.0;
-	  if ((wpvalue == 0) || (wpvalue != wpvalue) || (bpvalue  < min_pvalue)) {
-	    //If we have a bad fit, 0 or too low pvalue, print out the points.
-	    write_weibull_points = true;
-	  }
-        
-	}
-      
-      
-	if (write_weibull_points || Params::GetBool("write-weibull-points")) {
-	  writeTrainingCandidates(train_candidates, scan_num, weibull);
-	}
-	carp(CARP_DEBUG, "Delete train candidates.");
-	delete train_candidates;
-	carp(CARP_DEBUG, "Delete target train candidates.");
-	delete target_train_candidates;
-	
-      } // if (compute_p_values)
-      
-      //print out
-      target_candidates->setFilePath(ms2_file);
-      decoy_candidates->setFilePath(ms2_file);
-      vector<MatchCollection*> decoy_vec;
-    
-      if (Params::GetBool("concat")) {
-	for (size_t idx=0;idx < decoy_candidates->getMatchTotal();idx++) {
-	  target_candidates->add(decoy_candidates->at(idx), true);
-	}
-      } else {
-	
-	decoy_vec.push_back(decoy_candidates);
-
-	if (decoy_candidates->getScoredType(SP) == true) {
-	  decoy_candidates->populateMatchRank(SP);
-	}
-	decoy_candidates->populateMatchRank(XCORR);
-	decoy_candidates->sort(XCORR);
-      }
-      
-      carp(CARP_DEBUG, "Ranking.");
-      
-      if (target_candidates->getScoredType(SP) == true) {
-	target_candidates->populateMatchRank(SP);
+      workers.search(&batch, min_pvalue);
+
+      for (size_t search_idx = 0; search_idx < batch.size(); search_idx++) {
+        Crux::Spectrum* spectrum = batch[search_idx].spectrum;
+        vector<XLinkChargeSearch>& charges = batch[search_idx].charges;
+        int scan_num = spectrum->getFirstScan();
+        for (size_t charge_idx = 0; charge_idx < charges.size(); charge_idx++) {
+          XLinkChargeSearch& charge = charges[charge_idx];
+
+          if (print_interval > 0 && search_count > 0 && search_count % print_interval == 0) {
+            carp(CARP_INFO, 
+                 "%d spectrum-charge combinations searched, %.0f%% complete",
+                 search_count + spectrum_iterator->numSkipped(),
+                 (search_count + spectrum_iterator->numSkipped()) / num_spectra * 100);
+          }
+          search_count++;
+
+          if (charge.targets == NULL) {
+            skipped_no_candidates++;
+            carp(CARP_DETAILED_INFO, "Skipping scan %d charge %d mass %lg", 
+                 scan_num, 
+                 charge.zstate.getCharge(),
+                 charge.zstate.getNeutralMass()
+                 );
+            continue;
+          }
+
+          carp(CARP_DETAILED_INFO, "Scan=%d charge=%d mass=%lg candidates=%d", 
+               scan_num, 
+               charge.zstate.getCharge(), 
+               charge.zstate.getNeutralMass(), 
+               charge.targets->getMatchTotal());   
+
+          //print out
+          charge.targets->setFilePath(ms2_file);
+          charge.decoys->setFilePath(ms2_file);
+          vector<MatchCollection*> decoy_vec;
+          if (!Params::GetBool("concat")) {
+            decoy_vec.push_back(charge.decoys);
+          }
+
+          carp(CARP_DEBUG, "Writing results.");
+          output_files.writeMatches(
+            (MatchCollection*)charge.targets, 
+            decoy_vec,
+            XCORR,
+            spectrum);
+
+          /* Clean up */
+          delete charge.decoys;
+          delete charge.targets;
+        }
+        carp(CARP_DEBUG, "Done with spectrum %d.", scan_num);
       }
-      target_candidates->populateMatchRank(XCORR);
-      target_candidates->sort(XCORR);
-      
-    
-      carp(CARP_DEBUG, "Writing results.");
-      output_files.writeMatches(
-				(MatchCollection*)target_candidates, 
-				decoy_vec,
-				XCORR,
-				spectrum);
-
-      /* Clean up */
-      carp(CARP_DEBUG, "Deleting decoy candidates.");
-      delete decoy_candidates;
-      carp(CARP_DEBUG, "Deleting target candidates.");
-      delete target_candidates;
+      // No thread is using the shuffled peptides any more.
       XLink::deleteAllocatedPeptides();
-    
-      //free_spectrum(spectrum);
-      
-      carp(CARP_DEBUG, "Done with spectrum %d.", scan_num);
-      carp(CARP_DEBUG, "=====================================");
-    } // get next spectrum
+    } // get next batch of spectra
 
     carp(CARP_INFO, "Skipped %d (%g%%) spectra with 0 candidates.", 
 	 skipped_no_candidates, skipped_no_candidates / num_spectra * 100);
@@ -353,6 +553,8 @@ int SearchForXLinks::xlinkSearchMain() {
     delete spectra;
     XLink::deleteAllocatedPeptides();
   }
+  workers.stop();
+
   for(int mod_idx = 0; mod_idx < num_peptide_mods; mod_idx++) {
     free_peptide_mod(peptide_mods[mod_idx]);
   }
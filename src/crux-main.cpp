@@ -47,6 +47,7 @@
 #include "app/CascadeSearchApplication.h"
 #include "app/AssignConfidenceApplication.h"
 #include "app/SubtractIndexApplication.h"
+#include "app/MergeTideShardsApplication.h"
 /**
  * The starting point for crux.  Prints a general usage statement when
  * given no arguments.  Runs one of the crux commands, including
@@ -94,6 +95,7 @@ int main(int argc, char** argv) {
     applications.add(new PrintVersion());
     applications.add(new PSMConvertApplication());
     applications.add(new SubtractIndexApplication());
+    applications.add(new MergeTideShardsApplication());
     applications.add(new XLinkAssignIons());
     applications.add(new XLinkScoreSpectrum());
     applications.add(new LocalizeModificationApplication());
@@ -9,6 +9,7 @@
 
 #include <iostream>
 #include <string>
+#include <string.h>
 
 #include "carp.h"
 #include "DelimitedFile.h"
@@ -16,11 +17,149 @@
 
 using namespace std;
 
+/**
+ * \returns whether c is skipped before a number, as operator>> does.
+ */
+static bool isNumberSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+/**
+ * Converts text of the form [+-]digits[.digits][(e|E)[+-]digits] to a
+ * double. Only numbers with at most 15 significant digits and a small
+ * decimal exponent are converted, because their mantissa and power of ten
+ * are exact doubles, so that one multiplication or division gives the
+ * correctly rounded result, the same as strtod. The caller falls back to
+ * the stream-based conversion for everything else.
+ * \returns true if the text was converted.
+ */
+bool DelimitedFileReader::parseSimpleDouble(
+  const char* begin, ///< start of the text
+  const char* end, ///< end of the text
+  double* value ///< the number -out
+  ) {
+  static const double powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  const char* p = begin;
+  while (p < end && isNumberSpace(*p)) {
+    p++;
+  }
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+  unsigned long long mantissa = 0;
+  int digits = 0;
+  int significant = 0;
+  int exponent = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+    if (mantissa != 0 || *p != '0') {
+      mantissa = mantissa * 10 + (*p - '0');
+      significant++;
+    }
+    if (significant > 15) {
+      return false;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+      if (mantissa != 0 || *p != '0') {
+        mantissa = mantissa * 10 + (*p - '0');
+        significant++;
+      }
+      if (significant > 15) {
+        return false;
+      }
+      exponent--;
+    }
+  }
+  if (digits == 0) {
+    return false;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    bool negative_exponent = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      negative_exponent = (*p == '-');
+      p++;
+    }
+    int explicit_exponent = 0;
+    int exponent_digits = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, exponent_digits++) {
+      if (exponent_digits >= 4) {
+        return false;
+      }
+      explicit_exponent = explicit_exponent * 10 + (*p - '0');
+    }
+    if (exponent_digits == 0) {
+      return false;
+    }
+    exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+  }
+  if (p != end || exponent < -22 || exponent > 22) {
+    return false;
+  }
+  double result = (double)mantissa;
+  if (exponent < 0) {
+    result /= powers[-exponent];
+  } else {
+    result *= powers[exponent];
+  }
+  *value = negative ? -result : result;
+  return true;
+}
+
+/**
+ * Converts text of the form [+-]digits to an int, if it has at most 9
+ * digits. The caller falls back to the stream-based conversion for
+ * everything else.
+ * \returns true if the text was converted.
+ */
+bool DelimitedFileReader::parseSimpleInteger(
+  const char* begin, ///< start of the text
+  const char* end, ///< end of the text
+  int* value ///< the number -out
+  ) {
+  const char* p = begin;
+  while (p < end && isNumberSpace(*p)) {
+    p++;
+  }
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+  if (p == end || end - p > 9) {
+    return false;
+  }
+  int result = 0;
+  for (; p < end; p++) {
+    if (*p < '0' || *p > '9') {
+      return false;
+    }
+    result = result * 10 + (*p - '0');
+  }
+  *value = negative ? -result : result;
+  return true;
+}
+
+/**
+ * \returns whether the cell holds exactly the given text.
+ */
+static bool cellEquals(const DelimitedFileReader::Cell& cell, const char* text) {
+  size_t length = strlen(text);
+  return cell.length == length && memcmp(cell.data, text, length) == 0;
+}
+
 /**
  * \returns a DelimitedFileReader object
  */  
 DelimitedFileReader::DelimitedFileReader():
-  num_rows_valid_(false), istream_ptr_(NULL), delimiter_('\t'), owns_stream_(false) {
+  num_fields_(0), fields_split_(false), row_count_(0), read_pos_(0), read_end_(0),
+  delimiter_('\t'), owns_stream_(false), istream_ptr_(NULL), num_rows_valid_(false) {
 }
 
 /**
@@ -31,7 +170,8 @@ DelimitedFileReader::DelimitedFileReader(
   const char *file_name, ///< the path of the file to read
   bool has_header, ///< indicates whether the header exists (default true).
   char delimiter ///< the delimiter to use (default tab).
-): istream_ptr_(NULL), num_rows_valid_(false), delimiter_(delimiter) {
+): num_fields_(0), fields_split_(false), row_count_(0), read_pos_(0), read_end_(0),
+  delimiter_(delimiter), istream_ptr_(NULL), num_rows_valid_(false) {
   loadData(file_name, has_header);
 }
 
@@ -43,7 +183,8 @@ DelimitedFileReader::DelimitedFileReader(
   const std::string& file_name, ///< the path of the file  to read
   bool has_header, ///< indicates whether the header exists (default true).
   char delimiter ///< the delimiter to use (default tab)
-): istream_ptr_(NULL), delimiter_(delimiter) {
+): num_fields_(0), fields_split_(false), row_count_(0), read_pos_(0), read_end_(0),
+  delimiter_(delimiter), istream_ptr_(NULL) {
   loadData(file_name, has_header);
 }
 
@@ -55,8 +196,9 @@ DelimitedFileReader::DelimitedFileReader(
   std::istream* istream_ptr, ///< the stream to be read
   bool has_header, ///<indicates whether header exists
   char delimiter ///< the delimiter to use (default tab)
-): istream_ptr_(istream_ptr), istream_begin_(istream_ptr->tellg()), delimiter_(delimiter),
-has_header_(has_header), owns_stream_(false) {
+): num_fields_(0), fields_split_(false), row_count_(0), read_pos_(0), read_end_(0),
+  delimiter_(delimiter), has_header_(has_header), owns_stream_(false),
+  istream_ptr_(istream_ptr), istream_begin_(istream_ptr->tellg()) {
   loadData();
 }
 
@@ -153,13 +295,25 @@ void DelimitedFileReader::loadData() {
   has_current_ = false;
   column_mismatch_warned_ = false;
   istream_begin_ = istream_ptr_->tellg(); 
+  if (read_buffer_.empty()) {
+    read_buffer_.resize(1 << 20);
+  }
+  read_pos_ = 0;
+  read_end_ = 0;
+  fields_split_ = false;
+  num_fields_ = 0;
 
-  has_next_ = !getline(*istream_ptr_, next_data_string_).fail();
+  has_next_ = readLine(next_data_string_);
   next_data_string_ = StringUtils::Trim(next_data_string_);
   if (has_header_) {
     if (has_next_) {
       column_names_ = StringUtils::Split(next_data_string_, delimiter_);
-      has_next_ = !getline(*istream_ptr_, next_data_string_).fail();
+      column_indices_.clear();
+      for (unsigned int col_idx = 0; col_idx < column_names_.size(); col_idx++) {
+        //keep the first of duplicated names, as a linear search would.
+        column_indices_.insert(make_pair(column_names_[col_idx], (int)col_idx));
+      }
+      has_next_ = readLine(next_data_string_);
     } else {
       carp(CARP_WARNING, "No data/headers found!");
       return;
@@ -171,6 +325,42 @@ void DelimitedFileReader::loadData() {
   } 
 }
 
+/**
+ * reads the next line of the stream into line, without the line
+ * terminator. Like getline, a last line without a terminator is
+ * returned, and there is no empty line after a final terminator.
+ * \returns false if there are no more lines.
+ */
+bool DelimitedFileReader::readLine(
+  string& line ///< the line -out
+  ) {
+  line.clear();
+  bool found = false;
+  while (true) {
+    if (read_pos_ < read_end_) {
+      const char* start = &read_buffer_[read_pos_];
+      const char* newline = (const char*)memchr(start, '\n', read_end_ - read_pos_);
+      if (newline != NULL) {
+        line.append(start, newline - start);
+        read_pos_ += newline - start + 1;
+        return true;
+      }
+      line.append(start, read_end_ - read_pos_);
+      found = true;
+    }
+    read_pos_ = 0;
+    read_end_ = 0;
+    if (!istream_ptr_->good()) {
+      return found;
+    }
+    istream_ptr_->read(&read_buffer_[0], read_buffer_.size());
+    read_end_ = istream_ptr_->gcount();
+    if (read_end_ == 0) {
+      return found;
+    }
+  }
+}
+
 /**
  * clears the current data and column names,
  * parses the header if it exists,
@@ -215,12 +405,8 @@ void DelimitedFileReader::loadData(
 int DelimitedFileReader::findColumn(
   const string& column_name ///< the column name
   ) {
-  for (unsigned int col_idx=0;col_idx < column_names_.size();col_idx++) {
-    if (column_names_[col_idx] == column_name) {
-      return col_idx;
-    }
-  }
-  return -1;
+  map<string, int>::const_iterator i = column_indices_.find(column_name);
+  return (i == column_indices_.end()) ? -1 : i->second;
 }
 
 /**
@@ -273,11 +459,72 @@ const string& DelimitedFileReader::getString() {
 const string& DelimitedFileReader::getString(
   unsigned int col_idx ///< the column index
   ) {
-  if (col_idx >= data_.size()) {
+  Cell cell = getCell(col_idx);
+  if (data_row_[col_idx] != row_count_) {
+    data_[col_idx].assign(cell.data, cell.length);
+    data_row_[col_idx] = row_count_;
+  }
+  return data_[col_idx];
+}
+
+/**
+ * \returns the cell of the current row, without copying it into a string.
+ */
+DelimitedFileReader::Cell DelimitedFileReader::getCell(
+  unsigned int col_idx ///< the column index
+  ) {
+  if (!fields_split_) {
+    splitFields();
+  }
+  if (col_idx >= num_fields_) {
     carp(CARP_FATAL, "col idx:%i is out of bounds! (0,%i,%i)",
-         col_idx, (column_names_.size()-1), (data_.size()-1));
+         col_idx, (column_names_.size()-1), (num_fields_-1));
+  }
+  Cell cell;
+  if (col_idx + 1 < field_starts_.size()) {
+    cell.data = current_data_string_.data() + field_starts_[col_idx];
+    cell.length = field_starts_[col_idx + 1] - 1 - field_starts_[col_idx];
+  } else {
+    //padding for a row that is shorter than the header.
+    cell.data = current_data_string_.data() + current_data_string_.length();
+    cell.length = 0;
+  }
+  return cell;
+}
+
+/**
+ * finds the start of each field of the current row.
+ */
+void DelimitedFileReader::splitFields() {
+  field_starts_.clear();
+  field_starts_.push_back(0);
+  const char* row = current_data_string_.data();
+  size_t length = current_data_string_.length();
+  const char* delimiter;
+  size_t pos = 0;
+  while ((delimiter = (const char*)memchr(row + pos, delimiter_, length - pos)) != NULL) {
+    pos = delimiter - row + 1;
+    field_starts_.push_back(pos);
+  }
+  field_starts_.push_back(length + 1);
+  num_fields_ = field_starts_.size() - 1;
+  fields_split_ = true;
+
+  //make sure data has the right number of columns for the header.
+  if (num_fields_ < column_names_.size()) {
+    if (!column_mismatch_warned_) {
+      carp(CARP_WARNING, "Column count %d for line %d is less than header %d",
+           num_fields_, current_row_, column_names_.size());
+      carp(CARP_WARNING, "%s", current_data_string_.c_str());
+      carp(CARP_WARNING, "Suppressing warnings, other mismatches may exist!");
+      column_mismatch_warned_ = true;
+    }
+    num_fields_ = column_names_.size();
+  }
+  if (data_.size() < num_fields_) {
+    data_.resize(num_fields_);
+    data_row_.resize(num_fields_, 0);
   }
-  return data_.at(col_idx);
 }
 
 /** 
@@ -311,11 +558,15 @@ TValue DelimitedFileReader::getValue(
 FLOAT_T DelimitedFileReader::getFloat(
   unsigned int col_idx ///< the column index
   ) {
-  const string& string_ans = getString(col_idx);
-  if (string_ans == "Inf") {
+  Cell cell = getCell(col_idx);
+  double value;
+  if (cellEquals(cell, "Inf")) {
     return numeric_limits<FLOAT_T>::infinity();
-  } else if (string_ans == "-Inf") {
+  } else if (cellEquals(cell, "-Inf")) {
     return -numeric_limits<FLOAT_T>::infinity();
+  } else if (sizeof(FLOAT_T) == sizeof(double) &&
+             parseSimpleDouble(cell.data, cell.data + cell.length, &value)) {
+    return value;
   } else {
     return getValue<FLOAT_T>(col_idx);
   }
@@ -344,13 +595,16 @@ FLOAT_T DelimitedFileReader::getFloat(
 double DelimitedFileReader::getDouble(
   unsigned int col_idx ///< the column index 
   ) {
-  const string& string_ans = getString(col_idx);
-  if (string_ans == "") {
+  Cell cell = getCell(col_idx);
+  double value;
+  if (cell.length == 0) {
     return 0.0;
-  } else if (string_ans == "Inf") {
+  } else if (cellEquals(cell, "Inf")) {
     return numeric_limits<double>::infinity();
-  } else if (string_ans == "-Inf") {
+  } else if (cellEquals(cell, "-Inf")) {
     return -numeric_limits<double>::infinity();
+  } else if (parseSimpleDouble(cell.data, cell.data + cell.length, &value)) {
+    return value;
   } else {
     return getValue<double>(col_idx);
   }
@@ -378,7 +632,11 @@ double DelimitedFileReader::getDouble(
 int DelimitedFileReader::getInteger(
   unsigned int col_idx ///< the column index 
   ) {
-  //TODO : check the string for a valid integer.
+  Cell cell = getCell(col_idx);
+  int value;
+  if (parseSimpleInteger(cell.data, cell.data + cell.length, &value)) {
+    return value;
+  }
   return getValue<int>(col_idx);
 }
 
@@ -469,25 +727,13 @@ void DelimitedFileReader::reset() {
 void DelimitedFileReader::next() {
   if (has_next_) {
     current_row_++;
-    current_data_string_ = next_data_string_;
-    //parse next_data_string_ into data_
-    data_ = StringUtils::Split(current_data_string_, delimiter_);
-    //make sure data has the right number of columns for the header.
-    if (data_.size() < column_names_.size()) {
-      if (!column_mismatch_warned_) {
-        carp(CARP_WARNING, "Column count %d for line %d is less than header %d",
-             data_.size(), current_row_, column_names_.size());
-        carp(CARP_WARNING, "%s", current_data_string_.c_str());
-        carp(CARP_WARNING, "Suppressing warnings, other mismatches may exist!");
-        column_mismatch_warned_ = true;
-      }
-      while (data_.size() < column_names_.size()) {
-        data_.push_back("");
-      }
-    }
+    row_count_++;
+    //the row is split into cells when one is first asked for.
+    current_data_string_.swap(next_data_string_);
+    fields_split_ = false;
 
     //read next line
-    has_next_ = !getline(*istream_ptr_, next_data_string_).fail();
+    has_next_ = readLine(next_data_string_);
     has_current_ = true;
   } else {
     has_current_ = false;
@@ -9,7 +9,9 @@
  * Types from each cell of the table.  This class also provides function
  * for reading a list of integers or string from a cell using a delimiter
  * that is different from the column delimiter (default is comma ',').
- * This class reads the data in line by line
+ * This class reads the data in line by line. Rows are only split into
+ * cells when a cell is asked for, and cells are only copied into strings
+ * when they are asked for as strings.
  ****************************************************************************/
 #ifndef DELIMITEDFILEREADER_H
 #define DELIMITEDFILEREADER_H
@@ -36,8 +38,19 @@ class DelimitedFileReader {
 
   std::string next_data_string_; ///<the next data string.
   std::string current_data_string_; ///<the current data string.
-  std::vector<std::string> data_; ///<the current vectorized data.
+  std::vector<std::string> data_; ///<cells of the current row that were asked for as strings.
+  std::vector<unsigned long> data_row_; ///<the row each cell of data_ was copied from.
   std::vector<std::string> column_names_; ///<the column names.
+  std::map<std::string, int> column_indices_; ///<the index of each column name.
+
+  std::vector<size_t> field_starts_; ///<offsets of the fields in the current row, plus one past its end.
+  unsigned int num_fields_; ///<number of fields of the current row, padded to the header.
+  bool fields_split_; ///<whether field_starts_ is valid for the current row.
+  unsigned long row_count_; ///<number of rows read since the file was (re)loaded.
+
+  std::vector<char> read_buffer_; ///<block of the stream that is being split into lines.
+  size_t read_pos_; ///<start of the next line in read_buffer_.
+  size_t read_end_; ///<end of the valid data in read_buffer_.
 
   char delimiter_; ///<the delimiter to use.
 
@@ -68,6 +81,20 @@ class DelimitedFileReader {
    */
   void loadData();
 
+  /**
+   * reads the next line of the stream into line, without the line
+   * terminator. Lines are cut out of large blocks read from the stream.
+   * \returns false if there are no more lines.
+   */
+  bool readLine(
+    std::string& line ///< the line -out
+  );
+
+  /**
+   * finds the start of each field of the current row.
+   */
+  void splitFields();
+
   virtual void loadData(
     const char *file_name, ///< the file path
     bool has_header = true ///< header indicator
@@ -79,6 +106,39 @@ class DelimitedFileReader {
   );
 
  public:
+  /**
+   * A cell of the current row: a pointer to its text in the row and its
+   * length. The text is not null-terminated, and is only valid until
+   * next() is called.
+   */
+  struct Cell {
+    const char* data;
+    size_t length;
+  };
+
+  /**
+   * Converts text of the form [+-]digits[.digits][(e|E)[+-]digits] with
+   * at most 15 significant digits and a decimal exponent in [-22, 22].
+   * \returns true if the text was converted; false if the caller must
+   * fall back to the stream-based conversion.
+   */
+  static bool parseSimpleDouble(
+    const char* begin, ///< start of the text
+    const char* end, ///< end of the text
+    double* value ///< the number -out
+  );
+
+  /**
+   * Converts text of the form [+-]digits with at most 9 digits.
+   * \returns true if the text was converted; false if the caller must
+   * fall back to the stream-based conversion.
+   */
+  static bool parseSimpleInteger(
+    const char* begin, ///< start of the text
+    const char* end, ///< end of the text
+    int* value ///< the number -out
+  );
+
   /**
    * \returns a blank DelimitedFileReader object 
    */
@@ -190,6 +250,14 @@ class DelimitedFileReader {
     unsigned int col_idx ///< the column index
   );
 
+  /**
+   * \returns the cell of the current row, without copying it into a
+   * string. Cells past the end of a short row are empty.
+   */
+  Cell getCell(
+    unsigned int col_idx ///< the column index
+  );
+
   /**
    * \returns the value of the cell
    * using the current row
@@ -0,0 +1,170 @@
+/**
+ * \file PSMColumnReader.cpp
+ * \brief Reads the columns needed for q-value estimation into flat arrays.
+ ****************************************************************************/
+#include "PSMColumnReader.h"
+
+#include <stdlib.h>
+
+#include "io/carp.h"
+#include "util/StringUtils.h"
+
+using namespace std;
+
+/**
+ * Finds the start of each tab-delimited field of a line.
+ */
+static void findFields(const string& line, vector<size_t>* starts) {
+  starts->clear();
+  starts->push_back(0);
+  for (size_t pos = line.find('\t'); pos != string::npos; pos = line.find('\t', pos + 1)) {
+    starts->push_back(pos + 1);
+  }
+}
+
+PSMColumnReader::PSMColumnReader(const string& file_name)
+  : file_name_(file_name), file_(file_name.c_str(), ios::in | ios::binary) {
+  if (!file_.good()) {
+    carp(CARP_FATAL, "Could not open %s", file_name.c_str());
+  }
+  getline(file_, header_);
+  header_ = StringUtils::Trim(header_);
+  vector<string> columns = StringUtils::Split(header_, '\t');
+  for (int col = 0; col < NUMBER_MATCH_COLUMNS; col++) {
+    column_idx_[col] = -1;
+    for (size_t i = 0; i < columns.size(); i++) {
+      if (columns[i] == get_column_header(col)) {
+        column_idx_[col] = i;
+        break;
+      }
+    }
+  }
+  string line;
+  if (getline(file_, line)) {
+    first_row_ = StringUtils::Split(StringUtils::Trim(line), '\t');
+  }
+  file_.clear();
+}
+
+PSMColumnReader::~PSMColumnReader() {
+}
+
+const string& PSMColumnReader::getFileName() const {
+  return file_name_;
+}
+
+const string& PSMColumnReader::getHeader() const {
+  return header_;
+}
+
+bool PSMColumnReader::hasColumn(MATCH_COLUMNS_T col) const {
+  return column_idx_[col] >= 0;
+}
+
+bool PSMColumnReader::hasValues(MATCH_COLUMNS_T col) const {
+  int idx = column_idx_[col];
+  return idx >= 0 && idx < (int)first_row_.size() && !first_row_[idx].empty();
+}
+
+size_t PSMColumnReader::read(
+  MATCH_COLUMNS_T score_col,
+  MATCH_COLUMNS_T score_rank_col,
+  int max_rank,
+  const string& decoy_prefix,
+  bool all_decoys,
+  map<string, int>* spectrum_file_ids
+) {
+  clear();
+  int score_idx = column_idx_[score_col];
+  int xcorr_rank_idx = column_idx_[XCORR_RANK_COL];
+  int score_rank_idx = column_idx_[score_rank_col];
+  int scan_idx = column_idx_[SCAN_COL];
+  int charge_idx = column_idx_[CHARGE_COL];
+  int file_idx = column_idx_[FILE_COL];
+  int protein_idx = column_idx_[PROTEIN_ID_COL];
+  if (score_idx < 0) {
+    carp(CARP_FATAL, "Column \"%s\" not found in %s.",
+         get_column_header(score_col), file_name_.c_str());
+  }
+
+  file_.clear();
+  file_.seekg(0);
+  string line;
+  getline(file_, line);
+  streamoff offset = line.length() + 1;
+  vector<size_t> starts;
+  while (getline(file_, line)) {
+    streamoff row_offset = offset;
+    offset += line.length() + 1;
+    if (StringUtils::Trim(line).empty()) {
+      continue;
+    }
+    findFields(line, &starts);
+    int num_fields = starts.size();
+    const char* text = line.c_str();
+
+    int xcorr_rank = (xcorr_rank_idx >= 0 && xcorr_rank_idx < num_fields) ?
+      atoi(text + starts[xcorr_rank_idx]) : -1;
+    if (max_rank != 0 && xcorr_rank > max_rank) {
+      continue;
+    }
+    scores_.push_back(score_idx < num_fields ? strtod(text + starts[score_idx], NULL) : 0);
+    xcorr_ranks_.push_back(xcorr_rank);
+    score_ranks_.push_back((score_rank_idx >= 0 && score_rank_idx < num_fields) ?
+      atoi(text + starts[score_rank_idx]) : -1);
+    scans_.push_back((scan_idx >= 0 && scan_idx < num_fields) ?
+      atoi(text + starts[scan_idx]) : 0);
+    charges_.push_back((charge_idx >= 0 && charge_idx < num_fields) ?
+      atoi(text + starts[charge_idx]) : 0);
+
+    string spectrum_file;
+    if (file_idx >= 0 && file_idx < num_fields) {
+      size_t end = (file_idx + 1 < num_fields) ? starts[file_idx + 1] - 1 : line.length();
+      spectrum_file = StringUtils::Trim(line.substr(starts[file_idx], end - starts[file_idx]));
+    }
+    map<string, int>::const_iterator id = spectrum_file_ids->find(spectrum_file);
+    if (id == spectrum_file_ids->end()) {
+      id = spectrum_file_ids->insert(make_pair(spectrum_file, (int)spectrum_file_ids->size())).first;
+    }
+    spectrum_files_.push_back(id->second);
+
+    bool is_decoy = all_decoys;
+    if (!is_decoy && protein_idx >= 0 && protein_idx < num_fields && !decoy_prefix.empty()) {
+      is_decoy = line.compare(starts[protein_idx], decoy_prefix.length(), decoy_prefix) == 0;
+    }
+    decoys_.push_back(is_decoy);
+    offsets_.push_back(row_offset);
+  }
+  file_.clear();
+  return scores_.size();
+}
+
+void PSMColumnReader::clear() {
+  vector<FLOAT_T>().swap(scores_);
+  vector<int>().swap(xcorr_ranks_);
+  vector<int>().swap(score_ranks_);
+  vector<int>().swap(scans_);
+  vector<int>().swap(charges_);
+  vector<int>().swap(spectrum_files_);
+  vector<bool>().swap(decoys_);
+  vector<streamoff>().swap(offsets_);
+}
+
+void PSMColumnReader::getRow(streamoff offset, string* row) {
+  file_.clear();
+  file_.seekg(offset);
+  if (!getline(file_, *row)) {
+    carp(CARP_FATAL, "Could not read row at offset %lld of %s",
+         (long long)offset, file_name_.c_str());
+  }
+  if (!row->empty() && (*row)[row->length() - 1] == '\r') {
+    row->erase(row->length() - 1);
+  }
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
@@ -0,0 +1,115 @@
+/**
+ * \file PSMColumnReader.h
+ * \brief Reads the few columns of a tab-delimited PSM file that q-value
+ * estimation needs into flat arrays, one entry per row.
+ *
+ * Unlike MatchFileReader, no Match, Peptide, PeptideSrc or Spectrum objects
+ * are created, so a file with tens of millions of PSMs takes a few dozen
+ * bytes per row. Each row remembers its byte offset in the file, so that the
+ * original row can be read back and copied to the output.
+ ****************************************************************************/
+#ifndef PSMCOLUMNREADER_H
+#define PSMCOLUMNREADER_H
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "MatchColumns.h"
+#include "model/objects.h"
+
+class PSMColumnReader {
+
+ protected:
+  std::string file_name_;
+  std::ifstream file_;
+  std::string header_;
+  std::vector<std::string> first_row_;
+  int column_idx_[NUMBER_MATCH_COLUMNS];
+
+  std::vector<FLOAT_T> scores_;
+  std::vector<int> xcorr_ranks_;
+  std::vector<int> score_ranks_;
+  std::vector<int> scans_;
+  std::vector<int> charges_;
+  std::vector<int> spectrum_files_;
+  std::vector<bool> decoys_;
+  std::vector<std::streamoff> offsets_;
+
+ public:
+
+  /**
+   * Opens the file and reads its header. No rows are read yet.
+   */
+  explicit PSMColumnReader(const std::string& file_name);
+
+  /**
+   * Destructor
+   */
+  ~PSMColumnReader();
+
+  const std::string& getFileName() const;
+
+  /**
+   * \returns the header line of the file
+   */
+  const std::string& getHeader() const;
+
+  /**
+   * \returns true if the file has the column and its first row has a value
+   * in it. This mirrors how MatchFileReader decides which scores are present.
+   */
+  bool hasValues(MATCH_COLUMNS_T col) const;
+
+  bool hasColumn(MATCH_COLUMNS_T col) const;
+
+  /**
+   * Reads the score, ranks, scan, charge and spectrum file of every row
+   * whose xcorr rank is at most max_rank (0 means no limit). A row is a decoy
+   * if all_decoys is set, or if its protein id starts with decoy_prefix.
+   * Spectrum file names are replaced by ids from spectrum_file_ids, which
+   * can be shared between readers so that their ids can be compared.
+   * \returns the number of rows read
+   */
+  size_t read(
+    MATCH_COLUMNS_T score_col,
+    MATCH_COLUMNS_T score_rank_col,
+    int max_rank,
+    const std::string& decoy_prefix,
+    bool all_decoys,
+    std::map<std::string, int>* spectrum_file_ids
+  );
+
+  /**
+   * Frees the arrays filled by read(). The file stays open, so rows can
+   * still be retrieved with getRow().
+   */
+  void clear();
+
+  size_t size() const { return scores_.size(); }
+  FLOAT_T score(size_t row) const { return scores_[row]; }
+  int xcorrRank(size_t row) const { return xcorr_ranks_[row]; }
+  int scoreRank(size_t row) const { return score_ranks_[row]; }
+  int scan(size_t row) const { return scans_[row]; }
+  int charge(size_t row) const { return charges_[row]; }
+  int spectrumFile(size_t row) const { return spectrum_files_[row]; }
+  bool decoy(size_t row) const { return decoys_[row]; }
+  std::streamoff offset(size_t row) const { return offsets_[row]; }
+
+  /**
+   * Reads the text of the row that starts at the given byte offset, without
+   * its line terminator.
+   */
+  void getRow(std::streamoff offset, std::string* row);
+
+};
+
+#endif //PSMCOLUMNREADER_H
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
@@ -32,6 +32,7 @@ using namespace Crux;
 
 PinWriter::PinWriter():
   out_(NULL),
+  owns_out_(false),
   enzyme_(get_enzyme_type_parameter("enzyme")),
   precision_(Params::GetInt("precision")),
   mass_precision_(Params::GetInt("mass-precision")) {
@@ -79,6 +80,13 @@ void PinWriter::openFile(const string& filename, const string& output_dir, bool
   if (!(out_ = create_stream_in_path(filename.c_str(), output_dir.c_str(), overwrite))) {
     carp(CARP_FATAL, "Can't open file '%s'", filename.c_str());
   }
+  owns_out_ = true;
+}
+
+void PinWriter::openStream(ostream* out) {
+  closeFile();
+  out_ = out;
+  owns_out_ = false;
 }
 
 void PinWriter::openFile(CruxApplication* application, string filename, MATCH_FILE_TYPE type) {
@@ -109,10 +117,11 @@ void PinWriter::setEnabledStatus(const string& name, bool enabled) {
  * Close the file, if open.
  */
 void PinWriter::closeFile() {
-  if (out_) {
+  if (out_ && owns_out_) {
     delete out_;
-    out_ = NULL;
   }
+  out_ = NULL;
+  owns_out_ = false;
 }
 
 void PinWriter::write( 
@@ -45,6 +45,11 @@ class PinWriter : public PSMWriter {
     bool overwrite
   );
 
+  /**
+   * Writes to a stream owned by the caller instead of a file.
+   */
+  void openStream(std::ostream* out);
+
   // PSMWriter openfile version
   void openFile(
     CruxApplication* application, ///< application writing the file
@@ -58,7 +63,8 @@ class PinWriter : public PSMWriter {
  protected:
   std::vector< std::pair<std::string, bool> > features_;
   std::vector<std::string> enabledFeatures_;
-  std::ofstream* out_;
+  std::ostream* out_;
+  bool owns_out_; ///< whether out_ was opened by this writer
   ENZYME_T enzyme_; 
   int precision_;
   int mass_precision_;
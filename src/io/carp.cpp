@@ -11,13 +11,84 @@
 #include "util/Params.h"
 #include "util/utils.h"
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <vector>
+
 using namespace std;
 
+/**
+ * Writes log file messages on a background thread, so that carp does not
+ * wait on the log file. Messages are appended to a buffer, which the thread
+ * swaps out and writes as one block.
+ */
+class LogFileWriter {
+ public:
+  explicit LogFileWriter(FILE* file)
+    : file_(file), closing_(false) {
+    thread_ = boost::thread(boost::bind(&LogFileWriter::run, this));
+  }
+
+  ~LogFileWriter() {
+    close();
+  }
+
+  void write(const string& text) {
+    boost::mutex::scoped_lock lock(mutex_);
+    buffer_ += text;
+    ready_.notify_one();
+  }
+
+  /**
+   * Writes out the remaining messages and closes the file.
+   */
+  void close() {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (closing_) {
+        return;
+      }
+      closing_ = true;
+      ready_.notify_one();
+    }
+    thread_.join();
+    fclose(file_);
+  }
+
+ private:
+  void run() {
+    string out;
+    bool closing = false;
+    while (!closing) {
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        while (buffer_.empty() && !closing_) {
+          ready_.wait(lock);
+        }
+        out.swap(buffer_);
+        closing = closing_;
+      }
+      if (!out.empty()) {
+        fwrite(out.data(), 1, out.length(), file_);
+        fflush(file_);
+        out.clear();
+      }
+    }
+  }
+
+  FILE* file_;
+  string buffer_;
+  bool closing_;
+  boost::mutex mutex_;
+  boost::condition_variable ready_;
+  boost::thread thread_;
+};
+
 /**
  * Constants
  */
-static int G_verbosity; 
-static FILE* log_file = NULL;
+int G_verbosity;
+static LogFileWriter* log_writer = NULL;
 
 unsigned int hash_size_ = 1000;
 
@@ -25,10 +96,6 @@ void set_verbosity_level(int verbosity) {
   G_verbosity = verbosity;
 }
 
-int get_verbosity_level(void) {
-  return G_verbosity;
-}
-
 /**
  * Open log file for carp messages.
  *
@@ -38,7 +105,28 @@ void open_log_file(string log_file_name) {
   string output_dir = Params::GetString("output-dir");
   bool overwrite = Params::GetBool("overwrite");
   log_file_name = prefix_fileroot_to_name(log_file_name);
-  log_file = create_file_in_path(log_file_name, output_dir.c_str(), overwrite);
+  FILE* log_file = create_file_in_path(log_file_name, output_dir.c_str(), overwrite);
+  if (log_file != NULL) {
+    close_log_file();
+    log_writer = new LogFileWriter(log_file);
+    static bool registered = false;
+    if (!registered) {
+      atexit(close_log_file);
+      registered = true;
+    }
+  }
+}
+
+/**
+ * Writes out the log file messages that are still buffered and closes the
+ * log file.
+ */
+void close_log_file() {
+  if (log_writer != NULL) {
+    LogFileWriter* writer = log_writer;
+    log_writer = NULL;
+    delete writer;
+  }
 }
 
 /**
@@ -50,72 +138,76 @@ void log_command_line(int argc, char *argv[]) {
   // Command line arguments were shifted, shift back.
   ++argc;
   --argv;
-  if (log_file != NULL) {
-    fprintf(log_file, "COMMAND LINE: ");
+  if (log_writer != NULL) {
+    string line = "COMMAND LINE: ";
     int i = 0;
     for (i = 0; i < argc; ++i) {
-      fprintf(log_file, "%s%c", argv[i], i < (argc - 1) ? ' ' : '\n');
+      line += argv[i];
+      line += i < (argc - 1) ? ' ' : '\n';
     }
+    log_writer->write(line);
   }
 }
 
-static void carp_print(const char *string) {
-  fprintf(stderr, "%s", string);
-  if (log_file != NULL) {
-    fprintf(log_file, "%s", string);
+/**
+ * \returns the prefix that is printed before a message of the given level
+ */
+static const char* carp_prefix(int verbosity) {
+  if (verbosity == CARP_WARNING) {
+    return "WARNING: ";
+  } else if (verbosity == CARP_ERROR) {
+    return "ERROR: ";
+  } else if (verbosity == CARP_FATAL) {
+    return "FATAL: ";
+  } else if (verbosity == CARP_INFO) {
+    return "INFO: ";
+  } else if (verbosity == CARP_DETAILED_INFO) {
+    return "DETAILED INFO: ";
+  } else if (verbosity == CARP_DEBUG) {
+    return "DEBUG: ";
+  } else if (verbosity == CARP_DETAILED_DEBUG) {
+    return "DETAILED DEBUG: ";
   }
+  return "UNKNOWN: ";
 }
 
 /**
- * Print message to log file.
+ * Prints a message regardless of the verbosity level; the carp macro checks
+ * the level before its arguments are evaluated.
  *
- * Print severity level and message to log file.
- * The term 'carp' is used because 'log' is already used 
- * by the math library. 
+ * The message is formatted once and written to stderr with a single call,
+ * and handed to the log file writer.
  *
  * Verbosity of CARP_FATAL will cause the 
  * program to exit with status code 1.
- *
  */
-void carp( int verbosity, const char* format, ...) {
-  if (verbosity <= G_verbosity) {
-    va_list  argp;
-
-    if (verbosity == CARP_WARNING) {
-      carp_print("WARNING: ");
-    } else if (verbosity == CARP_ERROR) {
-      carp_print("ERROR: ");
-    } else if (verbosity == CARP_FATAL) {
-      carp_print("FATAL: ");
-    } else if (verbosity == CARP_INFO) {
-      carp_print("INFO: ");
-    } else if (verbosity == CARP_DETAILED_INFO) {
-      carp_print("DETAILED INFO: ");
-    } else if (verbosity == CARP_DEBUG) {
-      carp_print("DEBUG: ");
-    } else if (verbosity == CARP_DETAILED_DEBUG) {
-      carp_print("DETAILED DEBUG: ");
-    } else {
-      carp_print("UNKNOWN: ");
-    }
+void carp_message( int verbosity, const char* format, ...) {
+  string message = carp_prefix(verbosity);
 
+  char buffer[1024];
+  va_list argp;
+  va_start(argp, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, argp);
+  va_end(argp);
+  if (length >= (int)sizeof(buffer)) {
+    vector<char> long_buffer(length + 1);
     va_start(argp, format);
-    vfprintf(stderr, format, argp);
+    vsnprintf(&long_buffer[0], long_buffer.size(), format, argp);
     va_end(argp);
-    if (log_file != NULL) { 
-      va_start(argp, format); //BF: added to fix segfault
-      vfprintf(log_file, format, argp);
-      va_end(argp);
-    }
-    carp_print("\n");
-    fflush(stderr);
-    if (log_file != NULL) {
-      fflush(log_file);
-    }
-  } 
+    message += &long_buffer[0];
+  } else if (length > 0) {
+    message += buffer;
+  }
+  message += '\n';
+
+  fputs(message.c_str(), stderr);
+  if (log_writer != NULL) {
+    log_writer->write(message);
+  }
   if (verbosity == CARP_FATAL) {
     // Fatal carps cause the program to exit
 #ifdef DEBUG
+    close_log_file();
     abort(); // Dump core in DEBUG mode.  Use 'make CXXFLAGS=-DDEBUG"'
 #else
     exit(1);
@@ -123,10 +215,9 @@ void carp( int verbosity, const char* format, ...) {
   }
 }
 
-void carp ( int verbosity, string& msg) {
+void carp_message( int verbosity, string& msg) {
 
-  string carp_msg = msg;
-  carp(verbosity, "%s", carp_msg.c_str());
+  carp_message(verbosity, "%s", msg.c_str());
 }
 
 /*
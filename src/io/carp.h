@@ -51,9 +51,19 @@ static const int CARP_DETAILED_DEBUG = 60;
 static const int CARP_MAX = 100; 
 
 /**
- * Allow for compilation to remove carp commands in the preprocessor.
+ * The most verbose level whose carp messages are compiled in. Defining it
+ * as, for example, CARP_DETAILED_INFO leaves the debug messages and the
+ * evaluation of their arguments out of the build.
  */
-#define IF_CARP(x, y) if (get_verbosity_level() >= x) {y;}
+#ifndef CARP_COMPILED_LEVEL
+#define CARP_COMPILED_LEVEL CARP_MAX
+#endif
+
+/**
+ * Runs y only if verbosity level x is enabled. Levels above
+ * CARP_COMPILED_LEVEL are a compile-time false, so the compiler drops y.
+ */
+#define IF_CARP(x, y) if ((x) <= CARP_COMPILED_LEVEL && get_verbosity_level() >= (x)) {y;}
 #define CRUX_DEBUG 
 
 #ifdef CRUX_DEBUG
@@ -88,9 +98,17 @@ static const int CARP_MAX = 100;
 void set_verbosity_level(int verbosity);
 
 /**
- * \returns the current verbosity level.
+ * The current verbosity level. Set it with set_verbosity_level.
+ */
+extern int G_verbosity;
+
+/**
+ * \returns the current verbosity level. Inline, since every carp call
+ * checks it.
  */
-int get_verbosity_level(void);
+inline int get_verbosity_level(void) {
+  return G_verbosity;
+}
 
 /**
  * Open log file for carp messages.
@@ -116,18 +134,40 @@ void log_command_line(int argc, char *argv[]);
  * Verbosity of CARP_FATAL will cause the 
  * program to exit with status code 1.
  *
+ * This is a macro so that the message arguments are only evaluated when
+ * the message will be printed at the current verbosity level.
+ */
+#define carp(verbosity, ...) \
+  do { \
+    int carp_verbosity_ = (verbosity); \
+    if ((carp_verbosity_ <= CARP_COMPILED_LEVEL && \
+         carp_verbosity_ <= get_verbosity_level()) || \
+        carp_verbosity_ == CARP_FATAL) { \
+      carp_message(carp_verbosity_, __VA_ARGS__); \
+    } \
+  } while (0)
+
+/**
+ * Prints a message regardless of the verbosity level, and exits if the
+ * verbosity is CARP_FATAL. Use carp instead, which checks the level.
  */
-void carp(
+void carp_message(
   int verbosity, 
   const char* format,
   ...
 );
 
-void carp(
+void carp_message(
   int verbosity,
   std::string& msg
 );
 
+/**
+ * Writes out the log file messages that are still buffered and closes the
+ * log file.
+ */
+void close_log_file();
+
 /**
  * \def carp_once( verbosity, msg, ...)
  *
@@ -23,6 +23,8 @@
 
 #include <stack>
 
+#include "boost/thread/tss.hpp"
+
 using namespace Crux;
 using namespace std;
 
@@ -74,7 +76,20 @@ class IonCache {
 };
 
 
-IonCache ion_cache_;
+/**
+ * Each thread recycles its own ions, so that ions can be created and freed
+ * by threads scoring different spectra without locking.
+ */
+static boost::thread_specific_ptr<IonCache> ion_cache_;
+
+static IonCache& getIonCache() {
+  IonCache* cache = ion_cache_.get();
+  if (cache == NULL) {
+    cache = new IonCache();
+    ion_cache_.reset(cache);
+  }
+  return *cache;
+}
 
 
 // At one point I need to reverse the endianness for pfile_create to work
@@ -302,12 +317,12 @@ void Ion::freeIon(
   ion->pointer_count_--;
 
   if (ion->pointer_count_ <= 0) {
-    ion_cache_.checkin(ion);//delete ion;
+    getIonCache().checkin(ion);//delete ion;
   }
 }
 
 Ion* Ion::newIon() {
-  Ion* ion = ion_cache_.checkout();
+  Ion* ion = getIonCache().checkout();
   ion->init();
   return(ion);
 }
@@ -59,13 +59,6 @@ class Ion : public CacheableMass {
   virtual FLOAT_T calcMass(MASS_TYPE_T mass_type);
 
 
-  /**
-   * initializes the mass array
-   */
-  static void initializeModificationMasses(
-    MASS_TYPE_T mass_type ///< mass type (average, mono) -in
-  );
-
  /**
   *\return the modified mass_z accodring to the modification type
   */
@@ -96,6 +89,14 @@ class Ion : public CacheableMass {
 
  public:
 
+  /**
+   * initializes the mass array. It is otherwise initialized on first
+   * use, so call this before ions are predicted on several threads.
+   */
+  static void initializeModificationMasses(
+    MASS_TYPE_T mass_type ///< mass type (average, mono) -in
+  );
+
   /**
    * initializes an Ion object.
    */
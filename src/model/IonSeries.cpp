@@ -24,13 +24,22 @@
 
 #include <stack>
 
+#include "boost/thread/tss.hpp"
+
 using namespace Crux;
 
 static const int BINARY_GMTK = 1;
 static const int PRINT_NULL_IONS = 1;
 static const int MIN_FRAMES = 3;
 
-FLOAT_T* IonSeries::mass_matrix_ = NULL;
+static void deleteMassMatrix(FLOAT_T* mass_matrix) {
+  delete []mass_matrix;
+}
+
+/**
+ * Scratch space for createMassMatrix, one per thread.
+ */
+static boost::thread_specific_ptr<FLOAT_T> mass_matrix_(deleteMassMatrix);
 
 
 /**
@@ -80,7 +89,19 @@ class LossLimitCache {
 
 };
 
-static LossLimitCache loss_limit_cache;
+/**
+ * Like the ion cache, each thread recycles its own loss limit arrays.
+ */
+static boost::thread_specific_ptr<LossLimitCache> loss_limit_cache_;
+
+static LossLimitCache& getLossLimitCache() {
+  LossLimitCache* cache = loss_limit_cache_.get();
+  if (cache == NULL) {
+    cache = new LossLimitCache();
+    loss_limit_cache_.reset(cache);
+  }
+  return *cache;
+}
 
 
 
@@ -138,7 +159,7 @@ IonSeries::IonSeries(
   peptide_length_ = peptide_.length();
   
   // create the loss limit array
-  loss_limit_ = loss_limit_cache.checkout();
+  loss_limit_ = getLossLimitCache().checkout();
   //loss_limit_ = new LOSS_LIMIT_T[GlobalParams::getMaxLength()];
   memset(loss_limit_, 0, sizeof(LOSS_LIMIT_T) * peptide_length_);
 }
@@ -157,7 +178,7 @@ IonSeries::IonSeries(
   init();
   constraint_ = constraint;
   charge_ = charge;
-  loss_limit_ = loss_limit_cache.checkout();
+  loss_limit_ = getLossLimitCache().checkout();
   //loss_limit_ = new LOSS_LIMIT_T[GlobalParams::getMaxLength()];
 }
 
@@ -245,7 +266,7 @@ IonSeries::~IonSeries()
     freeModSeq(modified_aa_seq_);
   }
   if(loss_limit_){
-    loss_limit_cache.checkin(loss_limit_);
+    getLossLimitCache().checkin(loss_limit_);
   }
   // free constraint?
 
@@ -259,7 +280,7 @@ IonSeries::~IonSeries()
 }
 
 void IonSeries::finalize() {
-  delete []mass_matrix_;
+  mass_matrix_.reset();
 
 }
 
@@ -449,12 +470,12 @@ FLOAT_T* IonSeries::createIonMassMatrix(
     return NULL;
   }
 
-  if (mass_matrix_ == NULL) {
-    //Allocate the static mass_matrix_
-    mass_matrix_ = new FLOAT_T[sizeof(FLOAT_T)*(GlobalParams::getMaxLength()+1)];
+  if (mass_matrix_.get() == NULL) {
+    //Allocate this thread's mass_matrix_
+    mass_matrix_.reset(new FLOAT_T[sizeof(FLOAT_T)*(GlobalParams::getMaxLength()+1)]);
   }
 
-  FLOAT_T* mass_matrix = mass_matrix_;
+  FLOAT_T* mass_matrix = mass_matrix_.get();
   
   // at index 0, the length of the peptide is stored
   mass_matrix[0] = peptide_length;
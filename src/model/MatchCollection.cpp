@@ -1376,43 +1376,21 @@ vector<FLOAT_T> MatchCollection::extractScores(
 }
 
 /**
- * Given a hash table that maps from a score to its q-value, assign
- * q-values to all of the matches in a given collection.
+ * Assign q-values to the matches, given in the order of the
+ * collection (the order of extractScores).
  */
 void MatchCollection::assignQValues(
-  const map<FLOAT_T, FLOAT_T>* score_to_qvalue_hash,
-  SCORER_TYPE_T score_type,
+  const vector<FLOAT_T>& qvalues,
   SCORER_TYPE_T derived_score_type
 ){
-
-  // Iterate over the matches filling in the q-values
-  MatchIterator* match_iterator = 
-    new MatchIterator(this, score_type, false);
-
-  while(match_iterator->hasNext()){
-    Match* match = match_iterator->next();
-    FLOAT_T score = match->getScore(score_type);
-
-    FLOAT_T qvalue;
-    // If the score is not a number, punt.
-    if ( isinf(score) || isnan(score) ) {
-      carp(CARP_DEBUG, "Found inf or nan score.");
-      qvalue = numeric_limits<double>::quiet_NaN();
-    } else {
-      // Retrieve the corresponding q-value.
-      map<FLOAT_T, FLOAT_T>::const_iterator map_position 
-	= score_to_qvalue_hash->find(score);
-      if (map_position == score_to_qvalue_hash->end()) {
-	carp(CARP_FATAL,
-	     "Cannot find q-value corresponding to score of %g.",
-	     score);
-      }
-      qvalue = map_position->second;
-    }
-    match->setScore(derived_score_type, qvalue);
+  if (qvalues.size() != match_.size()) {
+    carp(CARP_FATAL, "Cannot assign %d q-values to %d matches.",
+         qvalues.size(), match_.size());
+  }
+  for (size_t i = 0; i < match_.size(); i++) {
+    match_[i]->setScore(derived_score_type, qvalues[i]);
   }
   scored_type_[derived_score_type] = true;
-  delete match_iterator;
 }
 
 /*
@@ -365,12 +365,11 @@ class MatchCollection {
   ) const;
 
   /**
-   * Given a hash table that maps from a score to its q-value, assign
-   * q-values to all of the matches in a given collection.
+   * Assign q-values to the matches, given in the order of the
+   * collection (the order of extractScores).
    */
   void assignQValues(
-    const map<FLOAT_T, FLOAT_T>* score_to_qvalue_hash,
-    SCORER_TYPE_T score_type,
+    const std::vector<FLOAT_T>& qvalues,
     SCORER_TYPE_T derived_score_type
     );
 
@@ -964,86 +964,114 @@ FLOAT_T Scorer::scoreIntensityIonSeries(
   IonSeries* ion_series ///< the ion series to score against the spectrum (theoretical) -in
   ) {
 
-  
-  FLOAT_T ans = 0.0;
-  
-  Ion* ion = NULL;
-  int intensity_array_idx = 0;
-  int ion_charge = 0;
-  ION_TYPE_T ion_type;
-  FLOAT_T ion_mass_z = 0;
-  FLOAT_T bin_width = bin_width_;
-  FLOAT_T bin_offset = bin_offset_;
-  int max_bin = getMaxBin();
   FLOAT_T B_Y_sum = 0.0;
   FLOAT_T FLANK_sum = 0.0;
   FLOAT_T LOSS_sum = 0.0;
-  
-  // create the ion iterator that will iterate through the ions
+  int max_bin = getMaxBin();
 
   // while there are ion's in ion iterator, add matched observed peak intensity
   IonIterator eiter = ion_series->end();
   for (IonIterator ion_iterator = ion_series->begin();
     ion_iterator != eiter;
     ++ion_iterator) {
-    
-    ion = *ion_iterator;
-    
-    ion_mass_z = ion->getMassZ();
-    intensity_array_idx 
-      = INTEGERIZE(ion_mass_z, bin_width, bin_offset);
 
-    // skip ions that are located beyond max mz limit
-    if(intensity_array_idx >= max_bin){
-      continue;
+    Ion* ion = *ion_iterator;
+    ION_TYPE_T ion_type = ion->getType();
+    if (ion_type != B_ION && ion_type != Y_ION && ion_type != A_ION) {
+      // ERROR!, only should create B, Y, A type ions for xcorr theoreical 
+      carp(CARP_ERROR, "only should create B, Y, A type ions for xcorr theoretical spectrum");
+      return 0;
     }
-    ion_type = ion->getType();
-
-    // is it B, Y ion?
-    if(ion_type == B_ION || 
-       ion_type == Y_ION){
-
-      //      if (!ion->isModified()){
-      // Add peaks of intensity 50.0 for B, Y type ions. 
-      // In addition, add peaks of intensity of 25.0 to +/- 1 m/z flanking each B, Y ion if requested.
-      // Skip ions that are located beyond max mz limit
-      B_Y_sum += observed_[intensity_array_idx];
-      if (use_flanks_) {
-        FLANK_sum += observed_[intensity_array_idx-1];
-        if ((intensity_array_idx + 1) < max_bin) {
-          FLANK_sum += observed_[intensity_array_idx+1];
-	      }
-      }
-        
-      // add neutral loss of water and NH3
-      ion_charge = ion->getCharge();
-      if(ion_type == B_ION){
-        int h2o_array_idx = 
-          INTEGERIZE((ion_mass_z - (MASS_H2O_MONO/ion_charge)),
-                       bin_width, bin_offset);  
-        LOSS_sum += observed_[h2o_array_idx];
-      }
+    addXcorrIon(ion_type, ion->getMassZ(), ion->getCharge(), max_bin,
+                &B_Y_sum, &FLANK_sum, &LOSS_sum);
+  }
+
+  return combineXcorrSums(B_Y_sum, FLANK_sum, LOSS_sum);
+}
+
+/**
+ * Adds the observed intensities matched by one a, b or y ion to the sums
+ * of an XCorr.
+ */
+void Scorer::addXcorrIon(
+  ION_TYPE_T ion_type, ///< A_ION, B_ION or Y_ION -in
+  FLOAT_T ion_mass_z, ///< m/z of the ion -in
+  int ion_charge, ///< charge of the ion -in
+  int max_bin, ///< getMaxBin() of the scorer -in
+  FLOAT_T* B_Y_sum, ///< sum at the b and y ion bins -in/out
+  FLOAT_T* FLANK_sum, ///< sum at the flanking bins -in/out
+  FLOAT_T* LOSS_sum ///< sum at the neutral loss and a ion bins -in/out
+  ) {
+
+  int intensity_array_idx = INTEGERIZE(ion_mass_z, bin_width_, bin_offset_);
+
+  // skip ions that are located beyond max mz limit
+  if(intensity_array_idx >= max_bin){
+    return;
+  }
 
-      int nh3_array_idx 
-        = INTEGERIZE((ion_mass_z -  (MASS_NH3_MONO/ion_charge)),
-                       bin_width, bin_offset);
-      LOSS_sum += observed_[nh3_array_idx];
+  // is it B, Y ion?
+  if(ion_type == B_ION || 
+     ion_type == Y_ION){
 
-    }// is it A ion?
-    else if(ion_type == A_ION){
-      // Add peaks of intensity 10.0 for A type ions.
-      LOSS_sum += observed_[intensity_array_idx];
+    // Add peaks of intensity 50.0 for B, Y type ions. 
+    // In addition, add peaks of intensity of 25.0 to +/- 1 m/z flanking each B, Y ion if requested.
+    *B_Y_sum += observed_[intensity_array_idx];
+    if (use_flanks_) {
+      *FLANK_sum += observed_[intensity_array_idx-1];
+      if ((intensity_array_idx + 1) < max_bin) {
+        *FLANK_sum += observed_[intensity_array_idx+1];
+      }
     }
-    else{// ERROR!, only should create B, Y, A type ions for xcorr theoreical 
-      carp(CARP_ERROR, "only should create B, Y, A type ions for xcorr theoretical spectrum");
-      return 0;
+
+    // add neutral loss of water and NH3
+    if(ion_type == B_ION){
+      int h2o_array_idx = 
+        INTEGERIZE((ion_mass_z - (MASS_H2O_MONO/ion_charge)),
+                   bin_width_, bin_offset_);  
+      *LOSS_sum += observed_[h2o_array_idx];
     }
+
+    int nh3_array_idx 
+      = INTEGERIZE((ion_mass_z -  (MASS_NH3_MONO/ion_charge)),
+                   bin_width_, bin_offset_);
+    *LOSS_sum += observed_[nh3_array_idx];
+
+  } else {
+    // Add peaks of intensity 10.0 for A type ions.
+    *LOSS_sum += observed_[intensity_array_idx];
   }
+}
 
-  ans = B_Y_sum * B_Y_HEIGHT + FLANK_sum * FLANK_HEIGHT + LOSS_sum * LOSS_HEIGHT;
+/**
+ * \returns the XCorr of the sums collected by addXcorrIon
+ */
+FLOAT_T Scorer::combineXcorrSums(
+  FLOAT_T B_Y_sum, ///< sum at the b and y ion bins -in
+  FLOAT_T FLANK_sum, ///< sum at the flanking bins -in
+  FLOAT_T LOSS_sum ///< sum at the neutral loss and a ion bins -in
+  ) {
+
+  FLOAT_T ans = B_Y_sum * B_Y_HEIGHT + FLANK_sum * FLANK_HEIGHT + LOSS_sum * LOSS_HEIGHT;
   return ans / 10000.0;
 }
 
+/**
+ * Preprocesses the observed spectrum for XCorr, unless that was already done.
+ */
+void Scorer::initXcorr(
+  Spectrum* spectrum, ///< the spectrum to score -in
+  int charge ///< the peptide charge -in
+  ) {
+
+  if(!initialized_){
+    // create intensity array for observed spectrum, if already not been done
+    if(!createIntensityArrayXcorr(spectrum, charge)){
+      carp(CARP_FATAL, "failed to produce XCORR");
+    }
+  }
+}
+
 /**
  * create the intensity arrays for both observed and theoretical spectrum
  * SCORER must have been created for XCORR type
@@ -1110,13 +1138,8 @@ FLOAT_T Scorer::genScoreXcorr(
   FLOAT_T final_score = 0;
   // initialize the scorer before scoring if necessary
   // preprocess the observed spectrum in scorer
-  if(!initialized_){
-    // create intensity array for observed spectrum, if already not been done
-    if(!createIntensityArrayXcorr(spectrum, ion_series->getCharge())){
-      carp(CARP_FATAL, "failed to produce XCORR");
-    }
-  }
-    final_score = scoreIntensityIonSeries(ion_series);
+  initXcorr(spectrum, ion_series->getCharge());
+  final_score = scoreIntensityIonSeries(ion_series);
   // debug
   // carp(CARP_INFO, "xcorr: %.2f", final_score);
   
@@ -389,6 +389,40 @@ class Scorer {
 
   FLOAT_T* getIntensityArrayObserved();
 
+  /**
+   * Preprocesses the observed spectrum for XCorr, unless that was already
+   * done. Must be called before addXcorrIon.
+   */
+  void initXcorr(
+    Crux::Spectrum* spectrum, ///< the spectrum to score -in
+    int charge ///< the peptide charge -in
+    );
+
+  /**
+   * Adds the observed intensities matched by one a, b or y ion to the sums
+   * of an XCorr, without needing an Ion object. Summing over the ions of an
+   * ion series and passing the sums to combineXcorrSums gives the same score
+   * as scoreSpectrumVIonSeries.
+   */
+  void addXcorrIon(
+    ION_TYPE_T ion_type, ///< A_ION, B_ION or Y_ION -in
+    FLOAT_T ion_mass_z, ///< m/z of the ion -in
+    int ion_charge, ///< charge of the ion -in
+    int max_bin, ///< getMaxBin() of the scorer -in
+    FLOAT_T* B_Y_sum, ///< sum at the b and y ion bins -in/out
+    FLOAT_T* FLANK_sum, ///< sum at the flanking bins -in/out
+    FLOAT_T* LOSS_sum ///< sum at the neutral loss and a ion bins -in/out
+    );
+
+  /**
+   * \returns the XCorr of the sums collected by addXcorrIon
+   */
+  static FLOAT_T combineXcorrSums(
+    FLOAT_T B_Y_sum, ///< sum at the b and y ion bins -in
+    FLOAT_T FLANK_sum, ///< sum at the flanking bins -in
+    FLOAT_T LOSS_sum ///< sum at the neutral loss and a ion bins -in
+    );
+
   bool createIntensityArrayObserved(
     Crux::Spectrum* spectrum,    ///< the spectrum to score(observed) -in
     int charge,              ///< the peptide charge -in 
@@ -600,12 +600,8 @@ Peak * Spectrum::getNearestPeak(
   this->populateMzPeakArray(); // for rapid peak lookup by mz
 
   FLOAT_T min_distance = BILLION;
-  int min_mz_idx = (int)((mz - max) * MZ_TO_PEAK_ARRAY_RESOLUTION + 0.5);
-  min_mz_idx = min_mz_idx < 0 ? 0 : min_mz_idx;
-  int max_mz_idx = (int)((mz + max) * MZ_TO_PEAK_ARRAY_RESOLUTION + 0.5);
-  int absolute_max_mz_idx = MAX_PEAK_MZ * MZ_TO_PEAK_ARRAY_RESOLUTION - 1;
-  max_mz_idx = max_mz_idx > absolute_max_mz_idx 
-    ? absolute_max_mz_idx : max_mz_idx;
+  int min_mz_idx, max_mz_idx;
+  getNearestPeakBins(mz, max, &min_mz_idx, &max_mz_idx);
   Peak * peak = NULL;
   Peak * nearest_peak = NULL;
   int peak_idx;
@@ -626,6 +622,85 @@ Peak * Spectrum::getNearestPeak(
   return nearest_peak;
 }
 
+/**
+ * Finds the bins of the mz_peak_array_ that getNearestPeak searches.
+ */
+void Spectrum::getNearestPeakBins(
+  FLOAT_T mz, ///< the mz of the peak around which to sum intensities -in
+  FLOAT_T max, ///< the maximum distance to get intensity -in
+  int* min_mz_idx, ///< the first bin -out
+  int* max_mz_idx ///< the last bin -out
+  ) {
+  *min_mz_idx = (int)((mz - max) * MZ_TO_PEAK_ARRAY_RESOLUTION + 0.5);
+  *min_mz_idx = *min_mz_idx < 0 ? 0 : *min_mz_idx;
+  *max_mz_idx = (int)((mz + max) * MZ_TO_PEAK_ARRAY_RESOLUTION + 0.5);
+  int absolute_max_mz_idx = MAX_PEAK_MZ * MZ_TO_PEAK_ARRAY_RESOLUTION - 1;
+  *max_mz_idx = *max_mz_idx > absolute_max_mz_idx 
+    ? absolute_max_mz_idx : *max_mz_idx;
+}
+
+/**
+ * Fills bins and peaks with the peaks that mz_peak_array_ holds, in the
+ * order of their bins, without creating the array.
+ */
+void Spectrum::getBinnedPeaks(
+  vector<int>* bins, ///< the bin of each peak -out
+  vector<Peak*>* peaks ///< the peaks -out
+  ) const {
+  int array_length = MZ_TO_PEAK_ARRAY_RESOLUTION * MAX_PEAK_MZ;
+  vector< pair<int, int> > peak_bins; // bin and index in peaks_
+  for (int peak_idx = 0; peak_idx < (int)peaks_.size(); peak_idx++) {
+    int mz_idx = (int)(peaks_[peak_idx]->getLocation() * MZ_TO_PEAK_ARRAY_RESOLUTION);
+    if (mz_idx >= 0 && mz_idx < array_length) {
+      peak_bins.push_back(make_pair(mz_idx, peak_idx));
+    }
+  }
+  sort(peak_bins.begin(), peak_bins.end());
+
+  bins->clear();
+  peaks->clear();
+  for (size_t i = 0; i < peak_bins.size(); i++) {
+    Peak* peak = peaks_[peak_bins[i].second];
+    if (!bins->empty() && bins->back() == peak_bins[i].first) {
+      // same rule as populateMzPeakArray for peaks in the same bin
+      if (peaks->back()->getIntensity() < peak->getIntensity()) {
+        peaks->back() = peak;
+      }
+    } else {
+      bins->push_back(peak_bins[i].first);
+      peaks->push_back(peak);
+    }
+  }
+}
+
+/**
+ * \returns The same peak as getNearestPeak, looked up in the peaks
+ * returned by getBinnedPeaks.
+ */
+Peak* Spectrum::getNearestPeak(
+  const vector<int>& bins, ///< bins from getBinnedPeaks -in
+  const vector<Peak*>& peaks, ///< peaks from getBinnedPeaks -in
+  FLOAT_T mz, ///< the mz of the peak around which to sum intensities -in
+  FLOAT_T max ///< the maximum distance to get intensity -in
+  ) {
+  int min_mz_idx, max_mz_idx;
+  getNearestPeakBins(mz, max, &min_mz_idx, &max_mz_idx);
+  FLOAT_T min_distance = BILLION;
+  Peak* nearest_peak = NULL;
+  for (size_t i = lower_bound(bins.begin(), bins.end(), min_mz_idx) - bins.begin();
+       i < bins.size() && bins[i] <= max_mz_idx; i++) {
+    FLOAT_T distance = fabs(mz - peaks[i]->getLocation());
+    if (distance > max) {
+      continue;
+    }
+    if (distance < min_distance) {
+      nearest_peak = peaks[i];
+      min_distance = distance;
+    }
+  }
+  return nearest_peak;
+}
+
 /**
  * \returns The PEAK_T within 'max' of 'mz' in 'spectrum'
  * that is the maximum intensity.
@@ -252,6 +252,28 @@ class Spectrum{
     (FLOAT_T mz, ///< the mz of the peak around which to sum intensities -in
      FLOAT_T max ///< the maximum distance to get intensity -in
      );
+
+  /**
+   * Fills bins and peaks with the peaks that getNearestPeak can return:
+   * for each m/z bin of its lookup array, the peak that the array keeps.
+   * The peaks are sorted by bin. Unlike getNearestPeak, this does not
+   * modify the spectrum, so it can be used while other threads read it.
+   */
+  void getBinnedPeaks(
+    std::vector<int>* bins, ///< the bin of each peak -out
+    std::vector<Peak*>* peaks ///< the peaks -out
+  ) const;
+
+  /**
+   * \returns The same peak as getNearestPeak, looked up in the peaks
+   * returned by getBinnedPeaks.
+   */
+  static Peak* getNearestPeak(
+    const std::vector<int>& bins, ///< bins from getBinnedPeaks -in
+    const std::vector<Peak*>& peaks, ///< peaks from getBinnedPeaks -in
+    FLOAT_T mz, ///< the mz of the peak around which to sum intensities -in
+    FLOAT_T max ///< the maximum distance to get intensity -in
+  );
   
   /**
    * \returns The PEAK_T within 'max' of 'mz' in 'spectrum'
@@ -350,6 +372,16 @@ class Spectrum{
    */
   void populateMzPeakArray();
 
+  /**
+   * Finds the bins of the mz_peak_array_ that getNearestPeak searches.
+   */
+  static void getNearestPeakBins(
+    FLOAT_T mz, ///< the mz of the peak around which to sum intensities -in
+    FLOAT_T max, ///< the maximum distance to get intensity -in
+    int* min_mz_idx, ///< the first bin -out
+    int* max_mz_idx ///< the last bin -out
+  );
+
   /**
    *if ms2 file dose not have any Z line then assignZState will create it  
    */
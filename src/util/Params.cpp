@@ -532,6 +532,19 @@ Params::Params() : finalized_(false) {
     "Show search progress by printing every n spectra searched. Set to 0 to show no "
     "search progress.",
     "Available for tide-search", true);
+  InitIntParam("checkpoint-interval", 0, 0, BILLION,
+    "Write a checkpoint to tide-search.checkpoint.txt in the output directory "
+    "every n spectrum-charge combinations searched, and after each spectrum "
+    "file. A search that was interrupted can then be continued with --resume T. "
+    "Set to 0 to write no checkpoints.",
+    "Available for tide-search", true);
+  InitBoolParam("resume", false,
+    "Continue an interrupted search from tide-search.checkpoint.txt in the "
+    "output directory. The index and spectrum files must be the same as in the "
+    "interrupted search. Matches written after the checkpoint are discarded. "
+    "Because the log and parameter files are rewritten, this option must be used "
+    "with --overwrite T.",
+    "Available for tide-search", true);
   // Sp scoring params
   InitDoubleParam("max-mz", 4000, 0, BILLION,
     "Used in scoring sp.",
@@ -722,6 +735,12 @@ Params::Params() : finalized_(false) {
     "conditions\" by Klammer AA, Yi X, MacCoss MJ and Noble WS. ([[html:<em>]]Analytical "
     "Chemistry[[html:</em>]]. 2007 Aug 15;79(16):6111-8.).",
     "Available for crux percolator", true);
+  InitBoolParam("in-memory-pin", false,
+    "When the input is not already in pin format, convert it to pin format "
+    "while Percolator runs and stream it directly to Percolator, rather than "
+    "writing make-pin.pin to the output directory and reading it back. Only a "
+    "small part of the pin is held in memory at any time.",
+    "Available for crux percolator", true);
   InitBoolParam("only-psms", false,
     "Do not remove redundant peptides; keep all PSMs and exclude peptide level probability.",
     "Available for crux percolator", true);
@@ -743,6 +762,9 @@ Params::Params() : finalized_(false) {
     "of the file formats supported by ProteoWizard. Alternatively, the argument "
     "may be one or more binary spectrum files produced by a previous run of crux "
     "tide-search using the store-spectra parameter.");
+  InitArgParam("tide-search shard directory",
+    "The output directory of a tide-search run with the mass-shard option. One "
+    "directory must be given for each shard.");
   InitArgParam("tide database",
     "Either a FASTA file or a directory containing a database index created by a previous "
     "run of crux tide-index.");
@@ -895,6 +917,14 @@ Params::Params() : finalized_(false) {
   InitBoolParam("skip-decoys", true,
     "Skips decoys when reading a Tide index.",
     "Available for read-tide-index", false);
+  InitStringParam("mass-shard", "",
+    "Search only part of each spectrum file, so that one search can be spread "
+    "over several processes or machines. The value has the form i/N: the "
+    "spectrum-charge combinations are sorted by precursor mass and divided into "
+    "N consecutive ranges of equal size, and only the i-th range is searched. "
+    "Run each shard with its own output directory and combine the results with "
+    "merge-tide-shards. Not available with peptide-centric-search.",
+    "Available for tide-search", true);
   InitBoolParam("skip-preprocessing", false,
     "Skip preprocessing steps on spectra. Default = F.",
     "Available for tide-search", true);
@@ -920,7 +950,9 @@ Params::Params() : finalized_(false) {
                   "Available for tide-search", true);
   InitIntParam("num-threads", 0, 0, 64,
                "0=poll CPU to set num threads; else specify num threads directly.",
-               "Available for tide-search tab-delimited files only.", true);
+               "Available for tide-search tab-delimited files, q-ranker, barista, "
+               "sort-by-column, spectral-counts, assign-confidence, "
+               "search-for-xlinks and hardklor.", true);
   /*
    * Comet parameters
    */
@@ -1251,6 +1283,13 @@ Params::Params() : finalized_(false) {
   InitStringParam("optimization", "protein", "protein|peptide|psm",
      "Specifies whether to do optimization at the protein, peptide or psm level.",
      "Available for barista.", true);
+  InitIntParam("minibatch-size", 1, 1, 100000,
+    "Number of proteins whose gradients are summed before each weight update "
+    "when barista trains at the protein level. The default of 1 updates the "
+    "weights after every protein. Larger values split each minibatch among "
+    "the threads given by num-threads; the result then depends on the random "
+    "seed and the minibatch size, but not on the number of threads.",
+    "Available for barista.", true);
   /* analyze-matches parameter options */
   InitArgParam("target input",
     "One or more files, each containing a collection of peptide-spectrum matches (PSMs) "
@@ -1292,6 +1331,13 @@ Params::Params() : finalized_(false) {
     "p-values, and that it requires the presence of the \"distinct matches/spectrum\" "
     "feature for each PSM.",
     "Used by assign-confidence.", true);
+  InitBoolParam("low-memory", false,
+    "Estimate q-values from the score columns of tab-delimited input without loading "
+    "the PSMs into memory. The output then contains the original target rows, sorted by "
+    "score, with the q-value column appended. This option is ignored, and the PSMs are "
+    "loaded as usual, for non-tab-delimited input or output, peptide-level estimation, "
+    "the Sidak adjustment, and inputs with multiple decoys per target.",
+    "Used by assign-confidence.", true);
   InitStringParam("score", "",
     "Specify the column (for tab-delimited input) or tag (for XML input) "
     "used as input to the q-value estimation procedure. If this parameter is unspecified, "
@@ -1565,6 +1611,12 @@ Params::Params() : finalized_(false) {
     "Keep shuffling and collecting XCorr scores until the minimum number of points for "
     "weibull fitting (using targets and decoys) is achieved.",
     "Available for crux search-for-xlinks", true);
+  InitBoolParam("xlink-weibull-reuse-decoys", false,
+    "Fit the Weibull distribution to the XCorr scores of the target and decoy candidates "
+    "that were already scored for the spectrum, instead of scoring a separate set of "
+    "candidates from the precursor-window-weibull window. Additional decoys are shuffled "
+    "and scored only if there are fewer than min-weibull-points scores.",
+    "Available for crux search-for-xlinks when compute-p-values=T.", true);
   InitArgParam("link sites",
     "Specification of the the two sets of amino acids that the cross-linker can "
     "connect. These are specified as two comma-separated sets of amino acids, "
@@ -1662,6 +1714,13 @@ Params::Params() : finalized_(false) {
   InitStringParam("hardklor-data-file", "",
     "Specifies an ASCII text file that defines symbols for the periodic table.",
     "Available for crux hardklor", true);
+  InitStringParam("hardklor-model-cache", "",
+    "Specifies a file in which the isotope distribution models are stored between runs. "
+    "If the file was written by a run with the same charge range, averagine-mod, "
+    "hardklor-data-file and isotope-data-file, the models are read from it instead of "
+    "being recomputed; otherwise they are computed and the file is replaced. Only used "
+    "when hardklor-algorithm = version2. Leave empty to compute the models on every run.",
+    "Available for crux hardklor", true);
   InitStringParam("instrument", "fticr", "fticr|orbitrap|tof|qit",
     "Indicates the type of instrument used to collect data. This parameter, combined with "
     "the resolution parameter, define how spectra will be centroided (if you provide "
@@ -2013,6 +2072,7 @@ void Params::Categorize() {
   items.insert("precursor-window-weibull");
   items.insert("remove-precursor-peak");
   items.insert("remove-precursor-tolerance");
+  items.insert("mass-shard");
   items.insert("scan-number");
   items.insert("skip-preprocessing");
   items.insert("spectrum-charge");
@@ -2065,6 +2125,7 @@ void Params::Categorize() {
   items.insert("xlink-include-linears");
   items.insert("xlink-include-selfloops");
   items.insert("xlink-prevents-cleavage");
+  items.insert("xlink-weibull-reuse-decoys");
   AddCategory("Cross-linking parameters", items);
 
   items.clear();
@@ -2160,6 +2221,7 @@ void Params::Categorize() {
 
   items.clear();
   items.insert("only-psms");
+  items.insert("in-memory-pin");
   items.insert("tdc");
   items.insert("search-input");
   AddCategory("General options", items);
@@ -2232,6 +2294,8 @@ void Params::Categorize() {
   items.insert("pout-output");
   items.insert("precision");
   items.insert("print-search-progress");
+  items.insert("checkpoint-interval");
+  items.insert("resume");
   items.insert("print_expect_score");
   items.insert("sample_enzyme_number");
   items.insert("show_fragment_ions");
@@ -0,0 +1,129 @@
+/**
+ * \file PipeBuffer.cpp
+ * \brief A bounded in-memory pipe between two threads.
+ *****************************************************************************/
+#include "PipeBuffer.h"
+
+using namespace std;
+
+PipeBuffer::PipeBuffer(size_t chunk_size, size_t max_chunks)
+  : max_chunks_(max_chunks > 0 ? max_chunks : 1),
+    write_closed_(false),
+    read_closed_(false),
+    write_buf_(this, chunk_size > 0 ? chunk_size : 1),
+    read_buf_(this) {
+}
+
+PipeBuffer::~PipeBuffer() {
+}
+
+streambuf* PipeBuffer::writeBuf() {
+  return &write_buf_;
+}
+
+streambuf* PipeBuffer::readBuf() {
+  return &read_buf_;
+}
+
+void PipeBuffer::closeWrite() {
+  write_buf_.flushChunk();
+  boost::mutex::scoped_lock lock(mutex_);
+  write_closed_ = true;
+  changed_.notify_all();
+}
+
+void PipeBuffer::closeRead() {
+  boost::mutex::scoped_lock lock(mutex_);
+  read_closed_ = true;
+  chunks_.clear();
+  changed_.notify_all();
+}
+
+bool PipeBuffer::push(string* chunk) {
+  boost::mutex::scoped_lock lock(mutex_);
+  while (chunks_.size() >= max_chunks_ && !read_closed_) {
+    changed_.wait(lock);
+  }
+  if (read_closed_) {
+    return false;
+  }
+  chunks_.push_back(string());
+  chunks_.back().swap(*chunk);
+  changed_.notify_all();
+  return true;
+}
+
+bool PipeBuffer::pop(string* chunk) {
+  boost::mutex::scoped_lock lock(mutex_);
+  while (chunks_.empty() && !write_closed_) {
+    changed_.wait(lock);
+  }
+  if (chunks_.empty()) {
+    return false;
+  }
+  chunk->swap(chunks_.front());
+  chunks_.pop_front();
+  changed_.notify_all();
+  return true;
+}
+
+PipeBuffer::WriteBuf::WriteBuf(PipeBuffer* pipe, size_t chunk_size)
+  : pipe_(pipe), chunk_(chunk_size, '\0') {
+  setp(&chunk_[0], &chunk_[0] + chunk_.size());
+}
+
+/**
+ * Passes the bytes written so far to the reader and starts a new chunk.
+ */
+bool PipeBuffer::WriteBuf::flushChunk() {
+  size_t used = pptr() - pbase();
+  if (used == 0) {
+    return true;
+  }
+  size_t chunk_size = chunk_.size();
+  chunk_.resize(used);
+  bool ok = pipe_->push(&chunk_);
+  chunk_.assign(chunk_size, '\0');
+  setp(&chunk_[0], &chunk_[0] + chunk_.size());
+  return ok;
+}
+
+int PipeBuffer::WriteBuf::overflow(int c) {
+  if (!flushChunk()) {
+    return EOF;
+  }
+  if (c != EOF) {
+    *pptr() = (char)c;
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+int PipeBuffer::WriteBuf::sync() {
+  return flushChunk() ? 0 : -1;
+}
+
+PipeBuffer::ReadBuf::ReadBuf(PipeBuffer* pipe)
+  : pipe_(pipe) {
+  setg(NULL, NULL, NULL);
+}
+
+int PipeBuffer::ReadBuf::underflow() {
+  if (gptr() < egptr()) {
+    return traits_type::to_int_type(*gptr());
+  }
+  do {
+    if (!pipe_->pop(&chunk_)) {
+      return EOF;
+    }
+  } while (chunk_.empty());
+  setg(&chunk_[0], &chunk_[0], &chunk_[0] + chunk_.size());
+  return traits_type::to_int_type(*gptr());
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
@@ -0,0 +1,101 @@
+/**
+ * \file PipeBuffer.h
+ * \brief A bounded in-memory pipe between two threads. One thread writes to
+ * a stream on writeBuf() while another reads what was written from a stream
+ * on readBuf(). At most a few chunks are held at a time, so the writer waits
+ * when the reader falls behind.
+ *****************************************************************************/
+#ifndef PIPEBUFFER_H_
+#define PIPEBUFFER_H_
+
+#include <deque>
+#include <streambuf>
+#include <string>
+
+#include <boost/thread.hpp>
+
+class PipeBuffer {
+ public:
+  /**
+   * Creates a pipe that holds at most max_chunks chunks of chunk_size bytes.
+   */
+  explicit PipeBuffer(size_t chunk_size = 1 << 16, size_t max_chunks = 16);
+
+  ~PipeBuffer();
+
+  /**
+   * \returns the streambuf that the writing thread writes to
+   */
+  std::streambuf* writeBuf();
+
+  /**
+   * \returns the streambuf that the reading thread reads from
+   */
+  std::streambuf* readBuf();
+
+  /**
+   * Called by the writer when it is done. Flushes the last chunk; the reader
+   * sees the end of the stream once it has read everything.
+   */
+  void closeWrite();
+
+  /**
+   * Called by the reader when it stops reading. Later writes fail instead of
+   * waiting for a reader that is gone.
+   */
+  void closeRead();
+
+ protected:
+  class WriteBuf : public std::streambuf {
+   public:
+    WriteBuf(PipeBuffer* pipe, size_t chunk_size);
+   protected:
+    virtual int overflow(int c = EOF);
+    virtual int sync();
+   private:
+    friend class PipeBuffer;
+    bool flushChunk();
+    PipeBuffer* pipe_;
+    std::string chunk_;
+  };
+
+  class ReadBuf : public std::streambuf {
+   public:
+    explicit ReadBuf(PipeBuffer* pipe);
+   protected:
+    virtual int underflow();
+   private:
+    PipeBuffer* pipe_;
+    std::string chunk_;
+  };
+
+  /**
+   * Hands a chunk to the reader, waiting while the pipe is full.
+   * \returns false if the reader is gone
+   */
+  bool push(std::string* chunk);
+
+  /**
+   * Takes the next chunk, waiting while the pipe is empty.
+   * \returns false at the end of the stream
+   */
+  bool pop(std::string* chunk);
+
+  size_t max_chunks_;
+  std::deque<std::string> chunks_;
+  bool write_closed_;
+  bool read_closed_;
+  boost::mutex mutex_;
+  boost::condition_variable changed_;
+  WriteBuf write_buf_;
+  ReadBuf read_buf_;
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
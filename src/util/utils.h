@@ -242,6 +242,7 @@ char** parse_file(
 int myrandom();
 int myrandom_limit(int max);
 void mysrandom(unsigned seed);
+void mysrandom_thread(unsigned seed);
 
 #endif
 
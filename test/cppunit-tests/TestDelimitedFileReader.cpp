@@ -0,0 +1,124 @@
+#include <cppunit/config/SourcePrefix.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sstream>
+#include "TestDelimitedFileReader.h"
+#include "../../src/io/DelimitedFileReader.h"
+
+using namespace std;
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TestDelimitedFileReader );
+
+// The fast paths must give exactly what strtod and strtol give, and must
+// refuse anything they cannot convert exactly.
+
+static bool parseDouble(const char* text, double* value) {
+  return DelimitedFileReader::parseSimpleDouble(text, text + strlen(text), value);
+}
+
+static bool parseInt(const char* text, int* value) {
+  return DelimitedFileReader::parseSimpleInteger(text, text + strlen(text), value);
+}
+
+static void assertParsesAsStrtod(const char* text) {
+  double value = 0;
+  CPPUNIT_ASSERT_MESSAGE(text, parseDouble(text, &value));
+  CPPUNIT_ASSERT_MESSAGE(text, value == strtod(text, NULL));
+}
+
+void TestDelimitedFileReader::setUp(){
+}
+
+void TestDelimitedFileReader::tearDown(){
+}
+
+void TestDelimitedFileReader::parseDoubleForms(){
+  // sign
+  assertParsesAsStrtod("42");
+  assertParsesAsStrtod("-42");
+  assertParsesAsStrtod("+42");
+  assertParsesAsStrtod("-0.5");
+  // leading and trailing dot
+  assertParsesAsStrtod(".5");
+  assertParsesAsStrtod("-.125");
+  assertParsesAsStrtod("3.");
+  // exponent
+  assertParsesAsStrtod("1e5");
+  assertParsesAsStrtod("1E5");
+  assertParsesAsStrtod("2.5e-3");
+  assertParsesAsStrtod("-6.02e+2");
+  assertParsesAsStrtod(".5e1");
+  // leading zeros are not significant digits
+  assertParsesAsStrtod("0.000123456789012345");
+  assertParsesAsStrtod("1234.56789");
+
+  // not numbers, or not complete numbers
+  double value;
+  CPPUNIT_ASSERT(!parseDouble("", &value));
+  CPPUNIT_ASSERT(!parseDouble("-", &value));
+  CPPUNIT_ASSERT(!parseDouble(".", &value));
+  CPPUNIT_ASSERT(!parseDouble("1e", &value));
+  CPPUNIT_ASSERT(!parseDouble("1e+", &value));
+  CPPUNIT_ASSERT(!parseDouble("1.5x", &value));
+  CPPUNIT_ASSERT(!parseDouble("Inf", &value));
+  CPPUNIT_ASSERT(!parseDouble("nan", &value));
+}
+
+void TestDelimitedFileReader::parseDoubleLimits(){
+  double value;
+  // 15 significant digits are exact, 16 are refused
+  assertParsesAsStrtod("123456789012345");
+  assertParsesAsStrtod("0.123456789012345");
+  assertParsesAsStrtod("-1.23456789012345e10");
+  CPPUNIT_ASSERT(!parseDouble("1234567890123456", &value));
+  CPPUNIT_ASSERT(!parseDouble("0.1234567890123456", &value));
+
+  // decimal exponents up to 22 either way are exact, beyond that refused
+  assertParsesAsStrtod("1e22");
+  assertParsesAsStrtod("1e-22");
+  assertParsesAsStrtod("1.5e21");
+  assertParsesAsStrtod("0.1e-21");
+  CPPUNIT_ASSERT(!parseDouble("1e23", &value));
+  CPPUNIT_ASSERT(!parseDouble("1e-23", &value));
+  CPPUNIT_ASSERT(!parseDouble("0.1e-22", &value));
+  CPPUNIT_ASSERT(!parseDouble("1e00001", &value));
+}
+
+void TestDelimitedFileReader::parseInteger(){
+  int value = 0;
+  CPPUNIT_ASSERT(parseInt("0", &value) && value == 0);
+  CPPUNIT_ASSERT(parseInt("17", &value) && value == 17);
+  CPPUNIT_ASSERT(parseInt("-17", &value) && value == -17);
+  CPPUNIT_ASSERT(parseInt("+17", &value) && value == 17);
+  CPPUNIT_ASSERT(parseInt("999999999", &value) && value == 999999999);
+
+  CPPUNIT_ASSERT(!parseInt("", &value));
+  CPPUNIT_ASSERT(!parseInt("-", &value));
+  CPPUNIT_ASSERT(!parseInt("1000000000", &value));
+  CPPUNIT_ASSERT(!parseInt("1.0", &value));
+  CPPUNIT_ASSERT(!parseInt("12a", &value));
+}
+
+void TestDelimitedFileReader::getDoubleFallsBack(){
+  // cells outside the fast path still convert like strtod
+  const char* cells[] = {
+    "0.1234567890123456789", "1e23", "2.5e-300", "12345678901234567890", "3.25"
+  };
+  const int num_cells = sizeof(cells) / sizeof(cells[0]);
+  ostringstream text;
+  for (int i = 0; i < num_cells; i++) {
+    text << (i ? "\t" : "") << "c" << i;
+  }
+  text << "\n";
+  for (int i = 0; i < num_cells; i++) {
+    text << (i ? "\t" : "") << cells[i];
+  }
+  text << "\n";
+
+  istringstream stream(text.str());
+  DelimitedFileReader reader(&stream);
+  reader.next();
+  for (int i = 0; i < num_cells; i++) {
+    CPPUNIT_ASSERT_MESSAGE(cells[i], reader.getDouble(i) == strtod(cells[i], NULL));
+  }
+}
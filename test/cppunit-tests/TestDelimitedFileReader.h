@@ -0,0 +1,26 @@
+#ifndef CPP_UNIT_TESTDELIMITEDFILEREADER_H
+#define CPP_UNIT_TESTDELIMITEDFILEREADER_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestDelimitedFileReader : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TestDelimitedFileReader );
+  CPPUNIT_TEST( parseDoubleForms );
+  CPPUNIT_TEST( parseDoubleLimits );
+  CPPUNIT_TEST( parseInteger );
+  CPPUNIT_TEST( getDoubleFallsBack );
+  CPPUNIT_TEST_SUITE_END();
+
+ public:
+  void setUp();
+  void tearDown();
+
+ protected:
+  void parseDoubleForms();
+  void parseDoubleLimits();
+  void parseInteger();
+  void getDoubleFallsBack();
+};
+
+#endif //CPP_UNIT_TESTDELIMITEDFILEREADER_H
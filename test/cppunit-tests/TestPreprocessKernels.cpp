@@ -0,0 +1,261 @@
+#include <cppunit/config/SourcePrefix.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "TestPreprocessKernels.h"
+#include "../../src/app/tide/preprocess_kernels.h"
+#include "../../src/app/tide/theoretical_peak_pair.h"
+#include "../../src/app/tide/max_mz.h"
+
+using namespace std;
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TestPreprocessKernels );
+
+// The reference functions below are the scalar code that
+// ObservedPeakSet::PreprocessSpectrum() and Spectrum::CreateEvidenceVector()
+// used before PreprocessKernels existed. The kernels must reproduce their
+// results bit for bit.
+
+static const int BIN_NH3 = 17;
+static const int BIN_H2O = 18;
+
+static void ReferenceXCorrCache(vector<double> peaks, int largest_mz,
+                                double highest_intensity, int background_end,
+                                int cache_end, bool FP, bool NL,
+                                vector<int>* cache) {
+  double intensity_cutoff = highest_intensity * 0.05;
+  int region_size = largest_mz / 10 + 1;
+  for (int i = 0; i < 10; ++i) {
+    double highest = 0;
+    for (int j = 0; j < region_size; ++j) {
+      int index = i * region_size + j;
+      if (peaks[index] <= intensity_cutoff) {
+        peaks[index] = 0;
+      }
+      if (peaks[index] > highest) {
+        highest = peaks[index];
+      }
+    }
+    if (highest == 0) {
+      continue;
+    }
+    double normalizer = 50.0 / highest;
+    for (int j = 0; j < region_size; ++j) {
+      int index = i * region_size + j;
+      if (peaks[index] != 0) {
+        peaks[index] *= normalizer;
+      }
+    }
+  }
+
+  static const double multiplier = 1.0 / (MAX_XCORR_OFFSET * 2);
+  double total = 0;
+  vector<double> partial_sums(background_end + 1);
+  for (int i = 0; i < background_end; ++i)
+    partial_sums[i] = (total += peaks[i]);
+  partial_sums[background_end] = total;
+  for (int i = 0; i < background_end; ++i) {
+    int right_index = min(background_end, i + MAX_XCORR_OFFSET);
+    int left_index = max(0, i - MAX_XCORR_OFFSET - 1);
+    peaks[i] -= multiplier * (partial_sums[right_index] - partial_sums[left_index] - peaks[i]);
+  }
+
+  cache->assign(cache_end * NUM_PEAK_TYPES, 0);
+  int* c = &(*cache)[0];
+  for (int i = 0; i < background_end; ++i) {
+    double x = peaks[i] * 50000;
+    c[i * NUM_PEAK_TYPES + PeakMain] = x >= 0 ? int(x + 0.5) : int(x - 0.5);
+  }
+  for (int i = 0; i < background_end; ++i) {
+    int x = c[i * NUM_PEAK_TYPES + PeakMain];
+    int y = x + x;
+    c[i * NUM_PEAK_TYPES + LossPeak] = y;
+    int z = y + y + x;
+    c[i * NUM_PEAK_TYPES + FlankingPeak] = z;
+    c[i * NUM_PEAK_TYPES + PrimaryPeak] = z + z;
+  }
+  for (int i = 0; i < cache_end; ++i) {
+    int flanks = c[i * NUM_PEAK_TYPES + PrimaryPeak];
+    if (FP) {
+      if (i > 0) {
+        flanks += c[(i - 1) * NUM_PEAK_TYPES + FlankingPeak];
+      }
+      if (i < cache_end - 1) {
+        flanks += c[(i + 1) * NUM_PEAK_TYPES + FlankingPeak];
+      }
+    }
+    int Y1 = flanks;
+    if (NL) {
+      if (i > BIN_NH3) {
+        Y1 += c[(i - BIN_NH3) * NUM_PEAK_TYPES + LossPeak];
+      }
+      if (i > BIN_H2O) {
+        Y1 += c[(i - BIN_H2O) * NUM_PEAK_TYPES + LossPeak];
+      }
+    }
+    c[i * NUM_PEAK_TYPES + PeakCombinedY1] = Y1;
+    c[i * NUM_PEAK_TYPES + PeakCombinedB1] = Y1;
+    c[i * NUM_PEAK_TYPES + PeakCombinedY2] = flanks;
+    c[i * NUM_PEAK_TYPES + PeakCombinedB2] = flanks;
+  }
+}
+
+static void KernelXCorrCache(vector<double> peaks, int largest_mz,
+                             double highest_intensity, int background_end,
+                             int cache_end, bool FP, bool NL,
+                             vector<int>* cache) {
+  int region_size = largest_mz / 10 + 1;
+  for (int i = 0; i < 10; ++i) {
+    PreprocessKernels::NormalizeRegion(&peaks[i * region_size], region_size,
+                                       highest_intensity * 0.05, 50.0);
+  }
+  vector<double> partial_sums;
+  PreprocessKernels::SubtractBackground(&peaks[0], background_end,
+                                        1.0 / (MAX_XCORR_OFFSET * 2), false,
+                                        &partial_sums);
+  cache->assign(cache_end * NUM_PEAK_TYPES, 0);
+  PreprocessKernels::FillPeakCache(&peaks[0], background_end, &(*cache)[0]);
+  PreprocessKernels::CombinePeakCache(&(*cache)[0], cache_end, FP, NL,
+                                      BIN_NH3, BIN_H2O);
+}
+
+// Raw (not square-rooted) intensities, as CreateEvidenceVector() bins them.
+static void ReferenceEvidence(vector<double>& intensObs, double maxIonIntens,
+                              int regionSelector) {
+  int maxPrecurMass = intensObs.size();
+  vector<int> intensRegion(maxPrecurMass, -1);
+  for (int i = 0; i < maxPrecurMass; i++) {
+    if (intensObs[i] > 0) {
+      int region = (int)floor((double)i / (double)regionSelector);
+      intensRegion[i] = min(region, 9);
+    }
+  }
+  maxIonIntens = sqrt(maxIonIntens);
+  for (vector<double>::iterator i = intensObs.begin(); i != intensObs.end(); i++) {
+    *i = sqrt(*i);
+    if (*i <= 0.05 * maxIonIntens) {
+      *i = 0.0;
+    }
+  }
+  vector<double> maxRegion(10, 0);
+  for (int i = 0; i < maxPrecurMass; i++) {
+    int reg = intensRegion[i];
+    if (reg >= 0 && maxRegion[reg] < intensObs[i]) {
+      maxRegion[reg] = intensObs[i];
+    }
+  }
+  for (int i = 0; i < maxPrecurMass; i++) {
+    int reg = intensRegion[i];
+    if (reg >= 0 && maxRegion[reg] > 0.0) {
+      intensObs[i] *= (50.0 / maxRegion[reg]);
+    }
+  }
+  vector<double> partial_sums;
+  double total = 0.0;
+  for (vector<double>::const_iterator i = intensObs.begin(); i != intensObs.end(); i++) {
+    partial_sums.push_back(total += *i);
+  }
+  const double multiplier = 1.0 / (MAX_XCORR_OFFSET * 2.0 + 1.0);
+  for (int i = 0; i < maxPrecurMass; ++i) {
+    int right = std::min(maxPrecurMass - 1, i + MAX_XCORR_OFFSET);
+    int left = std::max(0, i - MAX_XCORR_OFFSET - 1);
+    intensObs[i] -= multiplier * (partial_sums[right] - partial_sums[left]);
+  }
+}
+
+static void KernelEvidence(vector<double>& intensObs, double maxIonIntens,
+                           int regionSelector) {
+  int maxPrecurMass = intensObs.size();
+  maxIonIntens = sqrt(maxIonIntens);
+  PreprocessKernels::SqrtTransform(&intensObs[0], maxPrecurMass);
+  for (int i = 0; i < 10; i++) {
+    int begin = min(i * regionSelector, maxPrecurMass);
+    int end = (i == 9) ? maxPrecurMass : min((i + 1) * regionSelector, maxPrecurMass);
+    PreprocessKernels::NormalizeRegion(&intensObs[0] + begin, end - begin,
+                                       0.05 * maxIonIntens, 50.0);
+  }
+  vector<double> partial_sums;
+  PreprocessKernels::SubtractBackground(&intensObs[0], maxPrecurMass,
+                                        1.0 / (MAX_XCORR_OFFSET * 2.0 + 1.0), true,
+                                        &partial_sums);
+}
+
+void TestPreprocessKernels::setUp(){
+  // Spectra of various lengths, including lengths that are not a multiple of
+  // the vector width and spectra shorter than the background window.
+  srand(42);
+  const int sizes[] = { 40, 151, 997, 2000, 2077, 5003 };
+  for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); ++s) {
+    for (int copy = 0; copy < 5; ++copy) {
+      vector<double> spectrum(sizes[s], 0);
+      int num_peaks = 1 + rand() % (sizes[s] / 4 + 1);
+      for (int p = 0; p < num_peaks; ++p) {
+        spectrum[rand() % (sizes[s] - 10)] = (rand() % 1000000) / 7.0;
+      }
+      spectra_.push_back(spectrum);
+    }
+  }
+}
+
+void TestPreprocessKernels::tearDown(){
+  spectra_.clear();
+  PreprocessKernels::SetVectorized(true);
+}
+
+void TestPreprocessKernels::xcorrCacheMatchesReference(){
+  for (size_t s = 0; s < spectra_.size(); ++s) {
+    int background_end = spectra_[s].size() - 10;
+    int cache_end = spectra_[s].size();
+    vector<double> peaks(spectra_[s].size(), 0);
+    int largest_mz = 0;
+    double highest = 0;
+    for (int i = 0; i < background_end; ++i) {
+      peaks[i] = sqrt(spectra_[s][i]);
+      if (spectra_[s][i] > 0) {
+        largest_mz = i;
+      }
+      highest = max(highest, peaks[i]);
+    }
+    for (int options = 0; options < 4; ++options) {
+      bool FP = (options & 1) != 0;
+      bool NL = (options & 2) != 0;
+      vector<int> expected, scalar, vectorized;
+      ReferenceXCorrCache(peaks, largest_mz, highest, background_end,
+                          cache_end, FP, NL, &expected);
+      PreprocessKernels::SetVectorized(false);
+      KernelXCorrCache(peaks, largest_mz, highest, background_end,
+                       cache_end, FP, NL, &scalar);
+      PreprocessKernels::SetVectorized(true);
+      KernelXCorrCache(peaks, largest_mz, highest, background_end,
+                       cache_end, FP, NL, &vectorized);
+      CPPUNIT_ASSERT(expected == scalar);
+      CPPUNIT_ASSERT(expected == vectorized);
+    }
+  }
+}
+
+void TestPreprocessKernels::evidenceMatchesReference(){
+  for (size_t s = 0; s < spectra_.size(); ++s) {
+    double maxIonIntens = *max_element(spectra_[s].begin(), spectra_[s].end());
+    int largest_mz = 0;
+    for (size_t i = 0; i < spectra_[s].size(); ++i) {
+      if (spectra_[s][i] > 0) {
+        largest_mz = i;
+      }
+    }
+    int regionSelector = largest_mz / 10;
+    if (regionSelector == 0) {
+      continue;
+    }
+    vector<double> expected = spectra_[s];
+    ReferenceEvidence(expected, maxIonIntens, regionSelector);
+    for (int vectorized = 0; vectorized < 2; ++vectorized) {
+      PreprocessKernels::SetVectorized(vectorized != 0);
+      vector<double> actual = spectra_[s];
+      KernelEvidence(actual, maxIonIntens, regionSelector);
+      CPPUNIT_ASSERT(memcmp(&expected[0], &actual[0],
+                            sizeof(double) * expected.size()) == 0);
+    }
+  }
+}
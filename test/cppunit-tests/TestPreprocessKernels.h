@@ -0,0 +1,27 @@
+#ifndef CPP_UNIT_TESTPREPROCESSKERNELS_H
+#define CPP_UNIT_TESTPREPROCESSKERNELS_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <vector>
+
+class TestPreprocessKernels : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TestPreprocessKernels );
+  CPPUNIT_TEST( xcorrCacheMatchesReference );
+  CPPUNIT_TEST( evidenceMatchesReference );
+  CPPUNIT_TEST_SUITE_END();
+
+ protected:
+  // synthetic spectra, one vector of binned intensities per spectrum
+  std::vector< std::vector<double> > spectra_;
+
+ public:
+  void setUp();
+  void tearDown();
+
+ protected:
+  void xcorrCacheMatchesReference();
+  void evidenceMatchesReference();
+};
+
+#endif //CPP_UNIT_TESTPREPROCESSKERNELS_H
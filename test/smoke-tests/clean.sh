@@ -2,6 +2,7 @@
 rm -f crux_match* gmon.out *.sqt get_ms2_spectrum.out test*csm out error
 rm -f nosp.txt
 rm -rf child ../yeast-index yeast-index ../sib
+rm -rf pin-file pin-memory pin-index
 rm -f existing_search/percolator.target.*
 rm -f *binary_fasta
 rm -f good_results/*.observed